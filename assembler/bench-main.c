@@ -0,0 +1,218 @@
+/*
+ * Copyright © 2024 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Measures the assembler library throughput over a corpus of sources given
+ * as arguments, such as the .g4a files of the assembler tests.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gen4asm_lib.h"
+
+static const struct option longopts[] = {
+	{"compact", no_argument, 0, 'c'},
+	{"gen", required_argument, 0, 'g'},
+	{"jobs", required_argument, 0, 'j'},
+	{"copies", required_argument, 0, 'n'},
+	{"reps", required_argument, 0, 'r'},
+	{ NULL, 0, NULL, 0 }
+};
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: intel-gen4asm-bench [options] inputfile...\n");
+	fprintf(stderr, "OPTIONS:\n");
+	fprintf(stderr, "\t-c, --compact               Compact instructions (Gen6, Gen7)\n");
+	fprintf(stderr, "\t-g, --gen <4|5|6|7|8|9>     Specify GPU generation\n");
+	fprintf(stderr, "\t-j, --jobs <n>              Parallel jobs of the batch, 0 for one per CPU\n");
+	fprintf(stderr, "\t-n, --copies <n>            Assemble each input n times\n");
+	fprintf(stderr, "\t-r, --reps <n>              Repetitions, the best one is reported\n");
+}
+
+static char *read_file(const char *path, size_t *len)
+{
+	FILE *file;
+	char *buf;
+	long size;
+
+	file = fopen(path, "r");
+	if (!file)
+		return NULL;
+
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	rewind(file);
+
+	buf = malloc(size);
+	if (buf && fread(buf, 1, size, file) != size) {
+		free(buf);
+		buf = NULL;
+	}
+	fclose(file);
+
+	*len = size;
+	return buf;
+}
+
+static double elapsed(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) +
+	       1e-9 * (end->tv_nsec - start->tv_nsec);
+}
+
+static void release(struct gen4asm_kernel *kernels, int count)
+{
+	for (int i = 0; i < count; i++) {
+		free(kernels[i].binary);
+		kernels[i].binary = NULL;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct gen4asm_kernel *corpus, *kernels;
+	struct timespec start, end;
+	struct gen4asm *assembler;
+	double serial = 0, batch = 0, t;
+	int gen = 40, jobs = 0, copies = 100, reps = 5, compact = 0;
+	int n_corpus = 0, count, i, r;
+	size_t bytes = 0, uncompacted = 0;
+	char o;
+
+	while ((o = getopt_long(argc, argv, "cg:j:n:r:", longopts, NULL)) != -1) {
+		switch (o) {
+		case 'c':
+			compact = 1;
+			break;
+		case 'g':
+			gen = strtod(optarg, NULL) * 10;
+			break;
+		case 'j':
+			jobs = atoi(optarg);
+			break;
+		case 'n':
+			copies = atoi(optarg);
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc < 1 || copies < 1 || reps < 1) {
+		usage();
+		return 1;
+	}
+
+	assembler = gen4asm_create(gen);
+	if (!assembler) {
+		usage();
+		return 1;
+	}
+	gen4asm_set_compaction(assembler, compact);
+
+	/* Keep the sources which assemble for this generation. */
+	corpus = calloc(argc, sizeof(*corpus));
+	for (i = 0; i < argc; i++) {
+		struct gen4asm_kernel *kernel = &corpus[n_corpus];
+
+		kernel->name = argv[i];
+		kernel->source = read_file(argv[i], &kernel->source_len);
+		if (!kernel->source) {
+			perror(argv[i]);
+			return 1;
+		}
+
+		if (gen4asm_assemble(assembler, kernel)) {
+			fprintf(stderr, "Skipping %s\n", argv[i]);
+			free((char *)kernel->source);
+			continue;
+		}
+		if (compact)
+			printf("%s: %zu to %zu bytes\n", argv[i],
+			       kernel->uncompacted_size, kernel->size);
+		bytes += kernel->size;
+		uncompacted += kernel->uncompacted_size;
+		free(kernel->binary);
+		n_corpus++;
+	}
+	if (!n_corpus) {
+		fprintf(stderr, "Nothing to assemble\n");
+		return 1;
+	}
+
+	count = n_corpus * copies;
+	kernels = calloc(count, sizeof(*kernels));
+	for (i = 0; i < count; i++)
+		kernels[i] = corpus[i % n_corpus];
+
+	for (r = 0; r < reps; r++) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < count; i++)
+			gen4asm_assemble(assembler, &kernels[i]);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		release(kernels, count);
+
+		t = elapsed(&start, &end);
+		if (!r || t < serial)
+			serial = t;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		gen4asm_assemble_batch(assembler, kernels, count, jobs);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		release(kernels, count);
+
+		t = elapsed(&start, &end);
+		if (!r || t < batch)
+			batch = t;
+	}
+
+	printf("%d kernels (%d sources, %zu bytes of binary each pass)\n",
+	       count, n_corpus, bytes * copies);
+	if (compact)
+		printf("compaction: %zu to %zu bytes (%zu%% smaller)\n",
+		       uncompacted, bytes,
+		       uncompacted ? (uncompacted - bytes) * 100 / uncompacted : 0);
+	printf("serial: %.3f s, %.0f kernels/s\n", serial, count / serial);
+	printf("batch:  %.3f s, %.0f kernels/s (%ld jobs)\n", batch,
+	       count / batch,
+	       jobs ? (long)jobs : sysconf(_SC_NPROCESSORS_ONLN));
+
+	for (i = 0; i < n_corpus; i++)
+		free((char *)corpus[i].source);
+	free(corpus);
+	free(kernels);
+	gen4asm_destroy(assembler);
+
+	return 0;
+}
@@ -95,6 +95,56 @@ read_program_binary (FILE *input)
     return program;
 }
 
+/*
+ * Disassembles the program as a stream of instructions, which are 16 bytes
+ * long or 8 bytes long when compacted.
+ */
+static void
+disassemble_program (FILE *output, struct brw_program *program, int gen)
+{
+    struct brw_program_instruction  *inst;
+    struct brw_context		    brw;
+    unsigned char		    *store;
+    int			size = 0;
+    int			offset;
+
+    for (inst = program->first; inst; inst = inst->next)
+	size += 16;
+
+    store = malloc (size ? size : 1);
+    if (!store)
+	exit (1);
+    for (inst = program->first, offset = 0; inst; inst = inst->next, offset += 16)
+	memcpy (store + offset, &inst->insn, 16);
+
+    brw_init_context (&brw, gen * 10);
+    brw_init_compaction_tables (&brw.intel);
+
+    for (offset = 0; offset < size;) {
+	struct brw_instruction *insn = (struct brw_instruction *) (store + offset);
+	struct brw_instruction uncompacted;
+
+	if (gen >= 6 && gen < 8 && insn->header.cmpt_control) {
+	    brw_uncompact_instruction (&brw.intel, &uncompacted,
+				       (struct brw_compact_instruction *) insn);
+	    insn = &uncompacted;
+	    offset += 8;
+	} else if (offset + 16 <= size) {
+	    offset += 16;
+	} else {
+	    fprintf (stderr, "Truncated instruction at offset %d\n", offset);
+	    break;
+	}
+
+	if (gen >= 8)
+	    gen8_disassemble (output, (struct gen8_instruction *) insn, gen);
+	else
+	    brw_disasm (output, insn, gen);
+    }
+
+    free (store);
+}
+
 static void usage(void)
 {
     fprintf(stderr, "usage: intel-gen4disasm [options] inputfile\n");
@@ -113,7 +163,6 @@ int main(int argc, char **argv)
     int			byte_array_input = 0;
     int			o;
     int			gen = 4;
-    struct brw_program_instruction  *inst;
 
     while ((o = getopt_long(argc, argv, "o:bg:", longopts, NULL)) != -1) {
 	switch (o) {
@@ -167,11 +216,7 @@ int main(int argc, char **argv)
 	}
     }
 
-    for (inst = program->first; inst; inst = inst->next)
-	if (gen >= 8)
-	    gen8_disassemble(output, &inst->insn.gen8, gen);
-	else
-	    brw_disasm (output, &inst->insn.gen, gen);
+    disassemble_program (output, program, gen);
 
     exit (0);
 }
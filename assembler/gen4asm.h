@@ -31,6 +31,7 @@
 
 #include <inttypes.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <assert.h>
 
 #include "brw_reg.h"
@@ -152,7 +153,7 @@ struct relocation {
  */
 struct brw_program_instruction {
     enum assembler_instruction_type type;
-    unsigned inst_offset;
+    unsigned inst_offset; // in number of instructions, or eight-byte units once compacted
     union {
 	struct brw_instruction gen;
 	struct gen8_instruction gen8;
@@ -178,6 +179,19 @@ static inline bool is_relocatable(struct brw_program_instruction *intruction)
     return intruction->type == GEN4ASM_INSTRUCTION_GEN_RELOCATABLE;
 }
 
+static inline bool is_compacted(struct brw_program_instruction *instruction)
+{
+    return !is_label(instruction) && instruction->insn.gen.header.cmpt_control;
+}
+
+static inline int instruction_size(struct brw_program_instruction *instruction)
+{
+    if (is_label(instruction))
+	return 0;
+
+    return is_compacted(instruction) ? 8 : 16;
+}
+
 /**
  * This structure is a list of instructions.  It is the final output of the
  * parser.
@@ -224,6 +238,19 @@ void insert_register(struct declared_register *reg);
 int yyparse(void);
 int yylex(void);
 int yylex_destroy(void);
+void lex_reset(FILE *input);
+
+struct compaction_stats {
+    int instructions, compacted;
+    int size, compacted_size; // in bytes
+};
+
+void gen4asm_set_gen(long int gen);
+int gen4asm_parse(FILE *input, const char *filename);
+int gen4asm_link(int (*is_entry_point)(const char *label),
+		 struct compaction_stats *compaction);
+void *gen4asm_program_binary(size_t *size);
+void gen4asm_free_program(void);
 
 char *
 lex_text(void);
@@ -0,0 +1,797 @@
+/* -*- c-basic-offset: 8 -*- */
+/*
+ * Copyright © 2006 Intel Corporation
+ * Copyright © 2024 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Eric Anholt <eric@anholt.net>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "ralloc.h"
+#include "gen4asm.h"
+#include "gen4asm_lib.h"
+#include "brw_eu.h"
+
+extern void set_branch_two_offsets(struct brw_program_instruction *insn, int jip_offset, int uip_offset);
+extern void set_branch_one_offset(struct brw_program_instruction *insn, int jip_offset);
+extern void set_compacted_branch_two_offsets(struct brw_program_instruction *insn, int jip_offset, int uip_offset);
+extern void set_compacted_branch_one_offset(struct brw_program_instruction *insn, int jip_offset);
+
+/*
+ * The parser and the scanner keep their state in globals, so a single
+ * program is assembled at a time in a process: the library serializes the
+ * callers, and assembles batches in parallel in worker processes.
+ */
+
+long int gen_level = 40;
+int advanced_flag = 0; /* 0: in unit of byte, 1: in unit of data element size */
+unsigned int warning_flags = WARN_ALWAYS;
+int need_export = 0;
+const char *input_filename = "<stdin>";
+int errors;
+
+struct brw_context genasm_brw_context;
+struct brw_compile genasm_compile;
+
+struct brw_program compiled_program;
+struct program_defaults program_defaults = {.register_type = BRW_REGISTER_TYPE_F};
+
+static void *compile_mem_ctx;
+
+#define HASH_SIZE 37
+
+struct hash_item {
+	char *key;
+	void *value;
+	struct hash_item *next;
+};
+
+typedef struct hash_item *hash_table[HASH_SIZE];
+
+static hash_table declared_register_table;
+
+struct label_item {
+	char *name;
+	int addr;
+	struct label_item *next;
+};
+static struct label_item *label_table;
+
+static int hash(char *key)
+{
+    unsigned ret = 0;
+    while(*key)
+        ret = (ret << 1) + (*key++);
+    return ret % HASH_SIZE;
+}
+
+static void *find_hash_item(hash_table t, char *key)
+{
+    struct hash_item *p;
+    for(p = t[hash(key)]; p; p = p->next)
+	if(strcasecmp(p->key, key) == 0)
+	    return p->value;
+    return NULL;
+}
+
+static void insert_hash_item(hash_table t, char *key, void *v)
+{
+    int index = hash(key);
+    struct hash_item *p = malloc(sizeof(*p));
+    p->key = key;
+    p->value = v;
+    p->next = t[index];
+    t[index] = p;
+}
+
+static void free_hash_table(hash_table t)
+{
+    struct hash_item *p, *next;
+    int i;
+    for (i = 0; i < HASH_SIZE; i++) {
+	p = t[i];
+	while(p) {
+	    next = p->next;
+	    free(p->key);
+	    free(p->value);
+	    free(p);
+	    p = next;
+	}
+	t[i] = NULL;
+    }
+}
+
+struct declared_register *find_register(char *name)
+{
+    return find_hash_item(declared_register_table, name);
+}
+
+void insert_register(struct declared_register *reg)
+{
+    insert_hash_item(declared_register_table, reg->name, reg);
+}
+
+static void add_label(struct brw_program_instruction *i)
+{
+    struct label_item **p = &label_table;
+
+    assert(is_label(i));
+
+    while(*p)
+        p = &((*p)->next);
+    *p = calloc(1, sizeof(**p));
+    (*p)->name = label_name(i);
+    (*p)->addr = i->inst_offset;
+}
+
+/* Some assembly code have duplicated labels.
+   Start from start_addr. Search as a loop. Return the first label found. */
+static int label_to_addr(char *name, int start_addr)
+{
+    /* return the first label just after start_addr, or the first label from the head */
+    struct label_item *p;
+    int r = -1;
+    for(p = label_table; p; p = p->next) {
+        if(strcmp(p->name, name) == 0) {
+            if(p->addr >= start_addr) // the first label just after start_addr
+                return p->addr;
+            else if(r == -1) // the first label from the head
+                r = p->addr;
+        }
+    }
+    if(r == -1)
+        fprintf(stderr, "%s: Can't find label %s\n", input_filename, name);
+    return r;
+}
+
+static void free_label_table(struct label_item *p)
+{
+    if(p) {
+        free_label_table(p->next);
+        free(p);
+    }
+}
+
+/**
+ * gen4asm_set_gen:
+ * @gen: GPU generation times ten, e.g. 75 for Haswell
+ *
+ * Sets up the compile state used by the parser for @gen.
+ */
+void gen4asm_set_gen(long int gen)
+{
+	gen_level = gen;
+
+	ralloc_free(compile_mem_ctx);
+	compile_mem_ctx = ralloc_context(NULL);
+
+	brw_init_context(&genasm_brw_context, gen_level);
+	brw_init_compile(&genasm_brw_context, &genasm_compile, compile_mem_ctx);
+}
+
+/**
+ * gen4asm_parse:
+ *
+ * Parses @input into compiled_program, starting from a clean parser state.
+ *
+ * Returns: 0 on success, -1 if errors were reported.
+ */
+int gen4asm_parse(FILE *input, const char *filename)
+{
+	input_filename = filename;
+	errors = 0;
+	memset(&compiled_program, 0, sizeof(compiled_program));
+	memset(&program_defaults, 0, sizeof(program_defaults));
+	program_defaults.register_type = BRW_REGISTER_TYPE_F;
+
+	lex_reset(input);
+
+	if (yyparse() || errors)
+		return -1;
+
+	return 0;
+}
+
+static bool can_compact(struct brw_program_instruction *entry)
+{
+	int opcode = entry->insn.gen.header.opcode;
+
+	/* Jump offsets are only known once the program is laid out. */
+	if (is_relocatable(entry) ||
+	    (opcode >= BRW_OPCODE_JMPI && opcode <= BRW_OPCODE_POP))
+		return false;
+
+	/* Gen6 and Gen7 have no compact encoding for 3-source instructions. */
+	if (opcode == BRW_OPCODE_MAD || opcode == BRW_OPCODE_LRP ||
+	    opcode == BRW_OPCODE_BFE || opcode == BRW_OPCODE_BFI2)
+		return false;
+
+	return true;
+}
+
+/*
+ * Replaces the instruction with its compact encoding, provided the hardware
+ * expands it back to the very same instruction.
+ */
+static bool compact_instruction(struct brw_program_instruction *entry)
+{
+	struct brw_instruction *insn = &entry->insn.gen;
+	struct brw_compact_instruction compacted;
+	struct brw_instruction uncompacted;
+
+	if (!can_compact(entry) ||
+	    !brw_try_compact_instruction(&genasm_compile, &compacted, insn))
+		return false;
+
+	brw_uncompact_instruction(&genasm_brw_context.intel, &uncompacted,
+				  &compacted);
+	if (memcmp(&uncompacted, insn, sizeof(uncompacted)))
+		return false;
+
+	memset(insn, 0, sizeof(*insn));
+	memcpy(insn, &compacted, sizeof(compacted));
+
+	return true;
+}
+
+static void insert_compact_nop(struct brw_program_instruction **prev)
+{
+	struct brw_program_instruction *nop;
+	struct brw_compact_instruction *compacted;
+
+	nop = calloc(1, sizeof(*nop));
+	compacted = (struct brw_compact_instruction *)&nop->insn.gen;
+	compacted->dw0.opcode = BRW_OPCODE_NOP;
+	compacted->dw0.cmpt_ctrl = 1;
+
+	nop->next = *prev;
+	*prev = nop;
+	if (!nop->next)
+		compiled_program.last = nop;
+}
+
+/*
+ * Number of eight-byte NOPs to insert before entry, at offset in eight-byte
+ * units, for the instructions which must stay aligned.
+ */
+static int compact_padding(struct brw_program_instruction *entry, int offset,
+			   int (*is_entry_point)(const char *label))
+{
+	struct brw_instruction *insn = &entry->insn.gen;
+
+	if (is_label(entry)) {
+		/* Entry points are on a 64 bytes boundary, as without
+		 * compaction. */
+		if (is_entry_point && is_entry_point(label_name(entry)))
+			return -offset & 7;
+		return 0;
+	}
+
+	/* The end of thread SEND must be aligned, or the GPU hangs. */
+	if ((insn->header.opcode == BRW_OPCODE_SEND ||
+	     insn->header.opcode == BRW_OPCODE_SENDC) &&
+	    insn->bits3.generic_gen5.end_of_thread)
+		return offset & 1;
+
+	return 0;
+}
+
+/*
+ * Compacts the instructions of the linked compiled_program, and moves the
+ * branch targets accordingly. Offsets are in eight-byte units afterwards.
+ */
+static void compact_program(int (*is_entry_point)(const char *label),
+			    struct compaction_stats *compaction)
+{
+	struct brw_program_instruction *entry, **prev;
+	int count = compaction->instructions;
+	int *new_offset;
+	int offset, pad;
+
+	/* Branches with an offset out of the program can't be moved. */
+	for (entry = compiled_program.first; entry; entry = entry->next) {
+	    int first = entry->inst_offset + entry->reloc.first_reloc_offset;
+	    int second = entry->inst_offset + entry->reloc.second_reloc_offset;
+
+	    if (is_relocatable(entry) &&
+		(first < 0 || first > count || second < 0 || second > count)) {
+		fprintf(stderr, "%s: branch out of the program, not compacting\n",
+			input_filename);
+		return;
+	    }
+	}
+
+	/* Offset of each instruction once compacted, and of the end */
+	new_offset = calloc(count + 1, sizeof(*new_offset));
+
+	offset = 0;
+	prev = &compiled_program.first;
+	while ((entry = *prev)) {
+	    for (pad = compact_padding(entry, offset, is_entry_point); pad; pad--) {
+		insert_compact_nop(prev);
+		prev = &(*prev)->next;
+		offset++;
+	    }
+
+	    if (!is_label(entry)) {
+		new_offset[entry->inst_offset] = offset;
+		if (compact_instruction(entry))
+		    compaction->compacted++;
+		offset += instruction_size(entry) / 8;
+	    }
+
+	    prev = &entry->next;
+	}
+	new_offset[count] = offset;
+
+	/* Keep the program a whole number of full instructions. */
+	if (offset & 1)
+	    insert_compact_nop(prev);
+
+	for (entry = compiled_program.first; entry; entry = entry->next) {
+	    struct relocation *reloc = &entry->reloc;
+	    int jip, uip;
+
+	    if (!is_relocatable(entry))
+		continue;
+
+	    offset = new_offset[entry->inst_offset];
+	    jip = new_offset[entry->inst_offset + reloc->first_reloc_offset] - offset;
+	    uip = new_offset[entry->inst_offset + reloc->second_reloc_offset] - offset;
+
+	    if (reloc->second_reloc_offset)
+		set_compacted_branch_two_offsets(entry, jip, uip);
+	    else if (reloc->first_reloc_offset)
+		set_compacted_branch_one_offset(entry, jip);
+	}
+
+	offset = 0;
+	for (entry = compiled_program.first; entry; entry = entry->next) {
+	    entry->inst_offset = offset;
+	    offset += instruction_size(entry) / 8;
+	}
+	compaction->compacted_size = offset * 8;
+
+	free(new_offset);
+}
+
+/**
+ * gen4asm_link:
+ * @is_entry_point: if not NULL, labels it returns true for are aligned
+ * with NOP instructions
+ * @compaction: if not NULL, the instructions are compacted where the
+ * generation has a compact encoding (Gen6 and Gen7), and @compaction is set
+ * to the code size before and after
+ *
+ * Lays out compiled_program and resolves the branch targets.
+ *
+ * Returns: 0 on success, -1 if a label can't be found.
+ */
+int gen4asm_link(int (*is_entry_point)(const char *label),
+		 struct compaction_stats *compaction)
+{
+	struct brw_program_instruction *entry, *entry1, *tmp_entry;
+	bool compact = compaction && gen_level >= 60 && gen_level < 80;
+	int (*align_entry_point)(const char *label);
+	int inst_offset;
+	int addr;
+
+	/* Compaction aligns the entry points of its own layout. */
+	align_entry_point = compact ? NULL : is_entry_point;
+
+	inst_offset = 0 ;
+	for (entry = compiled_program.first;
+		entry != NULL; entry = entry->next) {
+	    entry->inst_offset = inst_offset;
+	    entry1 = entry->next;
+	    if (align_entry_point && entry1 && is_label(entry1) &&
+		align_entry_point(label_name(entry1))) {
+		// insert NOP instructions until (inst_offset+1) % 4 == 0
+		while (((inst_offset+1) % 4) != 0) {
+		    tmp_entry = calloc(1, sizeof(*tmp_entry));
+		    tmp_entry->insn.gen.header.opcode = BRW_OPCODE_NOP;
+		    entry->next = tmp_entry;
+		    tmp_entry->next = entry1;
+		    entry = tmp_entry;
+		    tmp_entry->inst_offset = ++inst_offset;
+		}
+	    }
+	    if (!is_label(entry))
+              inst_offset++;
+	}
+
+	for (entry = compiled_program.first; entry; entry = entry->next)
+	    if (is_label(entry))
+		add_label(entry);
+
+	for (entry = compiled_program.first; entry; entry = entry->next) {
+	    struct relocation *reloc = &entry->reloc;
+
+	    if (!is_relocatable(entry))
+		continue;
+
+	    if (reloc->first_reloc_target) {
+		addr = label_to_addr(reloc->first_reloc_target, entry->inst_offset);
+		if (addr < 0)
+		    return -1;
+		reloc->first_reloc_offset = addr - entry->inst_offset;
+	    }
+
+	    if (reloc->second_reloc_target) {
+		addr = label_to_addr(reloc->second_reloc_target, entry->inst_offset);
+		if (addr < 0)
+		    return -1;
+		reloc->second_reloc_offset = addr - entry->inst_offset;
+	    }
+
+	    if (reloc->second_reloc_offset) { // this is a branch instruction with two offset arguments
+                set_branch_two_offsets(entry, reloc->first_reloc_offset, reloc->second_reloc_offset);
+	    } else if (reloc->first_reloc_offset) {
+                set_branch_one_offset(entry, reloc->first_reloc_offset);
+	    }
+	}
+
+	if (compaction) {
+	    memset(compaction, 0, sizeof(*compaction));
+	    for (entry = compiled_program.first; entry; entry = entry->next)
+		if (!is_label(entry))
+		    compaction->instructions++;
+	    compaction->size = compaction->instructions * 16;
+	    compaction->compacted_size = compaction->size;
+	}
+
+	if (compact)
+	    compact_program(is_entry_point, compaction);
+
+	return 0;
+}
+
+/**
+ * gen4asm_program_binary:
+ * @size: set to the size of the binary in bytes
+ *
+ * Returns: the instructions of the linked compiled_program in a buffer to be
+ * released with free(), or NULL if it can't be allocated.
+ */
+void *gen4asm_program_binary(size_t *size)
+{
+	struct brw_program_instruction *entry;
+	char *binary, *p;
+
+	*size = 0;
+	for (entry = compiled_program.first; entry; entry = entry->next)
+	    *size += instruction_size(entry);
+
+	binary = p = malloc(*size ?: 1);
+	if (!binary)
+	    return NULL;
+
+	for (entry = compiled_program.first; entry; entry = entry->next) {
+	    memcpy(p, &entry->insn.gen, instruction_size(entry));
+	    p += instruction_size(entry);
+	}
+
+	return binary;
+}
+
+/**
+ * gen4asm_free_program:
+ *
+ * Releases compiled_program and the tables built while assembling it.
+ */
+void gen4asm_free_program(void)
+{
+	struct brw_program_instruction *entry, *next;
+
+	for (entry = compiled_program.first; entry; entry = next) {
+	    next = entry->next;
+	    if (is_label(entry))
+		free(entry->insn.label.name);
+	    free(entry);
+	}
+	memset(&compiled_program, 0, sizeof(compiled_program));
+
+	free_hash_table(declared_register_table);
+	free_label_table(label_table);
+	label_table = NULL;
+}
+
+struct gen4asm {
+	int gen_level;
+	bool compact;
+};
+
+static pthread_mutex_t assembler_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Generation the compile state was last set up for */
+static int current_gen_level;
+
+/**
+ * gen4asm_create:
+ * @gen: GPU generation times ten, e.g. 75 for Haswell
+ *
+ * Returns: a new assembler for @gen, or NULL if the generation isn't
+ * supported.
+ */
+struct gen4asm *gen4asm_create(int gen)
+{
+	struct gen4asm *assembler;
+
+	if (gen < 40 || gen > 90)
+		return NULL;
+
+	assembler = calloc(1, sizeof(*assembler));
+	if (assembler)
+		assembler->gen_level = gen;
+
+	return assembler;
+}
+
+void gen4asm_destroy(struct gen4asm *assembler)
+{
+	free(assembler);
+}
+
+/**
+ * gen4asm_set_compaction:
+ * @compact: whether to compact the instructions
+ *
+ * Enables instruction compaction in the kernels assembled afterwards. Only
+ * Gen6 and Gen7 have a compact encoding, kernels of other generations are
+ * left as they are.
+ */
+void gen4asm_set_compaction(struct gen4asm *assembler, bool compact)
+{
+	assembler->compact = compact;
+}
+
+/* Called with assembler_lock held, or in a batch worker. */
+static int __gen4asm_assemble(struct gen4asm *assembler,
+			      struct gen4asm_kernel *kernel)
+{
+	struct compaction_stats compaction;
+	const char *name = kernel->name ?: "<memory>";
+	void *binary;
+	size_t size;
+	FILE *input;
+	int err;
+
+	kernel->binary = NULL;
+	kernel->size = 0;
+	kernel->uncompacted_size = 0;
+	kernel->error = -1;
+
+	/* The compile state only depends on the generation, reuse it. */
+	if (current_gen_level != assembler->gen_level) {
+		gen4asm_set_gen(assembler->gen_level);
+		current_gen_level = assembler->gen_level;
+	}
+
+	if (!kernel->source_len) {
+		fprintf(stderr, "%s: empty source\n", name);
+		return -1;
+	}
+
+	input = fmemopen((void *)kernel->source, kernel->source_len, "r");
+	if (!input) {
+		perror("fmemopen");
+		return -1;
+	}
+
+	err = gen4asm_parse(input, name);
+	fclose(input);
+
+	if (!err)
+		err = gen4asm_link(NULL, assembler->compact ? &compaction : NULL);
+
+	if (!err) {
+		binary = gen4asm_program_binary(&size);
+		if (!binary)
+			err = -1;
+	}
+
+	if (!err) {
+		kernel->binary = binary;
+		kernel->size = size;
+		kernel->uncompacted_size = assembler->compact ? compaction.size : size;
+		kernel->error = 0;
+	}
+
+	gen4asm_free_program();
+
+	return err;
+}
+
+/**
+ * gen4asm_assemble:
+ * @kernel: the source to assemble, and the resulting binary
+ *
+ * Assembles @kernel->source into @kernel->binary, with 16 bytes per
+ * instruction or 8 bytes per compacted one, as written by intel-gen4asm.
+ * Diagnostics are printed to stderr.
+ *
+ * This function can be called from several threads, the calls are
+ * serialized.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+int gen4asm_assemble(struct gen4asm *assembler, struct gen4asm_kernel *kernel)
+{
+	int err;
+
+	pthread_mutex_lock(&assembler_lock);
+	err = __gen4asm_assemble(assembler, kernel);
+	pthread_mutex_unlock(&assembler_lock);
+
+	return err;
+}
+
+struct batch_record {
+	int index;
+	int error;
+	size_t size;
+	size_t uncompacted_size;
+};
+
+static void batch_worker(struct gen4asm *assembler,
+			 struct gen4asm_kernel *kernels, int count,
+			 int *next, FILE *out)
+{
+	struct batch_record record;
+	int i;
+
+	while ((i = __atomic_fetch_add(next, 1, __ATOMIC_RELAXED)) < count) {
+		__gen4asm_assemble(assembler, &kernels[i]);
+
+		record.index = i;
+		record.error = kernels[i].error;
+		record.size = kernels[i].size;
+		record.uncompacted_size = kernels[i].uncompacted_size;
+		fwrite(&record, sizeof(record), 1, out);
+		fwrite(kernels[i].binary, 1, kernels[i].size, out);
+		free(kernels[i].binary);
+	}
+
+	fflush(out);
+}
+
+static void batch_collect(struct gen4asm_kernel *kernels, int count,
+			  char *reported, FILE *in)
+{
+	struct batch_record record;
+
+	rewind(in);
+	while (fread(&record, sizeof(record), 1, in) == 1) {
+		struct gen4asm_kernel *kernel;
+
+		if (record.index < 0 || record.index >= count)
+			break;
+
+		kernel = &kernels[record.index];
+		kernel->binary = malloc(record.size);
+		if (record.size && !kernel->binary)
+			break;
+		if (fread(kernel->binary, 1, record.size, in) != record.size) {
+			free(kernel->binary);
+			kernel->binary = NULL;
+			break;
+		}
+		kernel->size = record.size;
+		kernel->uncompacted_size = record.uncompacted_size;
+		kernel->error = record.error;
+		reported[record.index] = 1;
+	}
+}
+
+/**
+ * gen4asm_assemble_batch:
+ * @kernels: array of @count kernels to assemble
+ * @jobs: number of kernels assembled in parallel, or 0 for one per CPU
+ *
+ * Assembles all the @kernels, like gen4asm_assemble() for each of them.
+ * Kernels are handed out to @jobs worker processes, as the parser can only
+ * assemble one program at a time in a process.
+ *
+ * Returns: the number of kernels which failed to assemble.
+ */
+int gen4asm_assemble_batch(struct gen4asm *assembler,
+			   struct gen4asm_kernel *kernels, int count,
+			   int jobs)
+{
+	FILE **results;
+	char *reported;
+	pid_t *pids;
+	int *next;
+	int i, started, failed = 0;
+
+	if (jobs <= 0)
+		jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (jobs > count)
+		jobs = count;
+
+	results = calloc(jobs, sizeof(*results));
+	pids = calloc(jobs, sizeof(*pids));
+	reported = calloc(count, 1);
+	next = MAP_FAILED;
+	if (jobs > 1)
+		next = mmap(NULL, sizeof(*next), PROT_READ | PROT_WRITE,
+			    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	/* Hold the lock, so that no other thread is assembling while the
+	 * parser state is copied to the workers. */
+	pthread_mutex_lock(&assembler_lock);
+
+	started = 0;
+	if (next != MAP_FAILED && results && pids && reported) {
+		*next = 0;
+		for (started = 0; started < jobs; started++) {
+			results[started] = tmpfile();
+			if (!results[started])
+				break;
+
+			pids[started] = fork();
+			if (pids[started] == 0) {
+				batch_worker(assembler, kernels, count, next,
+					     results[started]);
+				_exit(0);
+			} else if (pids[started] < 0) {
+				fclose(results[started]);
+				break;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&assembler_lock);
+
+	for (i = 0; i < started; i++)
+		waitpid(pids[i], NULL, 0);
+
+	for (i = 0; i < started; i++) {
+		batch_collect(kernels, count, reported, results[i]);
+		fclose(results[i]);
+	}
+
+	/* Whatever the workers didn't report, e.g. if none could be started */
+	for (i = 0; i < count; i++) {
+		if (!reported || !reported[i])
+			gen4asm_assemble(assembler, &kernels[i]);
+		if (kernels[i].error)
+			failed++;
+	}
+
+	if (next != MAP_FAILED)
+		munmap(next, sizeof(*next));
+	free(reported);
+	free(pids);
+	free(results);
+
+	return failed;
+}
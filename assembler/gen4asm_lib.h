@@ -0,0 +1,66 @@
+/*
+ * Copyright © 2024 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __GEN4ASM_LIB_H__
+#define __GEN4ASM_LIB_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Library interface of the assembler: assembles sources held in memory
+ * to binaries in memory, with the same encoding as intel-gen4asm.
+ */
+
+struct gen4asm;
+
+/**
+ * gen4asm_kernel:
+ * @name: name used in diagnostics, or NULL
+ * @source: the assembly source, not necessarily NUL-terminated
+ * @source_len: length of @source in bytes
+ * @binary: set to the assembled instructions, to be released with free()
+ * @size: set to the size of @binary in bytes
+ * @uncompacted_size: set to the size @binary would have without compaction
+ * @error: set to 0 if the kernel was assembled, -1 otherwise
+ */
+struct gen4asm_kernel {
+	const char *name;
+	const char *source;
+	size_t source_len;
+
+	void *binary;
+	size_t size;
+	size_t uncompacted_size;
+	int error;
+};
+
+struct gen4asm *gen4asm_create(int gen);
+void gen4asm_destroy(struct gen4asm *assembler);
+void gen4asm_set_compaction(struct gen4asm *assembler, bool compact);
+int gen4asm_assemble(struct gen4asm *assembler, struct gen4asm_kernel *kernel);
+int gen4asm_assemble_batch(struct gen4asm *assembler,
+			   struct gen4asm_kernel *kernels, int count,
+			   int jobs);
+
+#endif /* __GEN4ASM_LIB_H__ */
@@ -121,6 +121,8 @@ static void set_direct_src_operand(struct src_operand *src, struct brw_reg *reg,
 
 void set_branch_two_offsets(struct brw_program_instruction *insn, int jip_offset, int uip_offset);
 void set_branch_one_offset(struct brw_program_instruction *insn, int jip_offset);
+void set_compacted_branch_two_offsets(struct brw_program_instruction *insn, int jip_offset, int uip_offset);
+void set_compacted_branch_one_offset(struct brw_program_instruction *insn, int jip_offset);
 
 enum message_level {
     WARN,
@@ -3353,11 +3355,28 @@ static inline int branch_offset(struct brw_program_instruction *insn, int offset
     return offset;
 }
 
-void set_branch_two_offsets(struct brw_program_instruction *insn, int jip_offset, int uip_offset)
+/*
+ * return the offset used in native flow control (branch) instructions, from
+ * an offset in number of eight-byte units in a compacted program (Gen6+)
+ */
+static inline int compacted_branch_offset(struct brw_program_instruction *insn, int offset)
 {
-    int jip = branch_offset(insn, jip_offset);
-    int uip = branch_offset(insn, uip_offset);
+    /*
+     * JMPI is relative to the incremented instruction pointer, and is never
+     * compacted.
+     */
+    if (instruction_opcode(insn) == BRW_OPCODE_JMPI) {
+        offset -= 2;
+
+        if (gen_level >= 75)
+            offset *= 8;
+    }
 
+    return offset;
+}
+
+static void set_branch_jip_uip(struct brw_program_instruction *insn, int jip, int uip)
+{
     assert(instruction_opcode(insn) != BRW_OPCODE_JMPI);
 
     if (IS_GENp(8)) {
@@ -3369,10 +3388,8 @@ void set_branch_two_offsets(struct brw_program_instruction *insn, int jip_offset
     }
 }
 
-void set_branch_one_offset(struct brw_program_instruction *insn, int jip_offset)
+static void set_branch_jip(struct brw_program_instruction *insn, int jip)
 {
-    int jip = branch_offset(insn, jip_offset);
-
     if (IS_GENp(8)) {
         gen8_set_jip(GEN8(insn), jip);
     } else if (IS_GENx(7)) {
@@ -3396,3 +3413,25 @@ void set_branch_one_offset(struct brw_program_instruction *insn, int jip_offset)
             GEN(insn)->bits3.break_cont.uip = 1; // Set the istack pop count, which must always be 1.
     }
 }
+
+void set_branch_two_offsets(struct brw_program_instruction *insn, int jip_offset, int uip_offset)
+{
+    set_branch_jip_uip(insn, branch_offset(insn, jip_offset),
+		       branch_offset(insn, uip_offset));
+}
+
+void set_branch_one_offset(struct brw_program_instruction *insn, int jip_offset)
+{
+    set_branch_jip(insn, branch_offset(insn, jip_offset));
+}
+
+void set_compacted_branch_two_offsets(struct brw_program_instruction *insn, int jip_offset, int uip_offset)
+{
+    set_branch_jip_uip(insn, compacted_branch_offset(insn, jip_offset),
+		       compacted_branch_offset(insn, uip_offset));
+}
+
+void set_compacted_branch_one_offset(struct brw_program_instruction *insn, int jip_offset)
+{
+    set_branch_jip(insn, compacted_branch_offset(insn, jip_offset));
+}
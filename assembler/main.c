@@ -37,50 +37,18 @@
 #include "gen4asm.h"
 #include "brw_eu.h"
 
-extern FILE *yyin;
-extern void set_branch_two_offsets(struct brw_program_instruction *insn, int jip_offset, int uip_offset);
-extern void set_branch_one_offset(struct brw_program_instruction *insn, int jip_offset);
-
-long int gen_level = 40;
-int advanced_flag = 0; /* 0: in unit of byte, 1: in unit of data element size */
-unsigned int warning_flags = WARN_ALWAYS;
-int need_export = 0;
-const char *input_filename = "<stdin>";
-int errors;
-
-struct brw_context genasm_brw_context;
-struct brw_compile genasm_compile;
-
-struct brw_program compiled_program;
-struct program_defaults program_defaults = {.register_type = BRW_REGISTER_TYPE_F};
+extern int need_export;
 
 /* 0: default output style, 1: nice C-style output */
 static int binary_like_output = 0;
+static int compact = 0;
 static char *export_filename = NULL;
 static const char binary_prepend[] = "static const char gen_eu_bytes[] = {\n";
 
-#define HASH_SIZE 37
-
-struct hash_item {
-	char *key;
-	void *value;
-	struct hash_item *next;
-};
-
-typedef struct hash_item *hash_table[HASH_SIZE];
-
-static hash_table declared_register_table;
-
-struct label_item {
-	char *name;
-	int addr;
-	struct label_item *next;
-};
-static struct label_item *label_table;
-
 static const struct option longopts[] = {
 	{"advanced", no_argument, 0, 'a'},
 	{"binary", no_argument, 0, 'b'},
+	{"compact", no_argument, 0, 'c'},
 	{"export", required_argument, 0, 'e'},
 	{"input_list", required_argument, 0, 'l'},
 	{"output", required_argument, 0, 'o'},
@@ -94,108 +62,13 @@ static void usage(void)
 	fprintf(stderr, "OPTIONS:\n");
 	fprintf(stderr, "\t-a, --advanced                       Set advanced flag\n");
 	fprintf(stderr, "\t-b, --binary                         C style binary output\n");
+	fprintf(stderr, "\t-c, --compact                        Compact instructions (Gen6, Gen7)\n");
 	fprintf(stderr, "\t-e, --export {exportfile}            Export label file\n");
 	fprintf(stderr, "\t-l, --input_list {entrytablefile}    Input entry_table_list file\n");
 	fprintf(stderr, "\t-o, --output {outputfile}            Specify output file\n");
 	fprintf(stderr, "\t-g, --gen <4|5|6|7|8|9>              Specify GPU generation\n");
 }
 
-static int hash(char *key)
-{
-    unsigned ret = 0;
-    while(*key)
-        ret = (ret << 1) + (*key++);
-    return ret % HASH_SIZE;
-}
-
-static void *find_hash_item(hash_table t, char *key)
-{
-    struct hash_item *p;
-    for(p = t[hash(key)]; p; p = p->next)
-	if(strcasecmp(p->key, key) == 0)
-	    return p->value;
-    return NULL;
-}
-
-static void insert_hash_item(hash_table t, char *key, void *v)
-{
-    int index = hash(key);
-    struct hash_item *p = malloc(sizeof(*p));
-    p->key = key;
-    p->value = v;
-    p->next = t[index];
-    t[index] = p;
-}
-
-static void free_hash_table(hash_table t)
-{
-    struct hash_item *p, *next;
-    int i;
-    for (i = 0; i < HASH_SIZE; i++) {
-	p = t[i];
-	while(p) {
-	    next = p->next;
-	    free(p->key);
-	    free(p->value);
-	    free(p);
-	    p = next;
-	}
-    }
-}
-
-struct declared_register *find_register(char *name)
-{
-    return find_hash_item(declared_register_table, name);
-}
-
-void insert_register(struct declared_register *reg)
-{
-    insert_hash_item(declared_register_table, reg->name, reg);
-}
-
-static void add_label(struct brw_program_instruction *i)
-{
-    struct label_item **p = &label_table;
-
-    assert(is_label(i));
-
-    while(*p)
-        p = &((*p)->next);
-    *p = calloc(1, sizeof(**p));
-    (*p)->name = label_name(i);
-    (*p)->addr = i->inst_offset;
-}
-
-/* Some assembly code have duplicated labels.
-   Start from start_addr. Search as a loop. Return the first label found. */
-static int label_to_addr(char *name, int start_addr)
-{
-    /* return the first label just after start_addr, or the first label from the head */
-    struct label_item *p;
-    int r = -1;
-    for(p = label_table; p; p = p->next) {
-        if(strcmp(p->name, name) == 0) {
-            if(p->addr >= start_addr) // the first label just after start_addr
-                return p->addr;
-            else if(r == -1) // the first label from the head
-                r = p->addr;
-        }
-    }
-    if(r == -1) {
-        fprintf(stderr, "Can't find label %s\n", name);
-        exit(1);
-    }
-    return r;
-}
-
-static void free_label_table(struct label_item *p)
-{
-    if(p) {
-        free_label_table(p->next);
-        free(p);
-    }
-}
-
 struct entry_point_item {
 	char *str;
 	struct entry_point_item *next;
@@ -222,14 +95,12 @@ static int read_entry_file(char *fn)
 	return 0;
 }
 
-static int is_entry_point(struct brw_program_instruction *i)
+static int is_entry_point(const char *label)
 {
 	struct entry_point_item *p;
 
-	assert(i->type == GEN4ASM_INSTRUCTION_LABEL);
-
 	for (p = entry_point_table; p; p = p->next) {
-	    if (strcmp(p->str, i->insn.label.name) == 0)
+	    if (strcmp(p->str, label) == 0)
 		return 1;
 	}
 	return 0;
@@ -279,14 +150,17 @@ int main(int argc, char **argv)
 {
 	char *output_file = NULL;
 	char *entry_table_file = NULL;
+	FILE *input = stdin;
 	FILE *output = stdout;
 	FILE *export_file;
-	struct brw_program_instruction *entry, *entry1, *tmp_entry;
-	int err, inst_offset;
+	struct brw_program_instruction *entry;
+	struct compaction_stats compaction;
+	unsigned char *binary;
+	size_t size, offset;
+	int err;
 	char o;
-	void *mem_ctx;
 
-	while ((o = getopt_long(argc, argv, "e:l:o:g:abW", longopts, NULL)) != -1) {
+	while ((o = getopt_long(argc, argv, "e:l:o:g:abcW", longopts, NULL)) != -1) {
 		switch (o) {
 		case 'o':
 			if (strcmp(optarg, "-") != 0)
@@ -325,6 +199,9 @@ int main(int argc, char **argv)
 		case 'b':
 			binary_like_output = 1;
 			break;
+		case 'c':
+			compact = 1;
+			break;
 
 		case 'e':
 			need_export = 1;
@@ -355,25 +232,23 @@ int main(int argc, char **argv)
 
 	if (strcmp(argv[0], "-") != 0) {
 		input_filename = argv[0];
-		yyin = fopen(input_filename, "r");
-		if (yyin == NULL) {
+		input = fopen(input_filename, "r");
+		if (input == NULL) {
 			perror("Couldn't open input file");
 			exit(1);
 		}
 	}
 
-	brw_init_context(&genasm_brw_context, gen_level);
-	mem_ctx = ralloc_context(NULL);
-	brw_init_compile(&genasm_brw_context, &genasm_compile, mem_ctx);
+	gen4asm_set_gen(gen_level);
 
-	err = yyparse();
+	err = gen4asm_parse(input, input_filename);
 
 	if (strcmp(argv[0], "-"))
-		fclose(yyin);
+		fclose(input);
 
 	yylex_destroy();
 
-	if (err || errors)
+	if (err)
 		exit (1);
 
 	if (output_file) {
@@ -389,29 +264,17 @@ int main(int argc, char **argv)
 		fprintf(stderr, "Read entry file error\n");
 		exit(1);
 	}
-	inst_offset = 0 ;
-	for (entry = compiled_program.first;
-		entry != NULL; entry = entry->next) {
-	    entry->inst_offset = inst_offset;
-	    entry1 = entry->next;
-	    if (entry1 && is_label(entry1) && is_entry_point(entry1)) {
-		// insert NOP instructions until (inst_offset+1) % 4 == 0
-		while (((inst_offset+1) % 4) != 0) {
-		    tmp_entry = calloc(1, sizeof(*tmp_entry));
-		    tmp_entry->insn.gen.header.opcode = BRW_OPCODE_NOP;
-		    entry->next = tmp_entry;
-		    tmp_entry->next = entry1;
-		    entry = tmp_entry;
-		    tmp_entry->inst_offset = ++inst_offset;
-		}
-	    }
-	    if (!is_label(entry))
-              inst_offset++;
-	}
+	if (gen4asm_link(is_entry_point, compact ? &compaction : NULL))
+		exit(1);
 
-	for (entry = compiled_program.first; entry; entry = entry->next)
-	    if (is_label(entry))
-		add_label(entry);
+	if (compact && compaction.size)
+		fprintf(stderr, "%s: %d of %d instructions compacted, "
+			"%d to %d bytes (%d%% smaller)\n",
+			input_filename, compaction.compacted,
+			compaction.instructions, compaction.size,
+			compaction.compacted_size,
+			(compaction.size - compaction.compacted_size) * 100 /
+			compaction.size);
 
 	if (need_export) {
 		if (export_filename) {
@@ -419,53 +282,40 @@ int main(int argc, char **argv)
 		} else {
 			export_file = fopen("export.inc", "w");
 		}
+		offset = 0;
 		for (entry = compiled_program.first;
 			entry != NULL; entry = entry->next) {
-		    if (is_label(entry))
+		    /* IPs are in number of full instructions */
+		    if (is_label(entry) && offset % 16)
+			fprintf(stderr, "Label %s isn't exported, it isn't 16 bytes aligned\n",
+				label_name(entry));
+		    else if (is_label(entry))
 			fprintf(export_file, "#define %s_IP %d\n",
-				label_name(entry), (IS_GENx(5) ? 2 : 1)*(entry->inst_offset));
+				label_name(entry), (IS_GENx(5) ? 2 : 1)*(int)(offset / 16));
+		    offset += instruction_size(entry);
 		}
 		fclose(export_file);
 	}
 
-	for (entry = compiled_program.first; entry; entry = entry->next) {
-	    struct relocation *reloc = &entry->reloc;
-
-	    if (!is_relocatable(entry))
-		continue;
-
-	    if (reloc->first_reloc_target)
-		reloc->first_reloc_offset = label_to_addr(reloc->first_reloc_target, entry->inst_offset) - entry->inst_offset;
-
-	    if (reloc->second_reloc_target)
-		reloc->second_reloc_offset = label_to_addr(reloc->second_reloc_target, entry->inst_offset) - entry->inst_offset;
-
-	    if (reloc->second_reloc_offset) { // this is a branch instruction with two offset arguments
-                set_branch_two_offsets(entry, reloc->first_reloc_offset, reloc->second_reloc_offset);
-	    } else if (reloc->first_reloc_offset) {
-                set_branch_one_offset(entry, reloc->first_reloc_offset);
-	    }
+	binary = gen4asm_program_binary(&size);
+	if (!binary) {
+		perror("Couldn't allocate the binary");
+		exit(1);
 	}
 
 	if (binary_like_output)
 		fprintf(output, "%s", binary_prepend);
 
-	for (entry = compiled_program.first;
-		entry != NULL;
-		entry = entry1) {
-	    entry1 = entry->next;
-	    if (!is_label(entry))
-		print_instruction(output, &entry->insn.gen);
-	    else
-		free(entry->insn.label.name);
-	    free(entry);
-	}
+	/* Compacted instructions are printed two by two */
+	for (offset = 0; offset < size; offset += sizeof(struct brw_instruction))
+		print_instruction(output, (struct brw_instruction *)(binary + offset));
 	if (binary_like_output)
 		fprintf(output, "};");
 
+	free(binary);
+
 	free_entry_point_table(entry_point_table);
-	free_hash_table(declared_register_table);
-	free_label_table(label_table);
+	gen4asm_free_program();
 
 	fflush (output);
 	if (ferror (output)) {
@@ -0,0 +1,331 @@
+/*
+ * Copyright © 2024 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Assembles the test cases given as arguments with the library, and checks
+ * the binaries against the expected output of intel-gen4asm, one at a time
+ * and as a batch.
+ *
+ * With -c, assembles them for Gen6 and Gen7 with and without compaction
+ * instead, and checks the compacted binaries disassemble to the same
+ * program.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../gen4asm_lib.h"
+#include "../brw_compat.h"
+#include "../brw_context.h"
+#include "../brw_eu.h"
+
+static char *read_file(const char *path, size_t *len)
+{
+	FILE *file;
+	char *buf;
+	long size;
+
+	file = fopen(path, "r");
+	if (!file) {
+		perror(path);
+		exit(1);
+	}
+
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	rewind(file);
+
+	buf = malloc(size + 1);
+	if (fread(buf, 1, size, file) != size) {
+		perror(path);
+		exit(1);
+	}
+	buf[size] = '\0';
+	fclose(file);
+
+	*len = size;
+	return buf;
+}
+
+/* Formats the binary like the default intel-gen4asm output. */
+static char *format_binary(const struct gen4asm_kernel *kernel)
+{
+	const unsigned int *dw = kernel->binary;
+	size_t count = kernel->size / 16;
+	char *out, *p;
+
+	out = p = malloc(count * 64 + 1);
+	*p = '\0';
+	for (size_t i = 0; i < count; i++, dw += 4)
+		p += sprintf(p, "   { 0x%08x, 0x%08x, 0x%08x, 0x%08x },\n",
+			     dw[0], dw[1], dw[2], dw[3]);
+
+	return out;
+}
+
+static int check_expected(const char *test, const struct gen4asm_kernel *kernel,
+			  const char *expected)
+{
+	char *out;
+	int ret = 0;
+
+	if (kernel->error) {
+		fprintf(stderr, "%s: failed to assemble\n", test);
+		return 1;
+	}
+
+	out = format_binary(kernel);
+	if (strcmp(out, expected)) {
+		fprintf(stderr, "%s: unexpected output:\n%s", test, out);
+		ret = 1;
+	}
+	free(out);
+
+	return ret;
+}
+
+static char *disassemble(struct brw_instruction *insn, int gen)
+{
+	char *text;
+	size_t len;
+	FILE *file;
+
+	file = open_memstream(&text, &len);
+	brw_disasm(file, insn, gen);
+	fclose(file);
+
+	return text;
+}
+
+/* Byte offset of the target of a JMPI at offset */
+static int jmpi_target(const struct brw_instruction *insn, int offset,
+		       int gen_level)
+{
+	/* JIP is relative to the next instruction, which is 16 bytes further
+	 * as JMPI isn't compacted, in bytes on Haswell, in 8 bytes units
+	 * before. */
+	return offset + 16 + insn->bits3.JIP * (gen_level >= 75 ? 1 : 8);
+}
+
+static int check_compaction(const char *test, int gen_level,
+			    const struct gen4asm_kernel *plain,
+			    const struct gen4asm_kernel *compacted)
+{
+	struct brw_instruction *insns = plain->binary, *expanded;
+	int count = plain->size / 16, n = 0, i, j;
+	int gen = gen_level / 10;
+	struct brw_context brw;
+	int *offsets, *map;
+	int offset, ret = 0;
+
+	if (plain->error || compacted->error) {
+		fprintf(stderr, "%s: failed to assemble for gen%d\n", test, gen_level);
+		return 1;
+	}
+
+	if (compacted->uncompacted_size != plain->size ||
+	    compacted->size > plain->size || compacted->size % 16) {
+		fprintf(stderr, "%s: unexpected gen%d compacted size %zu of %zu\n",
+			test, gen_level, compacted->size, plain->size);
+		return 1;
+	}
+
+	brw_init_context(&brw, gen_level);
+	brw_init_compaction_tables(&brw.intel);
+
+	/* Expand the compacted instructions, as the hardware does. */
+	expanded = calloc(compacted->size / 8, sizeof(*expanded));
+	offsets = calloc(compacted->size / 8 + 1, sizeof(*offsets));
+	for (offset = 0; offset < compacted->size; n++) {
+		struct brw_instruction *insn = compacted->binary + offset;
+
+		offsets[n] = offset;
+		if (insn->header.cmpt_control) {
+			brw_uncompact_instruction(&brw.intel, &expanded[n],
+						  (struct brw_compact_instruction *)insn);
+			offset += 8;
+		} else {
+			expanded[n] = *insn;
+			offset += 16;
+		}
+	}
+	offsets[n] = offset;
+
+	/* Match the instructions, skipping the NOPs added for alignment. */
+	map = calloc(count + 1, sizeof(*map));
+	for (i = j = 0; j < n; j++) {
+		if (expanded[j].header.opcode == BRW_OPCODE_NOP &&
+		    (i == count || insns[i].header.opcode != BRW_OPCODE_NOP))
+			continue;
+		if (i == count)
+			break;
+		map[i++] = j;
+	}
+	map[count] = n;
+	if (i != count || j != n) {
+		fprintf(stderr, "%s: gen%d compacted program doesn't match\n",
+			test, gen_level);
+		ret = 1;
+	}
+
+	for (i = 0; !ret && i < count; i++) {
+		struct brw_instruction *insn = &expanded[map[i]];
+		char *before, *after;
+
+		if (insns[i].header.opcode == BRW_OPCODE_JMPI) {
+			int target = jmpi_target(&insns[i], i * 16, gen_level) / 16;
+
+			if (target < 0 || target > count ||
+			    jmpi_target(insn, offsets[map[i]], gen_level) !=
+			    offsets[map[target]]) {
+				fprintf(stderr, "%s: gen%d jump %d moved to the wrong target\n",
+					test, gen_level, i);
+				ret = 1;
+			}
+			continue;
+		}
+
+		before = disassemble(&insns[i], gen);
+		after = disassemble(insn, gen);
+		if (strcmp(before, after)) {
+			fprintf(stderr, "%s: gen%d compaction changed\n  %s  to\n  %s",
+				test, gen_level, before, after);
+			ret = 1;
+		}
+		free(before);
+		free(after);
+	}
+
+	free(map);
+	free(offsets);
+	free(expanded);
+
+	return ret;
+}
+
+static int test_compaction(int count, char **tests)
+{
+	static const int gen_levels[] = { 60, 70, 75 };
+	const char *srcdir = getenv("srcdir") ?: ".";
+	struct gen4asm_kernel plain, compacted;
+	char path[4096];
+	int failed = 0;
+
+	for (int i = 0; i < count; i++) {
+		memset(&plain, 0, sizeof(plain));
+		snprintf(path, sizeof(path), "%s/%s.g4a", srcdir, tests[i]);
+		plain.name = tests[i];
+		plain.source = read_file(path, &plain.source_len);
+		compacted = plain;
+
+		for (int g = 0; g < ARRAY_SIZE(gen_levels); g++) {
+			struct gen4asm *assembler = gen4asm_create(gen_levels[g]);
+
+			gen4asm_assemble(assembler, &plain);
+			gen4asm_set_compaction(assembler, true);
+			gen4asm_assemble(assembler, &compacted);
+
+			failed += check_compaction(tests[i], gen_levels[g],
+						   &plain, &compacted);
+			if (compacted.size == plain.size) {
+				fprintf(stderr, "%s: nothing compacted for gen%d\n",
+					tests[i], gen_levels[g]);
+				failed++;
+			}
+
+			free(plain.binary);
+			free(compacted.binary);
+			gen4asm_destroy(assembler);
+		}
+
+		free((char *)plain.source);
+	}
+
+	return failed ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	static const char broken[] = "mov (1) g0<1>UD g1<0,1,0>UD {\n";
+	const char *srcdir = getenv("srcdir") ?: ".";
+	struct gen4asm_kernel *kernels, bad = {
+		.name = "broken",
+		.source = broken,
+		.source_len = sizeof(broken) - 1,
+	};
+	struct gen4asm *assembler;
+	char **expected;
+	char path[4096];
+	size_t len;
+	int count = argc - 1;
+	int i, failed = 0;
+
+	if (argc > 1 && !strcmp(argv[1], "-c"))
+		return test_compaction(argc - 2, argv + 2);
+
+	assembler = gen4asm_create(40);
+	if (!assembler)
+		return 1;
+
+	kernels = calloc(count, sizeof(*kernels));
+	expected = calloc(count, sizeof(*expected));
+	for (i = 0; i < count; i++) {
+		snprintf(path, sizeof(path), "%s/%s.g4a", srcdir, argv[i + 1]);
+		kernels[i].name = argv[i + 1];
+		kernels[i].source = read_file(path, &kernels[i].source_len);
+
+		snprintf(path, sizeof(path), "%s/%s.expected", srcdir, argv[i + 1]);
+		expected[i] = read_file(path, &len);
+	}
+
+	/* One at a time, with a failure in the middle to check the parser
+	 * state doesn't leak from one call to the next. */
+	for (i = 0; i < count; i++) {
+		gen4asm_assemble(assembler, &kernels[i]);
+		failed += check_expected(argv[i + 1], &kernels[i], expected[i]);
+		free(kernels[i].binary);
+
+		if (i == count / 2 && !gen4asm_assemble(assembler, &bad)) {
+			fprintf(stderr, "broken source was assembled\n");
+			failed++;
+		}
+	}
+
+	if (gen4asm_assemble_batch(assembler, kernels, count, 4)) {
+		fprintf(stderr, "batch failed\n");
+		failed++;
+	}
+	for (i = 0; i < count; i++) {
+		failed += check_expected(argv[i + 1], &kernels[i], expected[i]);
+		free(kernels[i].binary);
+		free((char *)kernels[i].source);
+		free(expected[i]);
+	}
+
+	free(expected);
+	free(kernels);
+	gen4asm_destroy(assembler);
+
+	return failed ? 1 : 0;
+}
@@ -46,51 +46,92 @@
 #include "intel_io.h"
 #include "ioctl_wrappers.h"
 
-enum {
-	ADD_BO = 0,
-	DEL_BO,
-	ADD_CTX,
-	DEL_CTX,
-	EXEC,
-	WAIT,
+#include "gem_exec_trace.h"
+
+struct trace_reader {
+	uint32_t version;
+	uint8_t *end;
+
+	/* Version 2 records, sorted by seqno */
+	struct trace_record **records;
+	unsigned long num_records;
+	unsigned long next;
 };
 
-struct trace_add_bo {
-	uint32_t handle;
-	uint64_t size;
-} __attribute__((packed));
-
-struct trace_del_bo {
-	uint32_t handle;
-} __attribute__((packed));
-
-struct trace_add_ctx {
-	uint32_t handle;
-} __attribute__((packed));
-
-struct trace_del_ctx {
-	uint32_t handle;
-} __attribute__((packed));
-
-struct trace_exec {
-	uint32_t object_count;
-	uint64_t flags;
-	uint32_t context;
-}__attribute__((packed));
-
-struct trace_exec_object {
-	uint32_t handle;
-	uint32_t relocation_count;
-	uint64_t alignment;
-	uint64_t offset;
-	uint64_t flags;
-	uint64_t rsvd1;
-	uint64_t rsvd2;
-}__attribute__((packed));
-
-struct trace_wait {
-	uint32_t handle;
-} __attribute__((packed));
+static int cmp_seqno(const void *A, const void *B)
+{
+	const struct trace_record *a = *(const struct trace_record **)A;
+	const struct trace_record *b = *(const struct trace_record **)B;
+
+	if (a->seqno < b->seqno)
+		return -1;
+	if (a->seqno > b->seqno)
+		return 1;
+	return 0;
+}
+
+/*
+ * The threads of the traced process record their commands independently,
+ * so the records of a version 2 trace are only ordered by their seqno.
+ */
+static int index_records(struct trace_reader *r, uint8_t *ptr)
+{
+	unsigned long size = 0;
+	bool sorted = true;
+
+	while (ptr + sizeof(struct trace_record) <= r->end) {
+		struct trace_record *rec = (void *)ptr;
+
+		/* A trace which was not closed ends with zeroes */
+		if (!rec->seqno)
+			break;
+
+		if ((uint8_t *)(rec + 1) + rec->length > r->end)
+			return -1;
+
+		if (r->num_records == size) {
+			size = size ? 2 * size : 4096;
+			r->records = realloc(r->records,
+					     size * sizeof(*r->records));
+			if (!r->records)
+				return -1;
+		}
+
+		if (r->num_records &&
+		    r->records[r->num_records - 1]->seqno > rec->seqno)
+			sorted = false;
+		r->records[r->num_records++] = rec;
+
+		ptr = (uint8_t *)(rec + 1) + rec->length;
+	}
+
+	if (!sorted)
+		qsort(r->records, r->num_records, sizeof(*r->records),
+		      cmp_seqno);
+
+	return 0;
+}
+
+/* Returns the arguments of the next command, or NULL at the end. */
+static uint8_t *next_command(struct trace_reader *r, uint8_t *ptr, uint8_t *cmd)
+{
+	struct trace_record *rec;
+
+	if (r->version == 1) {
+		if (ptr >= r->end)
+			return NULL;
+
+		*cmd = *ptr;
+		return ptr + 1;
+	}
+
+	if (r->next == r->num_records)
+		return NULL;
+
+	rec = r->records[r->next++];
+	*cmd = rec->cmd;
+	return (uint8_t *)(rec + 1);
+}
 
 static uint32_t hars_petruska_f54_1_random(void)
 {
@@ -117,17 +158,15 @@ static double replay(const char *filename, long nop, long range)
 {
 	struct timespec t_start, t_end;
 	struct drm_i915_gem_execbuffer2 eb = {};
-	const struct trace_version {
-		uint32_t magic;
-		uint32_t version;
-	} *tv;
+	const struct trace_version *tv;
 	const uint32_t bbe = 0xa << 23;
 	struct drm_i915_gem_exec_object2 *exec_objects = NULL;
+	struct trace_reader reader = {};
 	uint32_t *bo, *ctx;
 	int num_bo, num_ctx;
 	int max_objects = 0;
 	struct stat st;
-	uint8_t *ptr, *end;
+	uint8_t *ptr, cmd;
 	int fd;
 
 	fd = open(filename, O_RDONLY);
@@ -146,20 +185,26 @@ static double replay(const char *filename, long nop, long range)
 		return -1;
 
 	madvise(ptr, st.st_size, MADV_SEQUENTIAL);
-	end = ptr + st.st_size;
+	reader.end = ptr + st.st_size;
 
 	tv = (struct trace_version *)ptr;
-	if (tv->magic != 0xdeadbeef) {
+	if (tv->magic != TRACE_MAGIC) {
 		fprintf(stderr, "%s: invalid magic\n", filename);
 		return -1;
 	}
-	if (tv->version != 1) {
+	if (tv->version != 1 && tv->version != 2) {
 		fprintf(stderr, "%s: unhandled version %d\n",
 			filename, tv->version);
 		return -1;
 	}
 	ptr = (void *)(tv + 1);
 
+	reader.version = tv->version;
+	if (reader.version == 2 && index_records(&reader, ptr)) {
+		fprintf(stderr, "%s: truncated record\n", filename);
+		return -1;
+	}
+
 	ctx = calloc(1024, sizeof(*ctx));
 	num_ctx = 1024;
 
@@ -179,14 +224,14 @@ static double replay(const char *filename, long nop, long range)
 	}
 
 	clock_gettime(CLOCK_MONOTONIC, &t_start);
-	do switch (*ptr++) {
+	while ((ptr = next_command(&reader, ptr, &cmd))) switch (cmd) {
 	case ADD_BO:
 		{
 			struct trace_add_bo *t = (void *)ptr;
 			ptr = (void *)(t + 1);
 
 			if (t->handle >= num_bo) {
-				int new_bo = ALIGN(t->handle, 4096);
+				int new_bo = ALIGN(t->handle + 1, 4096);
 				bo = realloc(bo, sizeof(*bo)*new_bo);
 				memset(bo + num_bo, 0, sizeof(*bo)*(new_bo - num_bo));
 				num_bo = new_bo;
@@ -211,7 +256,7 @@ static double replay(const char *filename, long nop, long range)
 			ptr = (void *)(t + 1);
 
 			if (t->handle >= num_ctx) {
-				int new_ctx = ALIGN(t->handle, 1024);
+				int new_ctx = ALIGN(t->handle + 1, 1024);
 				ctx = realloc(ctx, sizeof(*ctx)*new_ctx);
 				memset(ctx + num_ctx, 0, sizeof(*ctx)*(new_ctx - num_ctx));
 				num_ctx = new_ctx;
@@ -297,11 +342,13 @@ static double replay(const char *filename, long nop, long range)
 		}
 
 	default:
-		fprintf(stderr, "Unknown cmd: %x\n", *ptr);
+		fprintf(stderr, "Unknown cmd: %x\n", cmd);
 		return -1;
-	} while (ptr < end);
+	}
 	clock_gettime(CLOCK_MONOTONIC, &t_end);
 
+	free(reader.records);
+
 	return elapsed(&t_start, &t_end);
 }
 
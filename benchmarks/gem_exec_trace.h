@@ -0,0 +1,100 @@
+/*
+ * Copyright © 2024 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef GEM_EXEC_TRACE_H
+#define GEM_EXEC_TRACE_H
+
+#include <stdint.h>
+
+/*
+ * Trace file format written by gem_exec_tracer, one file per DRM fd:
+ * a struct trace_version, then the commands.
+ *
+ * Version 1 prefixes each command with its cmd byte. Version 2 prefixes
+ * each one with a struct trace_record, and as the threads of the traced
+ * process are flushed independently, the records are ordered by their
+ * seqno rather than by their position in the file.
+ */
+#define TRACE_MAGIC 0xdeadbeef
+
+enum {
+	ADD_BO = 0,
+	DEL_BO,
+	ADD_CTX,
+	DEL_CTX,
+	EXEC,
+	WAIT,
+};
+
+struct trace_version {
+	uint32_t magic;
+	uint32_t version;
+};
+
+struct trace_record {
+	uint8_t cmd;
+	uint32_t length;	/* of the command following the header */
+	uint64_t seqno;		/* starting from 1, in submission order */
+	uint64_t timestamp;	/* CLOCK_MONOTONIC, in ns */
+} __attribute__((packed));
+
+struct trace_add_bo {
+	uint32_t handle;
+	uint64_t size;
+} __attribute__((packed));
+
+struct trace_del_bo {
+	uint32_t handle;
+} __attribute__((packed));
+
+struct trace_add_ctx {
+	uint32_t handle;
+} __attribute__((packed));
+
+struct trace_del_ctx {
+	uint32_t handle;
+} __attribute__((packed));
+
+/* Followed by object_count trace_exec_object */
+struct trace_exec {
+	uint32_t object_count;
+	uint64_t flags;
+	uint32_t context;
+} __attribute__((packed));
+
+/* Followed by relocation_count struct drm_i915_gem_relocation_entry */
+struct trace_exec_object {
+	uint32_t handle;
+	uint32_t relocation_count;
+	uint64_t alignment;
+	uint64_t offset;
+	uint64_t flags;
+	uint64_t rsvd1;
+	uint64_t rsvd2;
+} __attribute__((packed));
+
+struct trace_wait {
+	uint32_t handle;
+} __attribute__((packed));
+
+#endif /* GEM_EXEC_TRACE_H */
@@ -0,0 +1,682 @@
+/*
+ * Copyright © 2024 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Characterises the traces captured by gem_exec_tracer without replaying
+ * them: submission rate per context, memory footprint over time, depth
+ * of the implicit dependencies between execbufs and the gaps between them.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "i915_drm.h"
+#include "igt_stats.h"
+
+#include "gem_exec_trace.h"
+
+#define NSEC_PER_MSEC 1000000ull
+
+/*
+ * Bo handles and context ids index flat arrays, anything above this is
+ * taken as a corrupt trace rather than grown into.
+ */
+#define MAX_INDEX (1u << 24)
+
+/* Power of two buckets for display, quantiles from an igt_stats histogram */
+struct histogram {
+	const char *name;
+	uint64_t buckets[65];
+	igt_stats_t stats;
+};
+
+struct bo {
+	uint64_t size;
+	uint64_t interval;	/* last interval the bo was executed in */
+	uint32_t depth;		/* of the last exec using the bo */
+	bool live;
+};
+
+struct context {
+	uint64_t execs;
+	uint64_t objects;
+	uint64_t first, last;
+};
+
+struct analysis {
+	uint32_t version;
+	uint64_t counts[WAIT + 1];
+	uint64_t first, last;
+
+	struct bo *bo;
+	uint32_t num_bo;
+	struct context *ctx;
+	uint32_t num_ctx;
+
+	uint64_t live_bytes, peak_bytes;
+	uint64_t live_bos, peak_bos;
+
+	/* Timeline of the footprint, version 2 only */
+	uint64_t interval;
+	uint64_t interval_start;
+	uint64_t interval_index;
+	uint64_t interval_execs;
+	uint64_t interval_bytes;
+
+	uint64_t last_exec;
+
+	struct histogram working_set;
+	struct histogram exec_depth;
+	struct histogram wait_depth;
+	struct histogram gaps;
+};
+
+static void histogram_init(struct histogram *h, const char *name)
+{
+	memset(h, 0, sizeof(*h));
+	h->name = name;
+	igt_stats_init_with_mode(&h->stats, IGT_STATS_HISTOGRAM);
+}
+
+static void histogram_add(struct histogram *h, uint64_t value)
+{
+	h->buckets[value ? 64 - __builtin_clzll(value) : 0]++;
+	igt_stats_push(&h->stats, value);
+}
+
+static void histogram_print(struct histogram *h)
+{
+	uint64_t peak = 0;
+	int first = -1, last = 0;
+
+	if (!h->stats.n_values)
+		return;
+
+	for (int i = 0; i < 65; i++) {
+		if (!h->buckets[i])
+			continue;
+		if (first < 0)
+			first = i;
+		last = i;
+		if (h->buckets[i] > peak)
+			peak = h->buckets[i];
+	}
+
+	printf("  %s: p50 %.0f, p90 %.0f, p99 %.0f, p99.9 %.0f, max %"PRIu64"\n",
+	       h->name,
+	       igt_stats_get_quantile(&h->stats, .5),
+	       igt_stats_get_quantile(&h->stats, .9),
+	       igt_stats_get_quantile(&h->stats, .99),
+	       igt_stats_get_quantile(&h->stats, .999),
+	       igt_stats_get_max(&h->stats));
+
+	for (int i = first; i <= last; i++) {
+		uint64_t lo = i ? 1ull << (i - 1) : 0;
+		int len = 40 * h->buckets[i] / peak;
+
+		printf("    %12"PRIu64" | %-40.*s %"PRIu64"\n",
+		       lo, len, "########################################",
+		       h->buckets[i]);
+	}
+}
+
+/* index must be below MAX_INDEX, so that doubling new_count can't overflow */
+static void *grow(void *ptr, uint32_t *count, uint32_t index, size_t size)
+{
+	uint32_t new_count;
+
+	if (index < *count)
+		return ptr;
+
+	new_count = *count ?: 1024;
+	while (new_count <= index)
+		new_count *= 2;
+
+	ptr = realloc(ptr, new_count * size);
+	if (!ptr) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	memset((char *)ptr + *count * size, 0, (new_count - *count) * size);
+	*count = new_count;
+
+	return ptr;
+}
+
+static struct bo *get_bo(struct analysis *a, uint32_t handle)
+{
+	if (handle >= MAX_INDEX)
+		return NULL;
+
+	a->bo = grow(a->bo, &a->num_bo, handle, sizeof(*a->bo));
+	return &a->bo[handle];
+}
+
+static void flush_interval(struct analysis *a)
+{
+	if (a->interval_execs)
+		printf("  %10.3fs: %8"PRIu64" execs, working set %8.1f MiB, live %8.1f MiB in %"PRIu64" bos\n",
+		       (a->interval_start - a->first) * 1e-9,
+		       a->interval_execs, a->interval_bytes / 1048576.,
+		       a->live_bytes / 1048576., a->live_bos);
+
+	a->interval_index++;
+	a->interval_execs = 0;
+	a->interval_bytes = 0;
+}
+
+static void advance(struct analysis *a, uint64_t timestamp)
+{
+	if (!a->first) {
+		a->first = timestamp;
+		a->interval_start = timestamp;
+	}
+	a->last = timestamp;
+
+	if (!a->interval)
+		return;
+
+	while (timestamp - a->interval_start >= a->interval) {
+		flush_interval(a);
+		a->interval_start += a->interval;
+	}
+}
+
+static int add_bo(struct analysis *a, uint32_t handle, uint64_t size)
+{
+	struct bo *bo = get_bo(a, handle);
+
+	if (!bo)
+		return -1;
+
+	if (bo->live)
+		a->live_bytes -= bo->size;
+	else
+		a->live_bos++;
+
+	bo->size = size;
+	bo->depth = 0;
+	bo->live = true;
+
+	a->live_bytes += size;
+	if (a->live_bytes > a->peak_bytes)
+		a->peak_bytes = a->live_bytes;
+	if (a->live_bos > a->peak_bos)
+		a->peak_bos = a->live_bos;
+
+	return 0;
+}
+
+static int del_bo(struct analysis *a, uint32_t handle)
+{
+	struct bo *bo = get_bo(a, handle);
+
+	if (!bo)
+		return -1;
+
+	if (bo->live) {
+		a->live_bytes -= bo->size;
+		a->live_bos--;
+		bo->live = false;
+		bo->depth = 0;
+	}
+
+	return 0;
+}
+
+/*
+ * Execbufs sharing a bo are assumed to depend on each other, a WAIT on a
+ * bo reports the length of the chain of execbufs the client blocked on.
+ */
+static int exec(struct analysis *a, const uint8_t *ptr, const uint8_t *end,
+		uint64_t timestamp)
+{
+	const struct trace_exec *t = (const void *)ptr;
+	const uint8_t *start = ptr;
+	const struct trace_exec_object *obj;
+	struct context *ctx;
+	uint64_t bytes = 0;
+	uint32_t depth = 0;
+
+	if (ptr + sizeof(*t) > end)
+		return -1;
+	ptr += sizeof(*t);
+
+	/* Two passes: the depth of the exec is only known after the first */
+	obj = (const void *)ptr;
+	for (uint32_t i = 0; i < t->object_count; i++) {
+		struct bo *bo;
+
+		if ((const uint8_t *)(obj + 1) > end)
+			return -1;
+
+		bo = get_bo(a, obj->handle);
+		if (!bo)
+			return -1;
+		if (bo->depth > depth)
+			depth = bo->depth;
+		bytes += bo->size;
+
+		if (a->interval && bo->interval != a->interval_index + 1) {
+			bo->interval = a->interval_index + 1;
+			a->interval_bytes += bo->size;
+		}
+
+		obj = (const void *)((const uint8_t *)(obj + 1) +
+				     obj->relocation_count *
+				     sizeof(struct drm_i915_gem_relocation_entry));
+	}
+	if ((const uint8_t *)obj > end)
+		return -1;
+
+	depth++;
+	obj = (const void *)ptr;
+	for (uint32_t i = 0; i < t->object_count; i++) {
+		a->bo[obj->handle].depth = depth;
+		obj = (const void *)((const uint8_t *)(obj + 1) +
+				     obj->relocation_count *
+				     sizeof(struct drm_i915_gem_relocation_entry));
+	}
+
+	histogram_add(&a->working_set, bytes >> 10);
+	histogram_add(&a->exec_depth, depth);
+
+	if (t->context >= MAX_INDEX)
+		return -1;
+	a->ctx = grow(a->ctx, &a->num_ctx, t->context, sizeof(*a->ctx));
+	ctx = &a->ctx[t->context];
+	if (!ctx->execs)
+		ctx->first = timestamp;
+	ctx->last = timestamp;
+	ctx->execs++;
+	ctx->objects += t->object_count;
+
+	if (a->version > 1) {
+		if (a->last_exec)
+			histogram_add(&a->gaps,
+				      (timestamp - a->last_exec) / 1000);
+		a->last_exec = timestamp;
+	}
+
+	a->interval_execs++;
+
+	return (const uint8_t *)obj - start;
+}
+
+/* Returns the length of the command, or -1 if it is truncated or corrupt. */
+static int process(struct analysis *a, uint8_t cmd,
+		   const uint8_t *ptr, const uint8_t *end, uint64_t timestamp)
+{
+	if (cmd > WAIT)
+		return -1;
+
+	a->counts[cmd]++;
+	if (a->version > 1) {
+		/*
+		 * Records are replayed in seqno order, but their timestamps
+		 * were sampled outside the seqno allocation and so may step
+		 * backwards. Never let time run backwards, all the interval
+		 * and gap arithmetic below is unsigned.
+		 */
+		if (timestamp < a->last)
+			timestamp = a->last;
+		advance(a, timestamp);
+	}
+
+	switch (cmd) {
+	case ADD_BO: {
+		const struct trace_add_bo *t = (const void *)ptr;
+
+		if ((const uint8_t *)(t + 1) > end)
+			return -1;
+		if (add_bo(a, t->handle, t->size))
+			return -1;
+		return sizeof(*t);
+	}
+	case DEL_BO: {
+		const struct trace_del_bo *t = (const void *)ptr;
+
+		if ((const uint8_t *)(t + 1) > end)
+			return -1;
+		if (del_bo(a, t->handle))
+			return -1;
+		return sizeof(*t);
+	}
+	case ADD_CTX:
+		return sizeof(struct trace_add_ctx);
+	case DEL_CTX:
+		return sizeof(struct trace_del_ctx);
+	case EXEC:
+		return exec(a, ptr, end, timestamp);
+	case WAIT: {
+		const struct trace_wait *t = (const void *)ptr;
+		struct bo *bo;
+
+		if ((const uint8_t *)(t + 1) > end)
+			return -1;
+		bo = get_bo(a, t->handle);
+		if (!bo)
+			return -1;
+		histogram_add(&a->wait_depth, bo->depth);
+		bo->depth = 0;
+		return sizeof(*t);
+	}
+	}
+
+	return -1;
+}
+
+/*
+ * Restores the seqno order of version 2 records. The seqnos are dense, so
+ * the records which arrive early wait in a window indexed by their seqno,
+ * which only needs to span the distance between the threads' flushes.
+ */
+struct reorder {
+	const struct trace_record **window;
+	uint64_t size; /* power of two */
+	uint64_t next;
+	uint64_t count;
+};
+
+static void reorder_push(struct reorder *r, const struct trace_record *rec)
+{
+	if (rec->seqno - r->next >= r->size) {
+		const struct trace_record **window;
+		uint64_t size = r->size ?: 4096;
+
+		while (rec->seqno - r->next >= size)
+			size *= 2;
+
+		window = calloc(size, sizeof(*window));
+		if (!window) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+
+		for (uint64_t i = 0; i < r->size; i++) {
+			const struct trace_record *old = r->window[i];
+
+			if (old)
+				window[old->seqno & (size - 1)] = old;
+		}
+
+		free(r->window);
+		r->window = window;
+		r->size = size;
+	}
+
+	r->window[rec->seqno & (r->size - 1)] = rec;
+	r->count++;
+}
+
+/* Returns the next record in order, skipping lost ones if @flush. */
+static const struct trace_record *reorder_pop(struct reorder *r, bool flush)
+{
+	while (r->count) {
+		const struct trace_record **slot =
+			&r->window[r->next & (r->size - 1)];
+		const struct trace_record *rec = *slot;
+
+		if (!rec && !flush)
+			break;
+
+		r->next++;
+		if (rec) {
+			*slot = NULL;
+			r->count--;
+			return rec;
+		}
+	}
+
+	return NULL;
+}
+
+static int process_record(struct analysis *a, const struct trace_record *rec)
+{
+	const uint8_t *ptr = (const uint8_t *)(rec + 1);
+
+	if (process(a, rec->cmd, ptr, ptr + rec->length, rec->timestamp) < 0)
+		return -1;
+
+	return 0;
+}
+
+static int analyze_v2(struct analysis *a, const uint8_t *ptr, const uint8_t *end)
+{
+	const struct trace_record *rec;
+	struct reorder r = { .next = 1 };
+	int ret = 0;
+
+	while (ptr + sizeof(struct trace_record) <= end) {
+		rec = (const void *)ptr;
+
+		/* A trace which was not closed ends with zeroes */
+		if (!rec->seqno)
+			break;
+
+		ptr = (const uint8_t *)(rec + 1) + rec->length;
+		if (ptr > end || rec->seqno < r.next) {
+			ret = -1;
+			break;
+		}
+
+		if (rec->seqno == r.next) {
+			r.next++;
+			if ((ret = process_record(a, rec)))
+				break;
+			continue;
+		}
+
+		reorder_push(&r, rec);
+		while (!ret && (rec = reorder_pop(&r, false)))
+			ret = process_record(a, rec);
+		if (ret)
+			break;
+	}
+
+	if (ptr < end && ptr + sizeof(*rec) > end)
+		ret = -1;
+
+	/* Records lost by a crashed process leave gaps in the seqnos */
+	while (!ret && (rec = reorder_pop(&r, true)))
+		ret = process_record(a, rec);
+
+	free(r.window);
+	return ret;
+}
+
+static int analyze_v1(struct analysis *a, const uint8_t *ptr, const uint8_t *end)
+{
+	while (ptr < end) {
+		int len = process(a, *ptr, ptr + 1, end, 0);
+
+		if (len < 0)
+			return -1;
+
+		ptr += 1 + len;
+	}
+
+	return 0;
+}
+
+static void report(struct analysis *a)
+{
+	static const char *names[] = {
+		[ADD_BO] = "add-bo",
+		[DEL_BO] = "del-bo",
+		[ADD_CTX] = "add-ctx",
+		[DEL_CTX] = "del-ctx",
+		[EXEC] = "exec",
+		[WAIT] = "wait",
+	};
+	double duration = (a->last - a->first) * 1e-9;
+
+	if (a->interval)
+		flush_interval(a);
+
+	if (a->version > 1)
+		printf("  duration: %.3fs\n", duration);
+
+	printf("  commands:");
+	for (int i = 0; i <= WAIT; i++)
+		printf(" %s %"PRIu64"%s", names[i], a->counts[i],
+		       i < WAIT ? "," : "\n");
+
+	printf("  buffers: peak %.1f MiB, peak %"PRIu64" live bos\n",
+	       a->peak_bytes / 1048576., a->peak_bos);
+
+	for (uint32_t i = 0; i < a->num_ctx; i++) {
+		const struct context *ctx = &a->ctx[i];
+		double span = (ctx->last - ctx->first) * 1e-9;
+
+		if (!ctx->execs)
+			continue;
+
+		printf("  context %u: %"PRIu64" execs, %.1f objects/exec",
+		       i, ctx->execs, (double)ctx->objects / ctx->execs);
+		if (a->version > 1 && span > 0)
+			printf(", %.1f execs/s", ctx->execs / span);
+		printf("\n");
+	}
+
+	histogram_print(&a->working_set);
+	histogram_print(&a->exec_depth);
+	histogram_print(&a->wait_depth);
+	histogram_print(&a->gaps);
+}
+
+static int analyze(const char *filename, uint64_t interval)
+{
+	const struct trace_version *tv;
+	struct analysis a = {};
+	const uint8_t *ptr;
+	struct stat st;
+	int fd, ret;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+		return -1;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	if (st.st_size < sizeof(*tv)) {
+		fprintf(stderr, "%s: too short\n", filename);
+		close(fd);
+		return -1;
+	}
+
+	ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED) {
+		fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+		return -1;
+	}
+	madvise((void *)ptr, st.st_size, MADV_SEQUENTIAL);
+
+	tv = (const void *)ptr;
+	if (tv->magic != TRACE_MAGIC ||
+	    (tv->version != 1 && tv->version != 2)) {
+		fprintf(stderr, "%s: not a trace, or unhandled version\n",
+			filename);
+		munmap((void *)ptr, st.st_size);
+		return -1;
+	}
+
+	a.version = tv->version;
+	a.interval = a.version > 1 ? interval : 0;
+	histogram_init(&a.working_set, "exec working set (KiB)");
+	histogram_init(&a.exec_depth, "exec dependency depth");
+	histogram_init(&a.wait_depth, "wait dependency depth");
+	histogram_init(&a.gaps, "inter-exec gap (us)");
+
+	printf("%s: version %u\n", filename, a.version);
+	if (a.version > 1)
+		ret = analyze_v2(&a, ptr + sizeof(*tv), ptr + st.st_size);
+	else
+		ret = analyze_v1(&a, ptr + sizeof(*tv), ptr + st.st_size);
+	if (ret)
+		fprintf(stderr, "%s: truncated or corrupt, stopping\n",
+			filename);
+
+	report(&a);
+
+	igt_stats_fini(&a.working_set.stats);
+	igt_stats_fini(&a.exec_depth.stats);
+	igt_stats_fini(&a.wait_depth.stats);
+	igt_stats_fini(&a.gaps.stats);
+	free(a.bo);
+	free(a.ctx);
+	munmap((void *)ptr, st.st_size);
+
+	return ret;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-i <interval ms>] <trace>...\n"
+		"\t-i\tprint the footprint every interval, 0 to disable (default 1000ms)\n",
+		name);
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t interval = 1000 * NSEC_PER_MSEC;
+	int c, ret = 0;
+
+	while ((c = getopt(argc, argv, "i:h")) != -1) {
+		switch (c) {
+		case 'i':
+			interval = strtoull(optarg, NULL, 0) * NSEC_PER_MSEC;
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+
+	if (optind == argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (int i = optind; i < argc; i++)
+		ret |= analyze(argv[i], interval);
+
+	return ret ? 1 : 0;
+}
@@ -41,6 +41,8 @@
 #include "intel_aub.h"
 #include "intel_chipset.h"
 
+#include "gem_exec_trace.h"
+
 #ifdef __FreeBSD__
 #include "igt_freebsd.h"
 #endif
@@ -48,83 +50,41 @@
 static int (*libc_close)(int fd);
 static int (*libc_ioctl)(int fd, unsigned long request, void *argp);
 
-static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+/*
+ * Tracing must not serialise the threads of the traced process, so each
+ * thread appends its records to its own ring, and a background thread
+ * flushes the rings into the trace files. Records are numbered per trace
+ * so that gem_exec_trace can restore their order.
+ */
+static pthread_rwlock_t traces_lock = PTHREAD_RWLOCK_INITIALIZER;
 
+/*
+ * A trace is referenced by the traces list and by every ioctl() recording
+ * into it. The records in the rings point to the trace, so it is closed by
+ * whoever drops the last reference, once all of them have been committed.
+ */
 struct trace {
 	int fd;
-	FILE *file;
+	int out;
+	uint8_t *map;
+	size_t map_size;
+	size_t offset;
+	uint64_t seqno;
+	int refcount;
 	struct trace *next;
 } *traces;
 
 #define DRM_MAJOR 226
 
-enum {
-	ADD_BO = 0,
-	DEL_BO,
-	ADD_CTX,
-	DEL_CTX,
-	EXEC,
-	WAIT,
-};
+#ifndef ALIGN
+#define ALIGN(x, y) (((x) + (y) - 1) & -(y))
+#endif
 
-static struct trace_verion {
-	uint32_t magic;
-	uint32_t version;
-} version = {
-	.magic = 0xdeadbeef,
-	.version = 1
+static struct trace_version version = {
+	.magic = TRACE_MAGIC,
+	.version = 2
 };
 
-struct trace_add_bo {
-	uint8_t cmd;
-	uint32_t handle;
-	uint64_t size;
-} __attribute__((packed));
-struct trace_del_bo {
-	uint8_t cmd;
-	uint32_t handle;
-}__attribute__((packed));
-
-struct trace_add_ctx {
-	uint8_t cmd;
-	uint32_t handle;
-} __attribute__((packed));
-struct trace_del_ctx {
-	uint8_t cmd;
-	uint32_t handle;
-}__attribute__((packed));
-
-struct trace_exec {
-	uint8_t cmd;
-	uint32_t object_count;
-	uint64_t flags;
-	uint32_t context;
-}__attribute__((packed));
-
-struct trace_exec_object {
-	uint32_t handle;
-	uint32_t relocation_count;
-	uint64_t alignment;
-	uint64_t offset;
-	uint64_t flags;
-	uint64_t rsvd1;
-	uint64_t rsvd2;
-}__attribute__((packed));
-
-struct trace_exec_relocation {
-	uint32_t target_handle;
-	uint32_t delta;
-	uint64_t offset;
-	uint64_t presumed_offset;
-	uint32_t read_domains;
-	uint32_t write_domain;
-}__attribute__((packed));
-
-struct trace_wait {
-	uint8_t cmd;
-	uint32_t handle;
-} __attribute__((packed));
-
 static void __attribute__ ((format(__printf__, 2, 3)))
 fail_if(int cond, const char *format, ...)
 {
@@ -140,6 +100,236 @@ fail_if(int cond, const char *format, ...)
 	abort();
 }
 
+#define RING_SIZE (1 << 20)
+#define RING_ALIGN 8
+
+/*
+ * Single producer (the owning thread), single consumer (whoever holds
+ * flush_mutex) ring of records, each preceded by the trace it belongs to.
+ * Records never wrap: the space left at the end of the ring is skipped,
+ * marked by an entry without trace if there is room for one.
+ */
+struct ring {
+	uint8_t *data;
+	uint64_t head;
+	uint64_t tail;
+	uint64_t reserved; /* start of the record being written */
+	bool dead;
+	struct ring *next;
+};
+
+struct ring_entry {
+	struct trace *trace;
+	struct trace_record record;
+} __attribute__((packed));
+
+static pthread_mutex_t flush_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flush_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t flusher;
+static bool flusher_running, flusher_stop;
+static struct ring *rings;
+static pthread_key_t ring_key;
+static __thread struct ring *thread_ring;
+
+static size_t ring_entry_size(size_t length)
+{
+	return ALIGN(sizeof(struct ring_entry) + length, RING_ALIGN);
+}
+
+static void trace_write(struct trace *trace, const void *data, size_t len)
+{
+	if (trace->offset + len > trace->map_size) {
+		size_t size = trace->map_size ?: 1 << 20;
+
+		while (trace->offset + len > size)
+			size *= 2;
+
+		if (trace->map)
+			munmap(trace->map, trace->map_size);
+
+		fail_if(ftruncate(trace->out, size),
+			"failed to grow trace file\n");
+		trace->map = mmap(NULL, size, PROT_WRITE, MAP_SHARED,
+				  trace->out, 0);
+		fail_if(trace->map == MAP_FAILED, "failed to map trace file\n");
+		trace->map_size = size;
+	}
+
+	memcpy(trace->map + trace->offset, data, len);
+	trace->offset += len;
+}
+
+/* Called with flush_mutex held. */
+static void ring_flush(struct ring *ring)
+{
+	uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	uint64_t tail = ring->tail;
+
+	while (tail != head) {
+		size_t offset = tail % RING_SIZE;
+		const struct ring_entry *e = (void *)(ring->data + offset);
+
+		if (RING_SIZE - offset < sizeof(*e)) {
+			tail += RING_SIZE - offset;
+			continue;
+		}
+
+		if (e->trace)
+			trace_write(e->trace, &e->record,
+				    sizeof(e->record) + e->record.length);
+
+		tail += ring_entry_size(e->record.length);
+	}
+
+	__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+}
+
+/* Called with flush_mutex held, frees the rings of exited threads. */
+static void flush_all(void)
+{
+	struct ring *ring, **p;
+
+	for (p = &rings; (ring = *p); ) {
+		/* Checked first, the thread may still commit records */
+		bool dead = __atomic_load_n(&ring->dead, __ATOMIC_ACQUIRE);
+
+		ring_flush(ring);
+
+		if (dead) {
+			*p = ring->next;
+			free(ring->data);
+			free(ring);
+		} else {
+			p = &ring->next;
+		}
+	}
+}
+
+static void *flusher_thread(void *arg)
+{
+	pthread_mutex_lock(&flush_mutex);
+	while (!flusher_stop) {
+		struct timespec ts;
+
+		flush_all();
+
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += 10 * 1000 * 1000;
+		if (ts.tv_nsec >= 1000 * 1000 * 1000) {
+			ts.tv_nsec -= 1000 * 1000 * 1000;
+			ts.tv_sec++;
+		}
+		pthread_cond_timedwait(&flush_cond, &flush_mutex, &ts);
+	}
+	pthread_mutex_unlock(&flush_mutex);
+
+	return NULL;
+}
+
+static void ring_destroy(void *data)
+{
+	struct ring *ring = data;
+
+	__atomic_store_n(&ring->dead, true, __ATOMIC_RELEASE);
+}
+
+static struct ring *get_ring(void)
+{
+	struct ring *ring = thread_ring;
+
+	if (ring)
+		return ring;
+
+	ring = calloc(1, sizeof(*ring));
+	fail_if(!ring, "failed to allocate trace ring\n");
+	ring->data = malloc(RING_SIZE);
+	fail_if(!ring->data, "failed to allocate trace ring\n");
+
+	pthread_mutex_lock(&flush_mutex);
+	ring->next = rings;
+	rings = ring;
+	if (!flusher_running) {
+		flusher_stop = false;
+		fail_if(pthread_create(&flusher, NULL, flusher_thread, NULL),
+			"failed to start trace flusher\n");
+		flusher_running = true;
+	}
+	pthread_mutex_unlock(&flush_mutex);
+
+	pthread_setspecific(ring_key, ring);
+	return thread_ring = ring;
+}
+
+/* Space for @length bytes of command, to be committed with record_end(). */
+static void *
+record_begin(struct trace *trace, uint8_t cmd, size_t length)
+{
+	struct ring *ring = get_ring();
+	size_t size = ring_entry_size(length);
+	uint64_t head = ring->head;
+	size_t offset = head % RING_SIZE;
+	struct ring_entry *e;
+	struct timespec ts;
+
+	if (size > RING_SIZE / 2) {
+		/* Too big to be buffered, written directly by record_end() */
+		e = malloc(size);
+		fail_if(!e, "failed to allocate trace record\n");
+	} else {
+		size_t skip = RING_SIZE - offset < size ? RING_SIZE - offset : 0;
+
+		while (head + skip + size -
+		       __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > RING_SIZE) {
+			pthread_mutex_lock(&flush_mutex);
+			ring_flush(ring);
+			pthread_mutex_unlock(&flush_mutex);
+		}
+
+		if (skip >= sizeof(*e)) {
+			e = (void *)(ring->data + offset);
+			e->trace = NULL;
+			e->record.length = skip - ring_entry_size(0);
+		}
+
+		ring->reserved = head + skip;
+		e = (void *)(ring->data + ring->reserved % RING_SIZE);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	e->trace = trace;
+	e->record.cmd = cmd;
+	e->record.length = length;
+	e->record.seqno = __atomic_add_fetch(&trace->seqno, 1, __ATOMIC_RELAXED);
+	e->record.timestamp = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+
+	return e + 1;
+}
+
+static void record_end(void *data)
+{
+	struct ring_entry *e = (struct ring_entry *)data - 1;
+	struct ring *ring = thread_ring;
+	size_t size = ring_entry_size(e->record.length);
+	uint64_t head;
+
+	if ((uint8_t *)e < ring->data || (uint8_t *)e >= ring->data + RING_SIZE) {
+		pthread_mutex_lock(&flush_mutex);
+		trace_write(e->trace, &e->record,
+			    sizeof(e->record) + e->record.length);
+		pthread_mutex_unlock(&flush_mutex);
+		free(e);
+		return;
+	}
+
+	head = ring->reserved + size;
+	__atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+
+	/* Wake up the flusher early if the ring is filling up. */
+	if (head - __atomic_load_n(&ring->tail, __ATOMIC_RELAXED) > RING_SIZE / 2)
+		pthread_cond_signal(&flush_cond);
+}
+
 static void
 trace_exec(struct trace *trace,
 	   const struct drm_i915_gem_execbuffer2 *execbuffer2)
@@ -147,19 +337,26 @@ trace_exec(struct trace *trace,
 #define to_ptr(T, x) ((T *)(uintptr_t)(x))
 	const struct drm_i915_gem_exec_object2 *exec_objects =
 		to_ptr(typeof(*exec_objects), execbuffer2->buffers_ptr);
+	size_t length = sizeof(struct trace_exec);
+	uint8_t *ptr, *data;
 
 	fail_if(execbuffer2->flags & (I915_EXEC_FENCE_IN | I915_EXEC_FENCE_OUT),
 		"fences not supported yet\n");
 
-	flockfile(trace->file);
+	for (uint32_t i = 0; i < execbuffer2->buffer_count; i++)
+		length += sizeof(struct trace_exec_object) +
+			sizeof(struct drm_i915_gem_relocation_entry) *
+			exec_objects[i].relocation_count;
+
+	ptr = data = record_begin(trace, EXEC, length);
 	{
 		struct trace_exec t = {
-			EXEC,
 			execbuffer2->buffer_count,
 			execbuffer2->flags,
 			execbuffer2->rsvd1,
 		};
-		fwrite(&t, sizeof(t), 1, trace->file);
+		memcpy(ptr, &t, sizeof(t));
+		ptr += sizeof(t);
 	}
 
 	for (uint32_t i = 0; i < execbuffer2->buffer_count; i++) {
@@ -176,50 +373,131 @@ trace_exec(struct trace *trace,
 				obj->rsvd1,
 				obj->rsvd2
 			};
-			fwrite(&t, sizeof(t), 1, trace->file);
+			memcpy(ptr, &t, sizeof(t));
+			ptr += sizeof(t);
+		}
+		if (obj->relocation_count) {
+			memcpy(ptr, relocs,
+			       sizeof(*relocs) * obj->relocation_count);
+			ptr += sizeof(*relocs) * obj->relocation_count;
 		}
-		fwrite(relocs, sizeof(*relocs), obj->relocation_count,
-		       trace->file);
 	}
 
-	fflush(trace->file);
-	funlockfile(trace->file);
+	record_end(data);
 #undef to_ptr
 }
 
+static void
+trace_cmd(struct trace *trace, uint8_t cmd, const void *t, size_t len)
+{
+	void *data = record_begin(trace, cmd, len);
+
+	memcpy(data, t, len);
+	record_end(data);
+}
+
 static void
 trace_wait(struct trace *trace, uint32_t handle)
 {
-	struct trace_wait t = { WAIT, handle };
-	fwrite(&t, sizeof(t), 1, trace->file);
+	struct trace_wait t = { handle };
+	trace_cmd(trace, WAIT, &t, sizeof(t));
 }
 
 static void
 trace_add(struct trace *trace, uint32_t handle, uint64_t size)
 {
-	struct trace_add_bo t = { ADD_BO, handle, size };
-	fwrite(&t, sizeof(t), 1, trace->file);
+	struct trace_add_bo t = { handle, size };
+	trace_cmd(trace, ADD_BO, &t, sizeof(t));
 }
 
 static void
 trace_del(struct trace *trace, uint32_t handle)
 {
-	struct trace_del_bo t = { DEL_BO, handle };
-	fwrite(&t, sizeof(t), 1, trace->file);
+	struct trace_del_bo t = { handle };
+	trace_cmd(trace, DEL_BO, &t, sizeof(t));
 }
 
 static void
 trace_add_context(struct trace *trace, uint32_t handle)
 {
-	struct trace_add_ctx t = { ADD_CTX, handle };
-	fwrite(&t, sizeof(t), 1, trace->file);
+	struct trace_add_ctx t = { handle };
+	trace_cmd(trace, ADD_CTX, &t, sizeof(t));
 }
 
 static void
 trace_del_context(struct trace *trace, uint32_t handle)
 {
-	struct trace_del_ctx t = { DEL_CTX, handle };
-	fwrite(&t, sizeof(t), 1, trace->file);
+	struct trace_del_ctx t = { handle };
+	trace_cmd(trace, DEL_CTX, &t, sizeof(t));
+}
+
+/* Called with traces_lock held for writing. */
+static struct trace *trace_open(int fd)
+{
+	char filename[80];
+	struct trace *t;
+
+	t = calloc(1, sizeof(*t));
+	if (!t)
+		return NULL;
+
+	/*
+	 * The trace of a closed fd with the same number may still be held by
+	 * an ioctl() in flight, give this one its own file rather than
+	 * truncating the old file under its mapping.
+	 */
+	sprintf(filename, "/tmp/trace-%d.%d", getpid(), fd);
+	unlink(filename);
+	t->out = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (t->out < 0) {
+		free(t);
+		return NULL;
+	}
+
+	t->fd = fd;
+	t->refcount = 1;
+	trace_write(t, &version, sizeof(version));
+
+	t->next = traces;
+	traces = t;
+
+	return t;
+}
+
+/* Called with flush_mutex held, once all the rings have been flushed. */
+static void trace_close(struct trace *t)
+{
+	if (t->map)
+		munmap(t->map, t->map_size);
+	fail_if(ftruncate(t->out, t->offset), "failed to truncate trace file\n");
+	libc_close(t->out);
+	free(t);
+}
+
+/* Called with traces_lock held. */
+static struct trace *trace_get(int fd)
+{
+	struct trace *t;
+
+	for (t = traces; t; t = t->next) {
+		if (fd == t->fd) {
+			__atomic_add_fetch(&t->refcount, 1, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+
+	return t;
+}
+
+static void trace_put(struct trace *t)
+{
+	if (__atomic_sub_fetch(&t->refcount, 1, __ATOMIC_ACQ_REL))
+		return;
+
+	pthread_mutex_lock(&flush_mutex);
+	flush_all();
+	trace_close(t);
+	pthread_mutex_unlock(&flush_mutex);
 }
 
 int
@@ -227,16 +505,17 @@ close(int fd)
 {
 	struct trace *t, **p;
 
-	pthread_mutex_lock(&mutex);
+	pthread_rwlock_wrlock(&traces_lock);
 	for (p = &traces; (t = *p); p = &t->next) {
 		if (t->fd == fd) {
 			*p = t->next;
-			fclose(t->file);
-			free(t);
 			break;
 		}
 	}
-	pthread_mutex_unlock(&mutex);
+	pthread_rwlock_unlock(&traces_lock);
+
+	if (t)
+		trace_put(t);
 
 	return libc_close(fd);
 }
@@ -246,10 +525,6 @@ size_for_fb(const struct drm_mode_fb_cmd *cmd)
 {
 	unsigned long size;
 
-#ifndef ALIGN
-#define ALIGN(x, y) (((x) + (y) - 1) & -(y))
-#endif
-
 	size = ALIGN(cmd->width * cmd->bpp, 64);
 	size *= cmd->height;
 	return ALIGN(size, 4096);
@@ -277,7 +552,7 @@ ioctl(int fd, unsigned long request, ...)
 ioctl(int fd, int request, ...)
 #endif
 {
-	struct trace *t, **p;
+	struct trace *t;
 	va_list args;
 	void *argp;
 	int ret;
@@ -289,46 +564,26 @@ ioctl(int fd, int request, ...)
 	if (_IOC_TYPE(request) != DRM_IOCTL_BASE)
 		goto untraced;
 
-	pthread_mutex_lock(&mutex);
-	for (p = &traces; (t = *p); p = &t->next) {
-		if (fd == t->fd) {
-			if (traces != t) {
-				*p = t->next;
-				t->next = traces;
-				traces = t;
-			}
-			break;
-		}
-	}
-	if (!t) {
-		char filename[80];
+	pthread_rwlock_rdlock(&traces_lock);
+	t = trace_get(fd);
+	pthread_rwlock_unlock(&traces_lock);
 
-		if (!is_i915(fd)) {
-			pthread_mutex_unlock(&mutex);
+	if (!t) {
+		if (!is_i915(fd))
 			goto untraced;
-		}
 
-		t = malloc(sizeof(*t));
+		pthread_rwlock_wrlock(&traces_lock);
+		t = trace_get(fd);
 		if (!t) {
-			pthread_mutex_unlock(&mutex);
-			return -ENOMEM;
+			t = trace_open(fd);
+			if (t)
+				t->refcount++;
 		}
+		pthread_rwlock_unlock(&traces_lock);
 
-		sprintf(filename, "/tmp/trace-%d.%d", getpid(), fd);
-		t->file = fopen(filename, "w+");
-		t->fd = fd;
-
-		if (!fwrite(&version, sizeof(version), 1, t->file)) {
-			pthread_mutex_unlock(&mutex);
-			fclose(t->file);
-			free(t);
+		if (!t)
 			return -ENOMEM;
-		}
-
-		t->next = traces;
-		traces = t;
 	}
-	pthread_mutex_unlock(&mutex);
 
 	switch (request) {
 	case DRM_IOCTL_I915_GEM_EXECBUFFER2:
@@ -363,7 +618,7 @@ ioctl(int fd, int request, ...)
 
 	ret = libc_ioctl(fd, request, argp);
 	if (ret)
-		return ret;
+		goto out;
 
 	switch (request) {
 	case DRM_IOCTL_I915_GEM_CREATE: {
@@ -405,12 +660,36 @@ ioctl(int fd, int request, ...)
 	}
 	}
 
-	return 0;
+out:
+	trace_put(t);
+	return ret;
 
 untraced:
 	return libc_ioctl(fd, request, argp);
 }
 
+static void fork_prepare(void)
+{
+	pthread_mutex_lock(&flush_mutex);
+	flush_all();
+}
+
+static void fork_parent(void)
+{
+	pthread_mutex_unlock(&flush_mutex);
+}
+
+static void fork_child(void)
+{
+	/*
+	 * Only the forking thread survives, the flusher is restarted lazily.
+	 * The parent keeps writing its traces, the child starts its own.
+	 */
+	flusher_running = false;
+	traces = NULL;
+	pthread_mutex_unlock(&flush_mutex);
+}
+
 static void __attribute__ ((constructor))
 init(void)
 {
@@ -418,4 +697,35 @@ init(void)
 	libc_ioctl = dlsym(RTLD_NEXT, "ioctl");
 	fail_if(libc_close == NULL || libc_ioctl == NULL,
 		"failed to get libc ioctl or close\n");
+
+	fail_if(pthread_key_create(&ring_key, ring_destroy),
+		"failed to create trace ring key\n");
+	pthread_atfork(fork_prepare, fork_parent, fork_child);
+}
+
+static void __attribute__ ((destructor))
+fini(void)
+{
+	struct trace *t;
+
+	pthread_mutex_lock(&flush_mutex);
+	if (flusher_running) {
+		flusher_stop = true;
+		pthread_cond_signal(&flush_cond);
+		pthread_mutex_unlock(&flush_mutex);
+		pthread_join(flusher, NULL);
+		pthread_mutex_lock(&flush_mutex);
+		flusher_running = false;
+	}
+
+	flush_all();
+
+	pthread_rwlock_wrlock(&traces_lock);
+	while ((t = traces)) {
+		traces = t->next;
+		if (!__atomic_sub_fetch(&t->refcount, 1, __ATOMIC_ACQ_REL))
+			trace_close(t);
+	}
+	pthread_rwlock_unlock(&traces_lock);
+	pthread_mutex_unlock(&flush_mutex);
 }
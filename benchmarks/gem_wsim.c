@@ -33,10 +33,13 @@
 #include <inttypes.h>
 #include <errno.h>
 #include <poll.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
 #include <sys/time.h>
+#include <sys/timerfd.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <assert.h>
@@ -44,6 +47,7 @@
 #include <pthread.h>
 #include <math.h>
 #include <ctype.h>
+#include <getopt.h>
 
 #include "drm.h"
 #include "drmtest.h"
@@ -56,6 +60,7 @@
 #include "igt_aux.h"
 #include "igt_rand.h"
 #include "igt_perf.h"
+#include "igt_stats.h"
 #include "sw_sync.h"
 
 #include "i915/gem_create.h"
@@ -143,9 +148,11 @@ struct working_set {
 	unsigned int nr;
 	uint32_t *handles;
 	struct work_buffer_size *sizes;
+	struct sim_buffer *sim;
 };
 
 struct workload;
+struct sim_request;
 
 struct w_step {
 	struct workload *wrk;
@@ -200,6 +207,9 @@ struct w_step {
 			} *data;
 			struct drm_xe_sync *syncs;
 		} xe;
+		struct {
+			struct sim_request *rq;
+		} sim;
 	};
 	unsigned long bb_size;
 	uint32_t bb_handle;
@@ -288,6 +298,7 @@ static unsigned int master_prng;
 static int verbose = 1;
 static int fd;
 static bool is_xe;
+static bool simulate;
 static struct drm_i915_gem_context_param_sseu device_sseu = {
 	.slice_mask = -1 /* Force read on first use. */
 };
@@ -540,7 +551,24 @@ static struct intel_engine_data *query_engines(void)
 	if (engines.nengines)
 		return &engines;
 
-	if (is_xe) {
+	if (simulate) {
+		/* The modelled GPU: rcs0, bcs0, vcs0, vcs1 and vecs0. */
+		static const struct {
+			int class, instance;
+		} model[] = {
+			{ I915_ENGINE_CLASS_RENDER, 0 },
+			{ I915_ENGINE_CLASS_COPY, 0 },
+			{ I915_ENGINE_CLASS_VIDEO, 0 },
+			{ I915_ENGINE_CLASS_VIDEO, 1 },
+			{ I915_ENGINE_CLASS_VIDEO_ENHANCE, 0 },
+		};
+
+		for (int i = 0; i < ARRAY_SIZE(model); i++) {
+			engines.engines[i].class = model[i].class;
+			engines.engines[i].instance = model[i].instance;
+		}
+		engines.nengines = ARRAY_SIZE(model);
+	} else if (is_xe) {
 		struct drm_xe_engine_class_instance *hwe;
 
 		xe_for_each_engine(fd, hwe) {
@@ -889,7 +917,7 @@ parse_duration(unsigned int nr_steps, struct duration *dur, double scale_dur, ch
 	long tmpl;
 
 	if (field[0] == '*') {
-		if (intel_gen(intel_get_drm_devid(fd)) < 8) {
+		if (!simulate && intel_gen(intel_get_drm_devid(fd)) < 8) {
 			wsim_err("Infinite batch at step %u needs Gen8+!\n", nr_steps);
 			return -1;
 		}
@@ -920,6 +948,125 @@ parse_duration(unsigned int nr_steps, struct duration *dur, double scale_dur, ch
 	return 0;
 }
 
+/*
+ * Creates the workload from its parsed steps, appending @app_w, and validates
+ * the references between the steps.
+ */
+static struct workload *
+build_workload(struct w_arg *arg, unsigned int flags,
+	       struct w_step *steps, unsigned int nr_steps,
+	       struct workload *app_w)
+{
+	struct workload *wrk;
+	struct w_step *w;
+	int i, j, tmp;
+
+	if (app_w) {
+		steps = realloc(steps, sizeof(*steps) *
+				(nr_steps + app_w->nr_steps));
+		igt_assert(steps);
+
+		memcpy(&steps[nr_steps], app_w->steps,
+		       sizeof(*steps) * app_w->nr_steps);
+
+		for (i = 0; i < app_w->nr_steps; i++)
+			steps[nr_steps + i].idx += nr_steps;
+
+		nr_steps += app_w->nr_steps;
+	}
+
+	wrk = malloc(sizeof(*wrk));
+	igt_assert(wrk);
+
+	wrk->nr_steps = nr_steps;
+	wrk->steps = steps;
+	wrk->prio = arg->prio;
+	wrk->sseu = arg->sseu;
+	wrk->max_working_set_id = -1;
+	wrk->working_sets = NULL;
+	wrk->bo_prng = (flags & FLAG_SYNCEDCLIENTS) ? master_prng : rand();
+
+	/*
+	 * Tag all steps which need to emit a sync fence if another step is
+	 * referencing them as a sync fence dependency.
+	 */
+	for (i = 0; i < nr_steps; i++) {
+		struct dep_entry *dep;
+
+		for_each_dep(dep, steps[i].fence_deps) {
+			tmp = steps[i].idx + dep->target;
+			check_arg(tmp < 0 || tmp >= i ||
+				  (steps[tmp].type != BATCH &&
+				   steps[tmp].type != SW_FENCE),
+				  "Invalid dependency target %u!\n", i);
+			steps[tmp].emit_fence = -1;
+		}
+	}
+
+	/* Validate SW_FENCE_SIGNAL targets. */
+	for (i = 0; i < nr_steps; i++) {
+		if (steps[i].type == SW_FENCE_SIGNAL) {
+			tmp = steps[i].idx + steps[i].target;
+			check_arg(tmp < 0 || tmp >= i ||
+				  steps[tmp].type != SW_FENCE,
+				  "Invalid sw fence target %u!\n", i);
+		}
+	}
+
+	/*
+	 * Check no duplicate working set ids.
+	 */
+	for_each_w_step(w, wrk) {
+		struct w_step *w2;
+
+		if (w->type != WORKINGSET)
+			continue;
+
+		for_each_w_step(w2, wrk) {
+			if (w->idx == w2->idx)
+				continue;
+			if (w2->type != WORKINGSET)
+				continue;
+
+			check_arg(w->working_set.id == w2->working_set.id,
+				  "Duplicate working set id at %u!\n", j);
+		}
+	}
+
+	/*
+	 * Allocate shared working sets.
+	 */
+	for_each_w_step(w, wrk) {
+		if (w->type == WORKINGSET && w->working_set.shared) {
+			unsigned long total =
+				allocate_working_set(wrk, &w->working_set);
+
+			if (verbose > 1)
+				printf("%u: %lu bytes in shared working set %u\n",
+				       wrk->id, total, w->working_set.id);
+		}
+	}
+
+	wrk->max_working_set_id = -1;
+	for_each_w_step(w, wrk) {
+		if (w->type == WORKINGSET &&
+		    w->working_set.shared &&
+		    w->working_set.id > wrk->max_working_set_id)
+			wrk->max_working_set_id = w->working_set.id;
+	}
+
+	wrk->working_sets = calloc(wrk->max_working_set_id + 1,
+				   sizeof(*wrk->working_sets));
+	igt_assert(wrk->working_sets);
+
+	for_each_w_step(w, wrk) {
+		if (w->type == WORKINGSET && w->working_set.shared)
+			wrk->working_sets[w->working_set.id] = &w->working_set;
+	}
+
+	return wrk;
+}
+
 #define int_field(_STEP_, _FIELD_, _COND_, _ERR_) \
 	do { \
 		field = strtok_r(fstart, ".", &fctx); \
@@ -936,14 +1083,13 @@ static struct workload *
 parse_workload(struct w_arg *arg, unsigned int flags, double scale_dur,
 	       double scale_time, struct workload *app_w)
 {
-	struct workload *wrk;
 	unsigned int nr_steps = 0;
 	char *desc = strdup(arg->desc);
 	char *_token, *token, *tctx = NULL, *tstart = desc;
 	char *field, *fctx = NULL, *fstart;
-	struct w_step step, *w, *steps = NULL;
+	struct w_step step, *steps = NULL;
 	unsigned int valid;
-	int i, j, tmp;
+	int i, tmp;
 
 	igt_assert(desc);
 
@@ -1275,120 +1421,405 @@ add_step:
 		free(token);
 	}
 
-	if (app_w) {
-		steps = realloc(steps, sizeof(step) *
-				(nr_steps + app_w->nr_steps));
-		igt_assert(steps);
+	free(desc);
 
-		memcpy(&steps[nr_steps], app_w->steps,
-		       sizeof(step) * app_w->nr_steps);
+	return build_workload(arg, flags, steps, nr_steps, app_w);
+}
 
-		for (i = 0; i < app_w->nr_steps; i++)
-			steps[nr_steps + i].idx += nr_steps;
+/*
+ * Compiled workloads
+ *
+ * A parsed workload can be written out with -o as a flat array of steps,
+ * followed by the tables their dependencies, engine maps and working set
+ * buffers index into. Loading one is then a single mmap, with the tables
+ * referenced in place by the steps of every client, instead of parsing the
+ * text descriptor. The tables use the in-memory layout of this build, so
+ * compiled workloads are not portable between versions of gem_wsim.
+ */
 
-		nr_steps += app_w->nr_steps;
-	}
+#define WSIM_BIN_MAGIC		"gem_wsim"
+#define WSIM_BIN_VERSION	1
+
+#define WSIM_BIN_UNBOUND	(1 << 0)
+#define WSIM_BIN_DATA_SUBMIT	(1 << 1)
+#define WSIM_BIN_FENCE_SUBMIT	(1 << 2)
+#define WSIM_BIN_SHARED		(1 << 3)
+
+/* Contexts are looked up in a table sized by the largest id. */
+#define WSIM_BIN_MAX_CONTEXT	4095
+
+struct wsim_bin_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t vcs_engines; /* VCS engine maps were expanded for */
+	uint32_t nr_steps;
+	uint32_t nr_sizes;
+	uint32_t nr_deps;
+	uint32_t nr_engines;
+};
 
-	wrk = malloc(sizeof(*wrk));
-	igt_assert(wrk);
+struct wsim_bin_step {
+	uint32_t type;
+	uint32_t context;
+	uint32_t engine;
+	uint32_t flags;
+	uint32_t duration[2];
+	int32_t value; /* sync, delay, period, target, priority, sseu... */
+	uint32_t bond_master;
+	uint64_t bond_mask;
+	uint32_t data_deps, nr_data_deps;
+	uint32_t fence_deps, nr_fence_deps;
+	uint32_t list, nr_list; /* engine map or working set buffers */
+};
 
-	wrk->nr_steps = nr_steps;
-	wrk->steps = steps;
-	wrk->prio = arg->prio;
-	wrk->sseu = arg->sseu;
-	wrk->max_working_set_id = -1;
-	wrk->working_sets = NULL;
-	wrk->bo_prng = (flags & FLAG_SYNCEDCLIENTS) ? master_prng : rand();
+static void *append_table(void *table, unsigned int *nr, const void *src,
+			  unsigned int count, size_t size)
+{
+	if (!count)
+		return table;
 
-	free(desc);
+	table = realloc(table, (*nr + count) * size);
+	igt_assert(table);
+	memcpy((char *)table + *nr * size, src, count * size);
+	*nr += count;
 
-	/*
-	 * Tag all steps which need to emit a sync fence if another step is
-	 * referencing them as a sync fence dependency.
-	 */
-	for (i = 0; i < nr_steps; i++) {
-		struct dep_entry *dep;
+	return table;
+}
 
-		for_each_dep(dep, steps[i].fence_deps) {
-			tmp = steps[i].idx + dep->target;
-			check_arg(tmp < 0 || tmp >= i ||
-				  (steps[tmp].type != BATCH &&
-				   steps[tmp].type != SW_FENCE),
-				  "Invalid dependency target %u!\n", i);
-			steps[tmp].emit_fence = -1;
+static bool write_table(FILE *file, const void *table, size_t size,
+			unsigned int nr)
+{
+	return !nr || fwrite(table, size, nr, file) == nr;
+}
+
+static int compile_workload(struct workload *wrk, const char *filename)
+{
+	struct wsim_bin_header hdr = {
+		.magic = WSIM_BIN_MAGIC,
+		.version = WSIM_BIN_VERSION,
+		.vcs_engines = num_engines_in_class(VCS),
+		.nr_steps = wrk->nr_steps,
+	};
+	struct wsim_bin_step *steps = calloc(wrk->nr_steps, sizeof(*steps));
+	struct work_buffer_size *sizes = NULL;
+	enum intel_engine_id *engines = NULL;
+	struct dep_entry *deps = NULL;
+	struct w_step *w;
+	FILE *file;
+	int ret = 0;
+
+	igt_assert(steps);
+
+	for_each_w_step(w, wrk) {
+		struct wsim_bin_step *s = &steps[w->idx];
+
+		s->type = w->type;
+		s->context = w->context;
+		s->engine = w->engine;
+		s->duration[0] = w->duration.min;
+		s->duration[1] = w->duration.max;
+		if (w->duration.unbound)
+			s->flags |= WSIM_BIN_UNBOUND;
+		if (w->data_deps.submit_fence)
+			s->flags |= WSIM_BIN_DATA_SUBMIT;
+		if (w->fence_deps.submit_fence)
+			s->flags |= WSIM_BIN_FENCE_SUBMIT;
+
+		s->data_deps = hdr.nr_deps;
+		s->nr_data_deps = w->data_deps.nr;
+		deps = append_table(deps, &hdr.nr_deps, w->data_deps.list,
+				    w->data_deps.nr, sizeof(*deps));
+		s->fence_deps = hdr.nr_deps;
+		s->nr_fence_deps = w->fence_deps.nr;
+		deps = append_table(deps, &hdr.nr_deps, w->fence_deps.list,
+				    w->fence_deps.nr, sizeof(*deps));
+
+		switch (w->type) {
+		case ENGINE_MAP:
+			s->list = hdr.nr_engines;
+			s->nr_list = w->engine_map_count;
+			engines = append_table(engines, &hdr.nr_engines,
+					       w->engine_map,
+					       w->engine_map_count,
+					       sizeof(*engines));
+			break;
+		case LOAD_BALANCE:
+			s->value = w->load_balance;
+			break;
+		case BOND:
+			s->bond_mask = w->bond_mask;
+			s->bond_master = w->bond_master;
+			break;
+		case WORKINGSET:
+			s->value = w->working_set.id;
+			if (w->working_set.shared)
+				s->flags |= WSIM_BIN_SHARED;
+			s->list = hdr.nr_sizes;
+			s->nr_list = w->working_set.nr;
+			sizes = append_table(sizes, &hdr.nr_sizes,
+					     w->working_set.sizes,
+					     w->working_set.nr,
+					     sizeof(*sizes));
+			break;
+		default:
+			s->value = w->sync;
+			break;
 		}
 	}
 
-	/* Validate SW_FENCE_SIGNAL targets. */
-	for (i = 0; i < nr_steps; i++) {
-		if (steps[i].type == SW_FENCE_SIGNAL) {
-			tmp = steps[i].idx + steps[i].target;
-			check_arg(tmp < 0 || tmp >= i ||
-				  steps[tmp].type != SW_FENCE,
-				  "Invalid sw fence target %u!\n", i);
-		}
+	/* Sizes are picked anew when the working set is allocated. */
+	for (unsigned int i = 0; i < hdr.nr_sizes; i++)
+		sizes[i].size = 0;
+
+	/* Zero the padding of the dependency entries written out. */
+	for (unsigned int i = 0; i < hdr.nr_deps; i++)
+		deps[i] = (struct dep_entry) {
+			.target = deps[i].target,
+			.write = deps[i].write,
+			.working_set = deps[i].working_set,
+		};
+
+	file = fopen(filename, "w");
+	if (!file) {
+		wsim_err("Failed to create '%s'! (%s)\n",
+			 filename, strerror(errno));
+		ret = -1;
+		goto out;
 	}
 
-	/*
-	 * Check no duplicate working set ids.
-	 */
-	for_each_w_step(w, wrk) {
-		struct w_step *w2;
+	if (!write_table(file, &hdr, sizeof(hdr), 1) ||
+	    !write_table(file, steps, sizeof(*steps), hdr.nr_steps) ||
+	    !write_table(file, sizes, sizeof(*sizes), hdr.nr_sizes) ||
+	    !write_table(file, deps, sizeof(*deps), hdr.nr_deps) ||
+	    !write_table(file, engines, sizeof(*engines), hdr.nr_engines))
+		ret = -1;
 
-		if (w->type != WORKINGSET)
-			continue;
+	if (fclose(file))
+		ret = -1;
 
-		for_each_w_step(w2, wrk) {
-			if (w->idx == w2->idx)
-				continue;
-			if (w2->type != WORKINGSET)
-				continue;
+	if (ret)
+		wsim_err("Failed to write '%s'!\n", filename);
 
-			check_arg(w->working_set.id == w2->working_set.id,
-				  "Duplicate working set id at %u!\n", j);
-		}
-	}
+out:
+	free(engines);
+	free(deps);
+	free(sizes);
+	free(steps);
 
-	/*
-	 * Allocate shared working sets.
-	 */
-	for_each_w_step(w, wrk) {
-		if (w->type == WORKINGSET && w->working_set.shared) {
-			unsigned long total =
-				allocate_working_set(wrk, &w->working_set);
+	return ret;
+}
 
-			if (verbose > 1)
-				printf("%u: %lu bytes in shared working set %u\n",
-				       wrk->id, total, w->working_set.id);
-		}
-	}
+static bool is_compiled_workload(const char *filename)
+{
+	char magic[sizeof(WSIM_BIN_MAGIC) - 1];
+	bool ret = false;
+	int infd;
 
-	wrk->max_working_set_id = -1;
-	for_each_w_step(w, wrk) {
-		if (w->type == WORKINGSET &&
-		    w->working_set.shared &&
-		    w->working_set.id > wrk->max_working_set_id)
-			wrk->max_working_set_id = w->working_set.id;
-	}
+	infd = open(filename, O_RDONLY);
+	if (infd < 0)
+		return false;
 
-	wrk->working_sets = calloc(wrk->max_working_set_id + 1,
-				   sizeof(*wrk->working_sets));
-	igt_assert(wrk->working_sets);
+	if (read(infd, magic, sizeof(magic)) == sizeof(magic))
+		ret = !memcmp(magic, WSIM_BIN_MAGIC, sizeof(magic));
+	close(infd);
 
-	for_each_w_step(w, wrk) {
-		if (w->type == WORKINGSET && w->working_set.shared)
-			wrk->working_sets[w->working_set.id] = &w->working_set;
+	return ret;
+}
+
+static bool
+in_table(uint32_t first, uint32_t count, uint32_t nr)
+{
+	return (uint64_t)first + count <= nr;
+}
+
+/* Returns the header of a valid compiled workload, or NULL. */
+static const struct wsim_bin_header *
+check_compiled_workload(const struct w_arg *arg, const void *map,
+			uint64_t map_size, double scale_dur)
+{
+	const struct wsim_bin_header *hdr = map;
+	const struct wsim_bin_step *bin;
+	const enum intel_engine_id *engines;
+	const struct dep_entry *deps;
+	uint64_t size;
+
+	size = sizeof(*hdr) +
+	       (uint64_t)hdr->nr_steps * sizeof(*bin) +
+	       (uint64_t)hdr->nr_sizes * sizeof(struct work_buffer_size) +
+	       (uint64_t)hdr->nr_deps * sizeof(*deps) +
+	       (uint64_t)hdr->nr_engines * sizeof(enum intel_engine_id);
+	check_arg(memcmp(hdr->magic, WSIM_BIN_MAGIC, sizeof(hdr->magic)) ||
+		  hdr->version != WSIM_BIN_VERSION || size != map_size,
+		  "Invalid compiled workload '%s'!\n", arg->filename);
+	check_arg(hdr->nr_engines &&
+		  hdr->vcs_engines != num_engines_in_class(VCS),
+		  "Workload '%s' was compiled for %u VCS engines!\n",
+		  arg->filename, hdr->vcs_engines);
+
+	bin = (const void *)(hdr + 1);
+	deps = (const void *)((const struct work_buffer_size *)(bin + hdr->nr_steps) +
+			      hdr->nr_sizes);
+	engines = (const void *)(deps + hdr->nr_deps);
+
+	for (unsigned int i = 0; i < hdr->nr_steps; i++) {
+		const struct wsim_bin_step *s = &bin[i];
+
+		check_arg(s->type > WORKINGSET || s->engine >= NUM_ENGINES ||
+			  s->context > WSIM_BIN_MAX_CONTEXT ||
+			  !in_table(s->data_deps, s->nr_data_deps,
+				    hdr->nr_deps) ||
+			  !in_table(s->fence_deps, s->nr_fence_deps,
+				    hdr->nr_deps),
+			  "Invalid record at step %u!\n", i);
+		check_arg(is_xe &&
+			  (s->type == CTX_PRIORITY || s->type == SSEU ||
+			   s->type == BOND || s->type == WORKINGSET),
+			  "Step %u is not implemented with xe yet.\n", i);
+		check_arg(s->flags & WSIM_BIN_UNBOUND && !simulate &&
+			  intel_gen(intel_get_drm_devid(fd)) < 8,
+			  "Infinite batch at step %u needs Gen8+!\n", i);
+		/* Like parse_duration(), a range must survive the scaling */
+		check_arg(s->duration[1] != s->duration[0] &&
+			  __duration(s->duration[1], scale_dur) <=
+			  __duration(s->duration[0], scale_dur),
+			  "Invalid maximum duration at step %u!\n", i);
+
+		for (unsigned int j = 0; j < s->nr_data_deps; j++) {
+			const struct dep_entry *dep = &deps[s->data_deps + j];
+
+			check_arg(dep->working_set < -1 ||
+				  (dep->working_set == -1 &&
+				   (dep->target > 0 || (int)i + dep->target < 0)),
+				  "Invalid dependency at step %u!\n", i);
+		}
+
+		check_arg(s->type == ENGINE_MAP &&
+			  !in_table(s->list, s->nr_list, hdr->nr_engines),
+			  "Invalid engine map list at step %u!\n", i);
+		for (unsigned int j = 0; s->type == ENGINE_MAP && j < s->nr_list; j++)
+			check_arg((unsigned int)engines[s->list + j] >= NUM_ENGINES,
+				  "Invalid engine map at step %u!\n", i);
+		check_arg(s->type == BOND && s->bond_master >= NUM_ENGINES,
+			  "Invalid bond master at step %u!\n", i);
+		check_arg(s->type == WORKINGSET &&
+			  (s->value < 0 ||
+			   !in_table(s->list, s->nr_list, hdr->nr_sizes)),
+			  "Invalid working set at step %u!\n", i);
 	}
 
-	return wrk;
+	return hdr;
 }
 
+/*
+ * Compiled workloads hold the durations and delays of the descriptor as
+ * written, they are scaled here like parse_workload() does.
+ */
 static struct workload *
-clone_workload(struct workload *_wrk)
+map_workload(struct w_arg *arg, unsigned int flags, double scale_dur,
+	     double scale_time, struct workload *app_w)
 {
+	const struct wsim_bin_header *hdr;
+	const struct wsim_bin_step *bin;
+	struct work_buffer_size *sizes;
+	enum intel_engine_id *engines;
 	struct workload *wrk;
-	struct w_step *w;
-	int i;
+	struct dep_entry *deps;
+	struct w_step *steps;
+	struct stat sbuf;
+	void *map;
+	int infd;
+
+	infd = open(arg->filename, O_RDONLY);
+	if (infd < 0)
+		return NULL;
+
+	if (fstat(infd, &sbuf) || sbuf.st_size < sizeof(*hdr)) {
+		close(infd);
+		return NULL;
+	}
+
+	/* Private so the working set sizes can be filled in when allocated. */
+	map = mmap(NULL, sbuf.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		   infd, 0);
+	close(infd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	hdr = check_compiled_workload(arg, map, sbuf.st_size, scale_dur);
+	if (!hdr) {
+		munmap(map, sbuf.st_size);
+		return NULL;
+	}
+
+	bin = (const void *)(hdr + 1);
+	sizes = (void *)(bin + hdr->nr_steps);
+	deps = (void *)(sizes + hdr->nr_sizes);
+	engines = (void *)(deps + hdr->nr_deps);
+
+	steps = calloc(hdr->nr_steps, sizeof(*steps));
+	igt_assert(steps || !hdr->nr_steps);
+
+	for (unsigned int i = 0; i < hdr->nr_steps; i++) {
+		const struct wsim_bin_step *s = &bin[i];
+		struct w_step *w = &steps[i];
+
+		w->type = s->type;
+		w->context = s->context;
+		w->engine = s->engine;
+		w->duration.unbound = s->flags & WSIM_BIN_UNBOUND;
+		w->duration.min = __duration(s->duration[0], scale_dur);
+		w->duration.max = __duration(s->duration[1], scale_dur);
+
+		w->data_deps.nr = s->nr_data_deps;
+		w->data_deps.list = s->nr_data_deps ? deps + s->data_deps : NULL;
+		w->data_deps.submit_fence = s->flags & WSIM_BIN_DATA_SUBMIT;
+		w->fence_deps.nr = s->nr_fence_deps;
+		w->fence_deps.list = s->nr_fence_deps ? deps + s->fence_deps : NULL;
+		w->fence_deps.submit_fence = s->flags & WSIM_BIN_FENCE_SUBMIT;
+
+		switch (w->type) {
+		case ENGINE_MAP:
+			w->engine_map_count = s->nr_list;
+			w->engine_map = engines + s->list;
+			break;
+		case LOAD_BALANCE:
+			w->load_balance = s->value;
+			break;
+		case BOND:
+			w->bond_mask = s->bond_mask;
+			w->bond_master = s->bond_master;
+			break;
+		case WORKINGSET:
+			w->working_set.id = s->value;
+			w->working_set.shared = s->flags & WSIM_BIN_SHARED;
+			w->working_set.nr = s->nr_list;
+			w->working_set.sizes = sizes + s->list;
+			break;
+		case DELAY:
+			w->delay = __duration(s->value, scale_time);
+			break;
+		default:
+			w->sync = s->value;
+			break;
+		}
+
+		w->idx = i;
+		w->request = -1;
+	}
+
+	wrk = build_workload(arg, flags, steps, hdr->nr_steps, app_w);
+	if (!wrk)
+		munmap(map, sbuf.st_size);
+
+	return wrk;
+}
+
+static struct workload *
+clone_workload(struct workload *_wrk)
+{
+	struct workload *wrk;
+	struct w_step *w;
+	int i;
 
 	wrk = malloc(sizeof(*wrk));
 	igt_assert(wrk);
@@ -1416,7 +1847,7 @@ clone_workload(struct workload *_wrk)
 
 	/* Check if we need a sw sync timeline. */
 	for_each_w_step(w, wrk) {
-		if (w->type == SW_FENCE) {
+		if (w->type == SW_FENCE && !simulate) {
 			wrk->sync_timeline = sw_sync_timeline_create();
 			igt_assert(wrk->sync_timeline >= 0);
 			break;
@@ -1948,7 +2379,8 @@ allocate_working_set(struct workload *wrk, struct working_set *set)
 
 	for (i = 0; i < set->nr; i++) {
 		set->sizes[i].size = get_buffer_size(wrk, &set->sizes[i]);
-		set->handles[i] = alloc_bo(fd, &set->sizes[i].size);
+		if (!simulate)
+			set->handles[i] = alloc_bo(fd, &set->sizes[i].size);
 		total += set->sizes[i].size;
 	}
 
@@ -2539,7 +2971,7 @@ update_bb_start(struct workload *wrk, struct w_step *w)
 	*w->i915.bb_duration = ticks;
 }
 
-static void w_sync_to(struct workload *wrk, struct w_step *w, int target)
+static struct w_step *sync_target(struct workload *wrk, int target)
 {
 	if (target < 0)
 		target = wrk->nr_steps + target;
@@ -2554,7 +2986,12 @@ static void w_sync_to(struct workload *wrk, struct w_step *w, int target)
 	igt_assert(target < wrk->nr_steps);
 	igt_assert(wrk->steps[target].type == BATCH);
 
-	w_step_sync(&wrk->steps[target]);
+	return &wrk->steps[target];
+}
+
+static void w_sync_to(struct workload *wrk, struct w_step *w, int target)
+{
+	w_step_sync(sync_target(wrk, target));
 }
 
 static void do_xe_exec(struct workload *wrk, struct w_step *w)
@@ -2636,6 +3073,135 @@ static void sync_deps(struct workload *wrk, struct w_step *w)
 	}
 }
 
+static void do_step(struct workload *wrk, struct w_step *w,
+		    unsigned int *cur_seqno)
+{
+	if (w->type == SW_FENCE) {
+		igt_assert(w->emit_fence < 0);
+		w->emit_fence =
+			sw_sync_timeline_create_fence(wrk->sync_timeline,
+						      *cur_seqno + w->idx);
+		igt_assert(w->emit_fence > 0);
+		if (is_xe)
+			/* Convert sync file to syncobj */
+			syncobj_import_sync_file(fd, w->xe.syncs[0].handle,
+						 w->emit_fence);
+	} else if (w->type == SW_FENCE_SIGNAL) {
+		int tgt = w->idx + w->target;
+		int inc;
+
+		igt_assert(tgt >= 0 && tgt < w->idx);
+		igt_assert(wrk->steps[tgt].type == SW_FENCE);
+		*cur_seqno += wrk->steps[tgt].idx;
+		inc = *cur_seqno - wrk->sync_seqno;
+		sw_sync_timeline_inc(wrk->sync_timeline, inc);
+	} else if (w->type == CTX_PRIORITY) {
+		if (w->priority != wrk->ctx_list[w->context].priority) {
+			struct drm_i915_gem_context_param param = {
+				.ctx_id = wrk->ctx_list[w->context].id,
+				.param = I915_CONTEXT_PARAM_PRIORITY,
+				.value = w->priority,
+			};
+
+			gem_context_set_param(fd, &param);
+			wrk->ctx_list[w->context].priority = w->priority;
+		}
+	} else if (w->type == TERMINATE) {
+		unsigned int t_idx = w->idx + w->target;
+
+		igt_assert(t_idx >= 0 && t_idx < w->idx);
+		igt_assert(wrk->steps[t_idx].type == BATCH);
+		igt_assert(wrk->steps[t_idx].duration.unbound);
+
+		if (is_xe)
+			xe_spin_end(&wrk->steps[t_idx].xe.data->spin);
+		else
+			*wrk->steps[t_idx].i915.bb_duration = 0xffffffff;
+		__sync_synchronize();
+	} else if (w->type == SSEU) {
+		if (w->sseu != wrk->ctx_list[w->context * 2].sseu) {
+			wrk->ctx_list[w->context * 2].sseu =
+				set_ctx_sseu(&wrk->ctx_list[w->context * 2],
+					     w->sseu);
+		}
+	}
+
+	/* No action for the remaining types at execution time. */
+}
+
+static void submit_step(struct workload *wrk, struct w_step *w)
+{
+	enum intel_engine_id engine = w->engine;
+
+	if (is_xe)
+		do_xe_exec(wrk, w);
+	else
+		do_eb(wrk, w, engine);
+
+	if (w->request != -1) {
+		igt_list_del(&w->rq_link);
+		wrk->nrequest[w->request]--;
+	}
+	w->request = engine;
+	igt_list_add_tail(&w->rq_link, &wrk->requests[engine]);
+	wrk->nrequest[engine]++;
+}
+
+static void
+end_iteration(struct workload *wrk, unsigned int cur_seqno, bool batches)
+{
+	struct w_step *w;
+
+	if (wrk->sync_timeline) {
+		int inc;
+
+		inc = wrk->nr_steps - (cur_seqno - wrk->sync_seqno);
+		sw_sync_timeline_inc(wrk->sync_timeline, inc);
+		wrk->sync_seqno += wrk->nr_steps;
+	}
+
+	/* Cleanup all fences instantiated in this iteration. */
+	for_each_w_step(w, wrk) {
+		if (!wrk->run)
+			break;
+
+		if (!batches && w->type == BATCH)
+			continue;
+
+		if (w->emit_fence > 0) {
+			if (is_xe) {
+				igt_assert(w->type == SW_FENCE);
+				syncobj_reset(fd, &w->xe.syncs[0].handle, 1);
+			}
+			close(w->emit_fence);
+			w->emit_fence = -1;
+		}
+	}
+}
+
+static void release_steps(struct workload *wrk)
+{
+	struct w_step *w;
+
+	if (!is_xe)
+		return;
+
+	for_each_w_step(w, wrk) {
+		if (w->type == BATCH) {
+			w_step_sync(w);
+			syncobj_destroy(fd, w->xe.syncs[0].handle);
+			free(w->xe.syncs);
+			xe_vm_unbind_sync(fd, xe_get_vm(wrk, w)->id, 0, w->xe.exec.address,
+					  w->bb_size);
+			gem_munmap(w->xe.data, w->bb_size);
+			gem_close(fd, w->bb_handle);
+		} else if (w->type == SW_FENCE) {
+			syncobj_destroy(fd, w->xe.syncs[0].handle);
+			free(w->xe.syncs);
+		}
+	}
+}
+
 static void *run_workload(void *data)
 {
 	struct workload *wrk = (struct workload *)data;
@@ -2695,66 +3261,8 @@ static void *run_workload(void *data)
 			} else if (w->type == QD_THROTTLE) {
 				qd_throttle = w->throttle;
 				continue;
-			} else if (w->type == SW_FENCE) {
-				igt_assert(w->emit_fence < 0);
-				w->emit_fence =
-					sw_sync_timeline_create_fence(wrk->sync_timeline,
-								      cur_seqno + w->idx);
-				igt_assert(w->emit_fence > 0);
-				if (is_xe)
-					/* Convert sync file to syncobj */
-					syncobj_import_sync_file(fd, w->xe.syncs[0].handle,
-								 w->emit_fence);
-				continue;
-			} else if (w->type == SW_FENCE_SIGNAL) {
-				int tgt = w->idx + w->target;
-				int inc;
-
-				igt_assert(tgt >= 0 && tgt < w->idx);
-				igt_assert(wrk->steps[tgt].type == SW_FENCE);
-				cur_seqno += wrk->steps[tgt].idx;
-				inc = cur_seqno - wrk->sync_seqno;
-				sw_sync_timeline_inc(wrk->sync_timeline, inc);
-				continue;
-			} else if (w->type == CTX_PRIORITY) {
-				if (w->priority != wrk->ctx_list[w->context].priority) {
-					struct drm_i915_gem_context_param param = {
-						.ctx_id = wrk->ctx_list[w->context].id,
-						.param = I915_CONTEXT_PARAM_PRIORITY,
-						.value = w->priority,
-					};
-
-					gem_context_set_param(fd, &param);
-					wrk->ctx_list[w->context].priority =
-								    w->priority;
-				}
-				continue;
-			} else if (w->type == TERMINATE) {
-				unsigned int t_idx = w->idx + w->target;
-
-				igt_assert(t_idx >= 0 && t_idx < w->idx);
-				igt_assert(wrk->steps[t_idx].type == BATCH);
-				igt_assert(wrk->steps[t_idx].duration.unbound);
-
-				if (is_xe)
-					xe_spin_end(&wrk->steps[t_idx].xe.data->spin);
-				else
-					*wrk->steps[t_idx].i915.bb_duration = 0xffffffff;
-				__sync_synchronize();
-				continue;
-			} else if (w->type == SSEU) {
-				if (w->sseu != wrk->ctx_list[w->context * 2].sseu) {
-					wrk->ctx_list[w->context * 2].sseu =
-						set_ctx_sseu(&wrk->ctx_list[w->context * 2],
-							     w->sseu);
-				}
-				continue;
-			} else if (w->type == PREEMPTION ||
-				   w->type == ENGINE_MAP ||
-				   w->type == LOAD_BALANCE ||
-				   w->type == BOND ||
-				   w->type == WORKINGSET) {
-				   /* No action for these at execution time. */
+			} else if (w->type != BATCH) {
+				do_step(wrk, w, &cur_seqno);
 				continue;
 			}
 
@@ -2771,18 +3279,7 @@ static void *run_workload(void *data)
 			if (throttle > 0)
 				w_sync_to(wrk, w, w->idx - throttle);
 
-			if (is_xe)
-				do_xe_exec(wrk, w);
-			else
-				do_eb(wrk, w, engine);
-
-			if (w->request != -1) {
-				igt_list_del(&w->rq_link);
-				wrk->nrequest[w->request]--;
-			}
-			w->request = engine;
-			igt_list_add_tail(&w->rq_link, &wrk->requests[engine]);
-			wrk->nrequest[engine]++;
+			submit_step(wrk, w);
 
 			if (!wrk->run)
 				break;
@@ -2806,28 +3303,7 @@ static void *run_workload(void *data)
 			}
 		}
 
-		if (wrk->sync_timeline) {
-			int inc;
-
-			inc = wrk->nr_steps - (cur_seqno - wrk->sync_seqno);
-			sw_sync_timeline_inc(wrk->sync_timeline, inc);
-			wrk->sync_seqno += wrk->nr_steps;
-		}
-
-		/* Cleanup all fences instantiated in this iteration. */
-		for_each_w_step(w, wrk) {
-			if (!wrk->run)
-				break;
-
-			if (w->emit_fence > 0) {
-				if (is_xe) {
-					igt_assert(w->type == SW_FENCE);
-					syncobj_reset(fd, &w->xe.syncs[0].handle, 1);
-				}
-				close(w->emit_fence);
-				w->emit_fence = -1;
-			}
-		}
+		end_iteration(wrk, cur_seqno, true);
 	}
 
 	for (int i = 0; i < NUM_ENGINES; i++) {
@@ -2838,22 +3314,7 @@ static void *run_workload(void *data)
 		w_step_sync(w);
 	}
 
-	if (is_xe) {
-		for_each_w_step(w, wrk) {
-			if (w->type == BATCH) {
-				w_step_sync(w);
-				syncobj_destroy(fd, w->xe.syncs[0].handle);
-				free(w->xe.syncs);
-				xe_vm_unbind_sync(fd, xe_get_vm(wrk, w)->id, 0, w->xe.exec.address,
-						  w->bb_size);
-				gem_munmap(w->xe.data, w->bb_size);
-				gem_close(fd, w->bb_handle);
-			} else if (w->type == SW_FENCE) {
-				syncobj_destroy(fd, w->xe.syncs[0].handle);
-				free(w->xe.syncs);
-			}
-		}
-	}
+	release_steps(wrk);
 
 	clock_gettime(CLOCK_MONOTONIC, &t_end);
 
@@ -2872,139 +3333,1459 @@ static void *run_workload(void *data)
 	return NULL;
 }
 
-static void fini_workload(struct workload *wrk)
+/*
+ * Event driven executor
+ *
+ * With -t a small pool of threads drives all the clients instead of a thread
+ * per client. Each client is a state machine stepping through its workload
+ * like run_workload() does, but instead of blocking it arms a timerfd for
+ * delays and periods, or polls a sync_file for the request it needs to wait
+ * upon, and returns to its thread's epoll loop.
+ */
+
+struct executor;
+
+struct exec_client {
+	struct workload *wrk;
+	struct executor *ex;
+
+	int timer;
+	int fence;
+	uint64_t deadline;
+
+	bool active, done;
+	unsigned int step, stage, drain;
+	unsigned int cur_seqno;
+	int throttle, qd_throttle;
+
+	unsigned int count, missed;
+	unsigned long time_tot, time_min, time_max;
+	struct timespec t_start, repeat_start;
+	igt_stats_t jitter;
+};
+
+struct executor {
+	pthread_t thread;
+	int epoll;
+	unsigned int nr_clients, nr_active;
+	struct exec_client **clients;
+
+	struct workload **all;
+	unsigned int nr_all;
+	int master;
+};
+
+static uint64_t now_ns(void)
 {
-	free(wrk->steps);
-	free(wrk);
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
 }
 
-static void print_help(void)
+/* Returns a sync_file for the last submission of @w, -1 if there is none. */
+static int w_step_fence(struct w_step *w)
 {
-	puts(
-"Usage: gem_wsim [OPTIONS]\n"
-"\n"
-"Runs a simulated workload on the GPU.\n"
-"Options:\n"
-"  -h                This text.\n"
-"  -q                Be quiet - do not output anything to stdout.\n"
-"  -I <n>            Initial randomness seed.\n"
-"  -p <n>            Context priority to use for the following workload on the\n"
-"                    command line.\n"
-"  -w <desc|path>    Filename or a workload descriptor.\n"
-"                    Can be given multiple times.\n"
-"  -W <desc|path>    Filename or a master workload descriptor.\n"
-"                    Only one master workload can be optinally specified in which\n"
-"                    case all other workloads become background ones and run as\n"
-"                    long as the master.\n"
-"  -a <desc|path>    Append a workload to all other workloads.\n"
-"  -r <n>            How many times to emit the workload.\n"
-"  -c <n>            Fork N clients emitting the workload simultaneously.\n"
-"  -s                Turn on small SSEU config for the next workload on the\n"
-"                    command line. Subsequent -s switches it off.\n"
-"  -S                Synchronize the sequence of random batch durations between\n"
-"                    clients.\n"
-"  -d                Sync between data dependencies in userspace.\n"
-"  -f <scale>        Scale factor for batch durations.\n"
-"  -F <scale>        Scale factor for delays.\n"
-"  -L                List GPUs.\n"
-"  -D <gpu>          One of the GPUs from -L.\n"
-	);
+	if (is_xe) {
+		struct drm_syncobj_handle args = {
+			.handle = w->xe.syncs[0].handle,
+			.flags = DRM_SYNCOBJ_HANDLE_TO_FD_FLAGS_EXPORT_SYNC_FILE,
+		};
+
+		/* An unsubmitted syncobj has no fence to export. */
+		if (__syncobj_handle_to_fd(fd, &args))
+			return -1;
+
+		return args.fd;
+	}
+
+	return w->emit_fence > 0 ? dup(w->emit_fence) : -1;
 }
 
-static char *load_workload_descriptor(char *filename)
+static void exec_watch(struct exec_client *c, int watch_fd)
 {
-	struct stat sbuf;
-	char *buf;
-	int infd, ret, i;
-	ssize_t len;
-	bool in_comment = false;
+	struct epoll_event ev = {
+		.events = EPOLLIN,
+		.data.ptr = c,
+	};
 
-	ret = stat(filename, &sbuf);
-	if (ret || !S_ISREG(sbuf.st_mode))
-		return filename;
+	igt_assert_eq(epoll_ctl(c->ex->epoll, EPOLL_CTL_ADD, watch_fd, &ev), 0);
+}
 
-	igt_assert(sbuf.st_size < 1024 * 1024); /* Just so. */
-	buf = malloc(sbuf.st_size);
-	igt_assert(buf);
+/* Returns false and arms a wakeup if the last submission of @w is busy. */
+static bool exec_wait(struct exec_client *c, struct w_step *w)
+{
+	int fence = w_step_fence(w);
 
-	infd = open(filename, O_RDONLY);
-	igt_assert(infd >= 0);
-	len = read(infd, buf, sbuf.st_size);
-	igt_assert(len == sbuf.st_size);
-	close(infd);
+	if (fence < 0)
+		return true;
 
-	for (i = 0; i < len; i++) {
-		/*
-		 * Lines starting with '#' are skipped.
-		 * If command line step separator (',') is encountered after '#'
-		 * it is replaced with ';' to not break parsing.
-		 */
-		if (buf[i] == '#')
-			in_comment = true;
-		else if (buf[i] == '\n') {
-			buf[i] = ',';
-			in_comment = false;
-		} else if (in_comment && buf[i] == ',')
-			buf[i] = ';';
+	if (sync_fence_status(fence)) {
+		close(fence);
+		return true;
 	}
 
-	len--;
-	while (buf[len] == ',')
-		buf[len--] = 0;
-
-	return buf;
+	c->fence = fence;
+	exec_watch(c, fence);
+	return false;
 }
 
-static struct w_arg *
-add_workload_arg(struct w_arg *w_args, unsigned int nr_args, char *w_arg,
-		 int prio, bool sseu)
+/* Returns false and arms the client timer if @deadline is in the future. */
+static bool exec_sleep(struct exec_client *c, uint64_t deadline)
 {
-	w_args = realloc(w_args, sizeof(*w_args) * nr_args);
-	igt_assert(w_args);
-	w_args[nr_args - 1] = (struct w_arg) { w_arg, NULL, prio, sseu };
+	struct itimerspec its = {
+		.it_value.tv_sec = deadline / NSEC_PER_SEC,
+		.it_value.tv_nsec = deadline % NSEC_PER_SEC,
+	};
 
-	return w_args;
+	if (deadline <= now_ns())
+		return true;
+
+	c->deadline = deadline;
+	igt_assert_eq(timerfd_settime(c->timer, TFD_TIMER_ABSTIME, &its, NULL),
+		      0);
+	return false;
 }
 
-int main(int argc, char **argv)
+static bool exec_batch(struct exec_client *c, struct w_step *w)
 {
-	struct igt_device_card card = { };
-	bool list_devices_arg = false;
-	unsigned int repeat = 1;
-	unsigned int clients = 1;
-	unsigned int flags = 0;
-	struct timespec t_start, t_end;
-	struct workload **w, **wrk = NULL;
-	struct workload *app_w = NULL;
-	unsigned int nr_w_args = 0;
-	int master_workload = -1;
-	char *append_workload_arg = NULL;
-	struct w_arg *w_args = NULL;
-	int exitcode = EXIT_FAILURE;
-	char *device_arg = NULL;
-	double scale_time = 1.0f;
-	double scale_dur = 1.0f;
-	int prio = 0;
-	double t;
-	int i, c, ret;
-	char *drm_dev;
+	struct workload *wrk = c->wrk;
+	enum intel_engine_id engine = w->engine;
 
-	master_prng = time(NULL);
+	if (!c->stage) {
+		if (wrk->flags & FLAG_DEPSYNC) {
+			struct dep_entry *dep;
 
-	while ((c = getopt(argc, argv,
-			   "LhqvsSdc:r:w:W:a:p:I:f:F:D:")) != -1) {
-		switch (c) {
-		case 'L':
-			list_devices_arg = true;
-			break;
-		case 'D':
-			device_arg = strdup(optarg);
-			break;
-		case 'W':
-			if (master_workload >= 0) {
-				wsim_err("Only one master workload can be given!\n");
-				goto err;
-			}
+			/* As sync_deps(). */
+			for_each_dep(dep, w->data_deps) {
+				if (dep->working_set == -1 || !dep->target)
+					continue;
+
+				if (!exec_wait(c, &wrk->steps[w->idx + dep->target]))
+					return false;
+			}
+		}
+
+		if (c->throttle > 0 &&
+		    !exec_wait(c, sync_target(wrk, w->idx - c->throttle)))
+			return false;
+
+		/* Batches keep their out fence until resubmitted. */
+		if (!is_xe && w->emit_fence > 0) {
+			close(w->emit_fence);
+			w->emit_fence = -1;
+		}
+
+		submit_step(wrk, w);
+		c->stage = 1;
+
+		if (!wrk->run)
+			return true;
+	}
+
+	if (w->sync && !exec_wait(c, w))
+		return false;
+
+	if (c->qd_throttle > 0) {
+		while (wrk->nrequest[engine] > c->qd_throttle) {
+			struct w_step *s;
+
+			s = igt_list_first_entry(&wrk->requests[engine],
+						 s, rq_link);
+			if (!exec_wait(c, s))
+				return false;
+
+			s->request = -1;
+			igt_list_del(&s->rq_link);
+			wrk->nrequest[engine]--;
+		}
+	}
+
+	return true;
+}
+
+/* Returns false if the client has to wait before completing the step. */
+static bool exec_step(struct exec_client *c, struct w_step *w)
+{
+	struct workload *wrk = c->wrk;
+
+	if (w->type == DELAY) {
+		if (c->stage++)
+			return true;
+
+		return exec_sleep(c, now_ns() + 1000ull * w->delay);
+	} else if (w->type == PERIOD) {
+		struct timespec now;
+		int elapsed, do_sleep;
+
+		if (c->stage)
+			return true;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		elapsed = elapsed_us(&c->repeat_start, &now);
+		do_sleep = w->period - elapsed;
+		c->time_tot += elapsed;
+		if (elapsed < c->time_min)
+			c->time_min = elapsed;
+		if (elapsed > c->time_max)
+			c->time_max = elapsed;
+		if (do_sleep < 0) {
+			c->missed++;
+			if (verbose > 2)
+				printf("%u: Dropped period @ %u/%u (%dus late)!\n",
+				       wrk->id, c->count, w->idx, do_sleep);
+			return true;
+		}
+
+		c->stage = 1;
+		return exec_sleep(c, c->repeat_start.tv_sec * NSEC_PER_SEC +
+				     c->repeat_start.tv_nsec +
+				     1000ull * w->period);
+	} else if (w->type == SYNC) {
+		unsigned int s_idx = w->idx + w->target;
+
+		igt_assert(s_idx >= 0 && s_idx < w->idx);
+		igt_assert(wrk->steps[s_idx].type == BATCH);
+		return exec_wait(c, &wrk->steps[s_idx]);
+	} else if (w->type == THROTTLE) {
+		c->throttle = w->throttle;
+		return true;
+	} else if (w->type == QD_THROTTLE) {
+		c->qd_throttle = w->throttle;
+		return true;
+	} else if (w->type != BATCH) {
+		do_step(wrk, w, &c->cur_seqno);
+		return true;
+	}
+
+	return exec_batch(c, w);
+}
+
+static void print_exec_stats(struct exec_client *c)
+{
+	struct workload *wrk = c->wrk;
+	struct timespec t_end;
+	double t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+	t = elapsed(&c->t_start, &t_end);
+
+	printf("%c%u: %.3fs elapsed (%d cycles, %.3f workloads/s).",
+	       wrk->background ? ' ' : '*', wrk->id,
+	       t, c->count, c->count / t);
+	if (c->time_tot)
+		printf(" Time avg/min/max=%lu/%lu/%luus; %u missed.",
+		       c->time_tot / c->count, c->time_min, c->time_max,
+		       c->missed);
+	if (c->jitter.n_values)
+		printf(" Jitter avg/p50/p99/max=%.1f/%.1f/%.1f/%.1fus.",
+		       igt_stats_get_mean(&c->jitter) / 1e3,
+		       igt_stats_get_quantile(&c->jitter, 0.5) / 1e3,
+		       igt_stats_get_quantile(&c->jitter, 0.99) / 1e3,
+		       igt_stats_get_max(&c->jitter) / 1e3);
+	putchar('\n');
+}
+
+static void exec_client_finish(struct exec_client *c)
+{
+	struct workload *wrk = c->wrk;
+	struct w_step *w;
+
+	for_each_w_step(w, wrk) {
+		if (!is_xe && w->type == BATCH && w->emit_fence > 0) {
+			close(w->emit_fence);
+			w->emit_fence = -1;
+		}
+	}
+
+	release_steps(wrk);
+
+	if (wrk->print_stats)
+		print_exec_stats(c);
+
+	/* Background clients run for as long as the master one does. */
+	if (c->ex->master == (int)wrk->id) {
+		for (unsigned int i = 0; i < c->ex->nr_all; i++)
+			c->ex->all[i]->run = false;
+	}
+
+	c->done = true;
+	c->ex->nr_active--;
+}
+
+static void exec_client_run(struct exec_client *c)
+{
+	struct workload *wrk = c->wrk;
+
+	while (!c->done) {
+		if (!c->active) {
+			if (!wrk->run ||
+			    (!wrk->background && c->count >= wrk->repeat)) {
+				/* Wait for the last request on each engine. */
+				for (; c->drain < NUM_ENGINES; c->drain++) {
+					struct w_step *w;
+
+					if (!wrk->nrequest[c->drain])
+						continue;
+
+					w = igt_list_last_entry(&wrk->requests[c->drain],
+								w, rq_link);
+					if (!exec_wait(c, w))
+						return;
+				}
+
+				exec_client_finish(c);
+				return;
+			}
+
+			c->cur_seqno = wrk->sync_seqno;
+			clock_gettime(CLOCK_MONOTONIC, &c->repeat_start);
+			c->active = true;
+			c->step = 0;
+			c->stage = 0;
+		}
+
+		if (c->step < wrk->nr_steps && wrk->run) {
+			if (!exec_step(c, &wrk->steps[c->step]))
+				return;
+
+			c->step++;
+			c->stage = 0;
+			continue;
+		}
+
+		end_iteration(wrk, c->cur_seqno, false);
+		c->active = false;
+		c->count++;
+	}
+}
+
+static void exec_wakeup(struct exec_client *c)
+{
+	uint64_t now = now_ns();
+
+	if (c->fence >= 0) {
+		uint64_t signaled;
+
+		/* Spurious, the fence is still busy. */
+		if (!sync_fence_status(c->fence))
+			return;
+
+		signaled = sync_fence_timestamp(c->fence);
+		epoll_ctl(c->ex->epoll, EPOLL_CTL_DEL, c->fence, NULL);
+		close(c->fence);
+		c->fence = -1;
+
+		if (signaled && now > signaled)
+			igt_stats_push(&c->jitter, now - signaled);
+	} else {
+		uint64_t expirations;
+
+		if (read(c->timer, &expirations, sizeof(expirations)) !=
+		    sizeof(expirations))
+			return;
+
+		if (now > c->deadline)
+			igt_stats_push(&c->jitter, now - c->deadline);
+	}
+
+	exec_client_run(c);
+}
+
+static void *run_executor(void *data)
+{
+	struct executor *ex = data;
+	struct epoll_event events[64];
+
+	for (unsigned int i = 0; i < ex->nr_clients; i++) {
+		struct exec_client *c = ex->clients[i];
+
+		clock_gettime(CLOCK_MONOTONIC, &c->t_start);
+		exec_client_run(c);
+	}
+
+	while (ex->nr_active) {
+		int n = epoll_wait(ex->epoll, events, ARRAY_SIZE(events), -1);
+
+		if (n < 0) {
+			igt_assert_eq(errno, EINTR);
+			continue;
+		}
+
+		for (int i = 0; i < n; i++)
+			exec_wakeup(events[i].data.ptr);
+	}
+
+	return NULL;
+}
+
+static void execute_workloads(struct workload **w, unsigned int clients,
+			      int master_workload, unsigned int threads)
+{
+	struct executor *ex = calloc(threads, sizeof(*ex));
+	struct exec_client *c = calloc(clients, sizeof(*c));
+	unsigned int i;
+	int ret;
+
+	igt_assert(ex && c);
+
+	for (i = 0; i < threads; i++) {
+		ex[i].epoll = epoll_create1(EPOLL_CLOEXEC);
+		igt_assert(ex[i].epoll >= 0);
+		ex[i].clients = calloc(clients / threads + 1,
+				       sizeof(*ex[i].clients));
+		igt_assert(ex[i].clients);
+		ex[i].all = w;
+		ex[i].nr_all = clients;
+		ex[i].master = master_workload;
+	}
+
+	for (i = 0; i < clients; i++) {
+		struct executor *e = &ex[i % threads];
+		struct w_step *s;
+
+		/* Every batch needs an out fence to be waited upon. */
+		if (!is_xe) {
+			for_each_w_step(s, w[i]) {
+				if (s->type == BATCH)
+					s->emit_fence = -1;
+			}
+		}
+
+		c[i].wrk = w[i];
+		c[i].ex = e;
+		c[i].fence = -1;
+		c[i].throttle = -1;
+		c[i].qd_throttle = -1;
+		c[i].time_min = ULONG_MAX;
+		igt_stats_init_with_mode(&c[i].jitter, IGT_STATS_HISTOGRAM);
+
+		c[i].timer = timerfd_create(CLOCK_MONOTONIC,
+					    TFD_CLOEXEC | TFD_NONBLOCK);
+		igt_assert(c[i].timer >= 0);
+		exec_watch(&c[i], c[i].timer);
+
+		e->clients[e->nr_clients++] = &c[i];
+		e->nr_active++;
+	}
+
+	for (i = 0; i < threads; i++) {
+		ret = pthread_create(&ex[i].thread, NULL, run_executor, &ex[i]);
+		igt_assert_eq(ret, 0);
+	}
+
+	for (i = 0; i < threads; i++) {
+		ret = pthread_join(ex[i].thread, NULL);
+		igt_assert_eq(ret, 0);
+		close(ex[i].epoll);
+		free(ex[i].clients);
+	}
+
+	for (i = 0; i < clients; i++) {
+		close(c[i].timer);
+		igt_stats_fini(&c[i].jitter);
+	}
+
+	free(c);
+	free(ex);
+}
+
+static void fini_workload(struct workload *wrk)
+{
+	free(wrk->steps);
+	free(wrk);
+}
+
+/*
+ * Simulation backend
+ *
+ * Instead of submitting to the GPU, --simulate executes the parsed workloads
+ * on a model of the engines in virtual time. Every client walks its steps
+ * exactly like run_workload() does, but blocks on modelled requests and
+ * sleeps by advancing a virtual clock, driven by a single event queue.
+ *
+ * Requests execute in order on their context timeline, after their data and
+ * fence dependencies, and are picked by the engines in priority order. Load
+ * balanced contexts run on the first sibling to become idle and unmapped VCS
+ * submissions ping-pong between the video engines per client, as i915 does.
+ * Execution is not preemptive and engine bonds are not modelled.
+ */
+
+struct sim_buffer {
+	struct sim_request *write;
+	struct sim_request *read;
+};
+
+struct sim_waiter {
+	struct sim_request *rq;
+	bool submit;
+};
+
+struct sim_frame {
+	struct sim_client *client;
+	uint64_t start, end;
+	unsigned int pending;
+	bool closed;
+};
+
+struct sim_request {
+	unsigned int refcount;
+	struct sim_client *client;
+	struct w_step *w;
+	struct sim_frame *frame;
+	struct igt_list_head link;
+
+	unsigned int engines; /* mask of modelled engines, 0 for sw fences */
+	int engine;
+	int priority;
+	uint64_t duration;
+	bool unbound;
+	uint64_t start;
+
+	unsigned int pending;
+	bool started, completed;
+
+	unsigned int nr_waiters;
+	struct sim_waiter *waiters;
+};
+
+struct sim_client {
+	struct workload *wrk;
+	struct sim_request **timelines;
+	struct sim_request *wait;
+	bool wait_all;
+	unsigned int inflight;
+	enum intel_engine_id bsd_engine;
+
+	bool active, done;
+	unsigned int step, stage;
+	int throttle, qd_throttle;
+
+	unsigned int count, missed;
+	unsigned long time_tot, time_min, time_max;
+	uint64_t repeat_start, end;
+	struct sim_frame *frame;
+	igt_stats_t latency;
+};
+
+enum sim_event_type {
+	SIM_WAKE,
+	SIM_COMPLETE,
+};
+
+struct sim_event {
+	uint64_t time;
+	uint64_t seqno;
+	enum sim_event_type type;
+	void *ptr;
+};
+
+struct sim_engine {
+	struct sim_request *rq;
+	uint64_t busy;
+	unsigned long count;
+};
+
+struct sim {
+	uint64_t now;
+	uint64_t seqno;
+
+	struct sim_event *events;
+	unsigned int nr_events, max_events;
+
+	struct igt_list_head ready;
+	struct sim_engine engines[NUM_ENGINES];
+	unsigned int next_bsd;
+
+	struct sim_client *clients;
+	unsigned int nr_clients;
+	int master;
+};
+
+#define SIM_ENGINES ((1 << RCS) | (1 << BCS) | (1 << VCS1) | (1 << VCS2) | (1 << VECS))
+
+static bool sim_event_before(const struct sim_event *a,
+			     const struct sim_event *b)
+{
+	if (a->time != b->time)
+		return a->time < b->time;
+
+	return a->seqno < b->seqno;
+}
+
+static void
+sim_schedule(struct sim *sim, uint64_t time, enum sim_event_type type,
+	     void *ptr)
+{
+	struct sim_event ev = {
+		.time = time,
+		.seqno = sim->seqno++,
+		.type = type,
+		.ptr = ptr,
+	};
+	unsigned int i;
+
+	if (sim->nr_events == sim->max_events) {
+		sim->max_events = sim->max_events ? 2 * sim->max_events : 64;
+		sim->events = realloc(sim->events,
+				      sim->max_events * sizeof(*sim->events));
+		igt_assert(sim->events);
+	}
+
+	for (i = sim->nr_events++; i; i = (i - 1) / 2) {
+		struct sim_event *parent = &sim->events[(i - 1) / 2];
+
+		if (!sim_event_before(&ev, parent))
+			break;
+
+		sim->events[i] = *parent;
+	}
+	sim->events[i] = ev;
+}
+
+static struct sim_event sim_next_event(struct sim *sim)
+{
+	struct sim_event ev = sim->events[0];
+	struct sim_event last = sim->events[--sim->nr_events];
+	unsigned int i = 0;
+
+	for (;;) {
+		unsigned int child = 2 * i + 1;
+
+		if (child >= sim->nr_events)
+			break;
+
+		if (child + 1 < sim->nr_events &&
+		    sim_event_before(&sim->events[child + 1],
+				     &sim->events[child]))
+			child++;
+
+		if (!sim_event_before(&sim->events[child], &last))
+			break;
+
+		sim->events[i] = sim->events[child];
+		i = child;
+	}
+	sim->events[i] = last;
+
+	return ev;
+}
+
+static struct sim_request *sim_request_get(struct sim_request *rq)
+{
+	if (rq)
+		rq->refcount++;
+
+	return rq;
+}
+
+static void sim_request_put(struct sim_request *rq)
+{
+	if (!rq || --rq->refcount)
+		return;
+
+	free(rq->waiters);
+	free(rq);
+}
+
+/* Replaces the request held in @slot, keeping the references balanced. */
+static void sim_request_set(struct sim_request **slot, struct sim_request *rq)
+{
+	sim_request_get(rq);
+	sim_request_put(*slot);
+	*slot = rq;
+}
+
+static struct sim_request *
+sim_request_create(struct sim_client *c, struct w_step *w)
+{
+	struct sim_request *rq = calloc(1, sizeof(*rq));
+
+	igt_assert(rq);
+	rq->refcount = 1;
+	rq->client = c;
+	rq->w = w;
+	rq->engine = -1;
+
+	return rq;
+}
+
+/* Makes @rq wait for @dep to start (@submit) or to complete. */
+static void
+sim_await(struct sim_request *rq, struct sim_request *dep, bool submit)
+{
+	if (!dep || dep->completed || (submit && dep->started))
+		return;
+
+	dep->waiters = realloc(dep->waiters,
+			       (dep->nr_waiters + 1) * sizeof(*dep->waiters));
+	igt_assert(dep->waiters);
+	dep->waiters[dep->nr_waiters++] = (struct sim_waiter) {
+		.rq = sim_request_get(rq),
+		.submit = submit,
+	};
+	rq->pending++;
+}
+
+static void sim_ready(struct sim *sim, struct sim_request *rq)
+{
+	struct sim_request *pos;
+
+	/* Highest priority first, in submission order within a priority. */
+	igt_list_for_each_entry_reverse(pos, &sim->ready, link) {
+		if (pos->priority >= rq->priority)
+			break;
+	}
+	igt_list_add(&sim_request_get(rq)->link, &pos->link);
+}
+
+static void
+sim_signal(struct sim *sim, struct sim_request *rq, bool complete)
+{
+	unsigned int i, j;
+
+	for (i = 0, j = 0; i < rq->nr_waiters; i++) {
+		struct sim_waiter *waiter = &rq->waiters[i];
+
+		if (!complete && !waiter->submit) {
+			rq->waiters[j++] = *waiter;
+			continue;
+		}
+
+		if (!--waiter->rq->pending)
+			sim_ready(sim, waiter->rq);
+		sim_request_put(waiter->rq);
+	}
+	rq->nr_waiters = j;
+}
+
+static void sim_wake(struct sim *sim, struct sim_client *c)
+{
+	sim_schedule(sim, sim->now, SIM_WAKE, c);
+}
+
+static void sim_frame_retire(struct sim_frame *frame)
+{
+	if (frame->pending || !frame->closed)
+		return;
+
+	if (frame->end > frame->start)
+		igt_stats_push(&frame->client->latency,
+			       frame->end - frame->start);
+	free(frame);
+}
+
+static void sim_complete(struct sim *sim, struct sim_request *rq)
+{
+	struct sim_client *c = rq->client;
+
+	if (rq->completed)
+		return;
+
+	if (rq->engine >= 0) {
+		struct sim_engine *engine = &sim->engines[rq->engine];
+
+		igt_assert(engine->rq == rq);
+		engine->busy += sim->now - rq->start;
+		engine->count++;
+		engine->rq = NULL;
+		sim_request_put(rq);
+	}
+
+	rq->started = true;
+	rq->completed = true;
+	sim_signal(sim, rq, true);
+
+	if (rq->frame) {
+		rq->frame->pending--;
+		rq->frame->end = max(rq->frame->end, sim->now);
+		sim_frame_retire(rq->frame);
+		rq->frame = NULL;
+	}
+
+	if (rq->w->type == BATCH)
+		c->inflight--;
+
+	if (c->wait == rq) {
+		c->wait = NULL;
+		sim_wake(sim, c);
+	} else if (c->wait_all && !c->inflight) {
+		c->wait_all = false;
+		sim_wake(sim, c);
+	}
+}
+
+static void sim_start(struct sim *sim, struct sim_request *rq, unsigned int e)
+{
+	rq->engine = e;
+	rq->start = sim->now;
+	rq->started = true;
+	sim->engines[e].rq = rq; /* transfers the ready queue reference */
+
+	sim_signal(sim, rq, false);
+
+	if (!rq->unbound)
+		sim_schedule(sim, sim->now + rq->duration, SIM_COMPLETE,
+			     sim_request_get(rq));
+}
+
+static void sim_dispatch(struct sim *sim)
+{
+	for (unsigned int e = 0; e < NUM_ENGINES; e++) {
+		struct sim_request *rq;
+
+		if (!(SIM_ENGINES & (1 << e)) || sim->engines[e].rq)
+			continue;
+
+		igt_list_for_each_entry(rq, &sim->ready, link) {
+			if (rq->engines & (1 << e)) {
+				igt_list_del(&rq->link);
+				sim_start(sim, rq, e);
+				break;
+			}
+		}
+	}
+}
+
+static unsigned int sim_engines(struct sim_client *c, const struct w_step *w)
+{
+	struct ctx *ctx = __get_ctx(c->wrk, w);
+	unsigned int i, mask = 0;
+
+	if (ctx->engine_map) {
+		for (i = 0; i < ctx->engine_map_count; i++) {
+			if (ctx->engine_map[i] == w->engine)
+				return 1 << w->engine;
+
+			mask |= 1 << ctx->engine_map[i];
+		}
+
+		igt_assert(ctx->load_balance);
+		return mask;
+	}
+
+	switch (w->engine) {
+	case DEFAULT:
+		return 1 << RCS;
+	case VCS:
+		return 1 << c->bsd_engine;
+	default:
+		return 1 << w->engine;
+	}
+}
+
+static struct sim_buffer *
+sim_buffer(struct workload *wrk, const struct dep_entry *dep)
+{
+	struct working_set *set;
+
+	igt_assert(dep->working_set <= wrk->max_working_set_id);
+	set = wrk->working_sets[dep->working_set];
+	igt_assert(dep->target < set->nr);
+
+	if (!set->sim) {
+		set->sim = calloc(set->nr, sizeof(*set->sim));
+		igt_assert(set->sim);
+	}
+
+	return &set->sim[dep->target];
+}
+
+static void sim_submit(struct sim *sim, struct sim_client *c, struct w_step *w)
+{
+	struct workload *wrk = c->wrk;
+	struct sim_request *rq = sim_request_create(c, w);
+	struct sim_request **timeline;
+	struct dep_entry *dep;
+
+	rq->engines = sim_engines(c, w);
+	rq->priority = __get_ctx(wrk, w)->priority;
+	rq->unbound = w->duration.unbound;
+	if (!rq->unbound)
+		rq->duration = 1000ull * get_duration(wrk, w);
+
+	/* Requests execute in order on their context timeline. */
+	timeline = &c->timelines[w->context * NUM_ENGINES + w->engine];
+	sim_await(rq, *timeline, false);
+	sim_request_set(timeline, rq);
+
+	for_each_dep(dep, w->data_deps) {
+		struct sim_buffer *buf;
+
+		if (dep->working_set == -1) {
+			if (dep->target < 0)
+				sim_await(rq, wrk->steps[w->idx + dep->target].sim.rq,
+					  false);
+			continue;
+		}
+
+		/* Implicit synchronisation on the working set objects. */
+		buf = sim_buffer(wrk, dep);
+		sim_await(rq, buf->write, false);
+		if (dep->write) {
+			sim_await(rq, buf->read, false);
+			sim_request_set(&buf->write, rq);
+			sim_request_set(&buf->read, NULL);
+		} else {
+			sim_request_set(&buf->read, rq);
+		}
+	}
+
+	for_each_dep(dep, w->fence_deps)
+		sim_await(rq, wrk->steps[w->idx + dep->target].sim.rq,
+			  w->fence_deps.submit_fence);
+
+	rq->frame = c->frame;
+	c->frame->pending++;
+	c->inflight++;
+
+	if (!rq->pending)
+		sim_ready(sim, rq);
+
+	sim_request_set(&w->sim.rq, rq);
+	sim_request_put(rq);
+}
+
+static bool sim_wait(struct sim_client *c, struct sim_request *rq)
+{
+	if (!rq || rq->completed)
+		return true;
+
+	c->wait = rq;
+	return false;
+}
+
+static bool sim_batch(struct sim *sim, struct sim_client *c, struct w_step *w)
+{
+	struct workload *wrk = c->wrk;
+	enum intel_engine_id engine = w->engine;
+
+	if (!c->stage) {
+		if (wrk->flags & FLAG_DEPSYNC) {
+			struct dep_entry *dep;
+
+			for_each_dep(dep, w->data_deps) {
+				if (dep->working_set == -1 && dep->target < 0 &&
+				    !sim_wait(c, wrk->steps[w->idx + dep->target].sim.rq))
+					return false;
+			}
+		}
+
+		if (c->throttle > 0 &&
+		    !sim_wait(c, sync_target(wrk, w->idx - c->throttle)->sim.rq))
+			return false;
+
+		sim_submit(sim, c, w);
+		c->stage = 1;
+
+		if (w->request != -1) {
+			igt_list_del(&w->rq_link);
+			wrk->nrequest[w->request]--;
+		}
+		w->request = engine;
+		igt_list_add_tail(&w->rq_link, &wrk->requests[engine]);
+		wrk->nrequest[engine]++;
+	}
+
+	if (w->sync && !sim_wait(c, w->sim.rq))
+		return false;
+
+	if (c->qd_throttle > 0) {
+		while (wrk->nrequest[engine] > c->qd_throttle) {
+			struct w_step *s;
+
+			s = igt_list_first_entry(&wrk->requests[engine],
+						 s, rq_link);
+			if (!sim_wait(c, s->sim.rq))
+				return false;
+
+			s->request = -1;
+			igt_list_del(&s->rq_link);
+			wrk->nrequest[engine]--;
+		}
+	}
+
+	return true;
+}
+
+static void sim_signal_fences(struct sim *sim, struct workload *wrk,
+			      unsigned int last)
+{
+	for (unsigned int i = 0; i <= last && i < wrk->nr_steps; i++) {
+		struct w_step *w = &wrk->steps[i];
+
+		if (w->type == SW_FENCE && w->sim.rq)
+			sim_complete(sim, w->sim.rq);
+	}
+}
+
+/* Returns false if the client has to wait before completing the step. */
+static bool sim_step(struct sim *sim, struct sim_client *c, struct w_step *w)
+{
+	struct workload *wrk = c->wrk;
+	struct sim_request *rq;
+	unsigned long elapsed;
+
+	switch (w->type) {
+	case BATCH:
+		return sim_batch(sim, c, w);
+	case DELAY:
+		if (c->stage++)
+			return true;
+
+		sim_schedule(sim, sim->now + 1000ull * w->delay, SIM_WAKE, c);
+		return false;
+	case PERIOD:
+		if (c->stage)
+			return true;
+
+		elapsed = (sim->now - c->repeat_start) / 1000;
+		c->time_tot += elapsed;
+		c->time_min = min(c->time_min, elapsed);
+		c->time_max = max(c->time_max, elapsed);
+		if (elapsed > w->period) {
+			c->missed++;
+			if (verbose > 2)
+				printf("%u: Dropped period @ %u/%u (%luus late)!\n",
+				       wrk->id, c->count, w->idx,
+				       elapsed - w->period);
+			return true;
+		}
+
+		c->stage = 1;
+		sim_schedule(sim, c->repeat_start + 1000ull * w->period,
+			     SIM_WAKE, c);
+		return false;
+	case SYNC:
+		return sim_wait(c, wrk->steps[w->idx + w->target].sim.rq);
+	case THROTTLE:
+		c->throttle = w->throttle;
+		return true;
+	case QD_THROTTLE:
+		c->qd_throttle = w->throttle;
+		return true;
+	case SW_FENCE:
+		rq = sim_request_create(c, w);
+		sim_request_set(&w->sim.rq, rq);
+		sim_request_put(rq);
+		return true;
+	case SW_FENCE_SIGNAL:
+		sim_signal_fences(sim, wrk, w->idx + w->target);
+		return true;
+	case CTX_PRIORITY:
+		wrk->ctx_list[w->context].priority = w->priority;
+		return true;
+	case TERMINATE:
+		rq = wrk->steps[w->idx + w->target].sim.rq;
+		if (rq && rq->unbound) {
+			rq->unbound = false;
+			if (rq->started && !rq->completed)
+				sim_schedule(sim, sim->now, SIM_COMPLETE,
+					     sim_request_get(rq));
+		}
+		return true;
+	default:
+		/* No action for these at execution time. */
+		return true;
+	}
+}
+
+static void sim_client_finish(struct sim *sim, struct sim_client *c)
+{
+	c->done = true;
+	c->end = sim->now;
+
+	if (sim->master == (int)c->wrk->id) {
+		for (unsigned int i = 0; i < sim->nr_clients; i++)
+			sim->clients[i].wrk->run = false;
+	}
+}
+
+static void sim_client_run(struct sim *sim, struct sim_client *c)
+{
+	struct workload *wrk = c->wrk;
+
+	while (!c->done) {
+		if (!c->active) {
+			if (!wrk->run ||
+			    (!wrk->background && c->count >= wrk->repeat)) {
+				if (c->inflight) {
+					c->wait_all = true;
+					return;
+				}
+
+				sim_client_finish(sim, c);
+				return;
+			}
+
+			c->frame = calloc(1, sizeof(*c->frame));
+			igt_assert(c->frame);
+			c->frame->client = c;
+			c->frame->start = sim->now;
+
+			c->repeat_start = sim->now;
+			c->active = true;
+			c->step = 0;
+			c->stage = 0;
+		}
+
+		if (c->step < wrk->nr_steps && wrk->run) {
+			if (!sim_step(sim, c, &wrk->steps[c->step]))
+				return;
+
+			c->step++;
+			c->stage = 0;
+			continue;
+		}
+
+		/* Signal fences left outstanding by this iteration. */
+		sim_signal_fences(sim, wrk, wrk->nr_steps);
+
+		c->frame->closed = true;
+		sim_frame_retire(c->frame);
+		c->frame = NULL;
+
+		c->active = false;
+		c->count++;
+	}
+}
+
+static int sim_prepare_workload(unsigned int id, struct workload *wrk)
+{
+	struct ctx *ctx;
+	struct w_step *w;
+
+	wrk->id = id;
+	wrk->bb_prng = (wrk->flags & FLAG_SYNCEDCLIENTS) ? master_prng : rand();
+	wrk->bo_prng = (wrk->flags & FLAG_SYNCEDCLIENTS) ? master_prng : rand();
+	wrk->run = true;
+
+	allocate_contexts(id, wrk);
+
+	__for_each_ctx(ctx, wrk, ctx_idx) {
+		ctx->priority = wrk->prio;
+
+		for_each_w_step(w, wrk) {
+			if (w->context != ctx_idx)
+				continue;
+
+			if (w->type == ENGINE_MAP) {
+				ctx->engine_map = w->engine_map;
+				ctx->engine_map_count = w->engine_map_count;
+			} else if (w->type == LOAD_BALANCE) {
+				if (!ctx->engine_map) {
+					wsim_err("Load balancing needs an engine map!\n");
+					return 1;
+				}
+				ctx->load_balance = w->load_balance;
+			}
+		}
+	}
+
+	for_each_w_step(w, wrk) {
+		bool mapped = false;
+
+		ctx = __get_ctx(wrk, w);
+		if (w->type != BATCH || !ctx->engine_map || ctx->load_balance)
+			continue;
+
+		for (unsigned int i = 0; i < ctx->engine_map_count; i++)
+			mapped |= ctx->engine_map[i] == w->engine;
+
+		if (!mapped) {
+			wsim_err("Engine %s is not in the context %u map!\n",
+				 ring_str_map[w->engine], w->context);
+			return 1;
+		}
+	}
+
+	prepare_working_sets(id, wrk);
+
+	return 0;
+}
+
+static void print_sim_stats(struct sim_client *c)
+{
+	struct workload *wrk = c->wrk;
+	double t = c->end / 1e9;
+
+	printf("%c%u: %.3fs simulated (%u cycles, %.3f workloads/s).",
+	       wrk->background ? ' ' : '*', wrk->id,
+	       t, c->count, t ? c->count / t : 0);
+	if (c->time_tot)
+		printf(" Time avg/min/max=%lu/%lu/%luus; %u missed.",
+		       c->time_tot / c->count, c->time_min, c->time_max,
+		       c->missed);
+	if (c->latency.n_values)
+		printf(" Frame latency avg/p50/p99/max=%.0f/%.0f/%.0f/%.0fus.",
+		       igt_stats_get_mean(&c->latency) / 1e3,
+		       igt_stats_get_quantile(&c->latency, 0.5) / 1e3,
+		       igt_stats_get_quantile(&c->latency, 0.99) / 1e3,
+		       igt_stats_get_max(&c->latency) / 1e3);
+	putchar('\n');
+}
+
+static int simulate_workloads(struct workload **w, unsigned int clients,
+			      int master_workload)
+{
+	struct timespec t_start, t_end;
+	struct sim sim = { .master = master_workload };
+	uint64_t total = 0;
+	unsigned int i, e;
+	int ret = 0;
+
+	IGT_INIT_LIST_HEAD(&sim.ready);
+
+	sim.nr_clients = clients;
+	sim.clients = calloc(clients, sizeof(*sim.clients));
+	igt_assert(sim.clients);
+
+	for (i = 0; i < clients; i++) {
+		struct sim_client *c = &sim.clients[i];
+
+		c->wrk = w[i];
+		c->timelines = calloc(w[i]->nr_ctxs * NUM_ENGINES,
+				      sizeof(*c->timelines));
+		igt_assert(c->timelines);
+		c->bsd_engine = sim.next_bsd++ & 1 ? VCS2 : VCS1;
+		c->time_min = ULONG_MAX;
+		igt_stats_init_with_mode(&c->latency, IGT_STATS_HISTOGRAM);
+
+		sim_wake(&sim, c);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+
+	while (sim.nr_events) {
+		struct sim_event ev = sim_next_event(&sim);
+
+		sim.now = ev.time;
+
+		switch (ev.type) {
+		case SIM_WAKE:
+			sim_client_run(&sim, ev.ptr);
+			break;
+		case SIM_COMPLETE:
+			sim_complete(&sim, ev.ptr);
+			sim_request_put(ev.ptr);
+			break;
+		}
+
+		sim_dispatch(&sim);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+
+	for (i = 0; i < clients; i++) {
+		struct sim_client *c = &sim.clients[i];
+
+		if (!c->done) {
+			wsim_err("%u: Simulation stalled at step %u!\n",
+				 c->wrk->id, c->step);
+			ret = 1;
+		}
+
+		total = max(total, c->end);
+		if (c->wrk->print_stats)
+			print_sim_stats(c);
+	}
+
+	if (verbose) {
+		printf("%.3fs simulated in %.3fs (%.3f workloads/s)\n",
+		       total / 1e9, elapsed(&t_start, &t_end),
+		       total ? clients * w[0]->repeat / (total / 1e9) : 0);
+
+		for (e = 0; e < NUM_ENGINES; e++) {
+			if (!(SIM_ENGINES & (1 << e)))
+				continue;
+
+			printf("%s: %.1f%% busy (%lu batches)\n",
+			       ring_str_map[e],
+			       total ? 100.0 * sim.engines[e].busy / total : 0,
+			       sim.engines[e].count);
+		}
+	}
+
+	for (i = 0; i < clients; i++) {
+		struct sim_client *c = &sim.clients[i];
+		struct workload *wrk = c->wrk;
+		struct w_step *s;
+
+		for (unsigned int j = 0; j < wrk->nr_ctxs * NUM_ENGINES; j++)
+			sim_request_put(c->timelines[j]);
+		free(c->timelines);
+
+		/* Shared working sets are released by their first user. */
+		for (int id = 0; id <= wrk->max_working_set_id; id++) {
+			struct working_set *set = wrk->working_sets[id];
+
+			if (!set || !set->sim)
+				continue;
+
+			for (unsigned int j = 0; j < set->nr; j++) {
+				sim_request_put(set->sim[j].write);
+				sim_request_put(set->sim[j].read);
+			}
+			free(set->sim);
+			set->sim = NULL;
+		}
+
+		for_each_w_step(s, wrk) {
+			if (s->type == BATCH || s->type == SW_FENCE)
+				sim_request_set(&s->sim.rq, NULL);
+		}
+
+		igt_stats_fini(&c->latency);
+	}
+	free(sim.clients);
+	free(sim.events);
+
+	return ret;
+}
+
+static void print_help(void)
+{
+	puts(
+"Usage: gem_wsim [OPTIONS]\n"
+"\n"
+"Runs a simulated workload on the GPU.\n"
+"Options:\n"
+"  -h                This text.\n"
+"  -q                Be quiet - do not output anything to stdout.\n"
+"  -I <n>            Initial randomness seed.\n"
+"  -p <n>            Context priority to use for the following workload on the\n"
+"                    command line.\n"
+"  -w <desc|path>    Filename or a workload descriptor.\n"
+"                    Can be given multiple times.\n"
+"  -W <desc|path>    Filename or a master workload descriptor.\n"
+"                    Only one master workload can be optinally specified in which\n"
+"                    case all other workloads become background ones and run as\n"
+"                    long as the master.\n"
+"  -a <desc|path>    Append a workload to all other workloads.\n"
+"  -o <path>         Compile the workload into a binary file, which can be given\n"
+"                    in place of the descriptor to -w, -W and -a, and exit.\n"
+"  -r <n>            How many times to emit the workload.\n"
+"  -c <n>            Fork N clients emitting the workload simultaneously.\n"
+"  -s                Turn on small SSEU config for the next workload on the\n"
+"                    command line. Subsequent -s switches it off.\n"
+"  -S                Synchronize the sequence of random batch durations between\n"
+"                    clients.\n"
+"  -d                Sync between data dependencies in userspace.\n"
+"  -f <scale>        Scale factor for batch durations.\n"
+"  -F <scale>        Scale factor for delays.\n"
+"  -L                List GPUs.\n"
+"  -D <gpu>          One of the GPUs from -L.\n"
+"  -t <n>            Drive all clients from n event driven threads instead of a\n"
+"                    thread per client. Reports wakeup jitter per client.\n"
+"  -n, --simulate    Execute the workloads on modelled engines in virtual time,\n"
+"                    without a GPU. Reports engine utilization and frame\n"
+"                    latency.\n"
+	);
+}
+
+static char *load_workload_descriptor(char *filename)
+{
+	struct stat sbuf;
+	char *buf;
+	int infd, ret, i;
+	ssize_t len;
+	bool in_comment = false;
+
+	ret = stat(filename, &sbuf);
+	if (ret || !S_ISREG(sbuf.st_mode))
+		return filename;
+
+	igt_assert(sbuf.st_size < 1024 * 1024); /* Just so. */
+	buf = malloc(sbuf.st_size);
+	igt_assert(buf);
+
+	infd = open(filename, O_RDONLY);
+	igt_assert(infd >= 0);
+	len = read(infd, buf, sbuf.st_size);
+	igt_assert(len == sbuf.st_size);
+	close(infd);
+
+	for (i = 0; i < len; i++) {
+		/*
+		 * Lines starting with '#' are skipped.
+		 * If command line step separator (',') is encountered after '#'
+		 * it is replaced with ';' to not break parsing.
+		 */
+		if (buf[i] == '#')
+			in_comment = true;
+		else if (buf[i] == '\n') {
+			buf[i] = ',';
+			in_comment = false;
+		} else if (in_comment && buf[i] == ',')
+			buf[i] = ';';
+	}
+
+	len--;
+	while (buf[len] == ',')
+		buf[len--] = 0;
+
+	return buf;
+}
+
+static struct w_arg *
+add_workload_arg(struct w_arg *w_args, unsigned int nr_args, char *w_arg,
+		 int prio, bool sseu)
+{
+	w_args = realloc(w_args, sizeof(*w_args) * nr_args);
+	igt_assert(w_args);
+	w_args[nr_args - 1] = (struct w_arg) { w_arg, NULL, prio, sseu };
+
+	return w_args;
+}
+
+int main(int argc, char **argv)
+{
+	struct igt_device_card card = { };
+	bool list_devices_arg = false;
+	unsigned int repeat = 1;
+	unsigned int clients = 1;
+	unsigned int threads = 0;
+	unsigned int flags = 0;
+	struct timespec t_start, t_end;
+	struct workload **w, **wrk = NULL;
+	struct workload *app_w = NULL;
+	unsigned int nr_w_args = 0;
+	int master_workload = -1;
+	char *append_workload_arg = NULL;
+	char *compile_arg = NULL;
+	struct w_arg *w_args = NULL;
+	int exitcode = EXIT_FAILURE;
+	char *device_arg = NULL;
+	double scale_time = 1.0f;
+	double scale_dur = 1.0f;
+	int prio = 0;
+	double t;
+	int i, c, ret;
+	char *drm_dev;
+	static const struct option long_options[] = {
+		{ "simulate", no_argument, NULL, 'n' },
+		{ }
+	};
+
+	master_prng = time(NULL);
+
+	while ((c = getopt_long(argc, argv, "LhqvsSdnc:r:t:w:W:a:o:p:I:f:F:D:",
+				long_options, NULL)) != -1) {
+		switch (c) {
+		case 'n':
+			simulate = true;
+			break;
+		case 'L':
+			list_devices_arg = true;
+			break;
+		case 'D':
+			device_arg = strdup(optarg);
+			break;
+		case 'W':
+			if (master_workload >= 0) {
+				wsim_err("Only one master workload can be given!\n");
+				goto err;
+			}
 			master_workload = nr_w_args;
 			/* Fall through */
 		case 'w':
@@ -3021,6 +4802,9 @@ int main(int argc, char **argv)
 			}
 			append_workload_arg = optarg;
 			break;
+		case 'o':
+			compile_arg = optarg;
+			break;
 		case 'c':
 			clients = strtol(optarg, NULL, 0);
 			break;
@@ -3028,6 +4812,9 @@ int main(int argc, char **argv)
 		case 'r':
 			repeat = strtol(optarg, NULL, 0);
 			break;
+		case 't':
+			threads = strtol(optarg, NULL, 0);
+			break;
 		case 'q':
 			verbose = 0;
 			break;
@@ -3060,6 +4847,9 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (simulate)
+		goto load;
+
 	igt_devices_scan(false);
 
 	if (list_devices_arg) {
@@ -3117,6 +4907,7 @@ int main(int argc, char **argv)
 	if (is_xe)
 		xe_device_get(fd);
 
+load:
 	if (!nr_w_args) {
 		wsim_err("No workload descriptor(s)!\n");
 		goto err;
@@ -3127,7 +4918,26 @@ int main(int argc, char **argv)
 		goto err;
 	}
 
-	if (append_workload_arg) {
+	if (compile_arg && nr_w_args > 1) {
+		wsim_err("Only one workload can be compiled!\n");
+		goto err;
+	}
+
+	if (compile_arg && (scale_dur != 1.0 || scale_time != 1.0)) {
+		wsim_err("Scale factors apply when running compiled workloads!\n");
+		goto err;
+	}
+
+	if (append_workload_arg &&
+	    is_compiled_workload(append_workload_arg)) {
+		struct w_arg arg = { append_workload_arg, NULL, 0 };
+
+		app_w = map_workload(&arg, flags, scale_dur, scale_time, NULL);
+		if (!app_w) {
+			wsim_err("Failed to map append workload!\n");
+			goto err;
+		}
+	} else if (append_workload_arg) {
 		append_workload_arg = load_workload_descriptor(append_workload_arg);
 		if (!append_workload_arg) {
 			wsim_err("Failed to load append workload descriptor!\n");
@@ -3135,7 +4945,7 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if (append_workload_arg) {
+	if (append_workload_arg && !app_w) {
 		struct w_arg arg = { NULL, append_workload_arg, 0 };
 
 		app_w = parse_workload(&arg, flags, scale_dur, scale_time,
@@ -3150,6 +4960,16 @@ int main(int argc, char **argv)
 	igt_assert(wrk);
 
 	for (i = 0; i < nr_w_args; i++) {
+		if (is_compiled_workload(w_args[i].filename)) {
+			wrk[i] = map_workload(&w_args[i], flags, scale_dur,
+					      scale_time, app_w);
+			if (!wrk[i]) {
+				wsim_err("Failed to map compiled workload %u!\n", i);
+				goto err;
+			}
+			continue;
+		}
+
 		w_args[i].desc = load_workload_descriptor(w_args[i].filename);
 
 		if (!w_args[i].desc) {
@@ -3165,6 +4985,12 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (compile_arg) {
+		if (compile_workload(wrk[0], compile_arg))
+			goto err;
+		goto out;
+	}
+
 	if (nr_w_args > 1)
 		clients = nr_w_args;
 
@@ -3191,14 +5017,30 @@ int main(int argc, char **argv)
 		w[i]->print_stats = verbose > 1 ||
 				    (verbose > 0 && master_workload == i);
 
-		if (prepare_workload(i, w[i])) {
+		if (simulate)
+			ret = sim_prepare_workload(i, w[i]);
+		else
+			ret = prepare_workload(i, w[i]);
+		if (ret) {
 			wsim_err("Failed to prepare workload %u!\n", i);
 			goto err;
 		}
 	}
 
+	if (simulate) {
+		if (simulate_workloads(w, clients, master_workload))
+			goto err;
+		goto fini;
+	}
+
 	clock_gettime(CLOCK_MONOTONIC, &t_start);
 
+	if (threads) {
+		execute_workloads(w, clients, master_workload,
+				  min(threads, clients));
+		goto done;
+	}
+
 	for (i = 0; i < clients; i++) {
 		ret = pthread_create(&w[i]->thread, NULL, run_workload, w[i]);
 		igt_assert_eq(ret, 0);
@@ -3219,6 +5061,7 @@ int main(int argc, char **argv)
 		}
 	}
 
+done:
 	clock_gettime(CLOCK_MONOTONIC, &t_end);
 
 	t = elapsed(&t_start, &t_end);
@@ -3226,6 +5069,7 @@ int main(int argc, char **argv)
 		printf("%.3fs elapsed (%.3f workloads/s)\n",
 		       t, clients * repeat / t);
 
+fini:
 	for (i = 0; i < clients; i++)
 		fini_workload(w[i]);
 	free(w);
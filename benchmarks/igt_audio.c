@@ -0,0 +1,155 @@
+/*
+ * Copyright © 2024 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "drmtest.h"
+#include "igt_audio.h"
+#include "igt_stats.h"
+
+/* Same signal as kms_chamelium_audio's frequencies test. */
+static const int test_frequencies[] = {
+	300, 600, 1200, 10000, 80000,
+};
+
+static const snd_pcm_format_t test_formats[] = {
+	SND_PCM_FORMAT_S16_LE,
+	SND_PCM_FORMAT_S24_LE,
+	SND_PCM_FORMAT_S32_LE,
+};
+
+static double elapsed(const struct timespec *start,
+		      const struct timespec *end)
+{
+	return 1e9*(end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec);
+}
+
+/* Returns the ns per sample to generate one second of audio. */
+static double run(struct audio_signal *signal, int channels, int rate,
+		  int period, snd_pcm_format_t format, bool fused)
+{
+	struct timespec start, end;
+	double *tmp = NULL;
+	void *buf;
+
+	buf = malloc(period * channels * sizeof(int32_t));
+	if (!fused)
+		tmp = malloc(period * channels * sizeof(double));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int n = 0; n < rate; n += period) {
+		if (fused) {
+			audio_signal_fill_to(signal, buf, period, format);
+		} else {
+			audio_signal_fill(signal, tmp, period);
+			audio_convert_to(buf, tmp, period * channels, format);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	free(tmp);
+	free(buf);
+
+	return elapsed(&start, &end) / ((double)rate * channels);
+}
+
+int main(int argc, char **argv)
+{
+	struct audio_signal *signal;
+	int channels = 8, rate = 48000, period = 1024;
+	int reps = 13;
+	int c;
+
+	while ((c = getopt(argc, argv, "c:s:p:r:")) != -1) {
+		switch (c) {
+		case 'c':
+			channels = atoi(optarg);
+			break;
+
+		case 's':
+			rate = atoi(optarg);
+			break;
+
+		case 'p':
+			period = atoi(optarg);
+			break;
+
+		case 'r':
+			reps = atoi(optarg);
+			if (reps < 1)
+				reps = 1;
+			break;
+
+		default:
+			fprintf(stderr, "Usage: %s [-c channels] [-s sampling rate] [-p period] [-r reps]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (channels < 1 || channels > 8 || rate < 1 || period < 1) {
+		fprintf(stderr, "Invalid parameters\n");
+		return 1;
+	}
+
+	signal = audio_signal_init(channels, rate);
+	for (int i = 0; i < ARRAY_SIZE(test_frequencies); i++)
+		for (int j = 0; j < channels; j++)
+			audio_signal_add_frequency(signal,
+						   test_frequencies[i] +
+						   j * 2 * rate / 2048, j);
+	audio_signal_synthesize(signal);
+
+	printf("%d channels at %d Hz, %d frames per fill\n",
+	       channels, rate, period);
+
+	for (int i = 0; i < ARRAY_SIZE(test_formats); i++) {
+		for (int fused = 0; fused <= 1; fused++) {
+			igt_stats_t stats;
+			double ns;
+
+			igt_stats_init_with_size(&stats, reps);
+			for (int n = 0; n < reps; n++)
+				igt_stats_push_float(&stats,
+						     run(signal, channels, rate,
+							 period, test_formats[i],
+							 fused));
+			ns = igt_stats_get_trimean(&stats);
+			igt_stats_fini(&stats);
+
+			printf("%s %s: %.2f ns/sample, %.0fx realtime\n",
+			       snd_pcm_format_name(test_formats[i]),
+			       fused ? "audio_signal_fill_to" :
+				       "audio_signal_fill + audio_convert_to",
+			       ns, 1e9 / (ns * rate * channels));
+		}
+	}
+
+	audio_signal_fini(signal);
+	return 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright © 2024 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "drmtest.h"
+#include "igt_edid.h"
+#include "igt_kms.h"
+#include "igt_stats.h"
+
+static double elapsed(const struct timespec *start,
+		      const struct timespec *end)
+{
+	return 1e9*(end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec);
+}
+
+/* What igt_kms_get_hdmi_audio_edid() used to do on every call. */
+static void compose_hdmi_audio_edid(void)
+{
+	struct edid_builder builder;
+	struct cea_sad sad = {0};
+	struct cea_speaker_alloc speaker_alloc = {
+		.speakers = CEA_SPEAKER_FRONT_LEFT_RIGHT_CENTER,
+	};
+	const struct cea_vsdb *vsdb;
+	size_t vsdb_size;
+
+	cea_sad_init_pcm(&sad, 2, CEA_SAD_SAMPLING_RATE_48KHZ,
+			 CEA_SAD_SAMPLE_SIZE_16);
+	vsdb = cea_vsdb_get_hdmi_default(&vsdb_size);
+
+	edid_builder_init(&builder, igt_kms_get_base_edid());
+	edid_builder_add_sad(&builder, &sad, 1);
+	edid_builder_add_vsdb(&builder, vsdb, vsdb_size);
+	edid_builder_add_speaker_alloc(&builder, &speaker_alloc);
+	edid_builder_set_cea_flags(&builder, EDID_CEA_BASIC_AUDIO);
+	edid_template_unref(edid_builder_finish(&builder));
+}
+
+static void get_custom_edids(void)
+{
+	for (int i = 0; i < IGT_CUSTOM_EDID_COUNT; i++)
+		igt_assert(igt_kms_get_custom_edid(i));
+}
+
+static void get_tiled_edids(void)
+{
+	igt_assert(igt_kms_get_tiled_edid(1, 0));
+}
+
+static const struct edid *parsed_edid;
+
+static void parse_edid(void)
+{
+	char mfg[3];
+
+	edid_get_mfg(parsed_edid, mfg);
+	igt_assert(edid_get_deep_color_from_vsdb(parsed_edid));
+}
+
+/* Returns the ns per call of fn over loops calls. */
+static double run(void (*fn)(void), int loops)
+{
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int n = 0; n < loops; n++)
+		fn();
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return elapsed(&start, &end) / loops;
+}
+
+int main(int argc, char **argv)
+{
+	static const struct {
+		const char *name;
+		void (*fn)(void);
+	} cases[] = {
+		{ "compose hdmi audio EDID", compose_hdmi_audio_edid },
+		{ "get all custom EDIDs", get_custom_edids },
+		{ "get tiled EDIDs", get_tiled_edids },
+		{ "parse hdmi audio EDID", parse_edid },
+	};
+	int loops = 100000, reps = 13;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:r:")) != -1) {
+		switch (c) {
+		case 'n':
+			loops = atoi(optarg);
+			break;
+
+		case 'r':
+			reps = atoi(optarg);
+			if (reps < 1)
+				reps = 1;
+			break;
+
+		default:
+			fprintf(stderr, "Usage: %s [-n loops] [-r reps]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (loops < 1) {
+		fprintf(stderr, "Invalid parameters\n");
+		return 1;
+	}
+
+	parsed_edid = igt_kms_get_hdmi_audio_edid();
+
+	for (int i = 0; i < ARRAY_SIZE(cases); i++) {
+		igt_stats_t stats;
+
+		igt_stats_init_with_size(&stats, reps);
+		for (int n = 0; n < reps; n++)
+			igt_stats_push_float(&stats, run(cases[i].fn, loops));
+
+		printf("%s: %.1f ns/call\n", cases[i].name,
+		       igt_stats_get_trimean(&stats));
+		igt_stats_fini(&stats);
+	}
+
+	return 0;
+}
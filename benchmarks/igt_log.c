@@ -0,0 +1,144 @@
+/*
+ * Copyright © 2024 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_stats.h"
+
+#define LOOPS 100000
+
+struct thread {
+	pthread_t thread;
+	bool filtered;
+	double ns;
+};
+
+static double elapsed(const struct timespec *start,
+		      const struct timespec *end)
+{
+	return 1e9*(end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec);
+}
+
+static void *log_thread(void *data)
+{
+	struct thread *t = data;
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (t->filtered) {
+		for (int n = 0; n < LOOPS; n++)
+			igt_debug("filtered message %d: %s\n", n, "payload");
+	} else {
+		for (int n = 0; n < LOOPS; n++)
+			igt_info("unfiltered message %d: %s\n", n, "payload");
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	t->ns = elapsed(&start, &end) / LOOPS;
+	return NULL;
+}
+
+/* Returns the mean ns per call over all threads. */
+static double run(bool filtered, int nthreads)
+{
+	struct thread *threads = calloc(nthreads, sizeof(*threads));
+	double ns = 0;
+
+	for (int n = 0; n < nthreads; n++) {
+		threads[n].filtered = filtered;
+		pthread_create(&threads[n].thread, NULL, log_thread, &threads[n]);
+	}
+
+	for (int n = 0; n < nthreads; n++) {
+		pthread_join(threads[n].thread, NULL);
+		ns += threads[n].ns;
+	}
+
+	free(threads);
+	return ns / nthreads;
+}
+
+int main(int argc, char **argv)
+{
+	int reps = 13;
+	int nthreads = 1;
+	FILE *out;
+	int c, fd;
+
+	while ((c = getopt(argc, argv, "r:t:")) != -1) {
+		switch (c) {
+		case 'r':
+			reps = atoi(optarg);
+			if (reps < 1)
+				reps = 1;
+			break;
+
+		case 't':
+			nthreads = atoi(optarg);
+			if (nthreads < 1)
+				nthreads = 1;
+			break;
+
+		default:
+			fprintf(stderr, "Usage: %s [-r reps] [-t threads]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	/* Keep the results, but measure the cost of printing to /dev/null. */
+	out = fdopen(dup(STDOUT_FILENO), "w");
+	fd = open("/dev/null", O_WRONLY);
+	if (!out || fd < 0) {
+		perror("/dev/null");
+		return 1;
+	}
+	dup2(fd, STDOUT_FILENO);
+	close(fd);
+
+	igt_log_level = IGT_LOG_INFO;
+
+	for (int filtered = 1; filtered >= 0; filtered--) {
+		igt_stats_t stats;
+
+		igt_stats_init_with_size(&stats, reps);
+		for (int n = 0; n < reps; n++)
+			igt_stats_push_float(&stats, run(filtered, nthreads));
+
+		fprintf(out, "%s: %.1f ns/call\n",
+			filtered ? "filtered" : "unfiltered",
+			igt_stats_get_trimean(&stats));
+		igt_stats_fini(&stats);
+	}
+
+	fclose(out);
+	return 0;
+}
@@ -0,0 +1,386 @@
+/*
+ * Copyright © 2024 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Measures the CPU cost of the intel_bb object tracking: adding objects,
+ * emitting relocations to them, submitting, removing and resetting. The
+ * i915 device is mocked by interposing ioctl() on a /dev/null fd, so no
+ * GPU is needed and only the library overhead is measured.
+ *
+ * With -R the first batch is recorded and replayed in the following ones,
+ * the replay being accounted as adding objects. With -P batches are taken
+ * from the intel_bb pool instead of being recreated on each reset.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "drm.h"
+#include "i915_drm.h"
+#include "sync_file.h"
+
+#include "i915/gem_create.h"
+#include "igt_aux.h"
+#include "igt_core.h"
+#include "igt_rand.h"
+#include "intel_batchbuffer.h"
+#include "ioctl_wrappers.h"
+
+#define REMOVE 0x1
+#define PURGE 0x2
+#define REPLAY 0x4
+#define POOL 0x8
+
+static int mock_fd = -1;
+static int mock_fence = -1;
+
+static uint32_t *free_handles;
+static unsigned int num_free_handles, max_handles;
+static uint32_t next_handle = 1;
+
+static unsigned long mock_execbufs, mock_exec_objects, mock_creates;
+
+static uint32_t mock_create(void)
+{
+	mock_creates++;
+
+	if (num_free_handles)
+		return free_handles[--num_free_handles];
+
+	return next_handle++;
+}
+
+static void mock_close(uint32_t handle)
+{
+	/* Recycle handles like the kernel does */
+	if (num_free_handles == max_handles) {
+		max_handles = max_handles ? 2 * max_handles : 1024;
+		free_handles = realloc(free_handles,
+				       max_handles * sizeof(*free_handles));
+		igt_assert(free_handles);
+	}
+
+	free_handles[num_free_handles++] = handle;
+}
+
+static int mock_getparam(struct drm_i915_getparam *gp)
+{
+	switch (gp->param) {
+	case I915_PARAM_CHIPSET_ID:
+		*gp->value = 0x9a49; /* Tigerlake */
+		return 0;
+	case I915_PARAM_HAS_ALIASING_PPGTT:
+		*gp->value = 3; /* full 48b ppgtt */
+		return 0;
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+}
+
+static int mock_query(struct drm_i915_query *q)
+{
+	struct drm_i915_query_item *items = from_user_pointer(q->items_ptr);
+
+	/* Only system memory, see gem_get_query_memory_regions() */
+	for (uint32_t i = 0; i < q->num_items; i++)
+		items[i].length = items[i].query_id == DRM_I915_QUERY_MEMORY_REGIONS ?
+				  -ENODEV : -EINVAL;
+
+	return 0;
+}
+
+static int mock_execbuf(struct drm_i915_gem_execbuffer2 *eb)
+{
+	struct drm_i915_gem_exec_object2 *obj = from_user_pointer(eb->buffers_ptr);
+
+	if (!eb->buffer_count) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* Handle 0 is never valid, see gem_has_relocations() */
+	for (uint32_t i = 0; i < eb->buffer_count; i++) {
+		struct drm_i915_gem_relocation_entry *reloc =
+			from_user_pointer(obj[i].relocs_ptr);
+
+		for (uint32_t j = 0; j < obj[i].relocation_count; j++) {
+			if (!reloc[j].target_handle) {
+				errno = ENOENT;
+				return -1;
+			}
+		}
+	}
+
+	mock_execbufs++;
+	mock_exec_objects += eb->buffer_count;
+
+	if (eb->flags & I915_EXEC_FENCE_OUT) {
+		eb->rsvd2 &= 0xffffffff;
+		eb->rsvd2 |= (uint64_t)dup(mock_fence) << 32;
+	}
+
+	return 0;
+}
+
+static int mock_ioctl(unsigned long request, void *argp)
+{
+	switch (request) {
+	case DRM_IOCTL_VERSION: {
+		drm_version_t *v = argp;
+
+		if (v->name)
+			strncpy(v->name, "i915", v->name_len);
+		v->name_len = strlen("i915");
+		return 0;
+	}
+	case DRM_IOCTL_I915_GETPARAM:
+		return mock_getparam(argp);
+	case DRM_IOCTL_I915_GEM_CONTEXT_GETPARAM: {
+		struct drm_i915_gem_context_param *p = argp;
+
+		if (p->param != I915_CONTEXT_PARAM_GTT_SIZE)
+			break;
+
+		p->value = 1ull << 48;
+		return 0;
+	}
+	case DRM_IOCTL_I915_QUERY:
+		return mock_query(argp);
+	case DRM_IOCTL_I915_GEM_CREATE:
+		((struct drm_i915_gem_create *)argp)->handle = mock_create();
+		return 0;
+	case DRM_IOCTL_I915_GEM_CREATE_EXT:
+		((struct drm_i915_gem_create_ext *)argp)->handle = mock_create();
+		return 0;
+	case DRM_IOCTL_GEM_CLOSE:
+		mock_close(((struct drm_gem_close *)argp)->handle);
+		return 0;
+	case DRM_IOCTL_I915_GEM_PWRITE:
+	case DRM_IOCTL_I915_GEM_SET_DOMAIN:
+	case DRM_IOCTL_I915_GEM_WAIT:
+	case DRM_IOCTL_I915_GEM_BUSY:
+		return 0;
+	case DRM_IOCTL_I915_GEM_EXECBUFFER2:
+	case DRM_IOCTL_I915_GEM_EXECBUFFER2_WR:
+		return mock_execbuf(argp);
+	}
+
+	errno = EINVAL;
+	return -1;
+}
+
+int
+#ifdef __GLIBC__
+ioctl(int fd, unsigned long request, ...)
+#else
+ioctl(int fd, int request, ...)
+#endif
+{
+	va_list args;
+	void *argp;
+
+	va_start(args, request);
+	argp = va_arg(args, void *);
+	va_end(args);
+
+	if (fd == mock_fd && mock_fd >= 0)
+		return mock_ioctl(request, argp);
+
+	/* All mocked fences are signaled, merging them is a dup */
+	if (request == SYNC_IOC_MERGE) {
+		struct sync_merge_data *data = argp;
+
+		data->fence = dup(fd);
+		return data->fence < 0 ? -1 : 0;
+	}
+
+	return syscall(SYS_ioctl, fd, request, argp);
+}
+
+static double elapsed(const struct timespec *start,
+		      const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+enum { ADD, RELOC, EXEC, REMOVE_OBJ, RESET, NUM_PHASES };
+
+static const char *phase_names[NUM_PHASES] = {
+	[ADD] = "add",
+	[RELOC] = "reloc",
+	[EXEC] = "exec",
+	[REMOVE_OBJ] = "remove",
+	[RESET] = "reset",
+};
+
+static int loop(unsigned int num_objects, unsigned int num_handles,
+		unsigned int reps, unsigned int flags)
+{
+	double time[NUM_PHASES] = {};
+	struct timespec t[NUM_PHASES + 1];
+	struct intel_bb_recording *rec = NULL;
+	struct intel_bb *ibb;
+	uint32_t *handles, *batch;
+	uint32_t bb_size;
+
+	mock_fd = open("/dev/null", O_RDWR);
+	mock_fence = eventfd(1, EFD_CLOEXEC);
+	igt_assert(mock_fd >= 0 && mock_fence >= 0);
+
+	/* Each relocation takes a qword and the batch needs a bbe */
+	bb_size = ALIGN(8 * num_objects + 8, 4096);
+	if (flags & POOL)
+		intel_bb_pool_enable(mock_fd);
+	ibb = intel_bb_create_with_relocs(mock_fd, bb_size);
+
+	handles = malloc(num_handles * sizeof(*handles));
+	batch = malloc(num_objects * sizeof(*batch));
+	igt_assert(handles && batch);
+	for (unsigned int n = 0; n < num_handles; n++)
+		handles[n] = gem_create(mock_fd, 4096);
+
+	hars_petruska_f54_1_random_perturb(0);
+	for (unsigned int rep = 0; rep < reps; rep++) {
+		for (unsigned int n = 0; n < num_objects; n++)
+			batch[n] = handles[hars_petruska_f54_1_random_unsafe() %
+					   num_handles];
+
+		clock_gettime(CLOCK_MONOTONIC, &t[ADD]);
+		if (rec) {
+			intel_bb_replay(ibb, rec);
+			clock_gettime(CLOCK_MONOTONIC, &t[RELOC]);
+			goto exec;
+		}
+
+		if (flags & REPLAY)
+			intel_bb_record_begin(ibb);
+		for (unsigned int n = 0; n < num_objects; n++)
+			intel_bb_add_object(ibb, batch[n], 4096, 0, 0, n & 1);
+
+		clock_gettime(CLOCK_MONOTONIC, &t[RELOC]);
+		for (unsigned int n = 0; n < num_objects; n++)
+			intel_bb_emit_reloc(ibb, batch[n],
+					    I915_GEM_DOMAIN_RENDER,
+					    n & 1 ? I915_GEM_DOMAIN_RENDER : 0,
+					    0, 0);
+		intel_bb_emit_bbe(ibb);
+		if (flags & REPLAY)
+			rec = intel_bb_record_end(ibb);
+
+exec:
+
+		clock_gettime(CLOCK_MONOTONIC, &t[EXEC]);
+		intel_bb_exec(ibb, intel_bb_offset(ibb),
+			      I915_EXEC_DEFAULT | I915_EXEC_NO_RELOC, false);
+
+		clock_gettime(CLOCK_MONOTONIC, &t[REMOVE_OBJ]);
+		if (flags & REMOVE) {
+			for (unsigned int n = 0; n < num_objects; n += 2)
+				intel_bb_remove_object(ibb, batch[n], 0, 4096);
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &t[RESET]);
+		intel_bb_reset(ibb, flags & PURGE);
+
+		clock_gettime(CLOCK_MONOTONIC, &t[NUM_PHASES]);
+		for (int i = 0; i < NUM_PHASES; i++)
+			time[i] += elapsed(&t[i], &t[i + 1]);
+	}
+
+	intel_bb_sync(ibb);
+	intel_bb_destroy(ibb);
+	intel_bb_recording_destroy(rec);
+	if (flags & POOL)
+		intel_bb_pool_disable(mock_fd);
+
+	for (int i = 0; i < NUM_PHASES; i++)
+		printf("%s: %.3f us/batch, %.1f ns/object\n",
+		       phase_names[i], 1e6 * time[i] / reps,
+		       1e9 * time[i] / reps / num_objects);
+	printf("execbufs: %lu, objects/execbuf: %.1f, creates: %lu\n",
+	       mock_execbufs, (double)mock_exec_objects / mock_execbufs,
+	       mock_creates);
+
+	free(batch);
+	free(handles);
+	close(mock_fence);
+	close(mock_fd);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int num_objects = 256;
+	unsigned int num_handles = 1024;
+	unsigned int reps = 10000;
+	unsigned int flags = 0;
+	int c;
+
+	while ((c = getopt (argc, argv, "o:h:r:xpRP")) != -1) {
+		switch (c) {
+		case 'o':
+			num_objects = max(atoi(optarg), 1);
+			break;
+
+		case 'h':
+			num_handles = max(atoi(optarg), 1);
+			break;
+
+		case 'r':
+			reps = max(atoi(optarg), 1);
+			break;
+
+		case 'x':
+			flags |= REMOVE;
+			break;
+
+		case 'p':
+			flags |= PURGE;
+			break;
+
+		case 'R':
+			flags |= REPLAY;
+			break;
+
+		case 'P':
+			flags |= POOL;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	return loop(num_objects, num_handles, reps, flags);
+}
@@ -0,0 +1,52 @@
+#!/bin/sh
+#
+# Feed gem_exec_trace_stats a version 2 trace whose timestamps step
+# backwards between consecutive seqnos, as they may when two threads
+# race in the tracer. It must finish, not spin on the unsigned delta.
+
+BUILDDIR="${top_builddir-`pwd`}"
+TRACE="${BUILDDIR}/trace-stats-reorder.trace"
+
+# le <value> <bytes>: write value as little-endian binary
+le() {
+	v=$1
+	n=$2
+	while [ $n -gt 0 ]; do
+		printf "\\$(printf %03o $((v & 255)))"
+		v=$((v >> 8))
+		n=$((n - 1))
+	done
+}
+
+# record <cmd> <length> <seqno> <timestamp>
+record() {
+	le $1 1
+	le $2 4
+	le $3 8
+	le $4 8
+}
+
+# An execbuf on context 0 with no objects
+exec_empty() {
+	record 4 16 $1 $2
+	le 0 4
+	le 0 8
+	le 0 4
+}
+
+{
+	le 0xdeadbeef 4
+	le 2 4
+	exec_empty 1 2000000000
+	exec_empty 2 1000000000
+	exec_empty 3 2500000000
+} > "$TRACE"
+
+timeout 10 "${BUILDDIR}/gem_exec_trace_stats" -i 100 "$TRACE" > /dev/null
+ret=$?
+rm -f "$TRACE"
+
+if [ $ret -ne 0 ]; then
+	echo "gem_exec_trace_stats failed on an out-of-order trace ($ret)"
+	exit 1
+fi
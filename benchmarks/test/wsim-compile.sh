@@ -0,0 +1,37 @@
+#!/bin/sh
+#
+# Compile each of the example workloads and check that simulating the
+# compiled file, with scale factors, reports the same as simulating the
+# descriptor, so the durations and delays are scaled exactly once.
+
+SRCDIR="${srcdir-`pwd`}"
+BUILDDIR="${top_builddir-`pwd`}"
+WSIM="${BUILDDIR}/gem_wsim"
+BIN="${BUILDDIR}/wsim-compile.bin"
+
+# Only the wall clock time of the simulation differs between runs.
+simulate() {
+	"$WSIM" -n -v -v -I 1 -f 2 -F 2 -w "$1" 2>&1 |
+		sed -e 's/ simulated in [0-9.]*s / simulated /'
+}
+
+ret=0
+for wsim in "${SRCDIR}"/wsim/*.wsim; do
+	if ! "$WSIM" -n -w "$wsim" -o "$BIN" > /dev/null 2>&1; then
+		echo "$(basename "$wsim"): does not compile"
+		ret=1
+		continue
+	fi
+
+	parsed=$(simulate "$wsim")
+	mapped=$(simulate "$BIN")
+	if [ "$parsed" != "$mapped" ]; then
+		echo "$(basename "$wsim"): compiled workload differs from its descriptor"
+		echo "$parsed"
+		echo "$mapped"
+		ret=1
+	fi
+done
+
+rm -f "$BIN"
+exit $ret
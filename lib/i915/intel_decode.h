@@ -38,5 +38,7 @@ void intel_decode_set_head_tail(struct intel_decode *ctx,
 				uint32_t head, uint32_t tail);
 void intel_decode_set_output_file(struct intel_decode *ctx, FILE *output);
 void intel_decode(struct intel_decode *ctx);
+int intel_decode_find(struct intel_decode *ctx, uint32_t mask, uint32_t value,
+		      uint32_t *offsets, int max_offsets);
 
 #endif /* INTEL_DECODE_H */
@@ -0,0 +1,822 @@
+/*
+ * Copyright © 2024 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "igt_x86.h"
+#include "intel_error_state.h"
+
+/**
+ * SECTION:intel_error_state
+ * @short_description: Indexed reader of i915 GPU error states
+ * @title: Error state
+ * @include: i915/intel_error_state.h
+ *
+ * This library maps a GPU error state as dumped by the kernel and indexes it
+ * in a single pass: the PCI ID, the registers of each engine section and the
+ * location and encoding of every buffer object. Buffer contents are only
+ * decoded when requested with intel_error_state_decode_bo(), so that looking
+ * up a single buffer in a large dump does not require parsing all of it.
+ */
+
+static int zlib_inflate(uint32_t **ptr, int len)
+{
+	struct z_stream_s zstream;
+	size_t size;
+	void *out;
+
+	memset(&zstream, 0, sizeof(zstream));
+
+	zstream.next_in = (unsigned char *)*ptr;
+	zstream.avail_in = 4*len;
+
+	if (inflateInit(&zstream) != Z_OK)
+		return 0;
+
+	/* Start from a typical compression ratio of 16x the compressed
+	 * bytes (len is in dwords), trimmed once done.
+	 */
+	size = (size_t)16 * zstream.avail_in;
+	if (size < 4096)
+		size = 4096;
+	out = malloc(size);
+	if (out == NULL) {
+		inflateEnd(&zstream);
+		return 0;
+	}
+	zstream.next_out = out;
+	zstream.avail_out = size;
+
+	do {
+		switch (inflate(&zstream, Z_SYNC_FLUSH)) {
+		case Z_STREAM_END:
+			goto end;
+		case Z_OK:
+			break;
+		default:
+			inflateEnd(&zstream);
+			free(out);
+			return 0;
+		}
+
+		if (zstream.avail_out)
+			break;
+
+		size *= 2;
+		out = realloc(out, size);
+		if (out == NULL) {
+			inflateEnd(&zstream);
+			return 0;
+		}
+
+		zstream.next_out = (unsigned char *)out + zstream.total_out;
+		zstream.avail_out = size - zstream.total_out;
+	} while (1);
+end:
+	inflateEnd(&zstream);
+	free(*ptr);
+	*ptr = realloc(out, zstream.total_out ?: 4) ?: out;
+	return zstream.total_out / 4;
+}
+
+static inline bool is_ascii85(char c)
+{
+	return c >= '!' && c <= 'z';
+}
+
+/*
+ * Returns the length of the run of ascii85 characters at the start of
+ * in[0..len) and an upper bound of the number of words it decodes to, which
+ * is exact unless a 'z' appears in the middle of a group.
+ */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+static size_t ascii85_scan(const char *in, size_t len, size_t *words)
+{
+	const __m128i lo = _mm_set1_epi8('!'), hi = _mm_set1_epi8('z');
+	size_t i = 0, zeros = 0;
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i c = _mm_loadu_si128((const __m128i *)(in + i));
+		unsigned int invalid, z;
+
+		invalid = _mm_movemask_epi8(_mm_or_si128(_mm_cmplt_epi8(c, lo),
+							 _mm_cmpgt_epi8(c, hi)));
+		z = _mm_movemask_epi8(_mm_cmpeq_epi8(c, hi));
+		if (invalid) {
+			unsigned int n = __builtin_ctz(invalid);
+
+			zeros += __builtin_popcount(z & ((1u << n) - 1));
+			i += n;
+			goto out;
+		}
+
+		zeros += __builtin_popcount(z);
+	}
+
+	for (; i < len && is_ascii85(in[i]); i++)
+		zeros += in[i] == 'z';
+
+out:
+	*words = zeros + (i - zeros) / 5;
+	return i;
+}
+#else
+static size_t ascii85_scan(const char *in, size_t len, size_t *words)
+{
+	size_t i = 0, zeros = 0;
+
+	for (; i < len && is_ascii85(in[i]); i++)
+		zeros += in[i] == 'z';
+
+	*words = zeros + (i - zeros) / 5;
+	return i;
+}
+#endif
+
+static inline uint32_t ascii85_group(const char *in)
+{
+	uint32_t v = 0;
+
+	v += in[0] - 33; v *= 85;
+	v += in[1] - 33; v *= 85;
+	v += in[2] - 33; v *= 85;
+	v += in[3] - 33; v *= 85;
+	v += in[4] - 33;
+
+	return v;
+}
+
+/* Decodes one word, returns the number of characters consumed or 0. */
+static inline size_t ascii85_word(const char *in, size_t len, uint32_t *out)
+{
+	if (*in == 'z') {
+		*out = 0;
+		return 1;
+	}
+
+	if (len < 5)
+		return 0;
+
+	*out = ascii85_group(in);
+	return 5;
+}
+
+static size_t ascii85_decode_run_scalar(const char *in, size_t len, uint32_t *out)
+{
+	size_t count = 0, n;
+
+	while (len && (n = ascii85_word(in, len, &out[count]))) {
+		count++;
+		in += n;
+		len -= n;
+	}
+
+	return count;
+}
+
+#if defined(__x86_64__) && !defined(__clang__) && defined(__GLIBC__) && !defined(__UCLIBC__)
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+
+#include <smmintrin.h>
+
+#define A85_LO(b) ((b) < 16 ? (b) : -128), -128, -128, -128
+#define A85_HI(b) ((b) >= 16 ? (b) - 16 : -128), -128, -128, -128
+#define A85_SHUFFLE(X, k) \
+	_mm_setr_epi8(X(k), X(5 + (k)), X(10 + (k)), X(15 + (k)))
+
+/*
+ * Decodes four groups (20 characters) at a time, one group per 32bit lane:
+ * character k of each group is gathered from the two 16 byte halves and the
+ * group is evaluated with Horner's scheme modulo 2^32, as the scalar code.
+ */
+static size_t ascii85_decode_run_sse41(const char *in, size_t len, uint32_t *out)
+{
+	const __m128i z = _mm_set1_epi8('z');
+	const __m128i bias = _mm_set1_epi32(33);
+	const __m128i radix = _mm_set1_epi32(85);
+	const __m128i lo_idx[5] = {
+		A85_SHUFFLE(A85_LO, 0), A85_SHUFFLE(A85_LO, 1),
+		A85_SHUFFLE(A85_LO, 2), A85_SHUFFLE(A85_LO, 3),
+		A85_SHUFFLE(A85_LO, 4),
+	};
+	const __m128i hi_idx[5] = {
+		A85_SHUFFLE(A85_HI, 0), A85_SHUFFLE(A85_HI, 1),
+		A85_SHUFFLE(A85_HI, 2), A85_SHUFFLE(A85_HI, 3),
+		A85_SHUFFLE(A85_HI, 4),
+	};
+	size_t count = 0, n;
+
+	while (len >= 32) {
+		__m128i lo = _mm_loadu_si128((const __m128i *)in);
+		__m128i hi = _mm_loadu_si128((const __m128i *)(in + 16));
+		unsigned int zmask;
+		__m128i v;
+
+		zmask = _mm_movemask_epi8(_mm_cmpeq_epi8(lo, z)) |
+			(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(hi, z)) << 16;
+		if (zmask & 0xfffff) {
+			n = ascii85_word(in, len, &out[count++]);
+			in += n;
+			len -= n;
+			continue;
+		}
+
+		v = _mm_setzero_si128();
+		for (int k = 0; k < 5; k++) {
+			__m128i c = _mm_or_si128(_mm_shuffle_epi8(lo, lo_idx[k]),
+						 _mm_shuffle_epi8(hi, hi_idx[k]));
+
+			v = _mm_add_epi32(_mm_mullo_epi32(v, radix),
+					  _mm_sub_epi32(c, bias));
+		}
+
+		_mm_storeu_si128((__m128i *)&out[count], v);
+		count += 4;
+		in += 20;
+		len -= 20;
+	}
+
+	return count + ascii85_decode_run_scalar(in, len, out + count);
+}
+
+#pragma GCC pop_options
+
+/* The PLT is not initialized when ifunc resolvers run, so all external
+ * functions must be inlined with __attribute__((flatten)).
+ */
+__attribute__((flatten))
+static size_t (*resolve_ascii85_decode_run(void))(const char *in, size_t len, uint32_t *out)
+{
+	if (igt_x86_features() & SSE4_1)
+		return ascii85_decode_run_sse41;
+
+	return ascii85_decode_run_scalar;
+}
+
+static size_t ascii85_decode_run(const char *in, size_t len, uint32_t *out)
+	__attribute__((ifunc("resolve_ascii85_decode_run")));
+
+#else
+
+static size_t ascii85_decode_run(const char *in, size_t len, uint32_t *out)
+{
+	return ascii85_decode_run_scalar(in, len, out);
+}
+
+#endif
+
+/**
+ * intel_error_state_decode_ascii85:
+ * @in: ascii85 text, without the leading ':' or '~'
+ * @len: length of @in, decoding stops at the first non ascii85 character
+ * @inflate: whether the decoded data is zlib compressed (':' lines)
+ * @out: returns the decoded dwords
+ *
+ * Decodes a buffer object as encoded in the error state by the kernel.
+ * @out is allocated with malloc() and must be freed by the caller, even
+ * when decoding fails.
+ *
+ * Returns: the number of dwords decoded, 0 on failure.
+ */
+int intel_error_state_decode_ascii85(const char *in, size_t len, bool inflate,
+				     uint32_t **out)
+{
+	size_t words, count;
+
+	len = ascii85_scan(in, len, &words);
+
+	/* Allocated once at the exact size for well formed data. */
+	*out = malloc(sizeof(uint32_t) * (words ?: 1));
+	if (*out == NULL)
+		return 0;
+
+	count = ascii85_decode_run(in, len, *out);
+
+	if (!inflate)
+		return count;
+
+	return zlib_inflate(out, count);
+}
+
+static int hex_digit(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/* Parses up to @max hex digits, '_' separators are skipped. */
+static const char *
+parse_hex(const char *s, const char *end, int max, uint64_t *value)
+{
+	uint64_t v = 0;
+	int n = 0;
+
+	for (; s < end && n < max; s++) {
+		int d = hex_digit(*s);
+
+		if (d < 0) {
+			if (*s == '_' && n)
+				continue;
+			break;
+		}
+
+		v = v << 4 | d;
+		n++;
+	}
+
+	*value = v;
+	return n ? s : NULL;
+}
+
+/* Buffers dumped by older kernels, one "%08x : %08x" line per dword. */
+static bool
+parse_hex_line(const char *line, const char *eol, uint32_t *value)
+{
+	uint64_t offset, v;
+
+	if (eol - line < 19 || line[8] != ' ' || line[9] != ':' || line[10] != ' ')
+		return false;
+
+	if (parse_hex(line, line + 8, 8, &offset) != line + 8 ||
+	    parse_hex(line + 11, line + 19, 8, &v) != line + 19)
+		return false;
+
+	*value = v;
+	return true;
+}
+
+static bool
+has_suffix(const char *line, const char *eol, const char *suffix)
+{
+	size_t len = strlen(suffix);
+
+	return eol - line >= len && !memcmp(eol - len, suffix, len);
+}
+
+static const char *
+find(const char *line, const char *eol, const char *needle)
+{
+	return memmem(line, eol - line, needle, strlen(needle));
+}
+
+static void *grow(void *array, unsigned int count, size_t size)
+{
+	/* Arrays are grown whenever their count reaches a power of two. */
+	if (count & (count - 1))
+		return array;
+
+	return realloc(array, (count ? 2 * count : 1) * size);
+}
+
+static int add_register(struct intel_error_state *es,
+			const char *name, size_t len, uint64_t value)
+{
+	struct intel_error_state_register *reg;
+
+	reg = grow(es->registers, es->num_registers, sizeof(*reg));
+	if (!reg)
+		return -ENOMEM;
+	es->registers = reg;
+
+	reg += es->num_registers;
+	reg->name = strndup(name, len);
+	reg->value = value;
+	if (!reg->name)
+		return -ENOMEM;
+
+	es->num_registers++;
+	return 0;
+}
+
+/* "<engine> command stream:" */
+static int
+index_engine(struct intel_error_state *es, const char *line, const char *eol)
+{
+	struct intel_error_state_engine *engine;
+
+	engine = grow(es->engines, es->num_engines, sizeof(*engine));
+	if (!engine)
+		return -ENOMEM;
+	es->engines = engine;
+
+	engine += es->num_engines;
+	engine->name = strndup(line, eol - line - strlen(" command stream:"));
+	engine->first_register = es->num_registers;
+	engine->num_registers = 0;
+	if (!engine->name)
+		return -ENOMEM;
+
+	es->num_engines++;
+	return 0;
+}
+
+/* "<engine> --- <name> = 0x%08x %08x" */
+static int
+index_bo(struct intel_error_state *es, const char *line, const char *eol,
+	 const char *dashes)
+{
+	struct intel_error_state_bo *bo;
+	const char *name = dashes + strlen(" --- ");
+	const char *equal = find(name, eol, " = 0x");
+	uint64_t hi = 0, lo = 0;
+	const char *s;
+
+	if (!equal)
+		return 0;
+
+	s = parse_hex(equal + strlen(" = 0x"), eol, 8, &hi);
+	if (s && s < eol && *s == ' ')
+		parse_hex(s + 1, eol, 8, &lo);
+
+	bo = grow(es->bos, es->num_bos, sizeof(*bo));
+	if (!bo)
+		return -ENOMEM;
+	es->bos = bo;
+
+	bo += es->num_bos;
+	memset(bo, 0, sizeof(*bo));
+	bo->engine = strndup(line, dashes - line);
+	bo->name = strndup(name, equal - name);
+	bo->gtt_offset = hi << 32 | lo;
+	bo->data_offset = eol - es->data;
+	if (!bo->engine || !bo->name) {
+		free(bo->engine);
+		free(bo->name);
+		return -ENOMEM;
+	}
+
+	es->num_bos++;
+	return 1;
+}
+
+/* "<name>: 0x<hex>", "<name>: 0x<hex>_<hex>", possibly indented. */
+static int
+index_register(struct intel_error_state *es, const char *line, const char *eol)
+{
+	const char *name, *colon;
+	uint64_t value;
+
+	for (name = line; name < eol && (*name == ' ' || *name == '\t'); name++)
+		;
+
+	colon = memchr(name, ':', eol - name);
+	if (!colon || colon == name)
+		return 0;
+
+	for (line = colon + 1; line < eol && *line == ' '; line++)
+		;
+	if (eol - line < 3 || line[0] != '0' || line[1] != 'x')
+		return 0;
+
+	if (!parse_hex(line + 2, eol, 16, &value))
+		return 0;
+
+	return add_register(es, name, colon - name, value);
+}
+
+static int index_error_state(struct intel_error_state *es)
+{
+	const char *pos = es->data, *end = es->data + es->size;
+	struct intel_error_state_bo *pending = NULL;
+	struct intel_error_state_engine *engine = NULL;
+	int ret = 0;
+
+	while (pos < end && ret >= 0) {
+		const char *line = pos;
+		const char *eol = memchr(line, '\n', end - line) ?: end;
+		const char *dashes;
+		uint32_t value;
+
+		pos = eol < end ? eol + 1 : end;
+
+		/* The contents of a buffer follow its header line. */
+		if (pending) {
+			if (line[0] == ':' || line[0] == '~') {
+				pending->encoding = line[0] == ':' ?
+					INTEL_ERROR_STATE_ASCII85_ZLIB :
+					INTEL_ERROR_STATE_ASCII85;
+				pending->data_offset = line + 1 - es->data;
+				pending->data_len = eol - line - 1;
+				pending = NULL;
+				continue;
+			}
+
+			if (parse_hex_line(line, eol, &value)) {
+				if (!pending->data_len)
+					pending->data_offset = line - es->data;
+				pending->encoding = INTEL_ERROR_STATE_HEX;
+				pending->data_len = eol - es->data - pending->data_offset;
+				continue;
+			}
+
+			pending = NULL;
+		}
+
+		if (line == eol || line[0] == ':' || line[0] == '~')
+			continue;
+
+		dashes = find(line, eol, " --- ");
+		if (dashes) {
+			engine = NULL;
+			ret = index_bo(es, line, eol, dashes);
+			if (ret > 0)
+				pending = &es->bos[es->num_bos - 1];
+			continue;
+		}
+
+		if (line[0] != ' ' && line[0] != '\t') {
+			engine = NULL;
+
+			if (has_suffix(line, eol, " command stream:")) {
+				ret = index_engine(es, line, eol);
+				if (ret == 0)
+					engine = &es->engines[es->num_engines - 1];
+				continue;
+			}
+		}
+
+		if (!es->devid) {
+			const char *pci_id = find(line, eol, "PCI ID: 0x");
+			uint64_t devid;
+
+			if (pci_id && parse_hex(pci_id + strlen("PCI ID: 0x"),
+						eol, 4, &devid))
+				es->devid = devid;
+		}
+
+		ret = index_register(es, line, eol);
+		if (engine)
+			engine->num_registers = es->num_registers - engine->first_register;
+		else if (es->num_registers > es->num_global_registers &&
+			 !es->num_engines)
+			es->num_global_registers = es->num_registers;
+	}
+
+	return ret < 0 ? ret : 0;
+}
+
+/**
+ * intel_error_state_open_fd:
+ * @fd: file descriptor of a saved error state
+ *
+ * Maps and indexes an error state, the file descriptor can be closed
+ * afterwards. Only regular files can be mapped, error states have to be
+ * copied out of sysfs first.
+ *
+ * Returns: the indexed error state or NULL on failure, with errno set.
+ */
+struct intel_error_state *intel_error_state_open_fd(int fd)
+{
+	struct intel_error_state *es;
+	struct stat st;
+	void *map;
+	int ret;
+
+	if (fstat(fd, &st))
+		return NULL;
+
+	if (!S_ISREG(st.st_mode) || !st.st_size) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	es = calloc(1, sizeof(*es));
+	if (!es) {
+		munmap(map, st.st_size);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	es->data = map;
+	es->size = st.st_size;
+
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	ret = index_error_state(es);
+	madvise(map, st.st_size, MADV_RANDOM);
+
+	if (ret) {
+		intel_error_state_close(es);
+		errno = -ret;
+		return NULL;
+	}
+
+	return es;
+}
+
+/**
+ * intel_error_state_open:
+ * @path: path of a saved error state
+ *
+ * Same as intel_error_state_open_fd() for the file at @path.
+ *
+ * Returns: the indexed error state or NULL on failure, with errno set.
+ */
+struct intel_error_state *intel_error_state_open(const char *path)
+{
+	struct intel_error_state *es;
+	int fd, err;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	es = intel_error_state_open_fd(fd);
+	err = errno;
+	close(fd);
+	errno = err;
+
+	return es;
+}
+
+/**
+ * intel_error_state_close:
+ * @es: an error state
+ *
+ * Unmaps @es and frees its index.
+ */
+void intel_error_state_close(struct intel_error_state *es)
+{
+	if (!es)
+		return;
+
+	for (unsigned int i = 0; i < es->num_bos; i++) {
+		free(es->bos[i].engine);
+		free(es->bos[i].name);
+	}
+	for (unsigned int i = 0; i < es->num_engines; i++)
+		free(es->engines[i].name);
+	for (unsigned int i = 0; i < es->num_registers; i++)
+		free(es->registers[i].name);
+
+	free(es->bos);
+	free(es->engines);
+	free(es->registers);
+	munmap((void *)es->data, es->size);
+	free(es);
+}
+
+/**
+ * intel_error_state_find_engine:
+ * @es: an error state
+ * @name: engine name, e.g. "rcs0"
+ *
+ * Returns: the first engine section of @es named @name, or NULL.
+ */
+const struct intel_error_state_engine *
+intel_error_state_find_engine(const struct intel_error_state *es,
+			      const char *name)
+{
+	for (unsigned int i = 0; i < es->num_engines; i++) {
+		if (!strcmp(es->engines[i].name, name))
+			return &es->engines[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * intel_error_state_read_register:
+ * @es: an error state
+ * @engine: engine section to look into, or NULL for the global registers
+ * @name: register name as printed in the error state, e.g. "ACTHD"
+ * @value: returns the register value
+ *
+ * Returns: true if the register was found.
+ */
+bool intel_error_state_read_register(const struct intel_error_state *es,
+				     const struct intel_error_state_engine *engine,
+				     const char *name, uint64_t *value)
+{
+	unsigned int first = engine ? engine->first_register : 0;
+	unsigned int count = engine ? engine->num_registers : es->num_global_registers;
+
+	for (unsigned int i = first; i < first + count; i++) {
+		if (!strcmp(es->registers[i].name, name)) {
+			*value = es->registers[i].value;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * intel_error_state_find_bo:
+ * @es: an error state
+ * @engine: owner of the buffer, e.g. "rcs0", or NULL to match any
+ * @name: buffer name, e.g. "batch", compared case insensitively
+ *
+ * Returns: the first buffer object of @es matching @engine and @name, or NULL.
+ */
+const struct intel_error_state_bo *
+intel_error_state_find_bo(const struct intel_error_state *es,
+			  const char *engine, const char *name)
+{
+	for (unsigned int i = 0; i < es->num_bos; i++) {
+		const struct intel_error_state_bo *bo = &es->bos[i];
+
+		if ((!engine || !strcmp(bo->engine, engine)) &&
+		    !strcasecmp(bo->name, name))
+			return bo;
+	}
+
+	return NULL;
+}
+
+static int decode_hex(const char *in, size_t len, uint32_t **out)
+{
+	const char *end = in + len;
+	size_t count = 0;
+
+	/* Lines are at least 20 bytes long including the newline. */
+	*out = malloc(sizeof(uint32_t) * (len / 20 + 1));
+	if (*out == NULL)
+		return 0;
+
+	while (in < end) {
+		const char *eol = memchr(in, '\n', end - in) ?: end;
+
+		if (!parse_hex_line(in, eol, &(*out)[count]))
+			break;
+
+		count++;
+		in = eol + 1;
+	}
+
+	return count;
+}
+
+/**
+ * intel_error_state_decode_bo:
+ * @es: an error state
+ * @bo: a buffer object of @es
+ * @data: returns the buffer contents
+ *
+ * Decodes the contents of @bo. @data is allocated with malloc() and must be
+ * freed by the caller, even when decoding fails.
+ *
+ * Returns: the number of dwords decoded, 0 for empty buffers or on failure.
+ */
+int intel_error_state_decode_bo(const struct intel_error_state *es,
+				const struct intel_error_state_bo *bo,
+				uint32_t **data)
+{
+	const char *in = es->data + bo->data_offset;
+
+	if (!bo->data_len) {
+		*data = NULL;
+		return 0;
+	}
+
+	switch (bo->encoding) {
+	case INTEL_ERROR_STATE_ASCII85:
+		return intel_error_state_decode_ascii85(in, bo->data_len, false, data);
+	case INTEL_ERROR_STATE_ASCII85_ZLIB:
+		return intel_error_state_decode_ascii85(in, bo->data_len, true, data);
+	case INTEL_ERROR_STATE_HEX:
+		return decode_hex(in, bo->data_len, data);
+	}
+
+	*data = NULL;
+	return 0;
+}
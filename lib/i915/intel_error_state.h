@@ -0,0 +1,100 @@
+/*
+ * Copyright © 2024 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef INTEL_ERROR_STATE_H
+#define INTEL_ERROR_STATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum intel_error_state_encoding {
+	INTEL_ERROR_STATE_ASCII85,	/* '~' line */
+	INTEL_ERROR_STATE_ASCII85_ZLIB,	/* ':' line */
+	INTEL_ERROR_STATE_HEX,		/* "%08x : %08x" lines */
+};
+
+struct intel_error_state_bo {
+	char *engine;	/* e.g. "rcs0" */
+	char *name;	/* e.g. "batch", "ring", "HW context" */
+	uint64_t gtt_offset;
+
+	/* Location of the encoded contents within the file. */
+	size_t data_offset;
+	size_t data_len;
+	enum intel_error_state_encoding encoding;
+};
+
+struct intel_error_state_register {
+	char *name;
+	uint64_t value;
+};
+
+struct intel_error_state_engine {
+	char *name;
+
+	/* Range of intel_error_state.registers. */
+	unsigned int first_register;
+	unsigned int num_registers;
+};
+
+struct intel_error_state {
+	const char *data;
+	size_t size;
+
+	uint32_t devid;
+
+	/* The first num_global_registers precede any engine section. */
+	struct intel_error_state_register *registers;
+	unsigned int num_registers;
+	unsigned int num_global_registers;
+
+	struct intel_error_state_engine *engines;
+	unsigned int num_engines;
+
+	struct intel_error_state_bo *bos;
+	unsigned int num_bos;
+};
+
+struct intel_error_state *intel_error_state_open(const char *path);
+struct intel_error_state *intel_error_state_open_fd(int fd);
+void intel_error_state_close(struct intel_error_state *es);
+
+const struct intel_error_state_engine *
+intel_error_state_find_engine(const struct intel_error_state *es,
+			      const char *name);
+bool intel_error_state_read_register(const struct intel_error_state *es,
+				     const struct intel_error_state_engine *engine,
+				     const char *name, uint64_t *value);
+
+const struct intel_error_state_bo *
+intel_error_state_find_bo(const struct intel_error_state *es,
+			  const char *engine, const char *name);
+int intel_error_state_decode_bo(const struct intel_error_state *es,
+				const struct intel_error_state_bo *bo,
+				uint32_t **data);
+
+int intel_error_state_decode_ascii85(const char *in, size_t len, bool inflate,
+				     uint32_t **out);
+
+#endif /* INTEL_ERROR_STATE_H */
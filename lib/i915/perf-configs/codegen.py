@@ -349,7 +349,9 @@ class Gen:
             return 'intel_perf_devinfo_subslice_available(&perf->devinfo, {0}, {1})'.format(m.group(1), m.group(2))
         return None
 
-    def output_rpn_equation_code(self, set, counter, equation):
+    # The value is returned, or given to result_fmt for the code storing it.
+    def output_rpn_equation_code(self, set, counter, equation,
+                                 result_fmt="return {0};"):
         self.c("/* RPN equation: " + equation + " */")
         tokens = equation.split()
         stack = []
@@ -389,7 +391,7 @@ class Gen:
                 raise Exception("Failed to resolve variable " + value + " in expression " + expression + " for " + set.name + " :: " + counter_name)
             value = resolved_variable
 
-        self.c("\nreturn " + value + ";")
+        self.c("\n" + result_fmt.format(value))
 
     def splice_rpn_expression(self, set, counter_name, expression):
         tokens = expression.split()
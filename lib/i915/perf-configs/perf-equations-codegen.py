@@ -68,15 +68,46 @@ def output_counter_read(gen, set, counter):
     c.outdent(4)
     c("}")
 
+    # The same equation evaluated for each accumulator of a batch.
+    batch_sym = counter.read_sym + "_batch"
+
+    c("\n")
+    c("void")
+    c(batch_sym + "(const struct intel_perf *perf,\n")
+    c.indent(len(batch_sym) + 1)
+    c("const struct intel_perf_metric_set *metric_set,\n")
+    c("struct intel_perf_accumulator *accs,\n")
+    c("uint32_t n_accs, " + ret_ctype + " *values)\n")
+    c.outdent(len(batch_sym) + 1)
+
+    c("{")
+    c.indent(4)
+    c("for (uint32_t i = 0; i < n_accs; i++) {")
+    c.indent(4)
+    c("uint64_t *accumulator = accs[i].deltas;\n")
+
+    gen.output_rpn_equation_code(set, counter, read_eq, "values[i] = {0};")
+
+    c.outdent(4)
+    c("}")
+    c.outdent(4)
+    c("}")
+
     hashed_funcs[counter.read_hash] = counter.read_sym
 
 
 def output_counter_read_definition(gen, set, counter):
+    batch_sym = counter.read_sym + "_batch"
+
     if counter.read_hash in hashed_funcs:
         h("#define %s \\" % counter.read_sym)
         h.indent(4)
         h("%s" % hashed_funcs[counter.read_hash])
         h.outdent(4)
+        h("#define %s \\" % batch_sym)
+        h.indent(4)
+        h("%s_batch" % hashed_funcs[counter.read_hash])
+        h.outdent(4)
     else:
         ret_type = counter.get('data_type')
         ret_ctype = data_type_to_ctype(ret_type)
@@ -89,6 +120,14 @@ def output_counter_read_definition(gen, set, counter):
         h("uint64_t *accumulator);\n")
         h.outdent(len(counter.read_sym) + 1)
 
+        h("void")
+        h(batch_sym + "(const struct intel_perf *perf,\n")
+        h.indent(len(batch_sym) + 1)
+        h("const struct intel_perf_metric_set *metric_set,\n")
+        h("struct intel_perf_accumulator *accs,\n")
+        h("uint32_t n_accs, " + ret_ctype + " *values);\n")
+        h.outdent(len(batch_sym) + 1)
+
         hashed_funcs[counter.read_hash] = counter.read_sym
 
 
@@ -207,6 +246,7 @@ def generate_equations(args, gens):
         #include <stdbool.h>
 
         struct intel_perf;
+        struct intel_perf_accumulator;
         struct intel_perf_metric_set;
 
         double
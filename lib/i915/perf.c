@@ -937,6 +937,293 @@ void intel_perf_accumulate_reports(struct intel_perf_accumulator *acc,
 
 }
 
+/*
+ * Batched accumulation: every report of the batch is unpacked once into a
+ * row of 64bit values laid out like intel_perf_accumulator.deltas[], after
+ * which the deltas of a pair of reports are a plain masked subtraction of two
+ * rows. Slot 0 holds the raw timestamp which is scaled separately.
+ */
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+static void
+unpack_uint32(uint64_t *values, const uint32_t *report, int n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	int i = 0;
+
+	for (; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(report + i));
+
+		_mm_storeu_si128((__m128i *)(values + i),
+				 _mm_unpacklo_epi32(v, zero));
+		_mm_storeu_si128((__m128i *)(values + i + 2),
+				 _mm_unpackhi_epi32(v, zero));
+	}
+
+	for (; i < n; i++)
+		values[i] = report[i];
+}
+
+static void
+unpack_uint40(uint64_t *values, const uint32_t *report, int a_index, int n)
+{
+	const uint8_t *high_bytes = (const uint8_t *)(report + 40);
+	const __m128i zero = _mm_setzero_si128();
+	int i;
+
+	/* All the 40bit counter ranges come in multiples of 4. */
+	assert(n % 4 == 0);
+
+	for (i = 0; i < n; i += 4) {
+		__m128i low, high;
+		uint32_t bytes;
+
+		low = _mm_loadu_si128((const __m128i *)(report + a_index + i + 4));
+
+		memcpy(&bytes, high_bytes + a_index + i, sizeof(bytes));
+		high = _mm_cvtsi32_si128(bytes);
+		high = _mm_unpacklo_epi8(high, zero);
+		high = _mm_unpacklo_epi16(high, zero);
+
+		/* Interleaving the low dwords with the high bytes yields the
+		 * little endian 40bit values.
+		 */
+		_mm_storeu_si128((__m128i *)(values + i),
+				 _mm_unpacklo_epi32(low, high));
+		_mm_storeu_si128((__m128i *)(values + i + 2),
+				 _mm_unpackhi_epi32(low, high));
+	}
+}
+
+static void
+subtract_rows(uint64_t *deltas,
+	      const uint64_t *values0,
+	      const uint64_t *values1,
+	      const uint64_t *masks)
+{
+	for (int i = 0; i < INTEL_PERF_MAX_RAW_OA_COUNTERS; i += 2) {
+		__m128i v0 = _mm_loadu_si128((const __m128i *)(values0 + i));
+		__m128i v1 = _mm_loadu_si128((const __m128i *)(values1 + i));
+		__m128i m = _mm_loadu_si128((const __m128i *)(masks + i));
+
+		_mm_storeu_si128((__m128i *)(deltas + i),
+				 _mm_and_si128(_mm_sub_epi64(v1, v0), m));
+	}
+}
+
+#else
+
+static void
+unpack_uint32(uint64_t *values, const uint32_t *report, int n)
+{
+	for (int i = 0; i < n; i++)
+		values[i] = report[i];
+}
+
+static void
+unpack_uint40(uint64_t *values, const uint32_t *report, int a_index, int n)
+{
+	const uint8_t *high_bytes = (const uint8_t *)(report + 40);
+
+	for (int i = 0; i < n; i++)
+		values[i] = report[a_index + i + 4] |
+			    (uint64_t)high_bytes[a_index + i] << 32;
+}
+
+static void
+subtract_rows(uint64_t *deltas,
+	      const uint64_t *values0,
+	      const uint64_t *values1,
+	      const uint64_t *masks)
+{
+	for (int i = 0; i < INTEL_PERF_MAX_RAW_OA_COUNTERS; i++)
+		deltas[i] = (values1[i] - values0[i]) & masks[i];
+}
+
+#endif
+
+static void
+fill_masks(uint64_t *masks, int first, int n, uint64_t mask)
+{
+	for (int i = 0; i < n; i++)
+		masks[first + i] = mask;
+}
+
+static void
+report_masks(const struct intel_perf_metric_set *metric_set, uint64_t *masks)
+{
+	const uint64_t mask32 = 0xffffffffull;
+	const uint64_t mask40 = (1ull << 40) - 1;
+
+	memset(masks, 0, sizeof(uint64_t) * INTEL_PERF_MAX_RAW_OA_COUNTERS);
+
+	switch (metric_set->perf_oa_format) {
+	case I915_OA_FORMAT_A24u40_A14u32_B8_C8:
+		fill_masks(masks, 0, 6, mask32);
+		fill_masks(masks, 6, 20, mask40);
+		fill_masks(masks, 26, 4, mask32);
+		fill_masks(masks, 30, 4, mask40);
+		fill_masks(masks, 34, 22, mask32);
+		break;
+
+	case I915_OAR_FORMAT_A32u40_A4u32_B8_C8:
+	case I915_OA_FORMAT_A32u40_A4u32_B8_C8:
+		fill_masks(masks, 0, 2, mask32);
+		fill_masks(masks, 2, 32, mask40);
+		fill_masks(masks, 34, 20, mask32);
+		break;
+
+	case I915_OA_FORMAT_A45_B8_C8:
+		fill_masks(masks, 0, 62, mask32);
+		break;
+
+	case I915_OAM_FORMAT_MPEC8u32_B8_C8:
+		fill_masks(masks, 0, 2, ~0ull);
+		fill_masks(masks, 2, 24, mask32);
+		break;
+
+	default:
+		assert(0);
+	}
+}
+
+static void
+unpack_report(const struct intel_perf_metric_set *metric_set,
+	      const struct drm_i915_perf_record_header *record,
+	      uint64_t *values)
+{
+	const uint32_t *report = (const uint32_t *)(record + 1);
+
+	switch (metric_set->perf_oa_format) {
+	case I915_OA_FORMAT_A24u40_A14u32_B8_C8:
+		values[0] = report[1];
+		values[1] = report[3];
+		unpack_uint32(values + 2, report + 4, 4);
+		unpack_uint40(values + 6, report, 4, 20);
+		unpack_uint32(values + 26, report + 28, 4);
+		unpack_uint40(values + 30, report, 28, 4);
+		unpack_uint32(values + 34, report + 36, 5);
+		values[39] = report[46];
+		unpack_uint32(values + 40, report + 48, 16);
+		break;
+
+	case I915_OAR_FORMAT_A32u40_A4u32_B8_C8:
+	case I915_OA_FORMAT_A32u40_A4u32_B8_C8:
+		values[0] = report[1];
+		values[1] = report[3];
+		unpack_uint40(values + 2, report, 0, 32);
+		unpack_uint32(values + 34, report + 36, 4);
+		unpack_uint32(values + 38, report + 48, 16);
+		break;
+
+	case I915_OA_FORMAT_A45_B8_C8:
+		values[0] = report[1];
+		unpack_uint32(values + 1, report + 3, 61);
+		break;
+
+	case I915_OAM_FORMAT_MPEC8u32_B8_C8: {
+		const uint64_t *report64 = (const uint64_t *)(record + 1);
+
+		values[0] = report64[1];
+		values[1] = report64[3];
+		unpack_uint32(values + 2, report + 8, 24);
+		break;
+	}
+
+	default:
+		assert(0);
+	}
+}
+
+/**
+ * intel_perf_accumulate_report_batch:
+ * @accs: array of @n_records - 1 accumulators
+ * @perf: the perf object
+ * @metric_set: metric set the records were captured with
+ * @records: array of @n_records consecutive records
+ * @n_records: number of records
+ *
+ * Equivalent to calling intel_perf_accumulate_reports() on each pair of
+ * consecutive records, i.e. @accs[i] holds the deltas between @records[i] and
+ * @records[i + 1], but each report is only decoded once.
+ */
+void intel_perf_accumulate_report_batch(struct intel_perf_accumulator *accs,
+					const struct intel_perf *perf,
+					const struct intel_perf_metric_set *metric_set,
+					const struct drm_i915_perf_record_header **records,
+					uint32_t n_records)
+{
+	uint64_t rows[2][INTEL_PERF_MAX_RAW_OA_COUNTERS] = { };
+	uint64_t masks[INTEL_PERF_MAX_RAW_OA_COUNTERS];
+	int shift = perf->devinfo.oa_timestamp_shift;
+	bool wide_timestamp =
+		metric_set->perf_oa_format == I915_OAM_FORMAT_MPEC8u32_B8_C8;
+
+	if (n_records < 2)
+		return;
+
+	report_masks(metric_set, masks);
+	unpack_report(metric_set, records[0], rows[0]);
+
+	for (uint32_t r = 1; r < n_records; r++) {
+		const uint64_t *prev = rows[(r - 1) & 1];
+		uint64_t *cur = rows[r & 1];
+		uint64_t *deltas = accs[r - 1].deltas;
+
+		unpack_report(metric_set, records[r], cur);
+		subtract_rows(deltas, prev, cur, masks);
+
+		/* Scale the timestamp with the same width as the scalar path. */
+		if (wide_timestamp)
+			deltas[0] = shift >= 0 ? deltas[0] << shift : deltas[0] >> -shift;
+		else
+			deltas[0] = shift >= 0 ?
+				(uint32_t)(deltas[0] << shift) : deltas[0] >> -shift;
+	}
+}
+
+/**
+ * intel_perf_read_counter_batch_uint64:
+ * @perf: the perf object
+ * @counter: a logical counter with integer storage
+ * @accs: array of accumulators
+ * @n_accs: number of accumulators
+ * @values: output array of @n_accs values
+ *
+ * Evaluates @counter for each accumulator of a batch. The generated equation
+ * loops over the batch itself, instead of being called once per accumulator.
+ */
+void intel_perf_read_counter_batch_uint64(const struct intel_perf *perf,
+					  const struct intel_perf_logical_counter *counter,
+					  struct intel_perf_accumulator *accs,
+					  uint32_t n_accs,
+					  uint64_t *values)
+{
+	counter->read_uint64_batch(perf, counter->metric_set, accs, n_accs, values);
+}
+
+/**
+ * intel_perf_read_counter_batch_float:
+ * @perf: the perf object
+ * @counter: a logical counter with floating point storage
+ * @accs: array of accumulators
+ * @n_accs: number of accumulators
+ * @values: output array of @n_accs values
+ *
+ * Evaluates @counter for each accumulator of a batch. The generated equation
+ * loops over the batch itself, instead of being called once per accumulator.
+ */
+void intel_perf_read_counter_batch_float(const struct intel_perf *perf,
+					 const struct intel_perf_logical_counter *counter,
+					 struct intel_perf_accumulator *accs,
+					 uint32_t n_accs,
+					 double *values)
+{
+	counter->read_float_batch(perf, counter->metric_set, accs, n_accs, values);
+}
+
 uint64_t intel_perf_read_record_timestamp(const struct intel_perf *perf,
 					  const struct intel_perf_metric_set *metric_set,
 					  const struct drm_i915_perf_record_header *record)
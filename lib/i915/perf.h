@@ -230,6 +230,18 @@ struct intel_perf_logical_counter {
 				     uint64_t *deltas);
 	};
 
+	/* The read equation evaluated for each accumulator of a batch. */
+	union {
+		void (*read_uint64_batch)(const struct intel_perf *perf,
+					  const struct intel_perf_metric_set *metric_set,
+					  struct intel_perf_accumulator *accs,
+					  uint32_t n_accs, uint64_t *values);
+		void (*read_float_batch)(const struct intel_perf *perf,
+					 const struct intel_perf_metric_set *metric_set,
+					 struct intel_perf_accumulator *accs,
+					 uint32_t n_accs, double *values);
+	};
+
 	struct igt_list_head link; /* list from intel_perf_logical_counter_group.counters */
 };
 
@@ -342,6 +354,23 @@ void intel_perf_accumulate_reports(struct intel_perf_accumulator *acc,
 				   const struct drm_i915_perf_record_header *record0,
 				   const struct drm_i915_perf_record_header *record1);
 
+void intel_perf_accumulate_report_batch(struct intel_perf_accumulator *accs,
+					const struct intel_perf *perf,
+					const struct intel_perf_metric_set *metric_set,
+					const struct drm_i915_perf_record_header **records,
+					uint32_t n_records);
+
+void intel_perf_read_counter_batch_uint64(const struct intel_perf *perf,
+					  const struct intel_perf_logical_counter *counter,
+					  struct intel_perf_accumulator *accs,
+					  uint32_t n_accs,
+					  uint64_t *values);
+void intel_perf_read_counter_batch_float(const struct intel_perf *perf,
+					 const struct intel_perf_logical_counter *counter,
+					 struct intel_perf_accumulator *accs,
+					 uint32_t n_accs,
+					 double *values);
+
 uint64_t intel_perf_read_record_timestamp(const struct intel_perf *perf,
 					  const struct intel_perf_metric_set *metric_set,
 					  const struct drm_i915_perf_record_header *record);
@@ -22,6 +22,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -37,6 +38,7 @@
 #include "perf_data_reader.h"
 
 #define MAX(a,b) ((a) > (b) ? (a) : (b))
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
 #define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
 
 static inline bool
@@ -58,17 +60,25 @@ oa_report_ctx_is_valid(const struct intel_perf_devinfo *devinfo,
 }
 
 static uint32_t
-oa_report_ctx_id(struct intel_perf_data_reader *reader, const uint8_t *report)
+report_ctx_id(const struct intel_perf_devinfo *devinfo,
+	      const struct intel_perf_metric_set *metric_set,
+	      const uint8_t *report)
 {
-	if (!oa_report_ctx_is_valid(&reader->devinfo, report))
+	if (!oa_report_ctx_is_valid(devinfo, report))
 		return 0xffffffff;
 
-	if (reader->metric_set->perf_oa_format == I915_OAM_FORMAT_MPEC8u32_B8_C8)
+	if (metric_set->perf_oa_format == I915_OAM_FORMAT_MPEC8u32_B8_C8)
 		return ((const uint32_t *) report)[4];
 	else
 		return ((const uint32_t *) report)[2];
 }
 
+static uint32_t
+oa_report_ctx_id(struct intel_perf_data_reader *reader, const uint8_t *report)
+{
+	return report_ctx_id(&reader->devinfo, reader->metric_set, report);
+}
+
 static void
 append_record(struct intel_perf_data_reader *reader,
 	      const struct drm_i915_perf_record_header *header)
@@ -116,6 +126,29 @@ find_metric_set(struct intel_perf *perf, const char *symbol_name)
 	return NULL;
 }
 
+static struct intel_perf *
+load_perf(const struct intel_perf_record_device_info *record_info,
+	  const struct intel_perf_record_device_topology *record_topology,
+	  char *error_msg, size_t error_msg_size)
+{
+	struct intel_perf *perf;
+
+	perf = intel_perf_for_devinfo(record_info->device_id,
+				      record_info->device_revision,
+				      record_info->timestamp_frequency,
+				      record_info->gt_min_frequency,
+				      record_info->gt_max_frequency,
+				      &record_topology->topology);
+	if (!perf) {
+		snprintf(error_msg, error_msg_size,
+			 "Recording occured on unsupported device (0x%x)",
+			 record_info->device_id);
+		return NULL;
+	}
+
+	return perf;
+}
+
 static bool
 parse_data(struct intel_perf_data_reader *reader)
 {
@@ -182,18 +215,10 @@ parse_data(struct intel_perf_data_reader *reader)
 	record_info = reader->record_info;
 	record_topology = reader->record_topology;
 
-	reader->perf = intel_perf_for_devinfo(record_info->device_id,
-					      record_info->device_revision,
-					      record_info->timestamp_frequency,
-					      record_info->gt_min_frequency,
-					      record_info->gt_max_frequency,
-					      &record_topology->topology);
-	if (!reader->perf) {
-		snprintf(reader->error_msg, sizeof(reader->error_msg),
-			 "Recording occured on unsupported device (0x%x)",
-			 record_info->device_id);
+	reader->perf = load_perf(record_info, record_topology,
+				 reader->error_msg, sizeof(reader->error_msg));
+	if (!reader->perf)
 		return false;
-	}
 
 	reader->devinfo = reader->perf->devinfo;
 
@@ -205,15 +230,19 @@ parse_data(struct intel_perf_data_reader *reader)
 }
 
 static uint64_t
-correlate_gpu_timestamp(struct intel_perf_data_reader *reader,
-			uint64_t gpu_ts)
+correlate_timestamp(const struct intel_perf *perf,
+		    const struct intel_perf_record_timestamp_correlation **correlations,
+		    uint32_t n_correlations,
+		    const struct intel_perf_correlation_chunk *chunks,
+		    uint32_t n_chunks,
+		    uint64_t gpu_ts)
 {
 	/* OA reports only have the lower 32bits of the timestamp
 	 * register, while our correlation data has the whole 36bits.
 	 * Try to figure what portion of the correlation data the
 	 * 32bit timestamp belongs to.
 	 */
-	uint64_t mask = reader->perf->devinfo.oa_timestamp_mask;
+	uint64_t mask = perf->devinfo.oa_timestamp_mask;
 	int corr_idx = -1;
 
 	/* On some OA formats, gpu_ts is a 64 bit value and the shift can
@@ -222,10 +251,10 @@ correlate_gpu_timestamp(struct intel_perf_data_reader *reader,
 	 */
 	gpu_ts = gpu_ts & mask;
 
-	for (uint32_t i = 0; i < reader->n_correlation_chunks; i++) {
-		if (gpu_ts >= (reader->correlation_chunks[i].gpu_ts_begin & mask) &&
-		    gpu_ts <= (reader->correlation_chunks[i].gpu_ts_end & mask)) {
-			corr_idx = reader->correlation_chunks[i].idx;
+	for (uint32_t i = 0; i < n_chunks; i++) {
+		if (gpu_ts >= (chunks[i].gpu_ts_begin & mask) &&
+		    gpu_ts <= (chunks[i].gpu_ts_end & mask)) {
+			corr_idx = chunks[i].idx;
 			break;
 		}
 	}
@@ -233,19 +262,19 @@ correlate_gpu_timestamp(struct intel_perf_data_reader *reader,
 	/* Not found? Assume prior to the first timestamp correlation.
 	 */
 	if (corr_idx < 0) {
-		return reader->correlations[0]->cpu_timestamp -
-			((reader->correlations[0]->gpu_timestamp & mask) - gpu_ts) *
-			(reader->correlations[1]->cpu_timestamp - reader->correlations[0]->cpu_timestamp) /
-			(reader->correlations[1]->gpu_timestamp - reader->correlations[0]->gpu_timestamp);
-	}
-
-	for (uint32_t i = corr_idx; i < (reader->n_correlations - 1); i++) {
-		if (gpu_ts >= (reader->correlations[i]->gpu_timestamp & mask) &&
-		    gpu_ts < (reader->correlations[i + 1]->gpu_timestamp & mask)) {
-			return reader->correlations[i]->cpu_timestamp +
-				(gpu_ts - (reader->correlations[i]->gpu_timestamp & mask)) *
-				(reader->correlations[i + 1]->cpu_timestamp - reader->correlations[i]->cpu_timestamp) /
-				(reader->correlations[i + 1]->gpu_timestamp - reader->correlations[i]->gpu_timestamp);
+		return correlations[0]->cpu_timestamp -
+			((correlations[0]->gpu_timestamp & mask) - gpu_ts) *
+			(correlations[1]->cpu_timestamp - correlations[0]->cpu_timestamp) /
+			(correlations[1]->gpu_timestamp - correlations[0]->gpu_timestamp);
+	}
+
+	for (uint32_t i = corr_idx; i < (n_correlations - 1); i++) {
+		if (gpu_ts >= (correlations[i]->gpu_timestamp & mask) &&
+		    gpu_ts < (correlations[i + 1]->gpu_timestamp & mask)) {
+			return correlations[i]->cpu_timestamp +
+				(gpu_ts - (correlations[i]->gpu_timestamp & mask)) *
+				(correlations[i + 1]->cpu_timestamp - correlations[i]->cpu_timestamp) /
+				(correlations[i + 1]->gpu_timestamp - correlations[i]->gpu_timestamp);
 		}
 	}
 
@@ -255,6 +284,17 @@ correlate_gpu_timestamp(struct intel_perf_data_reader *reader,
 	assert(0);
 }
 
+static uint64_t
+correlate_gpu_timestamp(struct intel_perf_data_reader *reader,
+			uint64_t gpu_ts)
+{
+	return correlate_timestamp(reader->perf,
+				   reader->correlations, reader->n_correlations,
+				   reader->correlation_chunks,
+				   reader->n_correlation_chunks,
+				   gpu_ts);
+}
+
 static void
 append_timeline_event(struct intel_perf_data_reader *reader,
 		      uint64_t ts_start, uint64_t ts_end,
@@ -322,25 +362,40 @@ generate_cpu_events(struct intel_perf_data_reader *reader)
 		append_timeline_event(reader, gpu_ts_start, gpu_ts_end, last_header_idx, reader->n_records - 1, last_ctx_id);
 }
 
-static void
-compute_correlation_chunks(struct intel_perf_data_reader *reader)
+static uint32_t
+compute_chunks(const struct intel_perf_record_timestamp_correlation **correlations,
+	       uint32_t n_correlations,
+	       struct intel_perf_correlation_chunk *chunks,
+	       uint32_t max_chunks)
 {
 	uint64_t mask = ~(0xffffffff);
 	uint32_t last_idx = 0;
-	uint64_t last_ts = reader->correlations[last_idx]->gpu_timestamp;
-
-	for (uint32_t i = 0; i < reader->n_correlations; i++) {
-		if (!reader->n_correlation_chunks ||
-		    (last_ts & mask) != (reader->correlations[i]->gpu_timestamp & mask)) {
-			assert(reader->n_correlation_chunks < ARRAY_SIZE(reader->correlation_chunks));
-			reader->correlation_chunks[reader->n_correlation_chunks].gpu_ts_begin = last_ts;
-			reader->correlation_chunks[reader->n_correlation_chunks].gpu_ts_end = last_ts | ~mask;
-			reader->correlation_chunks[reader->n_correlation_chunks].idx = last_idx;
-			last_ts = reader->correlation_chunks[reader->n_correlation_chunks].gpu_ts_end + 1;
+	uint64_t last_ts = correlations[last_idx]->gpu_timestamp;
+	uint32_t n_chunks = 0;
+
+	for (uint32_t i = 0; i < n_correlations; i++) {
+		if (!n_chunks ||
+		    (last_ts & mask) != (correlations[i]->gpu_timestamp & mask)) {
+			assert(n_chunks < max_chunks);
+			chunks[n_chunks].gpu_ts_begin = last_ts;
+			chunks[n_chunks].gpu_ts_end = last_ts | ~mask;
+			chunks[n_chunks].idx = last_idx;
+			last_ts = chunks[n_chunks].gpu_ts_end + 1;
 			last_idx = i;
-			reader->n_correlation_chunks++;
+			n_chunks++;
 		}
 	}
+
+	return n_chunks;
+}
+
+static void
+compute_correlation_chunks(struct intel_perf_data_reader *reader)
+{
+	reader->n_correlation_chunks =
+		compute_chunks(reader->correlations, reader->n_correlations,
+			       reader->correlation_chunks,
+			       ARRAY_SIZE(reader->correlation_chunks));
 }
 
 bool
@@ -384,3 +439,584 @@ intel_perf_data_reader_fini(struct intel_perf_data_reader *reader)
 	free(reader->correlations);
 	munmap((void *)reader->mmap_data, reader->mmap_size);
 }
+
+/* Size of the window through which the stream reads the file. */
+#define STREAM_WINDOW_SIZE (1 << 20)
+
+/* Number of sample records between two entries of the seek index. */
+#define STREAM_INDEX_INTERVAL 4096
+
+/* Returns 0 with *data pointing at @len bytes of the file at @offset,
+ * -EINVAL if the file ends before that or -EIO if reading failed.
+ */
+static int
+stream_fetch(struct intel_perf_data_stream *stream, uint64_t offset, size_t len,
+	     const void **data)
+{
+	if (offset >= stream->buf_offset &&
+	    offset + len <= stream->buf_offset + stream->buf_len) {
+		*data = stream->buf + (offset - stream->buf_offset);
+		return 0;
+	}
+
+	if (offset + len > stream->file_size)
+		return -EINVAL;
+
+	if (len > stream->buf_size) {
+		stream->buf_size = len;
+		stream->buf = realloc(stream->buf, stream->buf_size);
+		assert(stream->buf);
+	}
+
+	stream->buf_offset = offset;
+	stream->buf_len = 0;
+	while (stream->buf_len < stream->buf_size &&
+	       offset + stream->buf_len < stream->file_size) {
+		ssize_t ret = pread(stream->fd,
+				    stream->buf + stream->buf_len,
+				    stream->buf_size - stream->buf_len,
+				    offset + stream->buf_len);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0) {
+			snprintf(stream->error_msg, sizeof(stream->error_msg),
+				 "Unable to read file (%s)", strerror(errno));
+			return -EIO;
+		}
+		if (ret == 0)
+			break;
+
+		stream->buf_len += ret;
+	}
+
+	/* The file shrank since we looked at its size. */
+	if (stream->buf_len < len)
+		return -EINVAL;
+
+	*data = stream->buf;
+	return 0;
+}
+
+/* Read the record at the current offset, whatever its type.
+ *
+ * Returns 1 with *record set, 0 at the end of the file, or a negative
+ * error code with @stream->error_msg set when the record is truncated,
+ * malformed or cannot be read.
+ */
+static int
+stream_read_record(struct intel_perf_data_stream *stream,
+		   const struct drm_i915_perf_record_header **record)
+{
+	const struct drm_i915_perf_record_header *header;
+	const void *data;
+	int ret;
+
+	if (stream->offset >= stream->file_size)
+		return 0;
+
+	ret = stream_fetch(stream, stream->offset, sizeof(*header), &data);
+	if (ret == 0) {
+		header = data;
+		if (header->size < sizeof(*header)) {
+			snprintf(stream->error_msg, sizeof(stream->error_msg),
+				 "Invalid record size (%u) at offset %"PRIu64,
+				 header->size, stream->offset);
+			return -EINVAL;
+		}
+
+		ret = stream_fetch(stream, stream->offset, header->size, &data);
+	}
+	if (ret == -EINVAL) {
+		snprintf(stream->error_msg, sizeof(stream->error_msg),
+			 "Truncated record at offset %"PRIu64" (file size %"PRIu64")",
+			 stream->offset, stream->file_size);
+	}
+	if (ret)
+		return ret;
+
+	header = data;
+	stream->offset += header->size;
+	*record = header;
+
+	return 1;
+}
+
+static void
+stream_append_index(struct intel_perf_data_stream *stream,
+		    uint64_t offset, uint64_t record)
+{
+	if (stream->n_index >= stream->n_allocated_index) {
+		stream->n_allocated_index = MAX(100, 2 * stream->n_allocated_index);
+		stream->index = realloc(stream->index,
+					stream->n_allocated_index *
+					sizeof(*stream->index));
+		assert(stream->index);
+	}
+
+	stream->index[stream->n_index].offset = offset;
+	stream->index[stream->n_index].record = record;
+	stream->n_index++;
+}
+
+static void
+stream_append_correlation(struct intel_perf_data_stream *stream,
+			  const struct intel_perf_record_timestamp_correlation *corr)
+{
+	if (stream->n_correlations >= stream->n_allocated_correlations) {
+		stream->n_allocated_correlations = MAX(100, 2 * stream->n_allocated_correlations);
+		stream->correlation_data = realloc(stream->correlation_data,
+						   stream->n_allocated_correlations *
+						   sizeof(*stream->correlation_data));
+		assert(stream->correlation_data);
+	}
+
+	memcpy(&stream->correlation_data[stream->n_correlations++],
+	       corr, sizeof(*corr));
+}
+
+static bool
+stream_parse(struct intel_perf_data_stream *stream)
+{
+	const struct drm_i915_perf_record_header *header;
+	bool has_info = false;
+	int ret;
+
+	while ((ret = stream_read_record(stream, &header)) > 0) {
+		switch (header->type) {
+		case DRM_I915_PERF_RECORD_SAMPLE:
+			if (stream->n_records % stream->index_interval == 0)
+				stream_append_index(stream,
+						    stream->offset - header->size,
+						    stream->n_records);
+			stream->n_records++;
+			break;
+
+		case INTEL_PERF_RECORD_TYPE_VERSION: {
+			const struct intel_perf_record_version *version =
+				(const struct intel_perf_record_version *) (header + 1);
+			if (version->version != INTEL_PERF_RECORD_VERSION) {
+				snprintf(stream->error_msg, sizeof(stream->error_msg),
+					 "Unsupported recording version (%u, expected %u)",
+					 version->version, INTEL_PERF_RECORD_VERSION);
+				return false;
+			}
+			break;
+		}
+
+		case INTEL_PERF_RECORD_TYPE_DEVICE_INFO:
+			if (header->size != (sizeof(struct intel_perf_record_device_info) +
+					     sizeof(*header))) {
+				snprintf(stream->error_msg, sizeof(stream->error_msg),
+					 "Invalid device info record");
+				return false;
+			}
+			memcpy(&stream->record_info, header + 1,
+			       sizeof(stream->record_info));
+			has_info = true;
+			break;
+
+		case INTEL_PERF_RECORD_TYPE_DEVICE_TOPOLOGY:
+			free(stream->record_topology);
+			stream->record_topology = malloc(header->size - sizeof(*header));
+			assert(stream->record_topology);
+			memcpy(stream->record_topology, header + 1,
+			       header->size - sizeof(*header));
+			break;
+
+		case INTEL_PERF_RECORD_TYPE_TIMESTAMP_CORRELATION:
+			stream_append_correlation(stream,
+						  (const struct intel_perf_record_timestamp_correlation *) (header + 1));
+			break;
+		}
+	}
+
+	/* A recording cut short still has its complete records readable,
+	 * reading reports the truncated one once it gets there.
+	 */
+	if (ret == -EINVAL)
+		stream->error_msg[0] = '\0';
+	else if (ret < 0)
+		return false;
+
+	if (!has_info || !stream->record_topology) {
+		snprintf(stream->error_msg, sizeof(stream->error_msg),
+			 "Invalid file, missing device or topology info");
+		return false;
+	}
+
+	stream->perf = load_perf(&stream->record_info, stream->record_topology,
+				 stream->error_msg, sizeof(stream->error_msg));
+	if (!stream->perf)
+		return false;
+
+	stream->devinfo = stream->perf->devinfo;
+
+	stream->metric_set_name = stream->record_info.metric_set_name;
+	stream->metric_set_uuid = stream->record_info.metric_set_uuid;
+	stream->metric_set = find_metric_set(stream->perf,
+					     stream->record_info.metric_set_name);
+	if (!stream->metric_set) {
+		snprintf(stream->error_msg, sizeof(stream->error_msg),
+			 "Unknown metric set '%s'", stream->metric_set_name);
+		return false;
+	}
+
+	return true;
+}
+
+static void
+stream_build_index(struct intel_perf_data_stream *stream)
+{
+	if (stream->n_correlations) {
+		stream->correlations = calloc(stream->n_correlations,
+					      sizeof(*stream->correlations));
+		assert(stream->correlations);
+		for (uint32_t i = 0; i < stream->n_correlations; i++)
+			stream->correlations[i] = &stream->correlation_data[i];
+
+		stream->n_correlation_chunks =
+			compute_chunks(stream->correlations, stream->n_correlations,
+				       stream->correlation_chunks,
+				       ARRAY_SIZE(stream->correlation_chunks));
+	}
+
+	for (uint32_t i = 0; i < stream->n_index; i++) {
+		struct intel_perf_data_stream_index_entry *entry = &stream->index[i];
+		const struct drm_i915_perf_record_header *header;
+		int ret;
+
+		stream->offset = entry->offset;
+		ret = stream_read_record(stream, &header);
+		assert(ret > 0);
+
+		entry->gpu_ts = intel_perf_read_record_timestamp(stream->perf,
+								 stream->metric_set,
+								 header);
+		entry->cpu_ts = intel_perf_data_stream_cpu_timestamp(stream, header);
+	}
+}
+
+/**
+ * intel_perf_data_stream_init:
+ * @stream: stream to initialize
+ * @perf_file_fd: file descriptor of the recording
+ *
+ * Reads the metadata of the recording and builds the seek index, leaving
+ * the stream positioned on the first sample record. On failure
+ * @stream->error_msg describes the problem and
+ * intel_perf_data_stream_fini() must still be called.
+ *
+ * Returns: true on success.
+ */
+bool
+intel_perf_data_stream_init(struct intel_perf_data_stream *stream,
+			    int perf_file_fd)
+{
+	struct stat st;
+
+	memset(stream, 0, sizeof(*stream));
+
+	if (fstat(perf_file_fd, &st) != 0) {
+		snprintf(stream->error_msg, sizeof(stream->error_msg),
+			 "Unable to access file (%s)", strerror(errno));
+		return false;
+	}
+
+	stream->fd = perf_file_fd;
+	stream->file_size = st.st_size;
+	stream->index_interval = STREAM_INDEX_INTERVAL;
+	stream->buf_size = STREAM_WINDOW_SIZE;
+	stream->buf = malloc(stream->buf_size);
+	assert(stream->buf);
+
+	if (!stream_parse(stream))
+		return false;
+
+	stream_build_index(stream);
+
+	return intel_perf_data_stream_seek_record(stream, 0) == 0;
+}
+
+void
+intel_perf_data_stream_fini(struct intel_perf_data_stream *stream)
+{
+	if (stream->perf)
+		intel_perf_free(stream->perf);
+	free(stream->timeline.records[0]);
+	free(stream->timeline.records[1]);
+	free(stream->record_topology);
+	free(stream->correlations);
+	free(stream->correlation_data);
+	free(stream->index);
+	free(stream->buf);
+}
+
+/**
+ * intel_perf_data_stream_next_record:
+ * @stream: the stream
+ * @record: set to the next sample record
+ *
+ * The record is only valid until the next call into @stream.
+ *
+ * Returns: 1 when a record was read, 0 at the end of the file, or a negative
+ * error code with @stream->error_msg set when the next record is truncated
+ * (-EINVAL) or cannot be read (-EIO).
+ */
+int
+intel_perf_data_stream_next_record(struct intel_perf_data_stream *stream,
+				   const struct drm_i915_perf_record_header **record)
+{
+	const struct drm_i915_perf_record_header *header;
+	int ret;
+
+	while ((ret = stream_read_record(stream, &header)) > 0) {
+		if (header->type == DRM_I915_PERF_RECORD_SAMPLE) {
+			stream->record++;
+			*record = header;
+			return 1;
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * intel_perf_data_stream_cpu_timestamp:
+ * @stream: the stream
+ * @record: a sample record
+ *
+ * Returns: the CPU timestamp (CLOCK_MONOTONIC) of @record, or 0 if the
+ * recording does not hold enough correlation points.
+ */
+uint64_t
+intel_perf_data_stream_cpu_timestamp(struct intel_perf_data_stream *stream,
+				     const struct drm_i915_perf_record_header *record)
+{
+	if (stream->n_correlations < 2)
+		return 0;
+
+	return correlate_timestamp(stream->perf,
+				   stream->correlations, stream->n_correlations,
+				   stream->correlation_chunks,
+				   stream->n_correlation_chunks,
+				   intel_perf_read_record_timestamp(stream->perf,
+								    stream->metric_set,
+								    record));
+}
+
+static void
+stream_reset_timeline(struct intel_perf_data_stream *stream)
+{
+	stream->timeline.started = false;
+	stream->timeline.done = false;
+	stream->timeline_record_start = NULL;
+	stream->timeline_record_end = NULL;
+}
+
+/**
+ * intel_perf_data_stream_seek_record:
+ * @stream: the stream
+ * @record: index of a sample record
+ *
+ * Positions @stream so that the next call to
+ * intel_perf_data_stream_next_record() returns sample record @record.
+ *
+ * Returns: 0 on success, -ERANGE if @record is past the end of the recording
+ * or the error returned by intel_perf_data_stream_next_record().
+ */
+int
+intel_perf_data_stream_seek_record(struct intel_perf_data_stream *stream,
+				   uint64_t record)
+{
+	const struct intel_perf_data_stream_index_entry *entry;
+
+	stream_reset_timeline(stream);
+
+	if (record > stream->n_records)
+		return -ERANGE;
+
+	if (!stream->n_index) {
+		stream->offset = stream->file_size;
+		stream->record = 0;
+		return 0;
+	}
+
+	entry = &stream->index[MIN(record / stream->index_interval,
+				   stream->n_index - 1)];
+	stream->offset = entry->offset;
+	stream->record = entry->record;
+
+	while (stream->record < record) {
+		const struct drm_i915_perf_record_header *header;
+		int ret = intel_perf_data_stream_next_record(stream, &header);
+
+		if (ret <= 0)
+			return ret ?: -ERANGE;
+	}
+
+	return 0;
+}
+
+/**
+ * intel_perf_data_stream_seek_cpu_timestamp:
+ * @stream: the stream
+ * @cpu_ts: a CPU timestamp (CLOCK_MONOTONIC)
+ *
+ * Positions @stream on the first sample record at or after @cpu_ts.
+ *
+ * Returns: 0 on success, -ERANGE if there is no such record or the error
+ * returned by intel_perf_data_stream_next_record().
+ */
+int
+intel_perf_data_stream_seek_cpu_timestamp(struct intel_perf_data_stream *stream,
+					  uint64_t cpu_ts)
+{
+	uint32_t lo = 0, hi = stream->n_index;
+
+	stream_reset_timeline(stream);
+
+	if (!stream->n_index || stream->n_correlations < 2)
+		return -ERANGE;
+
+	/* Last index entry at or before cpu_ts. */
+	while (hi - lo > 1) {
+		uint32_t mid = (lo + hi) / 2;
+
+		if (stream->index[mid].cpu_ts <= cpu_ts)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	stream->offset = stream->index[lo].offset;
+	stream->record = stream->index[lo].record;
+
+	for (;;) {
+		const struct drm_i915_perf_record_header *header;
+		uint64_t offset = stream->offset;
+		uint64_t record = stream->record;
+		int ret;
+
+		ret = intel_perf_data_stream_next_record(stream, &header);
+		if (ret <= 0)
+			return ret ?: -ERANGE;
+
+		if (intel_perf_data_stream_cpu_timestamp(stream, header) >= cpu_ts) {
+			stream->offset = offset;
+			stream->record = record;
+			return 0;
+		}
+	}
+}
+
+static void
+stream_copy_timeline_record(struct intel_perf_data_stream *stream,
+			    uint32_t slot,
+			    const struct drm_i915_perf_record_header *header)
+{
+	if (stream->timeline.record_sizes[slot] < header->size) {
+		stream->timeline.record_sizes[slot] = header->size;
+		stream->timeline.records[slot] =
+			realloc(stream->timeline.records[slot], header->size);
+		assert(stream->timeline.records[slot]);
+	}
+
+	memcpy(stream->timeline.records[slot], header, header->size);
+	stream->timeline.record_idx[slot] = stream->record - 1;
+}
+
+static void
+stream_fill_timeline_item(struct intel_perf_data_stream *stream,
+			  struct intel_perf_timeline_item *item,
+			  uint32_t hw_id)
+{
+	const struct drm_i915_perf_record_header *start =
+		stream->timeline.records[stream->timeline.start];
+	const struct drm_i915_perf_record_header *end =
+		stream->timeline.records[!stream->timeline.start];
+
+	memset(item, 0, sizeof(*item));
+	item->ts_start = intel_perf_read_record_timestamp(stream->perf,
+							  stream->metric_set,
+							  start);
+	item->ts_end = intel_perf_read_record_timestamp(stream->perf,
+							stream->metric_set,
+							end);
+	item->cpu_ts_start = intel_perf_data_stream_cpu_timestamp(stream, start);
+	item->cpu_ts_end = intel_perf_data_stream_cpu_timestamp(stream, end);
+	item->record_start = stream->timeline.record_idx[stream->timeline.start];
+	item->record_end = stream->timeline.record_idx[!stream->timeline.start];
+	item->hw_id = hw_id;
+
+	stream->timeline_record_start = start;
+	stream->timeline_record_end = end;
+}
+
+/**
+ * intel_perf_data_stream_next_timeline_item:
+ * @stream: the stream
+ * @item: filled with the next timeline item
+ *
+ * Produces the same timeline items as intel_perf_data_reader, starting from
+ * the current position of @stream. This consumes the sample records of the
+ * stream. Copies of the first and last records of the item are available in
+ * @stream->timeline_record_start and @stream->timeline_record_end until the
+ * next call into @stream.
+ *
+ * Returns: 1 when @item was filled, 0 once there are no more items, or the
+ * error returned by intel_perf_data_stream_next_record().
+ */
+int
+intel_perf_data_stream_next_timeline_item(struct intel_perf_data_stream *stream,
+					  struct intel_perf_timeline_item *item)
+{
+	const struct drm_i915_perf_record_header *header;
+	uint32_t start = stream->timeline.start;
+	uint32_t start_ctx_id;
+	int ret;
+
+	if (stream->timeline.done)
+		return 0;
+
+	if (!stream->timeline.started) {
+		ret = intel_perf_data_stream_next_record(stream, &header);
+		if (ret <= 0) {
+			stream->timeline.done = true;
+			return ret;
+		}
+
+		stream_copy_timeline_record(stream, start, header);
+		stream->timeline.record_idx[!start] = stream->timeline.record_idx[start];
+		stream->timeline.started = true;
+	}
+
+	start_ctx_id = report_ctx_id(&stream->devinfo, stream->metric_set,
+				     (const uint8_t *) (stream->timeline.records[start] + 1));
+
+	while ((ret = intel_perf_data_stream_next_record(stream, &header)) > 0) {
+		stream_copy_timeline_record(stream, !start, header);
+
+		if (report_ctx_id(&stream->devinfo, stream->metric_set,
+				  (const uint8_t *) (header + 1)) == start_ctx_id)
+			continue;
+
+		stream_fill_timeline_item(stream, item, start_ctx_id);
+
+		/* The record ending this item starts the next one. */
+		stream->timeline.start = !start;
+		stream->timeline.record_idx[start] = stream->timeline.record_idx[!start];
+		return 1;
+	}
+
+	stream->timeline.done = true;
+
+	if (ret < 0)
+		return ret;
+
+	if (stream->timeline.record_idx[start] == stream->timeline.record_idx[!start])
+		return 0;
+
+	stream_fill_timeline_item(stream, item, start_ctx_id);
+	return 1;
+}
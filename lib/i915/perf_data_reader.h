@@ -53,6 +53,13 @@ struct intel_perf_timeline_item {
 	void *user_data;
 };
 
+/* Range of GPU timestamps sharing the same upper 32bits. */
+struct intel_perf_correlation_chunk {
+	uint64_t gpu_ts_begin;
+	uint64_t gpu_ts_end;
+	uint32_t idx;
+};
+
 struct intel_perf_data_reader {
 	/* Array of pointers into the mmapped i915 perf file. */
 	const struct drm_i915_perf_record_header **records;
@@ -69,11 +76,7 @@ struct intel_perf_data_reader {
 	uint32_t n_correlations;
 	uint32_t n_allocated_correlations;
 
-	struct {
-		uint64_t gpu_ts_begin;
-		uint64_t gpu_ts_end;
-		uint32_t idx;
-	} correlation_chunks[4];
+	struct intel_perf_correlation_chunk correlation_chunks[4];
 	uint32_t n_correlation_chunks;
 
 	const char *metric_set_uuid;
@@ -98,6 +101,116 @@ bool intel_perf_data_reader_init(struct intel_perf_data_reader *reader,
 				 int perf_file_fd);
 void intel_perf_data_reader_fini(struct intel_perf_data_reader *reader);
 
+/* Streaming reader of a i915-perf recording.
+ *
+ * Unlike intel_perf_data_reader which maps the whole file and builds arrays
+ * of all records and timeline items up front, the stream reads the file
+ * through a fixed size window and hands out records and timeline items one
+ * at a time. Opening the stream does one pass over the file to gather the
+ * metadata and correlation points and to build a sparse index of sample
+ * records (one entry every index_interval records), which is then used to
+ * seek to a given record or CPU timestamp.
+ *
+ * Records returned by the stream are only valid until the next call into
+ * the stream.
+ *
+ * A recording cut short can still be opened. Reading then returns -EINVAL
+ * once it reaches the truncated record, rather than 0 as at the end of a
+ * complete recording.
+ */
+
+struct intel_perf_data_stream_index_entry {
+	/* File offset of the sample record. */
+	uint64_t offset;
+
+	/* Index of the sample record, counting only sample records. */
+	uint64_t record;
+
+	uint64_t gpu_ts;
+	uint64_t cpu_ts;
+};
+
+struct intel_perf_data_stream {
+	int fd;
+	uint64_t file_size;
+
+	/* Window into the file. */
+	uint8_t *buf;
+	size_t buf_size;
+	uint64_t buf_offset;
+	size_t buf_len;
+
+	/* File offset and index of the next sample record. */
+	uint64_t offset;
+	uint64_t record;
+
+	/* Total number of sample records in the file. */
+	uint64_t n_records;
+
+	/**/
+	struct intel_perf_data_stream_index_entry *index;
+	uint32_t n_index;
+	uint32_t n_allocated_index;
+	uint32_t index_interval;
+
+	/**/
+	struct intel_perf_record_timestamp_correlation *correlation_data;
+	const struct intel_perf_record_timestamp_correlation **correlations;
+	uint32_t n_correlations;
+	uint32_t n_allocated_correlations;
+
+	struct intel_perf_correlation_chunk correlation_chunks[4];
+	uint32_t n_correlation_chunks;
+
+	/* Timeline iteration state, see
+	 * intel_perf_data_stream_next_timeline_item().
+	 */
+	struct {
+		struct drm_i915_perf_record_header *records[2];
+		uint32_t record_sizes[2];
+		uint64_t record_idx[2];
+		uint32_t start; /* Slot of the first record of the item. */
+		bool started;
+		bool done;
+	} timeline;
+
+	/* Copies of the first and last records of the last timeline item. */
+	const struct drm_i915_perf_record_header *timeline_record_start;
+	const struct drm_i915_perf_record_header *timeline_record_end;
+
+	const char *metric_set_uuid;
+	const char *metric_set_name;
+
+	struct intel_perf_devinfo devinfo;
+
+	struct intel_perf *perf;
+	struct intel_perf_metric_set *metric_set;
+
+	char error_msg[256];
+
+	/**/
+	struct intel_perf_record_device_info record_info;
+	struct intel_perf_record_device_topology *record_topology;
+};
+
+bool intel_perf_data_stream_init(struct intel_perf_data_stream *stream,
+				 int perf_file_fd);
+void intel_perf_data_stream_fini(struct intel_perf_data_stream *stream);
+
+int intel_perf_data_stream_next_record(struct intel_perf_data_stream *stream,
+				       const struct drm_i915_perf_record_header **record);
+
+int intel_perf_data_stream_next_timeline_item(struct intel_perf_data_stream *stream,
+					      struct intel_perf_timeline_item *item);
+
+int intel_perf_data_stream_seek_record(struct intel_perf_data_stream *stream,
+				       uint64_t record);
+int intel_perf_data_stream_seek_cpu_timestamp(struct intel_perf_data_stream *stream,
+					      uint64_t cpu_ts);
+
+uint64_t intel_perf_data_stream_cpu_timestamp(struct intel_perf_data_stream *stream,
+					      const struct drm_i915_perf_record_header *record);
+
 #ifdef __cplusplus
 };
 #endif
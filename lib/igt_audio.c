@@ -33,12 +33,16 @@
 #include <unistd.h>
 
 #include "igt_audio.h"
+#include "igt_aux.h"
 #include "igt_core.h"
+#include "igt_x86.h"
 
 #define FREQS_MAX 64
 #define CHANNELS_MAX 8
 #define SYNTHESIZE_AMPLITUDE 0.9
 #define SYNTHESIZE_ACCURACY 0.2
+/** FILL_BLOCK: number of frames mixed at once by #audio_signal_fill. */
+#define FILL_BLOCK 256
 /** MIN_FREQ: minimum frequency that audio_signal can generate.
  *
  * To make sure the audio signal doesn't contain noise, #audio_signal_detect
@@ -50,6 +54,10 @@
  */
 #define MIN_FREQ 200 /* Hz */
 #define NOISE_THRESHOLD 0.0005
+/** DETECT_RESIDUAL_THRESHOLD: maximum fraction of the power received outside
+ * of the expected frequencies by #audio_detector.
+ */
+#define DETECT_RESIDUAL_THRESHOLD 0.001
 
 /**
  * SECTION:igt_audio
@@ -65,6 +73,8 @@ struct audio_signal_freq {
 	int freq;
 	int channel;
 
+	/* A full period, followed by FILL_BLOCK more samples so that a block
+	 * can be read from any offset without wrapping around. */
 	double *period;
 	size_t period_len;
 	int offset;
@@ -76,6 +86,9 @@ struct audio_signal {
 
 	struct audio_signal_freq freqs[FREQS_MAX];
 	size_t freqs_count;
+
+	/* Weight of each frequency in the mix of a channel */
+	double channel_scale[CHANNELS_MAX];
 };
 
 /**
@@ -147,6 +160,21 @@ int audio_signal_add_frequency(struct audio_signal *signal, int frequency,
 	return 0;
 }
 
+static size_t audio_signal_count_freqs(struct audio_signal *signal, int channel)
+{
+	size_t n, i;
+	struct audio_signal_freq *freq;
+
+	n = 0;
+	for (i = 0; i < signal->freqs_count; i++) {
+		freq = &signal->freqs[i];
+		if (freq->channel < 0 || freq->channel == channel)
+			n++;
+	}
+
+	return n;
+}
+
 /**
  * audio_signal_synthesize:
  * @signal: The target signal structure
@@ -159,7 +187,7 @@ void audio_signal_synthesize(struct audio_signal *signal)
 {
 	double *period;
 	double value;
-	size_t period_len;
+	size_t period_len, n;
 	int freq;
 	int i, j;
 
@@ -167,7 +195,7 @@ void audio_signal_synthesize(struct audio_signal *signal)
 		freq = signal->freqs[i].freq;
 		period_len = signal->sampling_rate / freq;
 
-		period = calloc(period_len, sizeof(double));
+		period = calloc(period_len + FILL_BLOCK, sizeof(double));
 
 		for (j = 0; j < period_len; j++) {
 			value = 2.0 * M_PI * freq / signal->sampling_rate * j;
@@ -175,10 +203,17 @@ void audio_signal_synthesize(struct audio_signal *signal)
 
 			period[j] = value;
 		}
+		for (; j < period_len + FILL_BLOCK; j++)
+			period[j] = period[j - period_len];
 
 		signal->freqs[i].period = period;
 		signal->freqs[i].period_len = period_len;
 	}
+
+	for (i = 0; i < signal->channels; i++) {
+		n = audio_signal_count_freqs(signal, i);
+		signal->channel_scale[i] = n ? 1.0 / n : 0;
+	}
 }
 
 /**
@@ -210,21 +245,6 @@ void audio_signal_reset(struct audio_signal *signal)
 	signal->freqs_count = 0;
 }
 
-static size_t audio_signal_count_freqs(struct audio_signal *signal, int channel)
-{
-	size_t n, i;
-	struct audio_signal_freq *freq;
-
-	n = 0;
-	for (i = 0; i < signal->freqs_count; i++) {
-		freq = &signal->freqs[i];
-		if (freq->channel < 0 || freq->channel == channel)
-			n++;
-	}
-
-	return n;
-}
-
 /** audio_sanity_check:
  *
  * Make sure our generated signal is not messed up. In particular, make sure
@@ -235,24 +255,85 @@ static size_t audio_signal_count_freqs(struct audio_signal *signal, int channel)
  * want the signal not to reach 1.0 so that we're sure it won't get capped by
  * the audio card or the receiver.
  */
-static void audio_sanity_check(double *samples, size_t samples_len)
+static void audio_sanity_check(double min, double max)
 {
-	size_t i;
-	double min = 0, max = 0;
-
-	for (i = 0; i < samples_len; i++) {
-		if (samples[i] < min)
-			min = samples[i];
-		if (samples[i] > max)
-			max = samples[i];
-	}
-
 	igt_assert(-SYNTHESIZE_AMPLITUDE <= min);
 	igt_assert(min <= -SYNTHESIZE_AMPLITUDE + SYNTHESIZE_ACCURACY);
 	igt_assert(SYNTHESIZE_AMPLITUDE - SYNTHESIZE_ACCURACY <= max);
 	igt_assert(max <= SYNTHESIZE_AMPLITUDE);
 }
 
+/* Mix the next FILL_BLOCK frames of every channel, without consuming them. */
+static void audio_signal_mix(struct audio_signal *signal,
+			     double block[CHANNELS_MAX][FILL_BLOCK])
+{
+	struct audio_signal_freq *freq;
+	size_t i, j;
+	int k;
+
+	for (k = 0; k < signal->channels; k++)
+		memset(block[k], 0, sizeof(block[k]));
+
+	for (i = 0; i < signal->freqs_count; i++) {
+		const double *src;
+
+		freq = &signal->freqs[i];
+		igt_assert(freq->period);
+		src = freq->period + freq->offset;
+
+		for (k = 0; k < signal->channels; k++) {
+			double *restrict dst = block[k];
+
+			if (freq->channel >= 0 && freq->channel != k)
+				continue;
+
+			/* Fixed length, so that the compiler vectorizes it */
+			for (j = 0; j < FILL_BLOCK; j++)
+				dst[j] += src[j];
+		}
+	}
+
+	for (k = 0; k < signal->channels; k++) {
+		double *restrict dst = block[k];
+		double scale = signal->channel_scale[k];
+
+		igt_assert(scale > 0);
+		for (j = 0; j < FILL_BLOCK; j++)
+			dst[j] *= scale;
+	}
+}
+
+static void audio_signal_consume(struct audio_signal *signal, size_t frames)
+{
+	struct audio_signal_freq *freq;
+	size_t i;
+
+	for (i = 0; i < signal->freqs_count; i++) {
+		freq = &signal->freqs[i];
+		freq->offset = (freq->offset + frames) % freq->period_len;
+	}
+}
+
+/* Interleave the first frames of the block, keeping track of the range. */
+static void audio_signal_interleave(struct audio_signal *signal, double *dst,
+				    double block[CHANNELS_MAX][FILL_BLOCK],
+				    size_t frames, double *min, double *max)
+{
+	int channels = signal->channels;
+	size_t j;
+	int k;
+
+	for (k = 0; k < channels; k++) {
+		for (j = 0; j < frames; j++) {
+			double v = block[k][j];
+
+			dst[j * channels + k] = v;
+			*min = fmin(*min, v);
+			*max = fmax(*max, v);
+		}
+	}
+}
+
 /**
  * audio_signal_fill:
  * @signal: The target signal structure
@@ -268,52 +349,68 @@ static void audio_sanity_check(double *samples, size_t samples_len)
 void audio_signal_fill(struct audio_signal *signal, double *buffer,
 		       size_t samples)
 {
-	double *dst, *src;
-	struct audio_signal_freq *freq;
-	int total;
-	int count;
-	int i, j, k;
-	size_t freqs_per_channel[CHANNELS_MAX];
+	double block[CHANNELS_MAX][FILL_BLOCK];
+	double min = 0, max = 0;
+	size_t done, n;
 
-	memset(buffer, 0, sizeof(double) * signal->channels * samples);
+	for (done = 0; done < samples; done += n) {
+		n = min_t(size_t, samples - done, FILL_BLOCK);
 
-	for (i = 0; i < signal->channels; i++) {
-		freqs_per_channel[i] = audio_signal_count_freqs(signal, i);
-		igt_assert(freqs_per_channel[i] > 0);
+		audio_signal_mix(signal, block);
+		audio_signal_interleave(signal,
+					buffer + done * signal->channels,
+					block, n, &min, &max);
+		audio_signal_consume(signal, n);
 	}
 
-	for (i = 0; i < signal->freqs_count; i++) {
-		freq = &signal->freqs[i];
-		total = 0;
-
-		igt_assert(freq->period);
-
-		while (total < samples) {
-			src = freq->period + freq->offset;
-			dst = buffer + total * signal->channels;
+	audio_sanity_check(min, max);
+}
 
-			count = freq->period_len - freq->offset;
-			if (count > samples - total)
-				count = samples - total;
+static size_t audio_format_size(snd_pcm_format_t format)
+{
+	switch (format) {
+	case SND_PCM_FORMAT_S16_LE:
+		return sizeof(int16_t);
+	case SND_PCM_FORMAT_S24_LE:
+	case SND_PCM_FORMAT_S32_LE:
+		return sizeof(int32_t);
+	default:
+		assert(false); /* unreachable */
+		return 0;
+	}
+}
 
-			freq->offset += count;
-			freq->offset %= freq->period_len;
+/**
+ * audio_signal_fill_to:
+ * @signal: The target signal structure
+ * @buffer: The target buffer to fill
+ * @samples: The number of samples to fill
+ * @format: The PCM format of @buffer
+ *
+ * Same as audio_signal_fill() followed by audio_convert_to(), without an
+ * intermediate buffer for the whole signal: the signal is mixed and
+ * converted in small blocks.
+ */
+void audio_signal_fill_to(struct audio_signal *signal, void *buffer,
+			  size_t samples, snd_pcm_format_t format)
+{
+	double block[CHANNELS_MAX][FILL_BLOCK];
+	double tmp[CHANNELS_MAX * FILL_BLOCK];
+	size_t frame_size = audio_format_size(format) * signal->channels;
+	double min = 0, max = 0;
+	size_t done, n;
 
-			for (j = 0; j < count; j++) {
-				for (k = 0; k < signal->channels; k++) {
-					if (freq->channel >= 0 &&
-					    freq->channel != k)
-						continue;
-					dst[j * signal->channels + k] +=
-						src[j] / freqs_per_channel[k];
-				}
-			}
+	for (done = 0; done < samples; done += n) {
+		n = min_t(size_t, samples - done, FILL_BLOCK);
 
-			total += count;
-		}
+		audio_signal_mix(signal, block);
+		audio_signal_interleave(signal, tmp, block, n, &min, &max);
+		audio_convert_to((char *)buffer + done * frame_size, tmp,
+				 n * signal->channels, format);
+		audio_signal_consume(signal, n);
 	}
 
-	audio_sanity_check(buffer, signal->channels * samples);
+	audio_sanity_check(min, max);
 }
 
 /* See https://en.wikipedia.org/wiki/Window_function#Hann_and_Hamming_windows */
@@ -322,6 +419,15 @@ static double hann_window(double v, size_t i, size_t N)
 	return v * 0.5 * (1 - cos(2.0 * M_PI * (double) i / (double) N));
 }
 
+/* See https://en.wikipedia.org/wiki/Window_function#Blackman%E2%80%93Harris_window */
+static double blackman_harris_window(size_t i, size_t N)
+{
+	double x = 2.0 * M_PI * (double) i / (double) N;
+
+	return 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2 * x) -
+	       0.01168 * cos(3 * x);
+}
+
 /**
  * Checks that frequencies specified in signal, and only those, are included
  * in the input data.
@@ -492,6 +598,243 @@ bool audio_signal_detect(struct audio_signal *signal, int sampling_rate,
 	return success;
 }
 
+struct audio_detector_tone {
+	int freq;
+	double coeff;	/* 2 cos(w), w being the tone's angular frequency */
+	double s1, s2;	/* Goertzel filter state */
+};
+
+struct audio_detector {
+	size_t window_len;
+	double *window;
+	double window_sum, window_energy;
+
+	/* Progress through the current window */
+	size_t pos;
+	double energy;
+
+	struct audio_detector_tone tones[FREQS_MAX];
+	size_t tones_count;
+
+	unsigned int streak;
+};
+
+/**
+ * audio_detector_init:
+ * @signal: The signal to detect, with its frequencies already added
+ * @sampling_rate: The sampling rate of the samples to analyze
+ * @channel: The channel of @signal to detect
+ * @window_len: The number of samples to analyze at once
+ *
+ * Allocate a streaming detector for the frequencies of @channel of @signal.
+ * Unlike audio_signal_detect(), samples are fed as they are received and
+ * only the power at the expected frequencies is computed, with a Goertzel
+ * filter per frequency. A window is considered to contain the signal when
+ * each expected frequency is there, and there's little power left
+ * elsewhere, which catches additional frequencies, noise and glitches.
+ *
+ * Returns: A newly-allocated detector, to be freed with
+ * audio_detector_fini()
+ */
+struct audio_detector *audio_detector_init(struct audio_signal *signal,
+					   int sampling_rate, int channel,
+					   size_t window_len)
+{
+	struct audio_detector *detector;
+	struct audio_signal_freq *freq;
+	size_t i;
+
+	igt_assert(window_len > 0);
+
+	detector = calloc(1, sizeof(*detector));
+	igt_assert(detector);
+
+	/* The power of each frequency is estimated on its own, so any leak
+	 * from the other frequencies would show up as missing or unexpected
+	 * power. The Blackman-Harris window leaks much less than the Hann one.
+	 */
+	detector->window_len = window_len;
+	detector->window = malloc(window_len * sizeof(double));
+	igt_assert(detector->window);
+	for (i = 0; i < window_len; i++) {
+		detector->window[i] = blackman_harris_window(i, window_len);
+		detector->window_sum += detector->window[i];
+		detector->window_energy += detector->window[i] *
+					   detector->window[i];
+	}
+
+	for (i = 0; i < signal->freqs_count; i++) {
+		struct audio_detector_tone *tone;
+		double f;
+
+		freq = &signal->freqs[i];
+		if (freq->channel >= 0 && freq->channel != channel)
+			continue;
+
+		/* Look for the frequency audio_signal_synthesize() produces */
+		f = (double)signal->sampling_rate /
+		    (signal->sampling_rate / freq->freq);
+
+		tone = &detector->tones[detector->tones_count++];
+		tone->freq = freq->freq;
+		tone->coeff = 2.0 * cos(2.0 * M_PI * f / sampling_rate);
+	}
+
+	return detector;
+}
+
+/**
+ * audio_detector_fini:
+ * @detector: The detector to free
+ *
+ * Release the detector.
+ */
+void audio_detector_fini(struct audio_detector *detector)
+{
+	free(detector->window);
+	free(detector);
+}
+
+/**
+ * audio_detector_reset:
+ * @detector: The target detector
+ *
+ * Drop the samples of the current window and the detection streak.
+ */
+void audio_detector_reset(struct audio_detector *detector)
+{
+	size_t i;
+
+	for (i = 0; i < detector->tones_count; i++)
+		detector->tones[i].s1 = detector->tones[i].s2 = 0;
+
+	detector->pos = 0;
+	detector->energy = 0;
+	detector->streak = 0;
+}
+
+static bool audio_detector_check(struct audio_detector *detector)
+{
+	double amplitude[FREQS_MAX];
+	double max = 0, explained = 0, residual;
+	bool success = detector->tones_count > 0;
+	size_t i;
+
+	for (i = 0; i < detector->tones_count; i++) {
+		struct audio_detector_tone *tone = &detector->tones[i];
+		double power;
+
+		power = tone->s1 * tone->s1 + tone->s2 * tone->s2 -
+			tone->coeff * tone->s1 * tone->s2;
+		tone->s1 = tone->s2 = 0;
+
+		/* A windowed sine of amplitude A peaks at A * sum(w) / 2 */
+		amplitude[i] = 2 * sqrt(fmax(power, 0)) / detector->window_sum;
+		explained += amplitude[i] * amplitude[i] / 2 *
+			     detector->window_energy;
+		max = fmax(max, amplitude[i]);
+	}
+
+	/* Same criteria as the FFT peaks of audio_signal_detect() */
+	for (i = 0; i < detector->tones_count; i++) {
+		if (amplitude[i] > max / 2 && amplitude[i] > NOISE_THRESHOLD)
+			continue;
+
+		igt_debug("Missing frequency: %d\n", detector->tones[i].freq);
+		success = false;
+	}
+
+	residual = detector->energy - explained;
+	if (residual > DETECT_RESIDUAL_THRESHOLD * detector->energy) {
+		igt_debug("Unexpected signal: %.3f%% of the power isn't in the "
+			  "expected frequencies\n",
+			  100 * residual / detector->energy);
+		success = false;
+	}
+
+	detector->pos = 0;
+	detector->energy = 0;
+
+	return success;
+}
+
+static void audio_detector_push(struct audio_detector *detector, double sample)
+{
+	size_t i;
+
+	sample *= detector->window[detector->pos];
+	detector->energy += sample * sample;
+
+	for (i = 0; i < detector->tones_count; i++) {
+		struct audio_detector_tone *tone = &detector->tones[i];
+		double s = sample + tone->coeff * tone->s1 - tone->s2;
+
+		tone->s2 = tone->s1;
+		tone->s1 = s;
+	}
+
+	if (++detector->pos < detector->window_len)
+		return;
+
+	if (audio_detector_check(detector))
+		detector->streak++;
+	else
+		detector->streak = 0;
+}
+
+/**
+ * audio_detector_feed:
+ * @detector: The target detector
+ * @samples: The next samples of the channel
+ * @samples_len: The number of elements in @samples
+ *
+ * Analyze the next samples of the channel. Every time a window is complete,
+ * the signal is checked.
+ *
+ * Returns: The number of consecutive windows containing the signal, up to
+ * the last complete one
+ */
+unsigned int audio_detector_feed(struct audio_detector *detector,
+				 const double *samples, size_t samples_len)
+{
+	size_t i;
+
+	for (i = 0; i < samples_len; i++)
+		audio_detector_push(detector, samples[i]);
+
+	return detector->streak;
+}
+
+/**
+ * audio_detector_feed_s32_le:
+ * @detector: The target detector
+ * @src: The next samples, in interleaved S32_LE format
+ * @src_len: The number of elements in @src
+ * @n_channels: The number of channels in @src
+ * @channel: The channel of @src to analyze
+ *
+ * Same as audio_detector_feed(), picking the samples of a channel straight
+ * from a multi-channel capture, e.g. from
+ * chamelium_stream_receive_realtime_audio().
+ *
+ * Returns: The number of consecutive windows containing the signal, up to
+ * the last complete one
+ */
+unsigned int audio_detector_feed_s32_le(struct audio_detector *detector,
+					const int32_t *src, size_t src_len,
+					int n_channels, int channel)
+{
+	size_t i;
+
+	igt_assert(channel < n_channels);
+	igt_assert(src_len % n_channels == 0);
+
+	for (i = channel; i < src_len; i += n_channels)
+		audio_detector_push(detector, (double) src[i] / INT32_MAX);
+
+	return detector->streak;
+}
+
 /**
  * audio_extract_channel_s32_le: extracts a single channel from a multi-channel
  * S32_LE input buffer.
@@ -544,8 +887,8 @@ static void audio_convert_to_s32_le(int32_t *dst, double *src, size_t len)
 		dst[i] = INT32_MAX * src[i];
 }
 
-void audio_convert_to(void *dst, double *src, size_t len,
-		      snd_pcm_format_t format)
+static void __audio_convert_to(void *dst, double *src, size_t len,
+			       snd_pcm_format_t format)
 {
 	switch (format) {
 	case SND_PCM_FORMAT_S16_LE:
@@ -562,6 +905,94 @@ void audio_convert_to(void *dst, double *src, size_t len,
 	}
 }
 
+#if defined(__x86_64__) && !defined(__clang__) && defined(__GLIBC__) && !defined(__UCLIBC__)
+#pragma GCC push_options
+#pragma GCC target("avx")
+
+#include <immintrin.h>
+
+/* Truncates like the C conversions, four samples at a time. */
+static void audio_convert_to_s16_le_avx(int16_t *dst, double *src, size_t len)
+{
+	const __m256d scale = _mm256_set1_pd(INT16_MAX);
+	size_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		__m128i lo, hi;
+
+		lo = _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_loadu_pd(src + i),
+						       scale));
+		hi = _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_loadu_pd(src + i + 4),
+						       scale));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(lo, hi));
+	}
+
+	audio_convert_to_s16_le(dst + i, src + i, len - i);
+}
+
+static void audio_convert_to_s32_avx(int32_t *dst, double *src, size_t len,
+				     double max)
+{
+	const __m256d scale = _mm256_set1_pd(max);
+	size_t i;
+
+	for (i = 0; i + 4 <= len; i += 4)
+		_mm_storeu_si128((__m128i *)(dst + i),
+				 _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_loadu_pd(src + i),
+								   scale)));
+
+	for (; i < len; i++)
+		dst[i] = max * src[i];
+}
+
+static void audio_convert_to_avx(void *dst, double *src, size_t len,
+				 snd_pcm_format_t format)
+{
+	switch (format) {
+	case SND_PCM_FORMAT_S16_LE:
+		audio_convert_to_s16_le_avx(dst, src, len);
+		break;
+	case SND_PCM_FORMAT_S24_LE:
+		audio_convert_to_s32_avx(dst, src, len, 0x7FFFFF);
+		break;
+	case SND_PCM_FORMAT_S32_LE:
+		audio_convert_to_s32_avx(dst, src, len, INT32_MAX);
+		break;
+	default:
+		assert(false); /* unreachable */
+	}
+}
+
+#pragma GCC pop_options
+
+/* The PLT is not initialized when ifunc resolvers run, so all external
+ * functions must be inlined with __attribute__((flatten)).
+ */
+__attribute__((flatten))
+static void (*resolve_audio_convert_to(void))(void *dst, double *src,
+					      size_t len,
+					      snd_pcm_format_t format)
+{
+	if (igt_x86_features() & AVX)
+		return audio_convert_to_avx;
+
+	return __audio_convert_to;
+}
+
+void audio_convert_to(void *dst, double *src, size_t len,
+		      snd_pcm_format_t format)
+	__attribute__((ifunc("resolve_audio_convert_to")));
+
+#else
+
+void audio_convert_to(void *dst, double *src, size_t len,
+		      snd_pcm_format_t format)
+{
+	__audio_convert_to(dst, src, len, format);
+}
+
+#endif
+
 #define RIFF_TAG "RIFF"
 #define WAVE_TAG "WAVE"
 #define FMT_TAG "fmt "
@@ -35,6 +35,7 @@
 #include <alsa/asoundlib.h>
 
 struct audio_signal;
+struct audio_detector;
 
 struct audio_signal *audio_signal_init(int channels, int sampling_rate);
 void audio_signal_fini(struct audio_signal *signal);
@@ -44,8 +45,20 @@ void audio_signal_synthesize(struct audio_signal *signal);
 void audio_signal_reset(struct audio_signal *signal);
 void audio_signal_fill(struct audio_signal *signal, double *buffer,
 		       size_t samples);
+void audio_signal_fill_to(struct audio_signal *signal, void *buffer,
+			  size_t samples, snd_pcm_format_t format);
 bool audio_signal_detect(struct audio_signal *signal, int sampling_rate,
 			 int channel, const double *samples, size_t samples_len);
+struct audio_detector *audio_detector_init(struct audio_signal *signal,
+					   int sampling_rate, int channel,
+					   size_t window_len);
+void audio_detector_fini(struct audio_detector *detector);
+void audio_detector_reset(struct audio_detector *detector);
+unsigned int audio_detector_feed(struct audio_detector *detector,
+				 const double *samples, size_t samples_len);
+unsigned int audio_detector_feed_s32_le(struct audio_detector *detector,
+					const int32_t *src, size_t src_len,
+					int n_channels, int channel);
 size_t audio_extract_channel_s32_le(double *dst, size_t dst_cap,
 				    int32_t *src, size_t src_len,
 				    int n_channels, int channel);
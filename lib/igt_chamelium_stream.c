@@ -28,6 +28,7 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <netdb.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <sys/types.h>
@@ -71,11 +72,45 @@ enum stream_message_type {
 	STREAM_MESSAGE_STOP_DUMP_AUDIO = 8,
 };
 
+struct stream_audio_slot {
+	struct chamelium_stream_audio_page page;
+	size_t size; /* allocated bytes */
+};
+
+/* State of the pipelined real-time audio receiver. */
+struct stream_audio_ring {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	struct stream_audio_slot *slots;
+	size_t len;
+	/* Free running counters, the slot index is the counter modulo len.
+	 * Pages are written by the receiver thread, then handed to the
+	 * consumer, then released by the consumer. */
+	unsigned long produced, handed, released;
+	struct chamelium_stream_audio_stats stats;
+
+	/* Set when the stop request is sent, later pages are discarded */
+	bool stopping;
+	/* Set by the receiver thread when it exits */
+	bool done;
+	bool error;
+	bool joined;
+	/* Response to the stop request, read by the receiver thread */
+	bool stopped;
+	enum stream_message_type stop_type;
+	enum stream_error stop_err;
+	size_t stop_len;
+};
+
 struct chamelium_stream {
 	char *host;
 	unsigned int port;
 
 	int fd;
+
+	struct stream_audio_ring *audio;
 };
 
 static const char *stream_error_str(enum stream_error err)
@@ -438,6 +473,8 @@ bool chamelium_stream_receive_realtime_audio(struct chamelium_stream *client,
 	char page_count_buf[4];
 	int32_t *ptr;
 
+	igt_assert(!client->audio || client->audio->joined);
+
 	while (true) {
 		if (!chamelium_stream_read_header(client, &kind, &type,
 						  &err, &body_len))
@@ -487,12 +524,37 @@ bool chamelium_stream_receive_realtime_audio(struct chamelium_stream *client,
 	return read_whole(client->fd, *buf, body_len);
 }
 
+/* Joins the pipelined receiver, which exits after reading the response. */
+static bool chamelium_stream_join_audio(struct chamelium_stream *client,
+					enum stream_message_type *type,
+					enum stream_error *err, size_t *len)
+{
+	struct stream_audio_ring *ring = client->audio;
+
+	pthread_join(ring->thread, NULL);
+	ring->joined = true;
+	/* Drop the pages which were not handed to the caller yet */
+	ring->handed = ring->produced;
+
+	if (!ring->stopped)
+		return false;
+
+	*type = ring->stop_type;
+	*err = ring->stop_err;
+	*len = ring->stop_len;
+	return true;
+}
+
 /**
  * chamelium_stream_stop_realtime_audio:
  *
  * Stops real-time audio capture. This also drops any buffered audio pages.
  * The caller shouldn't call #chamelium_stream_receive_realtime_audio after
  * stopping audio capture.
+ *
+ * If the capture was started with #chamelium_stream_start_realtime_audio,
+ * this also stops the pipelined receiver. The pages it still holds remain
+ * valid until the next capture is started.
  */
 bool chamelium_stream_stop_realtime_audio(struct chamelium_stream *client)
 {
@@ -503,21 +565,32 @@ bool chamelium_stream_stop_realtime_audio(struct chamelium_stream *client)
 
 	igt_debug("Stopping real-time audio capture\n");
 
+	if (client->audio && !client->audio->joined) {
+		pthread_mutex_lock(&client->audio->lock);
+		client->audio->stopping = true;
+		pthread_mutex_unlock(&client->audio->lock);
+	}
+
 	if (!chamelium_stream_write_request(client,
 					    STREAM_MESSAGE_STOP_DUMP_AUDIO,
 					    NULL, 0))
 		return false;
 
-	while (true) {
-		if (!chamelium_stream_read_header(client, &kind, &type,
-						  &err, &len))
+	if (client->audio && !client->audio->joined) {
+		if (!chamelium_stream_join_audio(client, &type, &err, &len))
 			return false;
+	} else {
+		while (true) {
+			if (!chamelium_stream_read_header(client, &kind, &type,
+							  &err, &len))
+				return false;
 
-		if (kind == STREAM_MESSAGE_RESPONSE)
-			break;
+			if (kind == STREAM_MESSAGE_RESPONSE)
+				break;
 
-		if (!read_and_discard(client->fd, len))
-			return false;
+			if (!read_and_discard(client->fd, len))
+				return false;
+		}
 	}
 
 	if (type != STREAM_MESSAGE_STOP_DUMP_AUDIO) {
@@ -537,19 +610,255 @@ bool chamelium_stream_stop_realtime_audio(struct chamelium_stream *client)
 	return true;
 }
 
+/* Receives real-time audio pages until the stop response, directly into the
+ * ring slots. This thread never waits for the consumer: if the ring is full
+ * the page is discarded, so that the Chamelium doesn't overflow. */
+static void *chamelium_stream_audio_thread(void *data)
+{
+	struct chamelium_stream *client = data;
+	struct stream_audio_ring *ring = client->audio;
+	struct stream_audio_slot *slot;
+	enum stream_message_kind kind;
+	enum stream_message_type type;
+	enum stream_error err;
+	size_t len;
+	char page_count_buf[4];
+	bool ok = false, discard;
+	void *ptr;
+
+	while (true) {
+		if (!chamelium_stream_read_header(client, &kind, &type,
+						  &err, &len))
+			break;
+
+		if (kind == STREAM_MESSAGE_RESPONSE) {
+			ring->stop_type = type;
+			ring->stop_err = err;
+			ring->stop_len = len;
+			ring->stopped = true;
+			ok = true;
+			break;
+		}
+
+		if (kind != STREAM_MESSAGE_DATA ||
+		    type != STREAM_MESSAGE_DUMP_REALTIME_AUDIO) {
+			igt_warn("Expected real-time audio dump message, "
+				 "got kind %d type %d\n", kind, type);
+			break;
+		}
+
+		if (err == STREAM_ERROR_AUDIO_MEM_OVERFLOW_DROP) {
+			igt_debug("Dropped an audio page because of an overflow\n");
+			pthread_mutex_lock(&ring->lock);
+			ring->stats.dropped++;
+			pthread_mutex_unlock(&ring->lock);
+
+			if (!read_and_discard(client->fd, len))
+				break;
+			continue;
+		} else if (err != STREAM_ERROR_NONE) {
+			igt_warn("Received error: %s (%d)\n",
+				 stream_error_str(err), err);
+			break;
+		}
+
+		if (len < sizeof(page_count_buf) ||
+		    (len - sizeof(page_count_buf)) % sizeof(int32_t) != 0) {
+			igt_warn("Invalid audio page size: %zu bytes\n", len);
+			break;
+		}
+
+		if (!read_whole(client->fd, page_count_buf,
+				sizeof(page_count_buf)))
+			break;
+		len -= sizeof(page_count_buf);
+
+		pthread_mutex_lock(&ring->lock);
+		discard = ring->stopping;
+		if (!discard && ring->produced - ring->released == ring->len) {
+			ring->stats.overruns++;
+			discard = true;
+		}
+		slot = &ring->slots[ring->produced % ring->len];
+		pthread_mutex_unlock(&ring->lock);
+
+		if (discard) {
+			if (!read_and_discard(client->fd, len))
+				break;
+			continue;
+		}
+
+		/* The slot isn't visible to the consumer until produced is
+		 * bumped, so it can be filled without the lock. */
+		if (slot->size < len) {
+			ptr = realloc(slot->page.buf, len);
+			if (!ptr) {
+				igt_warn("realloc failed: %s\n", strerror(errno));
+				break;
+			}
+			slot->page.buf = ptr;
+			slot->size = len;
+		}
+		slot->page.page_count = ntohl(*(uint32_t *) &page_count_buf[0]);
+		slot->page.buf_len = len / sizeof(int32_t);
+
+		if (!read_whole(client->fd, slot->page.buf, len))
+			break;
+
+		pthread_mutex_lock(&ring->lock);
+		ring->produced++;
+		ring->stats.received++;
+		pthread_cond_signal(&ring->cond);
+		pthread_mutex_unlock(&ring->lock);
+	}
+
+	pthread_mutex_lock(&ring->lock);
+	ring->done = true;
+	ring->error = !ok;
+	pthread_cond_signal(&ring->cond);
+	pthread_mutex_unlock(&ring->lock);
+
+	return NULL;
+}
+
+static void chamelium_stream_audio_ring_free(struct chamelium_stream *client)
+{
+	struct stream_audio_ring *ring = client->audio;
+	size_t i;
+
+	for (i = 0; i < ring->len; i++)
+		free(ring->slots[i].page.buf);
+	free(ring->slots);
+	pthread_cond_destroy(&ring->cond);
+	pthread_mutex_destroy(&ring->lock);
+	free(ring);
+	client->audio = NULL;
+}
+
 /**
- * chamelium_stream_init:
+ * chamelium_stream_start_realtime_audio:
+ * @mode: the real-time mode requested to the Chamelium
+ * @ring_len: number of pages which can be buffered before they are released
  *
- * Connects to the Chamelium streaming server.
+ * Starts audio capture, with a pipelined receiver: pages are read on a
+ * dedicated thread into a ring of @ring_len page buffers, and handed to the
+ * caller with #chamelium_stream_next_audio_page without any copy.
+ *
+ * The receiver keeps reading the socket while the ring is full, discarding
+ * pages: see #chamelium_stream_get_audio_stats.
  */
-struct chamelium_stream *chamelium_stream_init(void)
+bool chamelium_stream_start_realtime_audio(struct chamelium_stream *client,
+					   enum chamelium_stream_realtime_mode mode,
+					   size_t ring_len)
 {
-	struct chamelium_stream *client;
+	struct stream_audio_ring *ring;
+	int ret;
 
-	client = calloc(1, sizeof(*client));
+	igt_assert(ring_len > 0);
+	if (client->audio) {
+		igt_assert(client->audio->joined);
+		chamelium_stream_audio_ring_free(client);
+	}
 
-	if (!chamelium_stream_read_config(client))
-		goto error_client;
+	if (!chamelium_stream_dump_realtime_audio(client, mode))
+		return false;
+
+	ring = calloc(1, sizeof(*ring));
+	igt_assert(ring);
+	ring->slots = calloc(ring_len, sizeof(*ring->slots));
+	igt_assert(ring->slots);
+	ring->len = ring_len;
+	pthread_mutex_init(&ring->lock, NULL);
+	pthread_cond_init(&ring->cond, NULL);
+	client->audio = ring;
+
+	ret = pthread_create(&ring->thread, NULL,
+			     chamelium_stream_audio_thread, client);
+	if (ret != 0) {
+		igt_warn("pthread_create failed: %s\n", strerror(ret));
+		chamelium_stream_audio_ring_free(client);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * chamelium_stream_next_audio_page:
+ *
+ * Waits for the next audio page received by the pipelined receiver started
+ * with #chamelium_stream_start_realtime_audio. The page buffer belongs to the
+ * ring: it stays valid until the page is released with
+ * #chamelium_stream_release_audio_page. Several pages can be held at once,
+ * and must be released in order.
+ *
+ * Returns: the next page, or NULL if the receiver stopped because of an error.
+ */
+struct chamelium_stream_audio_page *
+chamelium_stream_next_audio_page(struct chamelium_stream *client)
+{
+	struct stream_audio_ring *ring = client->audio;
+	struct chamelium_stream_audio_page *page = NULL;
+
+	igt_assert(ring);
+
+	pthread_mutex_lock(&ring->lock);
+	while (ring->handed == ring->produced && !ring->done)
+		pthread_cond_wait(&ring->cond, &ring->lock);
+	if (ring->handed != ring->produced)
+		page = &ring->slots[ring->handed++ % ring->len].page;
+	pthread_mutex_unlock(&ring->lock);
+
+	return page;
+}
+
+/**
+ * chamelium_stream_release_audio_page:
+ * @page: the oldest page returned by #chamelium_stream_next_audio_page and
+ * not released yet
+ *
+ * Gives the page buffer back to the receiver.
+ */
+void chamelium_stream_release_audio_page(struct chamelium_stream *client,
+					 struct chamelium_stream_audio_page *page)
+{
+	struct stream_audio_ring *ring = client->audio;
+
+	igt_assert(ring);
+
+	pthread_mutex_lock(&ring->lock);
+	igt_assert(ring->released != ring->handed);
+	igt_assert(page == &ring->slots[ring->released % ring->len].page);
+	ring->released++;
+	pthread_mutex_unlock(&ring->lock);
+}
+
+/**
+ * chamelium_stream_get_audio_stats:
+ * @stats: will be filled with the pipelined receiver statistics
+ *
+ * Can be called while the receiver is running, or after
+ * #chamelium_stream_stop_realtime_audio to get the final statistics of the
+ * last capture.
+ */
+void chamelium_stream_get_audio_stats(struct chamelium_stream *client,
+				      struct chamelium_stream_audio_stats *stats)
+{
+	struct stream_audio_ring *ring = client->audio;
+
+	if (!ring) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	pthread_mutex_lock(&ring->lock);
+	*stats = ring->stats;
+	pthread_mutex_unlock(&ring->lock);
+}
+
+static struct chamelium_stream *
+chamelium_stream_open(struct chamelium_stream *client)
+{
 	if (!chamelium_stream_connect(client))
 		goto error_client;
 	if (!chamelium_stream_check_version(client))
@@ -560,13 +869,64 @@ struct chamelium_stream *chamelium_stream_init(void)
 error_fd:
 	close(client->fd);
 error_client:
+	free(client->host);
 	free(client);
 	return NULL;
 }
 
+/**
+ * chamelium_stream_init:
+ *
+ * Connects to the Chamelium streaming server.
+ */
+struct chamelium_stream *chamelium_stream_init(void)
+{
+	struct chamelium_stream *client;
+
+	client = calloc(1, sizeof(*client));
+
+	if (!chamelium_stream_read_config(client)) {
+		free(client->host);
+		free(client);
+		return NULL;
+	}
+
+	return chamelium_stream_open(client);
+}
+
+/**
+ * chamelium_stream_init_with_host:
+ * @host: the host name or address of the stream server
+ * @port: the TCP port of the stream server
+ *
+ * Connects to the stream server at the given address, instead of the one
+ * of the Chamelium from the configuration file.
+ */
+struct chamelium_stream *chamelium_stream_init_with_host(const char *host,
+							 unsigned int port)
+{
+	struct chamelium_stream *client;
+
+	client = calloc(1, sizeof(*client));
+	client->host = strdup(host);
+	client->port = port;
+
+	return chamelium_stream_open(client);
+}
+
 void chamelium_stream_deinit(struct chamelium_stream *client)
 {
+	if (client->audio) {
+		/* Unblock the receiver if the capture wasn't stopped */
+		if (!client->audio->joined) {
+			shutdown(client->fd, SHUT_RDWR);
+			pthread_join(client->audio->thread, NULL);
+		}
+		chamelium_stream_audio_ring_free(client);
+	}
+
 	if (close(client->fd) != 0)
 		igt_warn("close failed: %s\n", strerror(errno));
+	free(client->host);
 	free(client);
 }
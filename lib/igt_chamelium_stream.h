@@ -41,7 +41,34 @@ enum chamelium_stream_realtime_mode {
 
 struct chamelium_stream;
 
+/**
+ * chamelium_stream_audio_page:
+ * @page_count: the page number, as dumped by the Chamelium
+ * @buf: the page samples, in interleaved S32_LE format
+ * @buf_len: number of elements of @buf
+ */
+struct chamelium_stream_audio_page {
+	size_t page_count;
+	int32_t *buf;
+	size_t buf_len;
+};
+
+/**
+ * chamelium_stream_audio_stats:
+ * @received: pages received and queued for the consumer
+ * @dropped: pages dropped by the Chamelium because of an overflow
+ * @overruns: pages discarded because the consumer didn't release pages fast
+ * enough and the ring was full
+ */
+struct chamelium_stream_audio_stats {
+	unsigned long received;
+	unsigned long dropped;
+	unsigned long overruns;
+};
+
 struct chamelium_stream *chamelium_stream_init(void);
+struct chamelium_stream *chamelium_stream_init_with_host(const char *host,
+							 unsigned int port);
 void chamelium_stream_deinit(struct chamelium_stream *client);
 bool chamelium_stream_dump_realtime_audio(struct chamelium_stream *client,
 					  enum chamelium_stream_realtime_mode mode);
@@ -49,5 +76,14 @@ bool chamelium_stream_receive_realtime_audio(struct chamelium_stream *client,
 					     size_t *page_count,
 					     int32_t **buf, size_t *buf_len);
 bool chamelium_stream_stop_realtime_audio(struct chamelium_stream *client);
+bool chamelium_stream_start_realtime_audio(struct chamelium_stream *client,
+					   enum chamelium_stream_realtime_mode mode,
+					   size_t ring_len);
+struct chamelium_stream_audio_page *
+chamelium_stream_next_audio_page(struct chamelium_stream *client);
+void chamelium_stream_release_audio_page(struct chamelium_stream *client,
+					 struct chamelium_stream_audio_page *page);
+void chamelium_stream_get_audio_stats(struct chamelium_stream *client,
+				      struct chamelium_stream_audio_stats *stats);
 
 #endif
@@ -47,6 +47,7 @@
 #include <sys/syscall.h>
 #endif
 #include <pthread.h>
+#include <sched.h>
 #include <sys/utsname.h>
 #include <termios.h>
 #include <errno.h>
@@ -347,14 +348,46 @@ static int igt_exitcode = IGT_EXIT_SUCCESS;
 static const char *command_str;
 
 static char* igt_log_domain_filter;
+
+/*
+ * Every log message, filtered or not, is kept in a ring so that the last ones
+ * can be dumped when a test fails. Writers claim the slots with an atomic
+ * sequence number instead of a global lock, and only store the pieces of the
+ * message: the line is formatted when the ring is dumped or inspected.
+ */
+#define LOG_BUFFER_SIZE 256
+#define LOG_ENTRY_SIZE 1024 /* messages igt_vlog() formats on the stack */
+#define LOG_PREFIX_SIZE 32
+#define LOG_THREAD_ID_SIZE (LOG_PREFIX_SIZE + 24)
+#define LOG_DOMAIN_SIZE 32
+
+struct log_entry {
+	uint64_t seq; /* sequence number + 1, 0 if unused */
+	bool busy;
+	bool continuation;
+	bool has_domain;
+	enum igt_log_level level;
+	pid_t pid;
+	char thread_id[LOG_THREAD_ID_SIZE];
+	char domain[LOG_DOMAIN_SIZE];
+	char text[LOG_ENTRY_SIZE];
+	char *long_text; /* messages which do not fit in text, owned */
+};
+
 static struct {
-	char *entries[256];
-	uint8_t start, end;
+	struct log_entry entries[LOG_BUFFER_SIZE];
+	uint64_t start, end;
 } log_buffer;
-static pthread_mutex_t log_buffer_mutex = PTHREAD_MUTEX_INITIALIZER;
-#define LOG_PREFIX_SIZE 32
 char log_prefix[LOG_PREFIX_SIZE] = { 0 };
 
+static const char * const igt_log_level_str[] = {
+	"DEBUG",
+	"INFO",
+	"WARNING",
+	"CRITICAL",
+	"NONE"
+};
+
 GKeyFile *igt_key_file;
 
 char *igt_frame_dump_path;
@@ -447,26 +480,147 @@ const char *igt_test_name(void)
 	return command_str;
 }
 
-static void _igt_log_buffer_append(char *line)
+static const char *log_program_name(void)
+{
+#ifdef __GLIBC__
+	return program_invocation_short_name;
+#else
+	return command_str;
+#endif
+}
+
+/* getpid() is a syscall, the pid is refreshed after fork() instead. */
+static pid_t log_pid;
+
+static void log_refresh_pid(void)
+{
+	log_pid = getpid();
+}
+
+igt_constructor {
+	log_refresh_pid();
+	pthread_atfork(NULL, NULL, log_refresh_pid);
+}
+
+static void log_entry_lock(struct log_entry *entry)
+{
+	/* Only contended when writers lap the whole ring. */
+	while (__atomic_exchange_n(&entry->busy, true, __ATOMIC_ACQUIRE))
+		sched_yield();
+}
+
+static void log_entry_unlock(struct log_entry *entry)
 {
-	pthread_mutex_lock(&log_buffer_mutex);
+	__atomic_store_n(&entry->busy, false, __ATOMIC_RELEASE);
+}
 
-	free(log_buffer.entries[log_buffer.end]);
-	log_buffer.entries[log_buffer.end] = line;
-	log_buffer.end++;
-	if (log_buffer.end == log_buffer.start)
-		log_buffer.start++;
+static void copy_string(char *dst, size_t size, const char *src)
+{
+	size_t len = strnlen(src, size - 1);
 
-	pthread_mutex_unlock(&log_buffer_mutex);
+	memcpy(dst, src, len);
+	dst[len] = '\0';
+}
+
+/*
+ * Messages shorter than LOG_ENTRY_SIZE are copied into the entry, longer ones
+ * come from vasprintf() and the entry takes over @line.
+ */
+static void _igt_log_buffer_append(const char *domain, enum igt_log_level level,
+				   const char *thread_id, bool continuation,
+				   char *line, size_t len)
+{
+	uint64_t seq = __atomic_fetch_add(&log_buffer.end, 1, __ATOMIC_RELAXED);
+	struct log_entry *entry = &log_buffer.entries[seq % LOG_BUFFER_SIZE];
+
+	log_entry_lock(entry);
+
+	/* A writer lapping the ring may have filled the slot already. */
+	if (entry->seq > seq) {
+		if (len >= sizeof(entry->text))
+			free(line);
+		goto out;
+	}
+
+	entry->seq = seq + 1;
+	entry->level = level;
+	entry->pid = log_pid;
+	entry->continuation = continuation;
+	copy_string(entry->thread_id, sizeof(entry->thread_id), thread_id);
+	entry->has_domain = domain;
+	if (domain)
+		copy_string(entry->domain, sizeof(entry->domain), domain);
+
+	free(entry->long_text);
+	entry->long_text = NULL;
+	if (len < sizeof(entry->text))
+		memcpy(entry->text, line, len + 1);
+	else
+		entry->long_text = line;
+
+out:
+	log_entry_unlock(entry);
 }
 
 static void _igt_log_buffer_reset(void)
 {
-	pthread_mutex_lock(&log_buffer_mutex);
+	__atomic_store_n(&log_buffer.start,
+			 __atomic_load_n(&log_buffer.end, __ATOMIC_RELAXED),
+			 __ATOMIC_RELAXED);
+}
+
+static bool _igt_log_buffer_empty(void)
+{
+	return __atomic_load_n(&log_buffer.start, __ATOMIC_RELAXED) ==
+	       __atomic_load_n(&log_buffer.end, __ATOMIC_RELAXED);
+}
+
+/* Formats the line as it would have been printed, called with @entry locked. */
+static char *log_entry_format(const struct log_entry *entry)
+{
+	const char *text = entry->long_text ?: entry->text;
+	char *line;
+
+	if (entry->continuation)
+		return strdup(text);
 
-	log_buffer.start = log_buffer.end = 0;
+	if (asprintf(&line, "(%s:%d) %s%s%s%s: %s", log_program_name(),
+		     entry->pid, entry->thread_id,
+		     entry->has_domain ? entry->domain : "",
+		     entry->has_domain ? "-" : "",
+		     igt_log_level_str[entry->level], text) == -1)
+		return NULL;
 
-	pthread_mutex_unlock(&log_buffer_mutex);
+	return line;
+}
+
+static void _igt_log_buffer_for_each(igt_buffer_log_handler_t fn, void *data)
+{
+	uint64_t seq = __atomic_load_n(&log_buffer.start, __ATOMIC_RELAXED);
+	uint64_t end = __atomic_load_n(&log_buffer.end, __ATOMIC_RELAXED);
+
+	if (end - seq > LOG_BUFFER_SIZE)
+		seq = end - LOG_BUFFER_SIZE;
+
+	for (; seq < end; seq++) {
+		struct log_entry *entry = &log_buffer.entries[seq % LOG_BUFFER_SIZE];
+		char *line = NULL;
+		bool stop;
+
+		/* Slots still being written or already reused are skipped. */
+		log_entry_lock(entry);
+		if (entry->seq == seq + 1)
+			line = log_entry_format(entry);
+		log_entry_unlock(entry);
+
+		if (!line)
+			continue;
+
+		stop = fn(line, data);
+		free(line);
+		if (stop)
+			break;
+	}
 }
 
 static void _log_to_runner_split(int stream, const char *str)
@@ -572,10 +726,14 @@ static void _subtest_starting_message(enum _subtest_type subtest_type,
 			name);
 }
 
-static void _igt_log_buffer_dump(void)
+static bool _igt_log_buffer_dump_line(const char *line, void *data)
 {
-	uint8_t i;
+	_log_line_fprintf(stderr, "%s", line);
+	return false;
+}
 
+static void _igt_log_buffer_dump(void)
+{
 	if (in_subtest && !in_dynamic_subtest && _igt_dynamic_tests_executed >= 0) {
 		/*
 		 * We're exiting a subtest with dynamic subparts and
@@ -600,26 +758,19 @@ static void _igt_log_buffer_dump(void)
 	else
 		_log_line_fprintf(stderr, "Test %s failed.\n", command_str);
 
-	if (log_buffer.start == log_buffer.end) {
+	if (_igt_log_buffer_empty()) {
 		_log_line_fprintf(stderr, "No log.\n");
 		return;
 	}
 
-	pthread_mutex_lock(&log_buffer_mutex);
 	_log_line_fprintf(stderr, "**** DEBUG ****\n");
 
-	i = log_buffer.start;
-	do {
-		char *last_line = log_buffer.entries[i];
-		_log_line_fprintf(stderr, "%s", last_line);
-		i++;
-	} while (i != log_buffer.start && i != log_buffer.end);
+	_igt_log_buffer_for_each(_igt_log_buffer_dump_line, NULL);
 
 	/* reset the buffer */
-	log_buffer.start = log_buffer.end = 0;
+	_igt_log_buffer_reset();
 
 	_log_line_fprintf(stderr, "****  END  ****\n");
-	pthread_mutex_unlock(&log_buffer_mutex);
 }
 
 /**
@@ -633,17 +784,7 @@ static void _igt_log_buffer_dump(void)
  */
 void igt_log_buffer_inspect(igt_buffer_log_handler_t check, void *data)
 {
-	uint8_t i;
-	pthread_mutex_lock(&log_buffer_mutex);
-
-	i = log_buffer.start;
-	do {
-		if (check(log_buffer.entries[i], data))
-			break;
-		i++;
-	} while (i != log_buffer.start && i != log_buffer.end);
-
-	pthread_mutex_unlock(&log_buffer_mutex);
+	_igt_log_buffer_for_each(check, data);
 }
 
 void igt_kmsg(const char *format, ...)
@@ -1647,6 +1788,7 @@ __noreturn static void exit_subtest(const char *result)
 	 */
 	intel_allocator_init();
 	intel_bb_reinit_allocator();
+	intel_bb_pool_reinit();
 	gem_pool_init();
 
 	if (!in_dynamic_subtest)
@@ -3065,11 +3207,8 @@ void igt_log(const char *domain, enum igt_log_level level, const char *format, .
 	va_end(args);
 }
 
-static pthread_key_t __vlog_line_continuation;
-
-igt_constructor {
-	pthread_key_create(&__vlog_line_continuation, NULL);
-}
+/* Whether the last message of the thread did not end its line. */
+static __thread bool vlog_line_continuation;
 
 /**
  * igt_vlog:
@@ -3088,58 +3227,33 @@ igt_constructor {
 void igt_vlog(const char *domain, enum igt_log_level level, const char *format, va_list args)
 {
 	FILE *file;
-	char *line, *formatted_line;
-	char *thread_id;
-	const char *program_name;
-	const char *igt_log_level_str[] = {
-		"DEBUG",
-		"INFO",
-		"WARNING",
-		"CRITICAL",
-		"NONE"
-	};
+	char buf[LOG_ENTRY_SIZE], *line = buf;
+	char thread_id[LOG_THREAD_ID_SIZE];
+	bool continuation;
+	va_list copy;
+	int len;
 
 	assert(format);
 
-#ifdef __GLIBC__
-	program_name = program_invocation_short_name;
-#else
-	program_name = command_str;
-#endif
-
-	if (igt_thread_is_main()) {
-		thread_id = strdup(log_prefix);
-	} else {
-		if (asprintf(&thread_id, "%s[thread:%d] ", log_prefix, gettid()) == -1)
-			thread_id = NULL;
-	}
-
-	if (!thread_id)
-		return;
-
 	if (igt_only_list_subtests() && level <= IGT_LOG_WARN)
 		return;
 
-	if (vasprintf(&line, format, args) == -1)
-		return;
-
-	if (pthread_getspecific(__vlog_line_continuation)) {
-		formatted_line = strdup(line);
-		if (!formatted_line)
-			goto out;
-	} else if (asprintf(&formatted_line, "(%s:%d) %s%s%s%s: %s", program_name,
-		     getpid(), thread_id, (domain) ? domain : "", (domain) ? "-" : "",
-		     igt_log_level_str[level], line) == -1) {
-		goto out;
-	}
-
-	if (line[strlen(line) - 1] == '\n')
-		pthread_setspecific(__vlog_line_continuation, (void*) false);
+	if (igt_thread_is_main())
+		copy_string(thread_id, sizeof(thread_id), log_prefix);
 	else
-		pthread_setspecific(__vlog_line_continuation, (void*) true);
+		snprintf(thread_id, sizeof(thread_id), "%s[thread:%d] ",
+			 log_prefix, gettid());
+
+	va_copy(copy, args);
+	len = vsnprintf(buf, sizeof(buf), format, copy);
+	va_end(copy);
+	if (len < 0)
+		return;
+	if (len >= sizeof(buf) && vasprintf(&line, format, args) == -1)
+		return;
 
-	/* append log buffer */
-	_igt_log_buffer_append(formatted_line);
+	continuation = vlog_line_continuation;
+	vlog_line_continuation = !len || line[len - 1] != '\n';
 
 	/* check print log level */
 	if (igt_log_level > level)
@@ -3167,17 +3281,21 @@ void igt_vlog(const char *domain, enum igt_log_level level, const char *format,
 
 	/* prepend all except information messages with process, domain and log
 	 * level information */
-	if (level != IGT_LOG_INFO) {
-		_log_line_fprintf(file, "%s", formatted_line);
-	} else {
+	if (level == IGT_LOG_INFO)
 		_log_line_fprintf(file, "%s%s", thread_id, line);
-	}
+	else if (continuation)
+		_log_line_fprintf(file, "%s", line);
+	else
+		_log_line_fprintf(file, "(%s:%d) %s%s%s%s: %s",
+				  log_program_name(), log_pid, thread_id,
+				  (domain) ? domain : "", (domain) ? "-" : "",
+				  igt_log_level_str[level], line);
 
 	pthread_mutex_unlock(&print_mutex);
 
 out:
-	free(line);
-	free(thread_id);
+	/* append log buffer, last as it takes over a long line */
+	_igt_log_buffer_append(domain, level, thread_id, continuation, line, len);
 }
 
 static const char *timeout_op;
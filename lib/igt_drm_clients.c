@@ -6,6 +6,7 @@
 #include <assert.h>
 #include <ctype.h>
 #include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -24,6 +25,137 @@
 #define ARRAY_SIZE(array) (sizeof(array) / sizeof(array[0]))
 #endif
 
+#define DRM_MAJOR 226
+
+struct drm_clients_fd {
+	unsigned int fd;
+	unsigned int minor;
+};
+
+struct igt_drm_clients_cache {
+	char *proc_root;
+
+	/* Open addressed hash of client array indices plus one. */
+	unsigned int *index;
+	unsigned int index_size;
+	unsigned int num_index;
+
+	/* Scratch array of the DRM fds of the process being scanned. */
+	struct drm_clients_fd *drm_fds;
+	unsigned int num_drm_fds;
+	unsigned int max_drm_fds;
+};
+
+static uint64_t hash64(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+
+	return x;
+}
+
+static unsigned int client_hash(unsigned int drm_minor, unsigned long id)
+{
+	return hash64((uint64_t)id << 8 ^ drm_minor);
+}
+
+static void *
+hash_alloc(unsigned int *size, unsigned int entries, size_t elem)
+{
+	unsigned int sz = 16;
+
+	/* Keep the load factor under a half for short probe sequences. */
+	while (sz < 2 * entries)
+		sz <<= 1;
+
+	*size = sz;
+
+	return calloc(sz, elem);
+}
+
+static void client_index_insert(struct igt_drm_clients_cache *cache,
+				const struct igt_drm_client *c,
+				unsigned int idx)
+{
+	unsigned int mask = cache->index_size - 1;
+	unsigned int i = client_hash(c->drm_minor, c->id) & mask;
+
+	while (cache->index[i])
+		i = (i + 1) & mask;
+
+	cache->index[i] = idx + 1;
+	cache->num_index++;
+}
+
+static void client_index_rebuild(struct igt_drm_clients *clients)
+{
+	struct igt_drm_clients_cache *cache = clients->cache;
+	unsigned int i;
+
+	free(cache->index);
+	cache->index = hash_alloc(&cache->index_size, clients->num_clients,
+				  sizeof(*cache->index));
+	assert(cache->index);
+	cache->num_index = 0;
+
+	for (i = 0; i < clients->num_clients; i++) {
+		if (clients->client[i].status != IGT_DRM_CLIENT_FREE)
+			client_index_insert(cache, &clients->client[i], i);
+	}
+}
+
+/*
+ * Clients are looked up through an index hash rather than by walking the
+ * array. The index is rebuilt at the start of each scan since the caller is
+ * free to re-order the array with igt_drm_clients_sort in between.
+ */
+static struct igt_drm_client *
+igt_drm_clients_lookup(struct igt_drm_clients *clients,
+		       unsigned int drm_minor, unsigned long id)
+{
+	struct igt_drm_clients_cache *cache = clients->cache;
+	unsigned int mask = cache->index_size - 1;
+	unsigned int i = client_hash(drm_minor, id) & mask;
+
+	for (; cache->index[i]; i = (i + 1) & mask) {
+		struct igt_drm_client *c = &clients->client[cache->index[i] - 1];
+
+		if (c->status != IGT_DRM_CLIENT_FREE &&
+		    c->drm_minor == drm_minor && c->id == id)
+			return c;
+	}
+
+	return NULL;
+}
+
+static struct igt_drm_client *
+igt_drm_clients_find_free(struct igt_drm_clients *clients)
+{
+	unsigned int start, num;
+	struct igt_drm_client *c;
+
+	start = clients->active_clients; /* Free block at the end. */
+	num = clients->num_clients - start;
+
+	for (c = &clients->client[start]; num; c++, num--) {
+		if (c->status == IGT_DRM_CLIENT_FREE)
+			return c;
+	}
+
+	return NULL;
+}
+
+static void clients_cache_free(struct igt_drm_clients_cache *cache)
+{
+	free(cache->drm_fds);
+	free(cache->index);
+	free(cache->proc_root);
+	free(cache);
+}
+
 /**
  * igt_drm_clients_init:
  * @private_data: private data to store in the struct
@@ -39,32 +171,50 @@ struct igt_drm_clients *igt_drm_clients_init(void *private_data)
 	if (!clients)
 		return NULL;
 
+	clients->cache = calloc(1, sizeof(*clients->cache));
+	if (!clients->cache)
+		goto err;
+
+	clients->cache->proc_root = strdup("/proc");
+	if (!clients->cache->proc_root)
+		goto err;
+
 	clients->private_data = private_data;
 
 	return clients;
+
+err:
+	if (clients->cache)
+		clients_cache_free(clients->cache);
+	free(clients);
+
+	return NULL;
 }
 
-static struct igt_drm_client *
-igt_drm_clients_find(struct igt_drm_clients *clients,
-		     enum igt_drm_client_status status,
-		     unsigned int drm_minor, unsigned long id)
+/**
+ * igt_drm_clients_set_proc_root:
+ * @clients: Previously initialised clients object
+ * @proc_root: Path to the procfs root to scan
+ *
+ * Make further calls to igt_drm_clients_scan() look for DRM clients under
+ * @proc_root instead of /proc.
+ *
+ * Returns: 0 on success, negative errno on failure.
+ */
+int igt_drm_clients_set_proc_root(struct igt_drm_clients *clients,
+				  const char *proc_root)
 {
-	unsigned int start, num;
-	struct igt_drm_client *c;
+	struct igt_drm_clients_cache *cache = clients->cache;
+	char *root;
 
-	start = status == IGT_DRM_CLIENT_FREE ? clients->active_clients : 0; /* Free block at the end. */
-	num = clients->num_clients - start;
+	root = strdup(proc_root);
+	if (!root)
+		return -ENOMEM;
 
-	for (c = &clients->client[start]; num; c++, num--) {
-		if (status != c->status)
-			continue;
+	free(cache->proc_root);
+	cache->proc_root = root;
 
-		if (status == IGT_DRM_CLIENT_FREE ||
-		    (drm_minor == c->drm_minor && c->id == id))
-			return c;
-	}
-
-	return NULL;
+	return 0;
 }
 
 static void
@@ -162,13 +312,13 @@ igt_drm_client_add(struct igt_drm_clients *clients,
 		   const struct drm_client_fdinfo *info,
 		   unsigned int pid, char *name, unsigned int drm_minor)
 {
+	struct igt_drm_clients_cache *cache = clients->cache;
 	struct igt_drm_client *c;
 	unsigned int i;
 
-	assert(!igt_drm_clients_find(clients, IGT_DRM_CLIENT_ALIVE,
-				     drm_minor, info->id));
+	assert(!igt_drm_clients_lookup(clients, drm_minor, info->id));
 
-	c = igt_drm_clients_find(clients, IGT_DRM_CLIENT_FREE, 0, 0);
+	c = igt_drm_clients_find_free(clients);
 	if (!c) {
 		unsigned int idx = clients->num_clients;
 
@@ -190,6 +340,10 @@ igt_drm_client_add(struct igt_drm_clients *clients,
 	c->drm_minor = drm_minor;
 	c->clients = clients;
 
+	if (2 * (cache->num_index + 1) > cache->index_size)
+		client_index_rebuild(clients);
+	client_index_insert(cache, c, c - clients->client);
+
 	/* Engines */
 	c->engines = calloc(1, sizeof(*c->engines));
 	assert(c->engines);
@@ -352,26 +506,13 @@ void igt_drm_clients_free(struct igt_drm_clients *clients)
 	igt_for_each_drm_client(clients, c, tmp)
 		igt_drm_client_free(c, false);
 
+	if (clients->cache)
+		clients_cache_free(clients->cache);
+
 	free(clients->client);
 	free(clients);
 }
 
-static DIR *opendirat(int at, const char *name)
-{
-	DIR *dir;
-	int fd;
-
-	fd = openat(at, name, O_DIRECTORY);
-	if (fd < 0)
-		return NULL;
-
-	dir = fdopendir(fd);
-	if (!dir)
-		close(fd);
-
-	return dir;
-}
-
 static size_t readat2buf(int at, const char *name, char *buf, const size_t sz)
 {
 	ssize_t count;
@@ -431,7 +572,7 @@ static bool is_drm_fd(int fd_dir, const char *name, unsigned int *minor)
 
 	if (ret == 0 &&
 	    (stat.st_mode & S_IFMT) == S_IFCHR &&
-	    major(stat.st_rdev) == 226) {
+	    major(stat.st_rdev) == DRM_MAJOR) {
 		*minor = minor(stat.st_rdev);
 		return true;
 	}
@@ -439,6 +580,53 @@ static bool is_drm_fd(int fd_dir, const char *name, unsigned int *minor)
 	return false;
 }
 
+static void add_drm_fd(struct igt_drm_clients_cache *cache, unsigned int fd,
+		       unsigned int minor)
+{
+	if (cache->num_drm_fds == cache->max_drm_fds) {
+		cache->max_drm_fds = cache->max_drm_fds ?
+				     2 * cache->max_drm_fds : 4;
+		cache->drm_fds = realloc(cache->drm_fds,
+					 cache->max_drm_fds *
+					 sizeof(*cache->drm_fds));
+		assert(cache->drm_fds);
+	}
+
+	cache->drm_fds[cache->num_drm_fds].fd = fd;
+	cache->drm_fds[cache->num_drm_fds].minor = minor;
+	cache->num_drm_fds++;
+}
+
+/*
+ * Lists the DRM fds open by a process into the scratch array. Every fd is
+ * stat-ed on each scan: the fd directory entries carry no identity of the
+ * file they point to, so nothing cheaper notices an fd number closed and
+ * re-used for a DRM device between two scans.
+ */
+static void
+scan_pid_fds(struct igt_drm_clients_cache *cache, int fd_dir)
+{
+	struct dirent *dent;
+	unsigned int minor;
+	DIR *dir;
+
+	cache->num_drm_fds = 0;
+
+	dir = fdopendir(dup(fd_dir));
+	if (!dir)
+		return;
+
+	while ((dent = readdir(dir)) != NULL) {
+		if (!isdigit(dent->d_name[0]))
+			continue;
+
+		if (is_drm_fd(fd_dir, dent->d_name, &minor))
+			add_drm_fd(cache, atoi(dent->d_name), minor);
+	}
+
+	closedir(dir);
+}
+
 static void clients_update_max_lengths(struct igt_drm_clients *clients)
 {
 	struct igt_drm_client *c;
@@ -489,6 +677,7 @@ igt_drm_clients_scan(struct igt_drm_clients *clients,
 		     const char **name_map, unsigned int map_entries,
 		     const char **region_map, unsigned int region_entries)
 {
+	struct igt_drm_clients_cache *cache;
 	struct dirent *proc_dent;
 	struct igt_drm_client *c;
 	bool freed = false;
@@ -498,6 +687,9 @@ igt_drm_clients_scan(struct igt_drm_clients *clients,
 	if (!clients)
 		return clients;
 
+	cache = clients->cache;
+	assert(cache);
+
 	/*
 	 * First mark all alive clients as 'probe' so we can figure out which
 	 * ones have existed since the previous scan.
@@ -510,22 +702,26 @@ igt_drm_clients_scan(struct igt_drm_clients *clients,
 			break; /* Free block at the end of array. */
 	}
 
-	proc_dir = opendir("/proc");
+	client_index_rebuild(clients);
+
+	proc_dir = opendir(cache->proc_root);
 	if (!proc_dir)
 		return clients;
 
 	while ((proc_dent = readdir(proc_dir)) != NULL) {
-		unsigned int client_pid = 0, minor = 0;
-		int pid_dir = -1, fd_dir = -1;
-		struct dirent *fdinfo_dent;
+		unsigned int client_pid = 0, pid, i;
+		int pid_dir = -1, fd_dir = -1, fdinfo_dir = -1;
 		char client_name[64] = { };
-		DIR *fdinfo_dir = NULL;
 
 		if (proc_dent->d_type != DT_DIR)
 			continue;
 		if (!isdigit(proc_dent->d_name[0]))
 			continue;
 
+		pid = atoi(proc_dent->d_name);
+		if (!pid)
+			continue;
+
 		pid_dir = openat(dirfd(proc_dir), proc_dent->d_name,
 				 O_DIRECTORY | O_RDONLY);
 		if (pid_dir < 0)
@@ -535,23 +731,22 @@ igt_drm_clients_scan(struct igt_drm_clients *clients,
 		if (fd_dir < 0)
 			goto next;
 
-		fdinfo_dir = opendirat(pid_dir, "fdinfo");
-		if (!fdinfo_dir)
+		scan_pid_fds(cache, fd_dir);
+		if (!cache->num_drm_fds)
 			goto next;
 
-		while ((fdinfo_dent = readdir(fdinfo_dir)) != NULL) {
-			struct drm_client_fdinfo info = { };
+		fdinfo_dir = openat(pid_dir, "fdinfo", O_DIRECTORY | O_RDONLY);
+		if (fdinfo_dir < 0)
+			goto next;
 
-			if (fdinfo_dent->d_type != DT_REG)
-				continue;
-			if (!isdigit(fdinfo_dent->d_name[0]))
-				continue;
+		for (i = 0; i < cache->num_drm_fds; i++) {
+			struct drm_client_fdinfo info = { };
+			unsigned int minor = cache->drm_fds[i].minor;
+			char fd[16];
 
-			if (!is_drm_fd(fd_dir, fdinfo_dent->d_name, &minor))
-				continue;
+			snprintf(fd, sizeof(fd), "%u", cache->drm_fds[i].fd);
 
-			if (!__igt_parse_drm_fdinfo(dirfd(fdinfo_dir),
-						    fdinfo_dent->d_name, &info,
+			if (!__igt_parse_drm_fdinfo(fdinfo_dir, fd, &info,
 						    name_map, map_entries,
 						    region_map, region_entries))
 				continue;
@@ -559,8 +754,8 @@ igt_drm_clients_scan(struct igt_drm_clients *clients,
 			if (filter_client && !filter_client(clients, &info))
 				continue;
 
-			if (igt_drm_clients_find(clients, IGT_DRM_CLIENT_ALIVE,
-						 minor, info.id))
+			c = igt_drm_clients_lookup(clients, minor, info.id);
+			if (c && c->status == IGT_DRM_CLIENT_ALIVE)
 				continue; /* Skip duplicate fds. */
 
 			if (!client_pid) {
@@ -569,8 +764,6 @@ igt_drm_clients_scan(struct igt_drm_clients *clients,
 				assert(client_pid > 0);
 			}
 
-			c = igt_drm_clients_find(clients, IGT_DRM_CLIENT_PROBE,
-						 minor, info.id);
 			if (!c)
 				igt_drm_client_add(clients, &info, client_pid,
 						   client_name, minor);
@@ -580,8 +773,8 @@ igt_drm_clients_scan(struct igt_drm_clients *clients,
 		}
 
 next:
-		if (fdinfo_dir)
-			closedir(fdinfo_dir);
+		if (fdinfo_dir >= 0)
+			close(fdinfo_dir);
 		if (fd_dir >= 0)
 			close(fd_dir);
 		if (pid_dir >= 0)
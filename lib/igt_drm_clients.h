@@ -23,6 +23,10 @@
  * This library enumerates all DRM clients by parsing that data and tracks them
  * in a list of clients (struct igt_drm_clients) available for inspection
  * after one or more calls to igt_drm_clients_scan.
+ *
+ * Clients are looked up by a hash of their id between scans. The /proc root
+ * used for scanning can be changed with igt_drm_clients_set_proc_root, for
+ * example to point at a synthetic tree in unit tests.
  */
 
 struct drm_client_fdinfo;
@@ -89,6 +93,8 @@ struct igt_drm_client {
 	struct drm_client_meminfo *memory; /* Array of region memory utilisation as parsed from fdinfo. */
 };
 
+struct igt_drm_clients_cache;
+
 struct igt_drm_clients {
 	unsigned int num_clients;
 	unsigned int active_clients;
@@ -98,6 +104,8 @@ struct igt_drm_clients {
 
 	void *private_data;
 
+	struct igt_drm_clients_cache *cache; /* Scan state private to the library. */
+
 	struct igt_drm_client *client; /* Must be last. */
 };
 
@@ -108,6 +116,9 @@ struct igt_drm_clients {
 struct igt_drm_clients *igt_drm_clients_init(void *private_data);
 void igt_drm_clients_free(struct igt_drm_clients *clients);
 
+int igt_drm_clients_set_proc_root(struct igt_drm_clients *clients,
+				  const char *proc_root);
+
 struct igt_drm_clients *
 igt_drm_clients_scan(struct igt_drm_clients *clients,
 		     bool (*filter_client)(const struct igt_drm_clients *,
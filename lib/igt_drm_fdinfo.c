@@ -206,10 +206,90 @@ out:
 		}							\
 	} while (0)
 
-#define strstartswith(a, b, plen__) ({					\
-		*plen__ = strlen(b);					\
-		strncmp(a, b, *plen__) == 0;				\
-})
+enum fdinfo_key {
+	FDINFO_KEY_NONE = 0,
+	FDINFO_KEY_DRIVER,
+	FDINFO_KEY_CLIENT_ID,
+	FDINFO_KEY_PDEV,
+	FDINFO_KEY_ENGINE_CAPACITY,
+	FDINFO_KEY_ENGINE,
+	FDINFO_KEY_CYCLES,
+	FDINFO_KEY_TOTAL_CYCLES,
+	FDINFO_KEY_TOTAL,
+	FDINFO_KEY_SHARED,
+	FDINFO_KEY_RESIDENT,
+	FDINFO_KEY_PURGEABLE,
+	FDINFO_KEY_ACTIVE,
+};
+
+struct fdinfo_key_desc {
+	const char *str;
+	unsigned int len;
+	enum fdinfo_key key;
+};
+
+#define FDINFO_KEY(s, k) { .str = (s), .len = sizeof(s) - 1, .key = (k) }
+
+/*
+ * Known keys without the common "drm-" prefix, bucketed by their first
+ * character. Within a bucket keys which are prefixes of other keys must come
+ * after the longer ones.
+ */
+static const struct fdinfo_key_desc fdinfo_keys[][3] = {
+	['a' - 'a'] = {
+		FDINFO_KEY("active-", FDINFO_KEY_ACTIVE),
+	},
+	['c' - 'a'] = {
+		FDINFO_KEY("client-id:", FDINFO_KEY_CLIENT_ID),
+		FDINFO_KEY("cycles-", FDINFO_KEY_CYCLES),
+	},
+	['d' - 'a'] = {
+		FDINFO_KEY("driver:", FDINFO_KEY_DRIVER),
+	},
+	['e' - 'a'] = {
+		FDINFO_KEY("engine-capacity-", FDINFO_KEY_ENGINE_CAPACITY),
+		FDINFO_KEY("engine-", FDINFO_KEY_ENGINE),
+	},
+	['p' - 'a'] = {
+		FDINFO_KEY("pdev:", FDINFO_KEY_PDEV),
+		FDINFO_KEY("purgeable-", FDINFO_KEY_PURGEABLE),
+	},
+	['r' - 'a'] = {
+		FDINFO_KEY("resident-", FDINFO_KEY_RESIDENT),
+	},
+	['s' - 'a'] = {
+		FDINFO_KEY("shared-", FDINFO_KEY_SHARED),
+	},
+	['t' - 'a'] = {
+		FDINFO_KEY("total-cycles-", FDINFO_KEY_TOTAL_CYCLES),
+		FDINFO_KEY("total-", FDINFO_KEY_TOTAL),
+	},
+};
+
+static enum fdinfo_key
+match_fdinfo_key(const char *l, size_t len, size_t *keylen)
+{
+	const struct fdinfo_key_desc *desc;
+	unsigned int bucket, i;
+
+	if (len < 5 || memcmp(l, "drm-", 4))
+		return FDINFO_KEY_NONE;
+
+	bucket = (unsigned char)l[4] - 'a';
+	if (bucket >= ARRAY_SIZE(fdinfo_keys))
+		return FDINFO_KEY_NONE;
+
+	desc = fdinfo_keys[bucket];
+	for (i = 0; i < ARRAY_SIZE(fdinfo_keys[0]) && desc[i].str; i++) {
+		if (desc[i].len <= len - 4 &&
+		    !memcmp(l + 4, desc[i].str, desc[i].len)) {
+			*keylen = 4 + desc[i].len;
+			return desc[i].key;
+		}
+	}
+
+	return FDINFO_KEY_NONE;
+}
 
 unsigned int
 __igt_parse_drm_fdinfo(int dir, const char *fd, struct drm_client_fdinfo *info,
@@ -219,76 +299,94 @@ __igt_parse_drm_fdinfo(int dir, const char *fd, struct drm_client_fdinfo *info,
 	bool regions_found[DRM_CLIENT_FDINFO_MAX_REGIONS] = { };
 	bool engines_found[DRM_CLIENT_FDINFO_MAX_ENGINES] = { };
 	unsigned int good = 0, num_capacity = 0;
-	char buf[4096], *_buf = buf;
-	char *l, *ctx = NULL;
+	char buf[4096], *l, *end, *eob;
 	size_t count;
 
 	count = read_fdinfo(buf, sizeof(buf), dir, fd);
 	if (!count)
 		return 0;
 
-	while ((l = strtok_r(_buf, "\n", &ctx))) {
+	eob = buf + count - 1; /* read_fdinfo() terminated the last line here. */
+	for (l = buf; l < eob; l = end + 1) {
 		uint64_t val = 0;
 		size_t keylen;
 		const char *v;
 		char *end_ptr;
 		int idx;
 
-		_buf = NULL;
+		end = memchr(l, '\n', eob - l);
+		if (!end)
+			end = eob;
+		*end = 0;
 
-		if (strstartswith(l, "drm-driver:", &keylen)) {
+		switch (match_fdinfo_key(l, end - l, &keylen)) {
+		case FDINFO_KEY_NONE:
+			break;
+		case FDINFO_KEY_DRIVER:
 			v = ignore_space(l + keylen);
 			if (*v) {
 				strncpy(info->driver, v, sizeof(info->driver) - 1);
 				good++;
 			}
-		}  else if (strstartswith(l, "drm-client-id:", &keylen)) {
+			break;
+		case FDINFO_KEY_CLIENT_ID:
 			v = l + keylen;
 			info->id = strtol(v, &end_ptr, 10);
 			if (end_ptr != v)
 				good++;
-		} else if (strstartswith(l, "drm-pdev:", &keylen)) {
+			break;
+		case FDINFO_KEY_PDEV:
 			v = ignore_space(l + keylen);
 			strncpy(info->pdev, v, sizeof(info->pdev) - 1);
-		} else if (strstartswith(l, "drm-engine-capacity-", &keylen)) {
+			break;
+		case FDINFO_KEY_ENGINE_CAPACITY:
 			idx = parse_engine(l + keylen, info,
 					   name_map, map_entries, &val);
 			if (idx >= 0) {
 				info->capacity[idx] = val;
 				num_capacity++;
 			}
-		} else if (strstartswith(l, "drm-engine-", &keylen)) {
+			break;
+		case FDINFO_KEY_ENGINE:
 			idx = parse_engine(l + keylen, info,
 					   name_map, map_entries, &val);
 			UPDATE_ENGINE(idx, engine_time, val, DRM_FDINFO_UTILIZATION_ENGINE_TIME);
-		} else if (strstartswith(l, "drm-cycles-", &keylen)) {
+			break;
+		case FDINFO_KEY_CYCLES:
 			idx = parse_engine(l + keylen, info,
 					   name_map, map_entries, &val);
 			UPDATE_ENGINE(idx, cycles, val, DRM_FDINFO_UTILIZATION_CYCLES);
-		} else if (strstartswith(l, "drm-total-cycles-", &keylen)) {
+			break;
+		case FDINFO_KEY_TOTAL_CYCLES:
 			idx = parse_engine(l + keylen, info,
 					   name_map, map_entries, &val);
 			UPDATE_ENGINE(idx, total_cycles, val, DRM_FDINFO_UTILIZATION_TOTAL_CYCLES);
-		} else if (strstartswith(l, "drm-total-", &keylen)) {
+			break;
+		case FDINFO_KEY_TOTAL:
 			idx = parse_region(l + keylen, info,
 					   region_map, region_entries, &val);
 			UPDATE_REGION(idx, total, val);
-		} else if (strstartswith(l, "drm-shared-", &keylen)) {
+			break;
+		case FDINFO_KEY_SHARED:
 			idx = parse_region(l + keylen, info,
 					   region_map, region_entries, &val);
 			UPDATE_REGION(idx, shared, val);
-		} else if (strstartswith(l, "drm-resident-", &keylen)) {
+			break;
+		case FDINFO_KEY_RESIDENT:
 			idx = parse_region(l + keylen, info,
 					   region_map, region_entries, &val);
 			UPDATE_REGION(idx, resident, val);
-		} else if (strstartswith(l, "drm-purgeable-", &keylen)) {
+			break;
+		case FDINFO_KEY_PURGEABLE:
 			idx = parse_region(l + keylen, info,
 					   region_map, region_entries, &val);
 			UPDATE_REGION(idx, purgeable, val);
-		} else if (strstartswith(l, "drm-active-", &keylen)) {
+			break;
+		case FDINFO_KEY_ACTIVE:
 			idx = parse_region(l + keylen, info,
 					   region_map, region_entries, &val);
 			UPDATE_REGION(idx, active, val);
+			break;
 		}
 	}
 
@@ -26,6 +26,8 @@
 #include "config.h"
 
 #include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <time.h>
@@ -48,6 +50,10 @@
  *
  * The EDID CEA extension is defined in CEA-861-D section 7. The HDMI VSDB is
  * defined in the HDMI spec.
+ *
+ * EDIDs which are handed out repeatedly can be composed once with an
+ * #edid_builder into an immutable, reference-counted #edid_template, and
+ * cached with edid_template_get_cached().
  */
 
 static const char edid_header[] = {
@@ -367,7 +373,7 @@ uint8_t edid_get_deep_color_from_vsdb(const struct edid *edid)
 	const struct edid_cea *edid_cea;
 	const char *cea_data;
 	uint8_t deep_color = 0;
-	int offset, i, j;
+	int end, len, i, j;
 
 	/*
 	 * Read from vendor specific data block first, if vsdb not found
@@ -381,16 +387,27 @@ uint8_t edid_get_deep_color_from_vsdb(const struct edid *edid)
 		    (edid_cea->revision != 3))
 			continue;
 
-		offset = edid_cea->dtd_start;
+		/* dtd_start is relative to the extension tag, and points
+		 * right after the data block collection. */
+		end = min_t(int, edid_cea->dtd_start - 4,
+			    sizeof(edid_cea->data));
 		cea_data = edid_cea->data;
 
-		for (j = 0; j < offset; j += (cea_data[j] & 0x1F) + 1) {
+		for (j = 0; j < end; j += len + 1) {
 			struct edid_cea_data_block *vsdb =
 				(struct edid_cea_data_block *)(cea_data + j);
 
+			len = vsdb->type_len & 0x1F;
+			if (j + 1 + len > end)
+				break;
+
 			if (((vsdb->type_len & 0xE0) >> 5) != EDID_CEA_DATA_VENDOR_SPECIFIC)
 				continue;
 
+			/* flags1 is the first HDMI VSDB extension field */
+			if (len < CEA_VSDB_HDMI_MIN_SIZE + 1)
+				continue;
+
 			if (ieee_oui(vsdb->data.vsdbs->ieee_oui) == 0x000C03)
 				deep_color = vsdb->data.vsdbs->data.hdmi.flags1;
 
@@ -698,3 +715,275 @@ void *dispid_done(struct dispid_header *dispid, void *ptr)
 
 	return ptr + 1;
 }
+
+/**
+ * edid_builder_init:
+ * @builder: The builder
+ * @base: The base EDID block
+ *
+ * Start composing an EDID from a copy of the base block of @base. Extension
+ * blocks of @base aren't copied.
+ */
+void edid_builder_init(struct edid_builder *builder, const struct edid *base)
+{
+	struct edid *edid = edid_builder_edid(builder);
+
+	memset(builder, 0, sizeof(*builder));
+	memcpy(edid, base, sizeof(struct edid));
+	edid->extensions_len = 0;
+}
+
+/**
+ * edid_builder_init_with_mode:
+ * @builder: The builder
+ * @mode: The preferred mode
+ *
+ * Start composing an EDID from a new base block, see edid_init_with_mode().
+ */
+void edid_builder_init_with_mode(struct edid_builder *builder,
+				 drmModeModeInfo *mode)
+{
+	memset(builder, 0, sizeof(*builder));
+	edid_init_with_mode(edid_builder_edid(builder), mode);
+}
+
+/**
+ * edid_builder_edid:
+ * @builder: The builder
+ *
+ * Returns: The EDID being composed, which may be modified until
+ * edid_builder_finish() is called.
+ */
+struct edid *edid_builder_edid(struct edid_builder *builder)
+{
+	return (struct edid *) builder->raw;
+}
+
+/**
+ * edid_builder_add_ext:
+ * @builder: The builder
+ *
+ * Append an extension block, to be filled by the caller.
+ *
+ * Returns: The zeroed extension block
+ */
+struct edid_ext *edid_builder_add_ext(struct edid_builder *builder)
+{
+	struct edid *edid = edid_builder_edid(builder);
+	struct edid_ext *ext;
+
+	assert(edid->extensions_len < EDID_BUILDER_MAX_EXTENSIONS);
+	ext = &edid->extensions[edid->extensions_len++];
+	memset(ext, 0, sizeof(*ext));
+
+	return ext;
+}
+
+/* Reserves size bytes in the data block collection of the CEA extension,
+ * which is added along with the first data block. */
+static struct edid_cea_data_block *
+edid_builder_cea_block(struct edid_builder *builder, size_t size)
+{
+	if (!builder->cea)
+		builder->cea = edid_builder_add_ext(builder);
+
+	assert(builder->cea_size + size <= sizeof(builder->cea->data.cea.data));
+
+	return (struct edid_cea_data_block *)
+		&builder->cea->data.cea.data[builder->cea_size];
+}
+
+/**
+ * edid_builder_add_sad: append a CEA data block of Short Audio Descriptors
+ */
+void edid_builder_add_sad(struct edid_builder *builder,
+			  const struct cea_sad *sads, size_t sads_len)
+{
+	struct edid_cea_data_block *block;
+
+	block = edid_builder_cea_block(builder, sizeof(*block) +
+				       sads_len * sizeof(*sads));
+	builder->cea_size += edid_cea_data_block_set_sad(block, sads, sads_len);
+}
+
+/**
+ * edid_builder_add_svd: append a CEA data block of Short Video Descriptors
+ */
+void edid_builder_add_svd(struct edid_builder *builder,
+			  const uint8_t *svds, size_t svds_len)
+{
+	struct edid_cea_data_block *block;
+
+	block = edid_builder_cea_block(builder, sizeof(*block) + svds_len);
+	builder->cea_size += edid_cea_data_block_set_svd(block, svds, svds_len);
+}
+
+/**
+ * edid_builder_add_vsdb: append a CEA Vendor Specific Data Block
+ */
+void edid_builder_add_vsdb(struct edid_builder *builder,
+			   const struct cea_vsdb *vsdb, size_t vsdb_size)
+{
+	struct edid_cea_data_block *block;
+
+	block = edid_builder_cea_block(builder, sizeof(*block) + vsdb_size);
+	builder->cea_size += edid_cea_data_block_set_vsdb(block, vsdb,
+							  vsdb_size);
+}
+
+/**
+ * edid_builder_add_hdmi_vsdb: append an HDMI Vendor Specific Data Block
+ */
+void edid_builder_add_hdmi_vsdb(struct edid_builder *builder,
+				const struct hdmi_vsdb *hdmi, size_t hdmi_size)
+{
+	struct edid_cea_data_block *block;
+
+	block = edid_builder_cea_block(builder, sizeof(*block) +
+				       CEA_VSDB_HEADER_SIZE + hdmi_size);
+	builder->cea_size += edid_cea_data_block_set_hdmi_vsdb(block, hdmi,
+							       hdmi_size);
+}
+
+/**
+ * edid_builder_add_speaker_alloc: append a CEA Speaker Allocation Data block
+ */
+void edid_builder_add_speaker_alloc(struct edid_builder *builder,
+				    const struct cea_speaker_alloc *speakers)
+{
+	struct edid_cea_data_block *block;
+
+	block = edid_builder_cea_block(builder, sizeof(*block) +
+				       sizeof(*speakers));
+	builder->cea_size += edid_cea_data_block_set_speaker_alloc(block,
+								   speakers);
+}
+
+/**
+ * edid_builder_set_cea_flags:
+ * @builder: The builder
+ * @flags: Bitfield of enum edid_cea_flag
+ *
+ * Set the flags of the CEA extension, if there is one.
+ */
+void edid_builder_set_cea_flags(struct edid_builder *builder, uint8_t flags)
+{
+	builder->cea_flags = flags;
+}
+
+/**
+ * edid_builder_finish:
+ * @builder: The builder
+ *
+ * Finalize the CEA extension and the checksums of the composed EDID.
+ *
+ * Returns: A new template of the EDID, with a single reference
+ */
+struct edid_template *edid_builder_finish(struct edid_builder *builder)
+{
+	struct edid *edid = edid_builder_edid(builder);
+
+	if (builder->cea)
+		edid_ext_set_cea(builder->cea, builder->cea_size, 0,
+				 builder->cea_flags);
+
+	edid_update_checksum(edid);
+
+	return edid_template_create(edid);
+}
+
+struct edid_template {
+	int refcount;
+	uint8_t raw[]; /* the EDID and its extensions */
+};
+
+/**
+ * edid_template_create:
+ * @edid: The EDID
+ *
+ * Create an immutable copy of @edid, including its extension blocks.
+ *
+ * Returns: A new template, with a single reference
+ */
+struct edid_template *edid_template_create(const struct edid *edid)
+{
+	struct edid_template *tmpl;
+	size_t size = edid_get_size(edid);
+
+	tmpl = malloc(sizeof(*tmpl) + size);
+	igt_assert(tmpl);
+
+	tmpl->refcount = 1;
+	memcpy(tmpl->raw, edid, size);
+
+	return tmpl;
+}
+
+/**
+ * edid_template_ref: take a reference on a template
+ *
+ * Returns: @tmpl
+ */
+struct edid_template *edid_template_ref(struct edid_template *tmpl)
+{
+	__atomic_fetch_add(&tmpl->refcount, 1, __ATOMIC_RELAXED);
+
+	return tmpl;
+}
+
+/**
+ * edid_template_unref: drop a reference on a template, freeing it with the
+ * last one
+ */
+void edid_template_unref(struct edid_template *tmpl)
+{
+	if (tmpl && !__atomic_sub_fetch(&tmpl->refcount, 1, __ATOMIC_ACQ_REL))
+		free(tmpl);
+}
+
+/**
+ * edid_template_edid:
+ * @tmpl: The template
+ *
+ * Returns: The EDID of the template, valid as long as a reference is held
+ */
+const struct edid *edid_template_edid(const struct edid_template *tmpl)
+{
+	return (const struct edid *) tmpl->raw;
+}
+
+/**
+ * edid_template_get_cached:
+ * @cache: Where the template is cached, NULL until the first call
+ * @build: Function building the template from @data
+ * @data: Parameters of @build
+ *
+ * Build the template on the first call, and keep it in @cache for the
+ * following ones. The cache holds its reference for the lifetime of the
+ * process.
+ *
+ * @build must return the same EDID every time: when threads race on the
+ * first call, each builds a template and all but one are dropped. @build
+ * can get other cached templates.
+ *
+ * Returns: The EDID of the cached template
+ */
+const struct edid *edid_template_get_cached(struct edid_template **cache,
+					    edid_template_build_t build,
+					    const void *data)
+{
+	struct edid_template *tmpl, *cached = NULL;
+
+	tmpl = __atomic_load_n(cache, __ATOMIC_ACQUIRE);
+	if (tmpl)
+		return edid_template_edid(tmpl);
+
+	tmpl = build(data);
+	if (!__atomic_compare_exchange_n(cache, &cached, tmpl, false,
+					 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		edid_template_unref(tmpl);
+		tmpl = cached;
+	}
+
+	return edid_template_edid(tmpl);
+}
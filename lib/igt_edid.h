@@ -457,4 +457,47 @@ void *dispid_block_tiled(void *ptr,
 			 int hsize, int vsize,
 			 const char *topology_id);
 
+#define EDID_BUILDER_MAX_EXTENSIONS 3
+
+/**
+ * edid_builder: composes an EDID from a base block, CEA data blocks and
+ * extension blocks, see #edid_builder_init
+ */
+struct edid_builder {
+	uint8_t raw[(1 + EDID_BUILDER_MAX_EXTENSIONS) * EDID_BLOCK_SIZE];
+	struct edid_ext *cea; /* NULL until the first CEA data block */
+	size_t cea_size;
+	uint8_t cea_flags; /* enum edid_cea_flag */
+};
+
+struct edid_template;
+
+typedef struct edid_template *(*edid_template_build_t)(const void *data);
+
+void edid_builder_init(struct edid_builder *builder, const struct edid *base);
+void edid_builder_init_with_mode(struct edid_builder *builder,
+				 drmModeModeInfo *mode);
+struct edid *edid_builder_edid(struct edid_builder *builder);
+void edid_builder_add_sad(struct edid_builder *builder,
+			  const struct cea_sad *sads, size_t sads_len);
+void edid_builder_add_svd(struct edid_builder *builder,
+			  const uint8_t *svds, size_t svds_len);
+void edid_builder_add_vsdb(struct edid_builder *builder,
+			   const struct cea_vsdb *vsdb, size_t vsdb_size);
+void edid_builder_add_hdmi_vsdb(struct edid_builder *builder,
+				const struct hdmi_vsdb *hdmi, size_t hdmi_size);
+void edid_builder_add_speaker_alloc(struct edid_builder *builder,
+				    const struct cea_speaker_alloc *speakers);
+void edid_builder_set_cea_flags(struct edid_builder *builder, uint8_t flags);
+struct edid_ext *edid_builder_add_ext(struct edid_builder *builder);
+struct edid_template *edid_builder_finish(struct edid_builder *builder);
+
+struct edid_template *edid_template_create(const struct edid *edid);
+struct edid_template *edid_template_ref(struct edid_template *tmpl);
+void edid_template_unref(struct edid_template *tmpl);
+const struct edid *edid_template_edid(const struct edid_template *tmpl);
+const struct edid *edid_template_get_cached(struct edid_template **cache,
+					    edid_template_build_t build,
+					    const void *data);
+
 #endif
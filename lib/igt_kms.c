@@ -57,6 +57,7 @@
 #include "intel_chipset.h"
 #include "igt_debugfs.h"
 #include "igt_device.h"
+#include "igt_map.h"
 #include "igt_sysfs.h"
 #include "sw_sync.h"
 #ifdef HAVE_CHAMELIUM
@@ -104,6 +105,31 @@ struct igt_connector_attr {
 
 static struct igt_connector_attr connector_attrs[MAX_CONNECTORS];
 
+/* The EDIDs below are built on first use and shared by all the callers. */
+
+static struct edid_template *build_edid_with_mode(const void *data)
+{
+	drmModeModeInfo mode = *(const drmModeModeInfo *) data;
+	struct edid_builder builder;
+
+	edid_builder_init_with_mode(&builder, &mode);
+
+	return edid_builder_finish(&builder);
+}
+
+static const drmModeModeInfo base_edid_mode = {
+	.clock = 148500,
+	.hdisplay = 1920,
+	.hsync_start = 2008,
+	.hsync_end = 2052,
+	.htotal = 2200,
+	.vdisplay = 1080,
+	.vsync_start = 1084,
+	.vsync_end = 1089,
+	.vtotal = 1125,
+	.vrefresh = 60,
+};
+
 /**
  * igt_kms_get_base_edid:
  *
@@ -119,24 +145,41 @@ static struct igt_connector_attr connector_attrs[MAX_CONNECTORS];
  */
 const struct edid *igt_kms_get_base_edid(void)
 {
-	static struct edid edid;
+	static struct edid_template *tmpl;
+
+	return edid_template_get_cached(&tmpl, build_edid_with_mode,
+					&base_edid_mode);
+}
+
+static struct edid_template *build_full_edid(const void *data)
+{
+	struct edid_builder builder;
+	struct edid *edid;
 	drmModeModeInfo mode = {};
 
 	mode.clock = 148500;
-	mode.hdisplay = 1920;
+	mode.hdisplay = 2288;
 	mode.hsync_start = 2008;
 	mode.hsync_end = 2052;
 	mode.htotal = 2200;
-	mode.vdisplay = 1080;
+	mode.vdisplay = 1287;
 	mode.vsync_start = 1084;
 	mode.vsync_end = 1089;
 	mode.vtotal = 1125;
-	mode.vrefresh = 60;
+	mode.vrefresh = 144;
+	edid_builder_init_with_mode(&builder, &mode);
+	edid = edid_builder_edid(&builder);
 
-	edid_init_with_mode(&edid, &mode);
-	edid_update_checksum(&edid);
+	std_timing_set(&edid->standard_timings[0], 256, 60, STD_TIMING_16_10);
+	std_timing_set(&edid->standard_timings[1], 510, 69, STD_TIMING_4_3);
+	std_timing_set(&edid->standard_timings[2], 764, 78, STD_TIMING_5_4);
+	std_timing_set(&edid->standard_timings[3], 1018, 87, STD_TIMING_16_9);
+	std_timing_set(&edid->standard_timings[4], 1526, 96, STD_TIMING_16_10);
+	std_timing_set(&edid->standard_timings[5], 1780, 105, STD_TIMING_4_3);
+	std_timing_set(&edid->standard_timings[6], 2034, 114, STD_TIMING_5_4);
+	std_timing_set(&edid->standard_timings[7], 2288, 123, STD_TIMING_16_9);
 
-	return &edid;
+	return edid_builder_finish(&builder);
 }
 
 /**
@@ -155,34 +198,24 @@ const struct edid *igt_kms_get_base_edid(void)
  */
 const struct edid *igt_kms_get_full_edid(void)
 {
-	static struct edid edid;
-	drmModeModeInfo mode = {};
-
-	mode.clock = 148500;
-	mode.hdisplay = 2288;
-	mode.hsync_start = 2008;
-	mode.hsync_end = 2052;
-	mode.htotal = 2200;
-	mode.vdisplay = 1287;
-	mode.vsync_start = 1084;
-	mode.vsync_end = 1089;
-	mode.vtotal = 1125;
-	mode.vrefresh = 144;
-	edid_init_with_mode(&edid, &mode);
-
-	std_timing_set(&edid.standard_timings[0], 256, 60, STD_TIMING_16_10);
-	std_timing_set(&edid.standard_timings[1], 510, 69, STD_TIMING_4_3);
-	std_timing_set(&edid.standard_timings[2], 764, 78, STD_TIMING_5_4);
-	std_timing_set(&edid.standard_timings[3], 1018, 87, STD_TIMING_16_9);
-	std_timing_set(&edid.standard_timings[4], 1526, 96, STD_TIMING_16_10);
-	std_timing_set(&edid.standard_timings[5], 1780, 105, STD_TIMING_4_3);
-	std_timing_set(&edid.standard_timings[6], 2034, 114, STD_TIMING_5_4);
-	std_timing_set(&edid.standard_timings[7], 2288, 123, STD_TIMING_16_9);
+	static struct edid_template *tmpl;
 
-	edid_update_checksum(&edid);
-	return &edid;
+	return edid_template_get_cached(&tmpl, build_full_edid, NULL);
 }
 
+static const drmModeModeInfo base_tile_edid_mode = {
+	.clock = 277250,
+	.hdisplay = 1920,
+	.hsync_start = 1968,
+	.hsync_end = 2000,
+	.htotal = 2080,
+	.vdisplay = 2160,
+	.vsync_start = 2163,
+	.vsync_end = 2173,
+	.vtotal = 2222,
+	.vrefresh = 60,
+};
+
 /**
  * igt_kms_get_base_tile_edid:
  *
@@ -199,24 +232,25 @@ const struct edid *igt_kms_get_full_edid(void)
  */
 const struct edid *igt_kms_get_base_tile_edid(void)
 {
-	static struct edid edid;
-	drmModeModeInfo mode = {};
+	static struct edid_template *tmpl;
 
-	mode.clock = 277250;
-	mode.hdisplay = 1920;
-	mode.hsync_start = 1968;
-	mode.hsync_end = 2000;
-	mode.htotal = 2080;
-	mode.vdisplay = 2160;
-	mode.vsync_start = 2163;
-	mode.vsync_end = 2173;
-	mode.vtotal = 2222;
-	mode.vrefresh = 60;
-	edid_init_with_mode(&edid, &mode);
-	edid_update_checksum(&edid);
-	return &edid;
+	return edid_template_get_cached(&tmpl, build_edid_with_mode,
+					&base_tile_edid_mode);
 }
 
+static const drmModeModeInfo alt_edid_mode = {
+	.clock = 101000,
+	.hdisplay = 1400,
+	.hsync_start = 1448,
+	.hsync_end = 1480,
+	.htotal = 1560,
+	.vdisplay = 1050,
+	.vsync_start = 1053,
+	.vsync_end = 1057,
+	.vtotal = 1080,
+	.vrefresh = 60,
+};
+
 /**
  * igt_kms_get_alt_edid:
  *
@@ -233,75 +267,52 @@ const struct edid *igt_kms_get_base_tile_edid(void)
  */
 const struct edid *igt_kms_get_alt_edid(void)
 {
-	static struct edid edid;
-	drmModeModeInfo mode = {};
+	static struct edid_template *tmpl;
 
-	mode.clock = 101000;
-	mode.hdisplay = 1400;
-	mode.hsync_start = 1448;
-	mode.hsync_end = 1480;
-	mode.htotal = 1560;
-	mode.vdisplay = 1050;
-	mode.vsync_start = 1053;
-	mode.vsync_end = 1057;
-	mode.vtotal = 1080;
-	mode.vrefresh = 60;
-
-	edid_init_with_mode(&edid, &mode);
-	edid_update_checksum(&edid);
-
-	return &edid;
+	return edid_template_get_cached(&tmpl, build_edid_with_mode,
+					&alt_edid_mode);
 }
 
-#define AUDIO_EDID_SIZE (2 * EDID_BLOCK_SIZE)
-
-static const struct edid *
-generate_audio_edid(unsigned char raw_edid[static AUDIO_EDID_SIZE],
-		    bool with_vsdb, struct cea_sad *sad,
-		    struct cea_speaker_alloc *speaker_alloc)
+static struct edid_template *build_audio_edid(const void *data)
 {
-	struct edid *edid;
-	struct edid_ext *edid_ext;
-	struct edid_cea *edid_cea;
-	char *cea_data;
-	struct edid_cea_data_block *block;
+	bool with_vsdb = *(const bool *) data;
+	struct edid_builder builder;
+	struct cea_sad sad = {0};
+	struct cea_speaker_alloc speaker_alloc = {0};
 	const struct cea_vsdb *vsdb;
-	size_t cea_data_size, vsdb_size;
+	size_t vsdb_size;
+
+	/* Initialize the Short Audio Descriptor for PCM */
+	cea_sad_init_pcm(&sad, 2,
+			 CEA_SAD_SAMPLING_RATE_32KHZ |
+			 CEA_SAD_SAMPLING_RATE_44KHZ |
+			 CEA_SAD_SAMPLING_RATE_48KHZ,
+			 CEA_SAD_SAMPLE_SIZE_16 |
+			 CEA_SAD_SAMPLE_SIZE_20 |
+			 CEA_SAD_SAMPLE_SIZE_24);
+
+	/* Initialize the Speaker Allocation Data */
+	speaker_alloc.speakers = CEA_SPEAKER_FRONT_LEFT_RIGHT_CENTER;
 
 	/* Create a new EDID from the base IGT EDID, and add an
 	 * extension that advertises audio support. */
-	edid = (struct edid *) raw_edid;
-	memcpy(edid, igt_kms_get_base_edid(), sizeof(struct edid));
-	edid->extensions_len = 1;
-	edid_ext = &edid->extensions[0];
-	edid_cea = &edid_ext->data.cea;
-	cea_data = edid_cea->data;
-	cea_data_size = 0;
+	edid_builder_init(&builder, igt_kms_get_base_edid());
 
 	/* Short Audio Descriptor block */
-	block = (struct edid_cea_data_block *) &cea_data[cea_data_size];
-	cea_data_size += edid_cea_data_block_set_sad(block, sad, 1);
+	edid_builder_add_sad(&builder, &sad, 1);
 
 	/* A Vendor Specific Data block is needed for HDMI audio */
 	if (with_vsdb) {
-		block = (struct edid_cea_data_block *) &cea_data[cea_data_size];
 		vsdb = cea_vsdb_get_hdmi_default(&vsdb_size);
-		cea_data_size += edid_cea_data_block_set_vsdb(block, vsdb,
-							      vsdb_size);
+		edid_builder_add_vsdb(&builder, vsdb, vsdb_size);
 	}
 
 	/* Speaker Allocation Data block */
-	block = (struct edid_cea_data_block *) &cea_data[cea_data_size];
-	cea_data_size += edid_cea_data_block_set_speaker_alloc(block,
-							       speaker_alloc);
-
-	assert(cea_data_size <= sizeof(edid_cea->data));
-
-	edid_ext_set_cea(edid_ext, cea_data_size, 0, EDID_CEA_BASIC_AUDIO);
+	edid_builder_add_speaker_alloc(&builder, &speaker_alloc);
 
-	edid_update_checksum(edid);
+	edid_builder_set_cea_flags(&builder, EDID_CEA_BASIC_AUDIO);
 
-	return edid;
+	return edid_builder_finish(&builder);
 }
 
 /**
@@ -313,26 +324,10 @@ generate_audio_edid(unsigned char raw_edid[static AUDIO_EDID_SIZE],
  */
 const struct edid *igt_kms_get_hdmi_audio_edid(void)
 {
-	int channels;
-	uint8_t sampling_rates, sample_sizes;
-	static unsigned char raw_edid[AUDIO_EDID_SIZE] = {0};
-	struct cea_sad sad = {0};
-	struct cea_speaker_alloc speaker_alloc = {0};
+	static struct edid_template *tmpl;
+	static const bool with_vsdb = true;
 
-	/* Initialize the Short Audio Descriptor for PCM */
-	channels = 2;
-	sampling_rates = CEA_SAD_SAMPLING_RATE_32KHZ |
-			 CEA_SAD_SAMPLING_RATE_44KHZ |
-			 CEA_SAD_SAMPLING_RATE_48KHZ;
-	sample_sizes = CEA_SAD_SAMPLE_SIZE_16 |
-		       CEA_SAD_SAMPLE_SIZE_20 |
-		       CEA_SAD_SAMPLE_SIZE_24;
-	cea_sad_init_pcm(&sad, channels, sampling_rates, sample_sizes);
-
-	/* Initialize the Speaker Allocation Data */
-	speaker_alloc.speakers = CEA_SPEAKER_FRONT_LEFT_RIGHT_CENTER;
-
-	return generate_audio_edid(raw_edid, true, &sad, &speaker_alloc);
+	return edid_template_get_cached(&tmpl, build_audio_edid, &with_vsdb);
 }
 
 /**
@@ -344,26 +339,63 @@ const struct edid *igt_kms_get_hdmi_audio_edid(void)
  */
 const struct edid *igt_kms_get_dp_audio_edid(void)
 {
-	int channels;
-	uint8_t sampling_rates, sample_sizes;
-	static unsigned char raw_edid[AUDIO_EDID_SIZE] = {0};
-	struct cea_sad sad = {0};
-	struct cea_speaker_alloc speaker_alloc = {0};
+	static struct edid_template *tmpl;
+	static const bool with_vsdb = false;
 
-	/* Initialize the Short Audio Descriptor for PCM */
-	channels = 2;
-	sampling_rates = CEA_SAD_SAMPLING_RATE_32KHZ |
-			 CEA_SAD_SAMPLING_RATE_44KHZ |
-			 CEA_SAD_SAMPLING_RATE_48KHZ;
-	sample_sizes = CEA_SAD_SAMPLE_SIZE_16 |
-		       CEA_SAD_SAMPLE_SIZE_20 |
-		       CEA_SAD_SAMPLE_SIZE_24;
-	cea_sad_init_pcm(&sad, channels, sampling_rates, sample_sizes);
+	return edid_template_get_cached(&tmpl, build_audio_edid, &with_vsdb);
+}
 
-	/* Initialize the Speaker Allocation Data */
-	speaker_alloc.speakers = CEA_SPEAKER_FRONT_LEFT_RIGHT_CENTER;
+struct tiled_edid {
+	uint8_t htile, vtile;
+	int index;
+};
+
+static struct edid_template *build_tiled_edid(const void *data)
+{
+	const struct tiled_edid *tile = data;
+	struct edid_builder builder;
+	struct edid_ext *edid_ext;
+	struct edid_tile *edid_tile;
+
+	/* Create a new EDID from the base IGT EDID, and add an
+	 * extension that advertises tile support.
+	 */
+	edid_builder_init(&builder, igt_kms_get_base_tile_edid());
+	edid_ext = edid_builder_add_ext(&builder);
+	edid_tile = &edid_ext->data.tile;
+	/* Set 0x70 to 1st byte of extension,
+	 * so it is identified as display block
+	 */
+	edid_ext_set_displayid(edid_ext);
+	/* To identify it as a tiled display block extension */
+	edid_tile->header[0] = DISPLAY_TILE_BLOCK;
+	edid_tile->header[1] = 0x79;
+	edid_tile->header[2] = 0x00;
+	edid_tile->header[3] = 0x00;
+	edid_tile->header[4] = 0x12;
+	edid_tile->header[5] = 0x00;
+	edid_tile->header[6] = 0x16;
+	/* Tile Capabilities */
+	edid_tile->tile_cap = SCALE_TO_FIT;
+	/* Set number of htile and vtile, and the tile location */
+	edid_tile->topo[0] = tile->htile << 4 | tile->vtile;
+	edid_tile->topo[1] = tile->index ? 0x00 : 0x10;
+	edid_tile->topo[2] = ((tile->htile << 2) & 192) | (tile->vtile & 48);
+	/* Set tile resolution */
+	edid_tile->tile_size[0] = 0x7f;
+	edid_tile->tile_size[1] = 0x07;
+	edid_tile->tile_size[2] = 0x6f;
+	edid_tile->tile_size[3] = 0x08;
+	/* No bezels, the extension block is zeroed */
+	/* Manufacturer Information */
+	edid_tile->topology_id[0] = 0x44;
+	edid_tile->topology_id[1] = 0x45;
+	edid_tile->topology_id[2] = 0x4c;
+	edid_tile->topology_id[3] = 0x43;
+	edid_tile->topology_id[4] = 0x48;
+	edid_tile->topology_id[5] = 0x02;
 
-	return generate_audio_edid(raw_edid, false, &sad, &speaker_alloc);
+	return edid_builder_finish(&builder);
 }
 
 /**
@@ -371,87 +403,36 @@ const struct edid *igt_kms_get_dp_audio_edid(void)
  * @htile: Target H-tile
  * @vtile: Target V-tile
  *
- * Get a basic edid block, which includes tiled display
+ * Get a basic edid block, which includes tiled display, for each of the
+ * (@htile + 1) * (@vtile + 1) tiles. Up to 2 tiles are supported.
  *
- * Returns: A basic tiled display edid block
+ * Returns: An array of basic tiled display edid blocks
  */
-struct edid **igt_kms_get_tiled_edid(uint8_t htile, uint8_t vtile)
+const struct edid **igt_kms_get_tiled_edid(uint8_t htile, uint8_t vtile)
 {
-	uint8_t top[2];
+	static struct edid_template *tmpl[MAX_EDID][MAX_EDID][MAX_EDID];
+	static const struct edid *edid[MAX_EDID][MAX_EDID][MAX_EDID];
 	int edids, i;
-	static  char raw_edid[MAX_EDID][256] = { };
-	static struct edid *edid[MAX_EDID];
 
-	top[0] = 0x00;
-	top[1] = 0x00;
-	top[0] = top[0] | (htile<<4);
 	vtile = vtile & 15;
-	top[0] = top[0] | vtile;
-	top[1] = top[1] | ((htile << 2) & 192);
-	top[1] = top[1] | (vtile & 48);
-
-	edids = (htile+1) * (vtile+1);
-
-	for (i = 0; i < edids; i++)
-		edid[i] = (struct edid *) raw_edid[i];
+	edids = (htile + 1) * (vtile + 1);
+	igt_assert_f(edids <= MAX_EDID,
+		     "%d tiles requested, only up to %d are supported\n",
+		     edids, MAX_EDID);
 
 	for (i = 0; i < edids; i++) {
+		struct tiled_edid tile = {
+			.htile = htile,
+			.vtile = vtile,
+			.index = i,
+		};
 
-		struct edid_ext *edid_ext;
-		struct edid_tile *edid_tile;
-
-	/* Create a new EDID from the base IGT EDID, and add an
-	 * extension that advertises tile support.
-	 */
-		memcpy(edid[i],
-		igt_kms_get_base_tile_edid(), sizeof(struct edid));
-		edid[i]->extensions_len = 1;
-		edid_ext = &edid[i]->extensions[0];
-		edid_tile = &edid_ext->data.tile;
-	/* Set 0x70 to 1st byte of extension,
-	 * so it is identified as display block
-	 */
-		edid_ext_set_displayid(edid_ext);
-	/* To identify it as a tiled display block extension */
-		edid_tile->header[0] = DISPLAY_TILE_BLOCK;
-		edid_tile->header[1] = 0x79;
-		edid_tile->header[2] = 0x00;
-		edid_tile->header[3] = 0x00;
-		edid_tile->header[4] = 0x12;
-		edid_tile->header[5] = 0x00;
-		edid_tile->header[6] = 0x16;
-	/* Tile Capabilities */
-		edid_tile->tile_cap = SCALE_TO_FIT;
-	/* Set number of htile and vtile */
-		edid_tile->topo[0] = top[0];
-		if (i == 0)
-			edid_tile->topo[1] = 0x10;
-		else if (i == 1)
-			edid_tile->topo[1] = 0x00;
-		edid_tile->topo[2] = top[1];
-	/* Set tile resolution */
-		edid_tile->tile_size[0] = 0x7f;
-		edid_tile->tile_size[1] = 0x07;
-		edid_tile->tile_size[2] = 0x6f;
-		edid_tile->tile_size[3] = 0x08;
-	/* Dimension of Bezels */
-		edid_tile->tile_pixel_bezel[0] = 0;
-		edid_tile->tile_pixel_bezel[1] = 0;
-		edid_tile->tile_pixel_bezel[2] = 0;
-		edid_tile->tile_pixel_bezel[3] = 0;
-		edid_tile->tile_pixel_bezel[4] = 0;
-	/* Manufacturer Information */
-		edid_tile->topology_id[0] = 0x44;
-		edid_tile->topology_id[1] = 0x45;
-		edid_tile->topology_id[2] = 0x4c;
-		edid_tile->topology_id[3] = 0x43;
-		edid_tile->topology_id[4] = 0x48;
-		edid_tile->topology_id[5] = 0x02;
-		edid_tile->topology_id[6] = 0x00;
-		edid_tile->topology_id[7] = 0x00;
-		edid_tile->topology_id[8] = 0x00;
+		edid[htile][vtile][i] =
+			edid_template_get_cached(&tmpl[htile][vtile][i],
+						 build_tiled_edid, &tile);
 	}
-	return edid;
+
+	return edid[htile][vtile];
 }
 
 static const uint8_t edid_4k_svds[] = {
@@ -462,39 +443,19 @@ static const uint8_t edid_4k_svds[] = {
 	19,                  /* 720p @ 50Hz */
 };
 
-/**
- * igt_kms_get_4k_edid:
- *
- * Get a basic edid block, which includes 4K resolution
- *
- * Returns: A basic edid block with 4K resolution
- */
-const struct edid *igt_kms_get_4k_edid(void)
+static struct edid_template *build_4k_edid(const void *data)
 {
-	static unsigned char raw_edid[256] = {0};
-	struct edid *edid;
-	struct edid_ext *edid_ext;
-	struct edid_cea *edid_cea;
-	char *cea_data;
-	struct edid_cea_data_block *block;
+	struct edid_builder builder;
 	/* We'll add 6 extension fields to the HDMI VSDB. */
 	char raw_hdmi[HDMI_VSDB_MIN_SIZE + 6] = {0};
 	struct hdmi_vsdb *hdmi;
-	size_t cea_data_size = 0;
 
 	/* Create a new EDID from the base IGT EDID, and add an
 	 * extension that advertises 4K support. */
-	edid = (struct edid *) raw_edid;
-	memcpy(edid, igt_kms_get_base_edid(), sizeof(struct edid));
-	edid->extensions_len = 1;
-	edid_ext = &edid->extensions[0];
-	edid_cea = &edid_ext->data.cea;
-	cea_data = edid_cea->data;
+	edid_builder_init(&builder, igt_kms_get_base_edid());
 
 	/* Short Video Descriptor */
-	block = (struct edid_cea_data_block *) &cea_data[cea_data_size];
-	cea_data_size += edid_cea_data_block_set_svd(block, edid_4k_svds,
-						     sizeof(edid_4k_svds));
+	edid_builder_add_svd(&builder, edid_4k_svds, sizeof(edid_4k_svds));
 
 	/* Vendor-Specific Data Block */
 	hdmi = (struct hdmi_vsdb *) raw_hdmi;
@@ -508,52 +469,38 @@ const struct edid *igt_kms_get_4k_edid(void)
 	hdmi->data[1] = 1 << 5; /* 1 VIC entry, 0 3D entries */
 	hdmi->data[2] = 0x01; /* 2160p, specified as short descriptor */
 
-	block = (struct edid_cea_data_block *) &cea_data[cea_data_size];
-	cea_data_size += edid_cea_data_block_set_hdmi_vsdb(block, hdmi,
-							   sizeof(raw_hdmi));
-
-	assert(cea_data_size <= sizeof(edid_cea->data));
-
-	edid_ext_set_cea(edid_ext, cea_data_size, 0, 0);
+	edid_builder_add_hdmi_vsdb(&builder, hdmi, sizeof(raw_hdmi));
 
-	edid_update_checksum(edid);
-
-	return edid;
+	return edid_builder_finish(&builder);
 }
 
 /**
- * igt_kms_get_3d_edid:
+ * igt_kms_get_4k_edid:
  *
- * Get a basic edid block, which includes 3D mode
+ * Get a basic edid block, which includes 4K resolution
  *
- * Returns: A basic edid block with 3D mode
+ * Returns: A basic edid block with 4K resolution
  */
-const struct edid *igt_kms_get_3d_edid(void)
+const struct edid *igt_kms_get_4k_edid(void)
 {
-	static unsigned char raw_edid[256] = {0};
-	struct edid *edid;
-	struct edid_ext *edid_ext;
-	struct edid_cea *edid_cea;
-	char *cea_data;
-	struct edid_cea_data_block *block;
+	static struct edid_template *tmpl;
+
+	return edid_template_get_cached(&tmpl, build_4k_edid, NULL);
+}
+
+static struct edid_template *build_3d_edid(const void *data)
+{
+	struct edid_builder builder;
 	/* We'll add 5 extension fields to the HDMI VSDB. */
 	char raw_hdmi[HDMI_VSDB_MIN_SIZE + 5] = {0};
 	struct hdmi_vsdb *hdmi;
-	size_t cea_data_size = 0;
 
 	/* Create a new EDID from the base IGT EDID, and add an
 	 * extension that advertises 3D support. */
-	edid = (struct edid *) raw_edid;
-	memcpy(edid, igt_kms_get_base_edid(), sizeof(struct edid));
-	edid->extensions_len = 1;
-	edid_ext = &edid->extensions[0];
-	edid_cea = &edid_ext->data.cea;
-	cea_data = edid_cea->data;
+	edid_builder_init(&builder, igt_kms_get_base_edid());
 
 	/* Short Video Descriptor */
-	block = (struct edid_cea_data_block *) &cea_data[cea_data_size];
-	cea_data_size += edid_cea_data_block_set_svd(block, edid_4k_svds,
-						     sizeof(edid_4k_svds));
+	edid_builder_add_svd(&builder, edid_4k_svds, sizeof(edid_4k_svds));
 
 	/* Vendor-Specific Data Block */
 	hdmi = (struct hdmi_vsdb *) raw_hdmi;
@@ -566,17 +513,23 @@ const struct edid *igt_kms_get_3d_edid(void)
 	hdmi->data[0] = HDMI_VSDB_VIDEO_3D_PRESENT; /* HDMI video flags */
 	hdmi->data[1] = 0; /* 0 VIC entries, 0 3D entries */
 
-	block = (struct edid_cea_data_block *) &cea_data[cea_data_size];
-	cea_data_size += edid_cea_data_block_set_hdmi_vsdb(block, hdmi,
-							   sizeof(raw_hdmi));
+	edid_builder_add_hdmi_vsdb(&builder, hdmi, sizeof(raw_hdmi));
 
-	assert(cea_data_size <= sizeof(edid_cea->data));
-
-	edid_ext_set_cea(edid_ext, cea_data_size, 0, 0);
+	return edid_builder_finish(&builder);
+}
 
-	edid_update_checksum(edid);
+/**
+ * igt_kms_get_3d_edid:
+ *
+ * Get a basic edid block, which includes 3D mode
+ *
+ * Returns: A basic edid block with 3D mode
+ */
+const struct edid *igt_kms_get_3d_edid(void)
+{
+	static struct edid_template *tmpl;
 
-	return edid;
+	return edid_template_get_cached(&tmpl, build_3d_edid, NULL);
 }
 
 /* Set of Video Identification Codes advertised in the EDID */
@@ -584,6 +537,24 @@ static const uint8_t edid_ar_svds[] = {
 	16, /* 1080p @ 60Hz, 16:9 */
 };
 
+static struct edid_template *build_aspect_ratio_edid(const void *data)
+{
+	struct edid_builder builder;
+	const struct cea_vsdb *vsdb;
+	size_t vsdb_size;
+
+	edid_builder_init(&builder, igt_kms_get_base_edid());
+
+	/* The HDMI VSDB advertises support for InfoFrames */
+	vsdb = cea_vsdb_get_hdmi_default(&vsdb_size);
+	edid_builder_add_vsdb(&builder, vsdb, vsdb_size);
+
+	/* Short Video Descriptor */
+	edid_builder_add_svd(&builder, edid_ar_svds, sizeof(edid_ar_svds));
+
+	return edid_builder_finish(&builder);
+}
+
 /**
  * igt_kms_get_aspect_ratio_edid:
  *
@@ -600,40 +571,9 @@ static const uint8_t edid_ar_svds[] = {
  */
 const struct edid *igt_kms_get_aspect_ratio_edid(void)
 {
-	static unsigned char raw_edid[2 * EDID_BLOCK_SIZE] = {0};
-	struct edid *edid;
-	struct edid_ext *edid_ext;
-	struct edid_cea *edid_cea;
-	char *cea_data;
-	struct edid_cea_data_block *block;
-	size_t cea_data_size = 0, vsdb_size;
-	const struct cea_vsdb *vsdb;
+	static struct edid_template *tmpl;
 
-	edid = (struct edid *) raw_edid;
-	memcpy(edid, igt_kms_get_base_edid(), sizeof(struct edid));
-	edid->extensions_len = 1;
-	edid_ext = &edid->extensions[0];
-	edid_cea = &edid_ext->data.cea;
-	cea_data = edid_cea->data;
-
-	/* The HDMI VSDB advertises support for InfoFrames */
-	block = (struct edid_cea_data_block *) &cea_data[cea_data_size];
-	vsdb = cea_vsdb_get_hdmi_default(&vsdb_size);
-	cea_data_size += edid_cea_data_block_set_vsdb(block, vsdb,
-						      vsdb_size);
-
-	/* Short Video Descriptor */
-	block = (struct edid_cea_data_block *) &cea_data[cea_data_size];
-	cea_data_size += edid_cea_data_block_set_svd(block, edid_ar_svds,
-						     sizeof(edid_ar_svds));
-
-	assert(cea_data_size <= sizeof(edid_cea->data));
-
-	edid_ext_set_cea(edid_ext, cea_data_size, 0, 0);
-
-	edid_update_checksum(edid);
-
-	return edid;
+	return edid_template_get_cached(&tmpl, build_aspect_ratio_edid, NULL);
 }
 
 /**
@@ -731,7 +671,7 @@ const char * const igt_rotation_names[] = {
 
 static unsigned int
 igt_plane_rotations(igt_display_t *display, igt_plane_t *plane,
-		    drmModePropertyPtr prop)
+		    const drmModePropertyRes *prop)
 {
 	unsigned int rotations = 0;
 
@@ -756,107 +696,316 @@ igt_plane_rotations(igt_display_t *display, igt_plane_t *plane,
 }
 
 /*
- * Retrieve all the properties specified in props_name and store them into
- * plane->props.
+ * Property cache
+ *
+ * Property metadata (name, flags, enums) never changes for a given property
+ * id and properties are shared between objects, so each one is only queried
+ * once per display. The names are matched against the igt_*_prop_names
+ * tables through a perfect hash, built once per display by searching a seed
+ * without collisions.
+ *
+ * Property values can optionally be cached as well, per object, until the
+ * next commit or igt_display_invalidate_prop_cache().
  */
-static void
-igt_fill_plane_props(igt_display_t *display, igt_plane_t *plane,
-		     int num_props, const char * const prop_names[])
-{
+#define IGT_PROP_NAME_HASH_SIZE 128
+
+struct igt_prop_name_hash {
+	const char * const *names;
+	uint32_t seed;
+	int8_t slots[IGT_PROP_NAME_HASH_SIZE];
+};
+
+struct igt_prop_cache_object {
+	uint32_t id;
 	drmModeObjectPropertiesPtr props;
-	int i, j, fd;
+};
 
-	fd = display->drm_fd;
+struct igt_prop_cache {
+	/* Property id -> drmModePropertyPtr */
+	struct igt_map *props;
+	/* Object id -> struct igt_prop_cache_object, NULL unless caching values */
+	struct igt_map *objects;
 
-	props = drmModeObjectGetProperties(fd, plane->drm_plane->plane_id, DRM_MODE_OBJECT_PLANE);
-	igt_assert(props);
+	struct igt_prop_name_hash plane_names;
+	struct igt_prop_name_hash crtc_names;
+	struct igt_prop_name_hash connector_names;
+};
+
+static uint32_t igt_prop_name_hash(const char *name, uint32_t seed)
+{
+	uint32_t hash = 2166136261u ^ seed;
+
+	while (*name) {
+		hash ^= (uint8_t)*name++;
+		hash *= 16777619u;
+	}
+
+	return (hash ^ (hash >> 16)) & (IGT_PROP_NAME_HASH_SIZE - 1);
+}
+
+static void igt_prop_name_hash_init(struct igt_prop_name_hash *hash,
+				    const char * const names[], int num_names)
+{
+	int i;
 
-	for (i = 0; i < props->count_props; i++) {
-		drmModePropertyPtr prop =
-			drmModeGetProperty(fd, props->props[i]);
+	igt_assert(2 * num_names <= IGT_PROP_NAME_HASH_SIZE);
+	hash->names = names;
 
-		for (j = 0; j < num_props; j++) {
-			if (strcmp(prop->name, prop_names[j]) != 0)
+	for (hash->seed = 0; ; hash->seed++) {
+		memset(hash->slots, -1, sizeof(hash->slots));
+
+		for (i = 0; i < num_names; i++) {
+			int8_t *slot;
+
+			if (!names[i])
 				continue;
 
-			plane->props[j] = props->props[i];
-			break;
+			slot = &hash->slots[igt_prop_name_hash(names[i], hash->seed)];
+			if (*slot >= 0)
+				break;
+
+			*slot = i;
 		}
 
-		if (strcmp(prop->name, "rotation") == 0)
-			plane->rotations = igt_plane_rotations(display, plane, prop);
+		if (i == num_names)
+			break;
+	}
+}
+
+/* Returns the index of @name in the hashed table, -1 if it's not there */
+static int igt_prop_name_lookup(const struct igt_prop_name_hash *hash,
+				const char *name)
+{
+	int i = hash->slots[igt_prop_name_hash(name, hash->seed)];
+
+	if (i < 0 || strcmp(hash->names[i], name))
+		return -1;
+
+	return i;
+}
+
+static struct igt_prop_cache *igt_prop_cache(igt_display_t *display)
+{
+	struct igt_prop_cache *cache = display->prop_cache;
+
+	if (cache)
+		return cache;
+
+	cache = calloc(1, sizeof(*cache));
+	igt_assert(cache);
+
+	cache->props = igt_map_create(igt_map_hash_32, igt_map_equal_32);
+	igt_prop_name_hash_init(&cache->plane_names, igt_plane_prop_names,
+				IGT_NUM_PLANE_PROPS);
+	igt_prop_name_hash_init(&cache->crtc_names, igt_crtc_prop_names,
+				IGT_NUM_CRTC_PROPS);
+	igt_prop_name_hash_init(&cache->connector_names, igt_connector_prop_names,
+				IGT_NUM_CONNECTOR_PROPS);
+
+	display->prop_cache = cache;
+	return cache;
+}
+
+/* Returns the property metadata, owned by the cache */
+static const drmModePropertyRes *
+igt_prop_cache_get_property(igt_display_t *display, uint32_t prop_id)
+{
+	struct igt_prop_cache *cache = igt_prop_cache(display);
+	drmModePropertyPtr prop;
 
-		drmModeFreeProperty(prop);
+	prop = igt_map_search(cache->props, &prop_id);
+	if (prop) {
+		display->prop_stats.hits++;
+		return prop;
 	}
 
-	if (!plane->rotations)
-		plane->rotations = IGT_ROTATION_0;
+	prop = drmModeGetProperty(display->drm_fd, prop_id);
+	display->prop_stats.ioctls++;
+	igt_assert(prop);
 
-	drmModeFreeObjectProperties(props);
+	igt_map_insert(cache->props, &prop->prop_id, prop);
+	return prop;
 }
 
 /*
- * Retrieve all the properties specified in props_name and store them into
- * config->atomic_props_crtc and config->atomic_props_connector.
+ * Returns the properties of an object, to be released with
+ * igt_prop_cache_put_object().
  */
-static void
-igt_atomic_fill_connector_props(igt_display_t *display, igt_output_t *output,
-			int num_connector_props, const char * const conn_prop_names[])
+static drmModeObjectPropertiesPtr
+igt_prop_cache_get_object(igt_display_t *display, uint32_t object_id,
+			  uint32_t object_type)
 {
+	struct igt_prop_cache *cache = igt_prop_cache(display);
+	struct igt_prop_cache_object *object;
 	drmModeObjectPropertiesPtr props;
-	int i, j, fd;
 
-	fd = display->drm_fd;
+	if (cache->objects) {
+		object = igt_map_search(cache->objects, &object_id);
+		if (object) {
+			display->prop_stats.hits++;
+			return object->props;
+		}
+	}
 
-	props = drmModeObjectGetProperties(fd, output->config.connector->connector_id, DRM_MODE_OBJECT_CONNECTOR);
+	props = drmModeObjectGetProperties(display->drm_fd, object_id,
+					   object_type);
+	display->prop_stats.ioctls++;
 	igt_assert(props);
 
-	for (i = 0; i < props->count_props; i++) {
-		drmModePropertyPtr prop =
-			drmModeGetProperty(fd, props->props[i]);
+	if (cache->objects) {
+		object = malloc(sizeof(*object));
+		igt_assert(object);
 
-		for (j = 0; j < num_connector_props; j++) {
-			if (strcmp(prop->name, conn_prop_names[j]) != 0)
-				continue;
+		object->id = object_id;
+		object->props = props;
+		igt_map_insert(cache->objects, &object->id, object);
+	}
 
-			output->props[j] = props->props[i];
-			break;
-		}
+	return props;
+}
+
+static void igt_prop_cache_put_object(igt_display_t *display,
+				      drmModeObjectPropertiesPtr props)
+{
+	if (!display->prop_cache->objects)
+		drmModeFreeObjectProperties(props);
+}
+
+static void igt_prop_cache_free_property(struct igt_map_entry *entry)
+{
+	drmModeFreeProperty(entry->data);
+}
+
+static void igt_prop_cache_free_object(struct igt_map_entry *entry)
+{
+	struct igt_prop_cache_object *object = entry->data;
+
+	drmModeFreeObjectProperties(object->props);
+	free(object);
+}
+
+/**
+ * igt_display_cache_prop_values:
+ * @display: a pointer to an #igt_display_t structure
+ * @enable: whether property values should be cached
+ *
+ * Enables or disables caching of the property values returned by
+ * igt_plane_get_prop(), igt_pipe_obj_get_prop() and igt_output_get_prop().
+ * Cached values are dropped on each commit through @display and by
+ * igt_display_invalidate_prop_cache(), which tests have to call whenever
+ * properties may change behind the display's back, e.g. on hotplug or for
+ * properties updated by the kernel like "Content Protection".
+ */
+void igt_display_cache_prop_values(igt_display_t *display, bool enable)
+{
+	struct igt_prop_cache *cache = igt_prop_cache(display);
+
+	if (enable == !!cache->objects)
+		return;
 
-		drmModeFreeProperty(prop);
+	if (enable) {
+		cache->objects = igt_map_create(igt_map_hash_32,
+						igt_map_equal_32);
+	} else {
+		igt_map_destroy(cache->objects, igt_prop_cache_free_object);
+		cache->objects = NULL;
 	}
+}
 
-	drmModeFreeObjectProperties(props);
+/**
+ * igt_display_invalidate_prop_cache:
+ * @display: a pointer to an #igt_display_t structure
+ *
+ * Drops the cached property values of all objects, see
+ * igt_display_cache_prop_values(). The property metadata stays cached.
+ */
+void igt_display_invalidate_prop_cache(igt_display_t *display)
+{
+	struct igt_prop_cache *cache = display->prop_cache;
+
+	if (!cache || !cache->objects)
+		return;
+
+	igt_map_destroy(cache->objects, igt_prop_cache_free_object);
+	cache->objects = igt_map_create(igt_map_hash_32, igt_map_equal_32);
 }
 
-static void
-igt_fill_pipe_props(igt_display_t *display, igt_pipe_t *pipe,
-		    int num_crtc_props, const char * const crtc_prop_names[])
+static void igt_prop_cache_fini(igt_display_t *display)
 {
-	drmModeObjectPropertiesPtr props;
-	int i, j, fd;
+	struct igt_prop_cache *cache = display->prop_cache;
 
-	fd = display->drm_fd;
+	if (!cache)
+		return;
 
-	props = drmModeObjectGetProperties(fd, pipe->crtc_id, DRM_MODE_OBJECT_CRTC);
-	igt_assert(props);
+	if (cache->objects)
+		igt_map_destroy(cache->objects, igt_prop_cache_free_object);
+	igt_map_destroy(cache->props, igt_prop_cache_free_property);
+	free(cache);
+	display->prop_cache = NULL;
+}
 
-	for (i = 0; i < props->count_props; i++) {
-		drmModePropertyPtr prop =
-			drmModeGetProperty(fd, props->props[i]);
+/* Retrieves the ids of the properties named in @names into @props */
+static void igt_fill_props(igt_display_t *display, uint32_t object_id,
+			   uint32_t object_type,
+			   const struct igt_prop_name_hash *names,
+			   uint32_t *props)
+{
+	drmModeObjectPropertiesPtr proplist;
+	int i, j;
 
-		for (j = 0; j < num_crtc_props; j++) {
-			if (strcmp(prop->name, crtc_prop_names[j]) != 0)
-				continue;
+	proplist = igt_prop_cache_get_object(display, object_id, object_type);
 
-			pipe->props[j] = props->props[i];
-			break;
-		}
+	for (i = 0; i < proplist->count_props; i++) {
+		const drmModePropertyRes *prop =
+			igt_prop_cache_get_property(display, proplist->props[i]);
 
-		drmModeFreeProperty(prop);
+		j = igt_prop_name_lookup(names, prop->name);
+		if (j >= 0)
+			props[j] = proplist->props[i];
 	}
 
-	drmModeFreeObjectProperties(props);
+	igt_prop_cache_put_object(display, proplist);
+}
+
+/*
+ * Retrieve all the properties specified in igt_plane_prop_names and store
+ * them into plane->props.
+ */
+static void
+igt_fill_plane_props(igt_display_t *display, igt_plane_t *plane)
+{
+	const drmModePropertyRes *prop;
+
+	igt_fill_props(display, plane->drm_plane->plane_id, DRM_MODE_OBJECT_PLANE,
+		       &igt_prop_cache(display)->plane_names, plane->props);
+
+	if (plane->props[IGT_PLANE_ROTATION]) {
+		prop = igt_prop_cache_get_property(display,
+						   plane->props[IGT_PLANE_ROTATION]);
+		plane->rotations = igt_plane_rotations(display, plane, prop);
+	}
+
+	if (!plane->rotations)
+		plane->rotations = IGT_ROTATION_0;
+}
+
+/*
+ * Retrieve all the properties specified in igt_connector_prop_names and
+ * store them into output->props.
+ */
+static void
+igt_atomic_fill_connector_props(igt_display_t *display, igt_output_t *output)
+{
+	igt_fill_props(display, output->config.connector->connector_id,
+		       DRM_MODE_OBJECT_CONNECTOR,
+		       &igt_prop_cache(display)->connector_names, output->props);
+}
+
+static void
+igt_fill_pipe_props(igt_display_t *display, igt_pipe_t *pipe)
+{
+	igt_fill_props(display, pipe->crtc_id, DRM_MODE_OBJECT_CRTC,
+		       &igt_prop_cache(display)->crtc_names, pipe->props);
 }
 
 static igt_plane_t *igt_get_assigned_primary(igt_output_t *output, igt_pipe_t *pipe)
@@ -2000,10 +2149,12 @@ _kmstest_connector_config_find_encoder(int drm_fd, drmModeConnector *connector,
  * @connector_id: DRM connector id
  * @crtc_idx_mask: mask of allowed DRM CRTC indices
  * @config: structure filled with the possible configuration
+ * @connector: the connector if already fetched by the caller, or NULL
  * @probe: whether to fully re-probe mode list or not
  *
  * This tries to find a suitable configuration for the given connector and CRTC
- * constraint and fills it into @config.
+ * constraint and fills it into @config. A @connector passed in is owned by
+ * @config afterwards, or freed.
  *
  * Returns: True if suitable configuration found for a given connector & CRTC,
  * else False.
@@ -2011,10 +2162,10 @@ _kmstest_connector_config_find_encoder(int drm_fd, drmModeConnector *connector,
 static bool _kmstest_connector_config(int drm_fd, uint32_t connector_id,
 				      unsigned long crtc_idx_mask,
 				      struct kmstest_connector_config *config,
+				      drmModeConnector *connector,
 				      bool probe)
 {
 	drmModeRes *resources;
-	drmModeConnector *connector;
 	drmModePropertyBlobPtr path_blob;
 
 	config->pipe = PIPE_NONE;
@@ -2022,13 +2173,14 @@ static bool _kmstest_connector_config(int drm_fd, uint32_t connector_id,
 	resources = drmModeGetResources(drm_fd);
 	if (!resources) {
 		igt_warn("drmModeGetResources failed");
+		drmModeFreeConnector(connector);
 		goto err1;
 	}
 
 	/* First, find the connector & mode */
-	if (probe)
+	if (!connector && probe)
 		connector = drmModeGetConnector(drm_fd, connector_id);
-	else
+	else if (!connector)
 		connector = drmModeGetConnectorCurrent(drm_fd, connector_id);
 
 	if (!connector)
@@ -2111,7 +2263,7 @@ bool kmstest_get_connector_config(int drm_fd, uint32_t connector_id,
 				  struct kmstest_connector_config *config)
 {
 	return _kmstest_connector_config(drm_fd, connector_id, crtc_idx_mask,
-					 config, 0);
+					 config, NULL, 0);
 }
 
 /**
@@ -2158,7 +2310,7 @@ bool kmstest_probe_connector_config(int drm_fd, uint32_t connector_id,
 				    struct kmstest_connector_config *config)
 {
 	return _kmstest_connector_config(drm_fd, connector_id, crtc_idx_mask,
-					 config, 1);
+					 config, NULL, 1);
 }
 
 /**
@@ -2430,13 +2582,8 @@ static void igt_display_log_shift(igt_display_t *display, int shift)
 	igt_assert(display->log_shift >= 0);
 }
 
-/**
- * igt_output_refresh:
- * @output: Target output
- *
- * This function sets the given @output to a valid default pipe
- */
-void igt_output_refresh(igt_output_t *output)
+static void __igt_output_refresh(igt_output_t *output,
+				 drmModeConnector *connector)
 {
 	igt_display_t *display = output->display;
 	unsigned long crtc_idx_mask = 0;
@@ -2444,10 +2591,15 @@ void igt_output_refresh(igt_output_t *output)
 	if (output->pending_pipe != PIPE_NONE)
 		crtc_idx_mask = 1 << output->pending_pipe;
 
+	/* Reprobing picks up hotplugs, which may change any property */
+	if (output->force_reprobe)
+		igt_display_invalidate_prop_cache(display);
+
 	kmstest_free_connector_config(&output->config);
 
 	_kmstest_connector_config(display->drm_fd, output->id, crtc_idx_mask,
-				  &output->config, output->force_reprobe);
+				  &output->config, connector,
+				  output->force_reprobe);
 	output->force_reprobe = false;
 
 	if (!output->name && output->config.connector) {
@@ -2458,13 +2610,23 @@ void igt_output_refresh(igt_output_t *output)
 	}
 
 	if (output->config.connector)
-		igt_atomic_fill_connector_props(display, output,
-			IGT_NUM_CONNECTOR_PROPS, igt_connector_prop_names);
+		igt_atomic_fill_connector_props(display, output);
 
 	LOG(display, "%s: Selecting pipe %s\n", output->name,
 	    kmstest_pipe_name(output->pending_pipe));
 }
 
+/**
+ * igt_output_refresh:
+ * @output: Target output
+ *
+ * This function sets the given @output to a valid default pipe
+ */
+void igt_output_refresh(igt_output_t *output)
+{
+	__igt_output_refresh(output, NULL);
+}
+
 static int
 igt_plane_set_property(igt_plane_t *plane, uint32_t prop_id, uint64_t value)
 {
@@ -2480,17 +2642,27 @@ igt_plane_set_property(igt_plane_t *plane, uint32_t prop_id, uint64_t value)
  * find a type property, then the kernel doesn't support universal
  * planes and we know the plane is an overlay/sprite.
  */
-static int get_drm_plane_type(int drm_fd, uint32_t plane_id)
+static int get_drm_plane_type(igt_display_t *display, uint32_t plane_id)
 {
-	uint64_t value;
-	bool has_prop;
+	drmModeObjectPropertiesPtr proplist;
+	int type = DRM_PLANE_TYPE_OVERLAY;
 
-	has_prop = kmstest_get_property(drm_fd, plane_id, DRM_MODE_OBJECT_PLANE,
-					"type", NULL, &value, NULL);
-	if (has_prop)
-		return (int)value;
+	proplist = igt_prop_cache_get_object(display, plane_id,
+					     DRM_MODE_OBJECT_PLANE);
 
-	return DRM_PLANE_TYPE_OVERLAY;
+	for (int i = 0; i < proplist->count_props; i++) {
+		const drmModePropertyRes *prop =
+			igt_prop_cache_get_property(display, proplist->props[i]);
+
+		if (strcmp(prop->name, "type") == 0) {
+			type = proplist->prop_values[i];
+			break;
+		}
+	}
+
+	igt_prop_cache_put_object(display, proplist);
+
+	return type;
 }
 
 static void igt_plane_reset(igt_plane_t *plane)
@@ -2639,6 +2811,8 @@ void igt_display_reset(igt_display_t *display)
 	 */
 	display->first_commit = true;
 
+	igt_display_invalidate_prop_cache(display);
+
 	for_each_pipe(display, pipe) {
 		igt_pipe_t *pipe_obj = &display->pipes[pipe];
 		igt_plane_t *plane;
@@ -2751,17 +2925,170 @@ static void igt_handle_spurious_hpd(igt_display_t *display)
 	dump_connector_attrs();
 }
 
+struct igt_probe_result {
+	uint32_t id;
+	drmModeConnector *connector;
+	bool probe;	/* the connector needed a full probe */
+};
+
+static struct {
+	bool enabled;
+	dev_t rdev;
+	struct igt_probe_result *results;
+	int count;
+} probe_snapshot;
+
+static void igt_probe_connector(int drm_fd, struct igt_probe_result *result)
+{
+	drmModeConnector *connector;
+
+	/*
+	 * Start from the cached state, and only fully probe connectors
+	 * which don't know any better yet, like igt_output_refresh()
+	 * with force_reprobe does.
+	 */
+	connector = drmModeGetConnectorCurrent(drm_fd, result->id);
+	if (connector &&
+	    (!connector->count_modes ||
+	     connector->connection == DRM_MODE_UNKNOWNCONNECTION)) {
+		drmModeFreeConnector(connector);
+		connector = drmModeGetConnector(drm_fd, result->id);
+		result->probe = true;
+	}
+
+	result->connector = connector;
+}
+
+/*
+ * Connectors are probed one after the other: the kernel serializes the
+ * probes of a device on its mode_config mutex, so threads gain nothing.
+ */
+static void igt_probe_connectors(int drm_fd, struct igt_probe_result *results,
+				 int count)
+{
+	for (int i = 0; i < count; i++)
+		igt_probe_connector(drm_fd, &results[i]);
+}
+
+static drmModeConnector *igt_dup_connector(const drmModeConnector *connector)
+{
+	drmModeConnector *dup;
+
+	dup = igt_memdup(connector, sizeof(*connector));
+	igt_assert(dup);
+
+	dup->modes = igt_memdup(connector->modes,
+				connector->count_modes * sizeof(*connector->modes));
+	dup->props = igt_memdup(connector->props,
+				connector->count_props * sizeof(*connector->props));
+	dup->prop_values = igt_memdup(connector->prop_values,
+				      connector->count_props *
+				      sizeof(*connector->prop_values));
+	dup->encoders = igt_memdup(connector->encoders,
+				   connector->count_encoders *
+				   sizeof(*connector->encoders));
+	igt_assert((dup->modes || !connector->count_modes) &&
+		   ((dup->props && dup->prop_values) || !connector->count_props) &&
+		   (dup->encoders || !connector->count_encoders));
+
+	return dup;
+}
+
+static void igt_probe_results_free(struct igt_probe_result *results, int count)
+{
+	for (int i = 0; i < count; i++)
+		drmModeFreeConnector(results[i].connector);
+	free(results);
+}
+
+static dev_t igt_probe_device(int drm_fd)
+{
+	struct stat st;
+
+	if (fstat(drm_fd, &st) || !S_ISCHR(st.st_mode))
+		return 0;
+
+	return st.st_rdev;
+}
+
+static bool igt_probe_snapshot_get(int drm_fd, struct igt_probe_result *results,
+				   int count)
+{
+	dev_t rdev;
+
+	if (!probe_snapshot.enabled || !probe_snapshot.results)
+		return false;
+
+	rdev = igt_probe_device(drm_fd);
+	if (!rdev || rdev != probe_snapshot.rdev ||
+	    count != probe_snapshot.count)
+		return false;
+
+	for (int i = 0; i < count; i++)
+		if (results[i].id != probe_snapshot.results[i].id)
+			return false;
+
+	for (int i = 0; i < count; i++) {
+		const struct igt_probe_result *saved = &probe_snapshot.results[i];
+
+		results[i].probe = saved->probe;
+		results[i].connector = saved->connector ?
+			igt_dup_connector(saved->connector) : NULL;
+	}
+
+	return true;
+}
+
+static void igt_probe_snapshot_put(int drm_fd,
+				   const struct igt_probe_result *results,
+				   int count)
+{
+	if (!probe_snapshot.enabled)
+		return;
+
+	igt_probe_results_free(probe_snapshot.results, probe_snapshot.count);
+
+	probe_snapshot.rdev = igt_probe_device(drm_fd);
+	probe_snapshot.count = count;
+	probe_snapshot.results = calloc(count, sizeof(*results));
+	igt_assert(probe_snapshot.results);
+
+	for (int i = 0; i < count; i++) {
+		probe_snapshot.results[i] = results[i];
+		if (results[i].connector)
+			probe_snapshot.results[i].connector =
+				igt_dup_connector(results[i].connector);
+	}
+}
+
 /**
- * igt_display_reset_outputs:
- * @display: a pointer to an initialized #igt_display_t structure
+ * igt_display_probe_snapshot:
+ * @enable: whether connector probe results should be reused
  *
- * Initialize @display outputs with their connectors and pipes.
- * This function clears any previously allocated outputs.
+ * Enables or disables reusing the connector probe results of the previous
+ * igt_display_require() on the same device, which saves probing all the
+ * connectors again in every subtest that initializes its own display.
+ * The snapshot is refreshed by igt_display_reset_outputs(), which tests
+ * have to call after changing the connector state, e.g. on hotplug or after
+ * forcing a connector. Disabling drops the snapshot.
  */
-void igt_display_reset_outputs(igt_display_t *display)
+void igt_display_probe_snapshot(bool enable)
 {
-	int i;
+	probe_snapshot.enabled = enable;
+	if (enable)
+		return;
+
+	igt_probe_results_free(probe_snapshot.results, probe_snapshot.count);
+	probe_snapshot.results = NULL;
+	probe_snapshot.count = 0;
+}
+
+static void __igt_display_reset_outputs(igt_display_t *display,
+					bool use_snapshot)
+{
+	struct igt_probe_result *results;
 	drmModeRes *resources;
+	int i;
 
 	/* Clear any existing outputs*/
 	if (display->n_outputs) {
@@ -2786,9 +3113,22 @@ void igt_display_reset_outputs(igt_display_t *display)
 		     "Failed to allocate memory for %d outputs\n",
 		     display->n_outputs);
 
+	results = calloc(display->n_outputs, sizeof(*results));
+	igt_assert(results || !display->n_outputs);
+	for (i = 0; i < display->n_outputs; i++)
+		results[i].id = resources->connectors[i];
+
+	if (!use_snapshot ||
+	    !igt_probe_snapshot_get(display->drm_fd, results,
+				    display->n_outputs)) {
+		igt_probe_connectors(display->drm_fd, results,
+				     display->n_outputs);
+		igt_probe_snapshot_put(display->drm_fd, results,
+				       display->n_outputs);
+	}
+
 	for (i = 0; i < display->n_outputs; i++) {
 		igt_output_t *output = &display->outputs[i];
-		drmModeConnector *connector;
 
 		/*
 		 * We don't assign each output a pipe unless
@@ -2797,17 +3137,12 @@ void igt_display_reset_outputs(igt_display_t *display)
 		output->pending_pipe = PIPE_NONE;
 		output->id = resources->connectors[i];
 		output->display = display;
+		output->force_reprobe = results[i].probe;
 
-		igt_output_refresh(output);
-
-		connector = output->config.connector;
-		if (connector &&
-		    (!connector->count_modes ||
-		     connector->connection == DRM_MODE_UNKNOWNCONNECTION)) {
-			output->force_reprobe = true;
-			igt_output_refresh(output);
-		}
+		/* The output owns the connector from here. */
+		__igt_output_refresh(output, results[i].connector);
 	}
+	free(results);
 
 	/* Set reasonable default values for every object in the
 	 * display. */
@@ -2853,6 +3188,18 @@ void igt_display_reset_outputs(igt_display_t *display)
 	drmModeFreeResources(resources);
 }
 
+/**
+ * igt_display_reset_outputs:
+ * @display: a pointer to an initialized #igt_display_t structure
+ *
+ * Initialize @display outputs with their connectors and pipes.
+ * This function clears any previously allocated outputs.
+ */
+void igt_display_reset_outputs(igt_display_t *display)
+{
+	__igt_display_reset_outputs(display, false);
+}
+
 /**
  * igt_display_require:
  * @display: a pointer to an #igt_display_t structure
@@ -2946,7 +3293,7 @@ void igt_display_require(igt_display_t *display, int drm_fd)
 		plane->drm_plane = drmModeGetPlane(display->drm_fd, id);
 		igt_assert(plane->drm_plane);
 
-		plane->type = get_drm_plane_type(display->drm_fd, id);
+		plane->type = get_drm_plane_type(display, id);
 
 		/*
 		 * TODO: Fill in the rest of the plane properties here and
@@ -2970,7 +3317,7 @@ void igt_display_require(igt_display_t *display, int drm_fd)
 		pipe->planes = NULL;
 		pipe->num_primary_planes = 0;
 
-		igt_fill_pipe_props(display, pipe, IGT_NUM_CRTC_PROPS, igt_crtc_prop_names);
+		igt_fill_pipe_props(display, pipe);
 
 		/* Get valid crtc index from crtcs for a pipe */
 		crtc_mask = __get_crtc_mask_for_pipe(resources, pipe);
@@ -3035,7 +3382,7 @@ void igt_display_require(igt_display_t *display, int drm_fd)
 			if (!global_plane->ref)
 				igt_plane_set_pipe(plane, pipe);
 
-			igt_fill_plane_props(display, plane, IGT_NUM_PLANE_PROPS, igt_plane_prop_names);
+			igt_fill_plane_props(display, plane);
 
 			igt_fill_plane_format_mod(display, plane);
 		}
@@ -3059,7 +3406,7 @@ void igt_display_require(igt_display_t *display, int drm_fd)
 
 	igt_fill_display_format_mod(display);
 
-	igt_display_reset_outputs(display);
+	__igt_display_reset_outputs(display, true);
 
 out:
 	LOG_UNINDENT(display);
@@ -3273,6 +3620,8 @@ void igt_display_fini(igt_display_t *display)
 	display->pipes = NULL;
 	free(display->planes);
 	display->planes = NULL;
+
+	igt_prop_cache_fini(display);
 }
 
 static void igt_display_refresh(igt_display_t *display)
@@ -4005,7 +4354,7 @@ static uint64_t igt_mode_object_get_prop(igt_display_t *display,
 	int i;
 	uint64_t ret;
 
-	proplist = drmModeObjectGetProperties(display->drm_fd, object_id, object_type);
+	proplist = igt_prop_cache_get_object(display, object_id, object_type);
 	for (i = 0; i < proplist->count_props; i++) {
 		if (proplist->props[i] != prop)
 			continue;
@@ -4018,7 +4367,7 @@ static uint64_t igt_mode_object_get_prop(igt_display_t *display,
 
 	ret = proplist->prop_values[i];
 
-	drmModeFreeObjectProperties(proplist);
+	igt_prop_cache_put_object(display, proplist);
 	return ret;
 }
 
@@ -4041,18 +4390,17 @@ uint64_t igt_plane_get_prop(igt_plane_t *plane, enum igt_atomic_plane_properties
 					plane->drm_plane->plane_id, plane->props[prop]);
 }
 
-static bool igt_mode_object_get_prop_enum_value(int drm_fd, uint32_t id, const char *str, uint64_t *val)
+static bool igt_mode_object_get_prop_enum_value(igt_display_t *display, uint32_t id, const char *str, uint64_t *val)
 {
-	drmModePropertyPtr prop = drmModeGetProperty(drm_fd, id);
+	const drmModePropertyRes *prop;
 	int i;
 
 	igt_assert(id);
-	igt_assert(prop);
+	prop = igt_prop_cache_get_property(display, id);
 
 	for (i = 0; i < prop->count_enums; i++)
 		if (!strcmp(str, prop->enums[i].name)) {
 			*val = prop->enums[i].value;
-			drmModeFreeProperty(prop);
 			return true;
 		}
 
@@ -4077,7 +4425,7 @@ bool igt_plane_try_prop_enum(igt_plane_t *plane,
 
 	igt_assert(plane->props[prop]);
 
-	if (!igt_mode_object_get_prop_enum_value(display->drm_fd,
+	if (!igt_mode_object_get_prop_enum_value(display,
 						 plane->props[prop], val, &uval))
 		return false;
 
@@ -4114,18 +4462,14 @@ void igt_plane_set_prop_enum(igt_plane_t *plane,
 bool igt_plane_check_prop_is_mutable(igt_plane_t *plane,
 				     enum igt_atomic_plane_properties igt_prop)
 {
-	drmModePropertyPtr prop;
-	uint64_t value;
-	bool has_prop;
-
-	has_prop = kmstest_get_property(plane->pipe->display->drm_fd,
-					plane->drm_plane->plane_id,
-					DRM_MODE_OBJECT_PLANE,
-				        igt_plane_prop_names[igt_prop], NULL,
-					&value, &prop);
-	if (!has_prop)
+	const drmModePropertyRes *prop;
+
+	if (!igt_plane_has_prop(plane, igt_prop))
 		return false;
 
+	prop = igt_prop_cache_get_property(plane->pipe->display,
+					   plane->props[igt_prop]);
+
 	return !(prop->flags & DRM_MODE_PROP_IMMUTABLE);
 }
 
@@ -4198,7 +4542,7 @@ bool igt_output_try_prop_enum(igt_output_t *output,
 
 	igt_assert(output->props[prop]);
 
-	if (!igt_mode_object_get_prop_enum_value(display->drm_fd,
+	if (!igt_mode_object_get_prop_enum_value(display,
 						 output->props[prop], val, &uval))
 		return false;
 
@@ -4291,7 +4635,7 @@ bool igt_pipe_obj_try_prop_enum(igt_pipe_t *pipe_obj,
 
 	igt_assert(pipe_obj->props[prop]);
 
-	if (!igt_mode_object_get_prop_enum_value(display->drm_fd,
+	if (!igt_mode_object_get_prop_enum_value(display,
 						 pipe_obj->props[prop], val, &uval))
 		return false;
 
@@ -4578,6 +4922,9 @@ static int do_display_commit(igt_display_t *display,
 			ret = igt_output_commit(&display->outputs[i], s, fail_on_error);
 	}
 
+	/* Even failed legacy commits may have changed some properties */
+	igt_display_invalidate_prop_cache(display);
+
 	LOG_UNINDENT(display);
 	CHECK_RETURN(ret, fail_on_error);
 
@@ -4620,6 +4967,9 @@ int igt_display_try_commit_atomic(igt_display_t *display, uint32_t flags, void *
 
 	ret = igt_atomic_commit(display, flags, user_data);
 
+	if (!(flags & DRM_MODE_ATOMIC_TEST_ONLY))
+		igt_display_invalidate_prop_cache(display);
+
 	LOG_UNINDENT(display);
 
 	if (ret || (flags & DRM_MODE_ATOMIC_TEST_ONLY))
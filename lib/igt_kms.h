@@ -472,6 +472,11 @@ typedef struct {
 	uint64_t values[IGT_NUM_CONNECTOR_PROPS];
 } igt_output_t;
 
+typedef struct {
+	unsigned long hits;	/* lookups served from the property cache */
+	unsigned long ioctls;	/* property and object property queries */
+} igt_prop_cache_stats_t;
+
 struct igt_display {
 	int drm_fd;
 	int log_shift;
@@ -489,6 +494,10 @@ struct igt_display {
 	uint64_t *modifiers;
 	uint32_t *formats;
 	int format_mod_count;
+
+	/* see igt_display_cache_prop_values() */
+	struct igt_prop_cache *prop_cache;
+	igt_prop_cache_stats_t prop_stats;
 };
 
 typedef struct {
@@ -503,6 +512,9 @@ void igt_display_reset_outputs(igt_display_t *display);
 void igt_display_require(igt_display_t *display, int drm_fd);
 void igt_display_fini(igt_display_t *display);
 void igt_display_reset(igt_display_t *display);
+void igt_display_cache_prop_values(igt_display_t *display, bool enable);
+void igt_display_invalidate_prop_cache(igt_display_t *display);
+void igt_display_probe_snapshot(bool enable);
 int  igt_display_commit2(igt_display_t *display, enum igt_commit_style s);
 int  igt_display_commit(igt_display_t *display);
 int  igt_display_try_commit_atomic(igt_display_t *display, uint32_t flags, void *user_data);
@@ -1097,7 +1109,7 @@ const struct edid *igt_kms_get_dp_audio_edid(void);
 const struct edid *igt_kms_get_4k_edid(void);
 const struct edid *igt_kms_get_3d_edid(void);
 const struct edid *igt_kms_get_aspect_ratio_edid(void);
-struct edid **igt_kms_get_tiled_edid(uint8_t htile, uint8_t vtile);
+const struct edid **igt_kms_get_tiled_edid(uint8_t htile, uint8_t vtile);
 const struct edid *igt_kms_get_custom_edid(enum igt_custom_edid_type edid);
 struct udev_monitor *igt_watch_uevents(void);
 bool igt_hotplug_detected(struct udev_monitor *mon,
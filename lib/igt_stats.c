@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "igt_aux.h"
 #include "igt_core.h"
 #include "igt_stats.h"
 
@@ -64,7 +65,138 @@
  *
  *	igt_stats_fini(&stats);
  * ]|
+ *
+ * Keeping every sample is not an option for long running measurements that
+ * push millions of them. An #igt_stats_t initialized with
+ * igt_stats_init_with_mode() and #IGT_STATS_HISTOGRAM instead counts the
+ * samples in a log-linear histogram whose buckets span less than 1/128th of
+ * their values, so quantiles are approximated to within 0.4% in bounded
+ * memory. Histograms filled by different threads can be combined with
+ * igt_stats_merge().
+ */
+
+/*
+ * The histogram buckets are indexed by the top bits of the values converted
+ * to doubles: the sign and exponent select a group, and the most significant
+ * bits of the mantissa a bucket within the group. Groups are only allocated
+ * once a value falls into them.
  */
+#define HISTOGRAM_SUB_BITS 7
+#define HISTOGRAM_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_GROUPS (1 << 12) /* sign and exponent */
+#define HISTOGRAM_SHIFT (52 - HISTOGRAM_SUB_BITS)
+
+struct igt_stats_histogram {
+	uint64_t *groups[HISTOGRAM_GROUPS];
+};
+
+/* Maps doubles to integers sorted in the same order. */
+static uint64_t histogram_key(double value)
+{
+	uint64_t bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	return bits >> 63 ? ~bits : bits | 1ull << 63;
+}
+
+static double histogram_key_value(uint64_t key)
+{
+	uint64_t bits = key >> 63 ? key & ~(1ull << 63) : ~key;
+	double value;
+
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+/* The middle of the bucket, clamped to the range of pushed values. */
+static double histogram_bucket_value(igt_stats_t *stats, unsigned int bucket)
+{
+	uint64_t key = (uint64_t)bucket << HISTOGRAM_SHIFT;
+	double value;
+
+	value = (histogram_key_value(key) +
+		 histogram_key_value(key | ((1ull << HISTOGRAM_SHIFT) - 1))) / 2;
+
+	return fmin(fmax(value, stats->range[0]), stats->range[1]);
+}
+
+static void igt_stats_histogram_push(igt_stats_t *stats, double value)
+{
+	unsigned int bucket = histogram_key(value) >> HISTOGRAM_SHIFT;
+	uint64_t **group = &stats->histogram->groups[bucket / HISTOGRAM_BUCKETS];
+	double delta;
+
+	if (!*group) {
+		*group = calloc(HISTOGRAM_BUCKETS, sizeof(**group));
+		igt_assert(*group);
+	}
+	(*group)[bucket % HISTOGRAM_BUCKETS]++;
+
+	/* The values are not kept, so the mean and variance are running. */
+	delta = value - stats->mean;
+	stats->mean += delta / ++stats->n_values;
+	stats->m2 += delta * (value - stats->mean);
+	stats->mean_variance_valid = false;
+
+	if (value < stats->range[0])
+		stats->range[0] = value;
+	if (value > stats->range[1])
+		stats->range[1] = value;
+}
+
+/* Returns the approximate value of the given rank, 0 being the lowest. */
+static double igt_stats_histogram_rank(igt_stats_t *stats, uint64_t rank)
+{
+	for (unsigned int g = 0; g < HISTOGRAM_GROUPS; g++) {
+		const uint64_t *group = stats->histogram->groups[g];
+
+		if (!group)
+			continue;
+
+		for (unsigned int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+			if (rank < group[b])
+				return histogram_bucket_value(stats,
+							      g * HISTOGRAM_BUCKETS + b);
+			rank -= group[b];
+		}
+	}
+
+	return stats->range[1];
+}
+
+/* Mean of the values ranked in [n/4, 3n/4), see igt_stats_get_iqm(). */
+static double igt_stats_histogram_iqm(igt_stats_t *stats)
+{
+	uint64_t q1 = stats->n_values / 4, q3 = 3 * (uint64_t)stats->n_values / 4;
+	uint64_t rank = 0, n = 0;
+	double mean = 0;
+
+	if (q1 == q3)
+		return igt_stats_get_median(stats);
+
+	for (unsigned int g = 0; g < HISTOGRAM_GROUPS && rank < q3; g++) {
+		const uint64_t *group = stats->histogram->groups[g];
+
+		if (!group)
+			continue;
+
+		for (unsigned int b = 0; b < HISTOGRAM_BUCKETS && rank < q3; b++) {
+			uint64_t lo = max(rank, q1);
+			uint64_t hi = min(rank + group[b], q3);
+
+			if (hi > lo) {
+				double value = histogram_bucket_value(stats,
+								      g * HISTOGRAM_BUCKETS + b);
+
+				n += hi - lo;
+				mean += (hi - lo) * (value - mean) / n;
+			}
+			rank += group[b];
+		}
+	}
+
+	return mean;
+}
 
 static unsigned int get_new_capacity(int need)
 {
@@ -83,7 +215,7 @@ static void igt_stats_ensure_capacity(igt_stats_t *stats,
 	unsigned int new_n_values = stats->n_values + n_additional_values;
 	unsigned int new_capacity;
 
-	if (new_n_values <= stats->capacity)
+	if (stats->histogram || new_n_values <= stats->capacity)
 		return;
 
 	new_capacity = get_new_capacity(new_n_values);
@@ -137,6 +269,36 @@ void igt_stats_init_with_size(igt_stats_t *stats, unsigned int capacity)
 	stats->range[1] = -HUGE_VAL;
 }
 
+/**
+ * igt_stats_init_with_mode:
+ * @stats: An #igt_stats_t instance
+ * @mode: The #igt_stats_mode of storage
+ *
+ * Like igt_stats_init() but selecting how the values are stored. With
+ * #IGT_STATS_HISTOGRAM the memory used no longer depends on the number of
+ * values pushed, at the cost of approximate quantiles, median, quartiles and
+ * interquartile mean.
+ *
+ * igt_stats_fini() must be called once finished with @stats.
+ */
+void igt_stats_init_with_mode(igt_stats_t *stats, enum igt_stats_mode mode)
+{
+	if (mode == IGT_STATS_EXACT) {
+		igt_stats_init(stats);
+		return;
+	}
+
+	memset(stats, 0, sizeof(*stats));
+
+	stats->histogram = calloc(1, sizeof(*stats->histogram));
+	igt_assert(stats->histogram);
+
+	stats->min = U64_MAX;
+	stats->max = 0;
+	stats->range[0] = HUGE_VAL;
+	stats->range[1] = -HUGE_VAL;
+}
+
 /**
  * igt_stats_fini:
  * @stats: An #igt_stats_t instance
@@ -147,6 +309,12 @@ void igt_stats_fini(igt_stats_t *stats)
 {
 	free(stats->values_u64);
 	free(stats->sorted_u64);
+
+	if (stats->histogram) {
+		for (int g = 0; g < HISTOGRAM_GROUPS; g++)
+			free(stats->histogram->groups[g]);
+		free(stats->histogram);
+	}
 }
 
 
@@ -212,6 +380,11 @@ void igt_stats_push(igt_stats_t *stats, uint64_t value)
 		return;
 	}
 
+	if (stats->histogram) {
+		igt_stats_histogram_push(stats, value);
+		goto out;
+	}
+
 	igt_stats_ensure_capacity(stats, 1);
 
 	stats->values_u64[stats->n_values++] = value;
@@ -219,6 +392,7 @@ void igt_stats_push(igt_stats_t *stats, uint64_t value)
 	stats->mean_variance_valid = false;
 	stats->sorted_array_valid = false;
 
+out:
 	if (value < stats->min)
 		stats->min = value;
 	if (value > stats->max)
@@ -235,6 +409,12 @@ void igt_stats_push(igt_stats_t *stats, uint64_t value)
  */
 void igt_stats_push_float(igt_stats_t *stats, double value)
 {
+	if (stats->histogram) {
+		stats->is_float = true;
+		igt_stats_histogram_push(stats, value);
+		return;
+	}
+
 	igt_stats_ensure_capacity(stats, 1);
 
 	if (!stats->is_float) {
@@ -316,6 +496,112 @@ uint64_t igt_stats_get_range(igt_stats_t *stats)
 	return igt_stats_get_max(stats) - igt_stats_get_min(stats);
 }
 
+static void igt_stats_ensure_sorted_values(igt_stats_t *stats);
+
+/**
+ * igt_stats_get_quantile:
+ * @stats: An #igt_stats_t instance
+ * @q: The quantile to retrieve, between 0 and 1
+ *
+ * Retrieves the @q quantile of the @stats dataset, e.g. 0.99 for the 99th
+ * percentile, linearly interpolating between the closest values. For an
+ * #IGT_STATS_HISTOGRAM the value is approximated, except for the minimum
+ * and maximum.
+ *
+ * Returns: The value below which a fraction @q of the values fall.
+ */
+double igt_stats_get_quantile(igt_stats_t *stats, double q)
+{
+	unsigned int i;
+	double pos;
+
+	if (!stats->n_values)
+		return 0.;
+
+	q = fmin(fmax(q, 0.), 1.);
+	pos = q * (stats->n_values - 1);
+
+	if (stats->histogram) {
+		if (q == 0.)
+			return stats->range[0];
+		if (q == 1.)
+			return stats->range[1];
+
+		return igt_stats_histogram_rank(stats, pos + .5);
+	}
+
+	igt_stats_ensure_sorted_values(stats);
+
+	i = pos;
+	if (i == stats->n_values - 1)
+		return sorted_value(stats, i);
+
+	return sorted_value(stats, i) +
+	       (pos - i) * (sorted_value(stats, i + 1) - sorted_value(stats, i));
+}
+
+/**
+ * igt_stats_merge:
+ * @stats: An #igt_stats_t instance
+ * @other: The #igt_stats_t instance to add to @stats
+ *
+ * Adds all the values of @other to the @stats dataset, e.g. to combine the
+ * measurements of several threads each pushing into their own #igt_stats_t.
+ * An #IGT_STATS_HISTOGRAM can only be merged into another one.
+ */
+void igt_stats_merge(igt_stats_t *stats, const igt_stats_t *other)
+{
+	unsigned int n_values;
+	double delta;
+
+	if (!other->histogram) {
+		for (unsigned int i = 0; i < other->n_values; i++) {
+			if (other->is_float)
+				igt_stats_push_float(stats, other->values_f[i]);
+			else
+				igt_stats_push(stats, other->values_u64[i]);
+		}
+		return;
+	}
+
+	/* The values cannot be recovered from the bucket counts. */
+	igt_assert(stats->histogram);
+
+	if (!other->n_values)
+		return;
+
+	for (int g = 0; g < HISTOGRAM_GROUPS; g++) {
+		const uint64_t *src = other->histogram->groups[g];
+		uint64_t **dst = &stats->histogram->groups[g];
+
+		if (!src)
+			continue;
+
+		if (!*dst) {
+			*dst = calloc(HISTOGRAM_BUCKETS, sizeof(**dst));
+			igt_assert(*dst);
+		}
+
+		for (int b = 0; b < HISTOGRAM_BUCKETS; b++)
+			(*dst)[b] += src[b];
+	}
+
+	/* Chan et al. pairwise combination of the running variances */
+	n_values = stats->n_values + other->n_values;
+	delta = other->mean - stats->mean;
+	stats->m2 += other->m2 +
+		delta * delta * stats->n_values * other->n_values / n_values;
+	stats->mean += delta * other->n_values / n_values;
+	stats->n_values = n_values;
+	stats->mean_variance_valid = false;
+
+	stats->is_float |= other->is_float;
+	stats->min = min(stats->min, other->min);
+	stats->max = max(stats->max, other->max);
+	stats->range[0] = fmin(stats->range[0], other->range[0]);
+	stats->range[1] = fmax(stats->range[1], other->range[1]);
+}
+
 static int cmp_u64(const void *pa, const void *pb)
 {
 	const uint64_t *a = pa, *b = pb;
@@ -436,6 +722,16 @@ void igt_stats_get_quartiles(igt_stats_t *stats,
 		return;
 	}
 
+	if (stats->histogram) {
+		if (q1)
+			*q1 = igt_stats_get_quantile(stats, .25);
+		if (q2)
+			*q2 = igt_stats_get_quantile(stats, .5);
+		if (q3)
+			*q3 = igt_stats_get_quantile(stats, .75);
+		return;
+	}
+
 	ret = igt_stats_get_median_internal(stats, 0, stats->n_values,
 					    &lower_end, &upper_start);
 	if (q2)
@@ -475,6 +771,9 @@ double igt_stats_get_iqr(igt_stats_t *stats)
  */
 double igt_stats_get_median(igt_stats_t *stats)
 {
+	if (stats->histogram)
+		return igt_stats_get_quantile(stats, .5);
+
 	return igt_stats_get_median_internal(stats, 0, stats->n_values,
 					     NULL, NULL);
 }
@@ -495,6 +794,12 @@ static void igt_stats_knuth_mean_variance(igt_stats_t *stats)
 	if (stats->mean_variance_valid)
 		return;
 
+	/* igt_stats_histogram_push() keeps the running mean */
+	if (stats->histogram) {
+		m2 = stats->m2;
+		goto out;
+	}
+
 	for (i = 0; i < stats->n_values; i++) {
 		double delta = unsorted_value(stats, i) - mean;
 
@@ -503,6 +808,7 @@ static void igt_stats_knuth_mean_variance(igt_stats_t *stats)
 	}
 
 	stats->mean = mean;
+out:
 	if (stats->n_values > 1 && !stats->is_population)
 		stats->variance = m2 / (stats->n_values - 1);
 	else
@@ -579,6 +885,9 @@ double igt_stats_get_iqm(igt_stats_t *stats)
 	unsigned int q1, q3, i;
 	double mean;
 
+	if (stats->histogram)
+		return igt_stats_histogram_iqm(stats);
+
 	igt_stats_ensure_sorted_values(stats);
 
 	q1 = (stats->n_values + 3) / 4;
@@ -29,12 +29,30 @@
 #include <stdbool.h>
 #include <math.h>
 
+/**
+ * igt_stats_mode:
+ * @IGT_STATS_EXACT: Keep every pushed value, all the statistics are exact
+ * @IGT_STATS_HISTOGRAM: Keep a log-linear histogram of bounded size instead
+ *			 of the values. Quantiles are approximated, mean,
+ *			 variance, min and max remain exact.
+ *
+ * The storage used by an #igt_stats_t, see igt_stats_init_with_mode().
+ */
+enum igt_stats_mode {
+	IGT_STATS_EXACT,
+	IGT_STATS_HISTOGRAM,
+};
+
+struct igt_stats_histogram;
+
 /**
  * igt_stats_t:
  * @values_u64: An array containing pushed integer values
  * @is_float: Whether @values_f or @values_u64 is valid
  * @values_f: An array containing pushed float values
  * @n_values: The number of pushed values
+ *
+ * In #IGT_STATS_HISTOGRAM mode, @values_u64 and @values_f are NULL.
  */
 typedef struct {
 	unsigned int n_values;
@@ -58,10 +76,14 @@ typedef struct {
 		uint64_t *sorted_u64;
 		double *sorted_f;
 	};
+
+	struct igt_stats_histogram *histogram;
+	double m2;
 } igt_stats_t;
 
 void igt_stats_init(igt_stats_t *stats);
 void igt_stats_init_with_size(igt_stats_t *stats, unsigned int capacity);
+void igt_stats_init_with_mode(igt_stats_t *stats, enum igt_stats_mode mode);
 void igt_stats_fini(igt_stats_t *stats);
 bool igt_stats_is_population(igt_stats_t *stats);
 void igt_stats_set_population(igt_stats_t *stats, bool full_population);
@@ -72,6 +94,8 @@ void igt_stats_push_array(igt_stats_t *stats,
 uint64_t igt_stats_get_min(igt_stats_t *stats);
 uint64_t igt_stats_get_max(igt_stats_t *stats);
 uint64_t igt_stats_get_range(igt_stats_t *stats);
+double igt_stats_get_quantile(igt_stats_t *stats, double q);
+void igt_stats_merge(igt_stats_t *stats, const igt_stats_t *other);
 void igt_stats_get_quartiles(igt_stats_t *stats,
 			     double *q1, double *q2, double *q3);
 double igt_stats_get_iqr(igt_stats_t *stats);
@@ -25,7 +25,6 @@
  *
  **************************************************************************/
 
-#include <search.h>
 #include <glib.h>
 
 #include "gpgpu_fill.h"
@@ -802,7 +801,63 @@ igt_media_spinfunc_t igt_get_media_spinfunc(int devid)
 }
 
 /* Intel batchbuffer v2 */
-static bool intel_bb_debug_tree = false;
+static bool intel_bb_debug_cache = false;
+
+static inline uint32_t __object_hash(struct intel_bb *ibb, uint32_t handle)
+{
+	uint32_t hash = handle * 0x9e3779b1u;
+
+	return (hash ^ (hash >> 16)) & ibb->object_index_mask;
+}
+
+/*
+ * __object_index_slot:
+ * @ibb: pointer to intel_bb
+ * @handle: object handle
+ *
+ * Returns the index slot holding @handle or the empty slot where it should
+ * be inserted. The index is kept at most half full so probing terminates.
+ */
+static uint32_t *__object_index_slot(struct intel_bb *ibb, uint32_t handle)
+{
+	uint32_t i = __object_hash(ibb, handle);
+
+	while (ibb->object_index[i] &&
+	       ibb->objects[ibb->object_index[i] - 1].handle != handle)
+		i = (i + 1) & ibb->object_index_mask;
+
+	return &ibb->object_index[i];
+}
+
+static void __object_index_remove(struct intel_bb *ibb, uint32_t *slot)
+{
+	uint32_t mask = ibb->object_index_mask;
+	uint32_t i = slot - ibb->object_index, j = i, k;
+
+	/* Shift back the following entries of the probe chain */
+	for (j = (i + 1) & mask; ibb->object_index[j]; j = (j + 1) & mask) {
+		k = __object_hash(ibb, ibb->objects[ibb->object_index[j] - 1].handle);
+		if (((j - k) & mask) >= ((j - i) & mask)) {
+			ibb->object_index[i] = ibb->object_index[j];
+			i = j;
+		}
+	}
+
+	ibb->object_index[i] = 0;
+}
+
+static void __object_index_rebuild(struct intel_bb *ibb, uint32_t size)
+{
+	uint32_t i;
+
+	free(ibb->object_index);
+	ibb->object_index = calloc(size, sizeof(*ibb->object_index));
+	igt_assert(ibb->object_index);
+	ibb->object_index_mask = size - 1;
+
+	for (i = 0; i < ibb->num_cached; i++)
+		*__object_index_slot(ibb, ibb->objects[i].handle) = i + 1;
+}
 
 /*
  * __reallocate_objects:
@@ -814,7 +869,7 @@ static void __reallocate_objects(struct intel_bb *ibb)
 {
 	const uint32_t inc = 4096 / sizeof(*ibb->objects);
 
-	if (ibb->num_objects == ibb->allocated_objects) {
+	if (ibb->num_cached == ibb->allocated_objects) {
 		ibb->objects = realloc(ibb->objects,
 				       sizeof(*ibb->objects) *
 				       (inc + ibb->allocated_objects));
@@ -822,11 +877,35 @@ static void __reallocate_objects(struct intel_bb *ibb)
 		igt_assert(ibb->objects);
 		ibb->allocated_objects += inc;
 
-		memset(&ibb->objects[ibb->num_objects],	0,
+		memset(&ibb->objects[ibb->num_cached], 0,
 		       inc * sizeof(*ibb->objects));
+
+		if (!ibb->object_index ||
+		    2 * ibb->allocated_objects > ibb->object_index_mask + 1)
+			__object_index_rebuild(ibb,
+					       roundup_power_of_two(2 * ibb->allocated_objects));
 	}
 }
 
+static void __swap_objects(struct intel_bb *ibb, uint32_t a, uint32_t b)
+{
+	struct drm_i915_gem_exec_object2 tmp;
+	uint32_t *slot_a, *slot_b;
+
+	if (a == b)
+		return;
+
+	slot_a = __object_index_slot(ibb, ibb->objects[a].handle);
+	slot_b = __object_index_slot(ibb, ibb->objects[b].handle);
+
+	tmp = ibb->objects[a];
+	ibb->objects[a] = ibb->objects[b];
+	ibb->objects[b] = tmp;
+
+	*slot_a = b + 1;
+	*slot_b = a + 1;
+}
+
 static inline uint64_t __intel_bb_get_offset(struct intel_bb *ibb,
 					     uint32_t handle,
 					     uint64_t size,
@@ -846,6 +925,257 @@ static inline uint64_t __intel_bb_get_offset(struct intel_bb *ibb,
 	return offset;
 }
 
+/*
+ * Batch buffer pool
+ *
+ * Each intel_bb_reset() closes the batch and creates a fresh one, which
+ * for tests flushing thousands of small batches means a create/close ioctl
+ * pair per batch. With a pool enabled for the fd released batches are kept
+ * in power of two size classes, oldest first, together with the out-fence
+ * of their last execbuf. A batch is reused once that fence has signaled,
+ * checking only the oldest entry of the class so acquire stays O(1).
+ */
+#define INTEL_BB_POOL_MIN_SHIFT 12
+#define INTEL_BB_POOL_CLASSES 20 /* 4KiB .. 2GiB */
+
+struct intel_bb_pool_entry {
+	struct igt_list_head link;
+	uint32_t handle;
+	int fence;
+	unsigned int generation;
+};
+
+struct intel_bb_pool {
+	struct igt_list_head link;
+	int fd;
+	struct igt_list_head classes[INTEL_BB_POOL_CLASSES];
+};
+
+static IGT_LIST_HEAD(intel_bb_pools);
+static pthread_mutex_t intel_bb_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int intel_bb_pool_generation;
+
+static int __intel_bb_pool_class(uint32_t size)
+{
+	int class = 0;
+
+	if (size > 1u << INTEL_BB_POOL_MIN_SHIFT)
+		class = 32 - __builtin_clz(size - 1) - INTEL_BB_POOL_MIN_SHIFT;
+
+	return class < INTEL_BB_POOL_CLASSES ? class : -1;
+}
+
+static struct intel_bb_pool *__intel_bb_pool_find(int fd)
+{
+	struct intel_bb_pool *pool;
+
+	igt_list_for_each_entry(pool, &intel_bb_pools, link)
+		if (pool->fd == fd)
+			return pool;
+
+	return NULL;
+}
+
+static bool __intel_bb_pool_enabled(int fd)
+{
+	bool enabled;
+
+	pthread_mutex_lock(&intel_bb_pool_lock);
+	enabled = __intel_bb_pool_find(fd);
+	pthread_mutex_unlock(&intel_bb_pool_lock);
+
+	return enabled;
+}
+
+static bool __intel_bb_pool_entry_busy(struct intel_bb_pool_entry *entry)
+{
+	if (entry->fence < 0)
+		return false;
+
+	/* Errors mean the fence is unusable, don't wait on it forever */
+	if (sync_fence_status(entry->fence) == 0)
+		return true;
+
+	close(entry->fence);
+	entry->fence = -1;
+
+	return false;
+}
+
+static void __intel_bb_pool_free(struct intel_bb_pool *pool, bool close_handles)
+{
+	struct intel_bb_pool_entry *entry, *tmp;
+
+	for (int i = 0; i < INTEL_BB_POOL_CLASSES; i++) {
+		igt_list_for_each_entry_safe(entry, tmp, &pool->classes[i], link) {
+			if (close_handles)
+				gem_close(pool->fd, entry->handle);
+			if (entry->fence >= 0)
+				close(entry->fence);
+			free(entry);
+		}
+	}
+
+	igt_list_del(&pool->link);
+	free(pool);
+}
+
+/**
+ * intel_bb_pool_enable:
+ * @fd: i915 drm fd
+ *
+ * Enables batch buffer pooling for intel_bbs created on @fd afterwards.
+ * Batches are then rounded up to a power of two size, and instead of being
+ * closed on intel_bb_reset() or intel_bb_destroy() they are kept for reuse
+ * once idle. Pooled batches keep GEM handles open on @fd, so
+ * intel_bb_pool_disable() must be called before closing it. Pools are
+ * dropped, without closing the handles, at each subtest exit.
+ *
+ * Only i915 batches are pooled, on xe this is a no-op.
+ */
+void intel_bb_pool_enable(int fd)
+{
+	struct intel_bb_pool *pool;
+
+	pthread_mutex_lock(&intel_bb_pool_lock);
+
+	if (!__intel_bb_pool_find(fd)) {
+		pool = calloc(1, sizeof(*pool));
+		igt_assert(pool);
+
+		pool->fd = fd;
+		for (int i = 0; i < INTEL_BB_POOL_CLASSES; i++)
+			IGT_INIT_LIST_HEAD(&pool->classes[i]);
+		igt_list_add(&pool->link, &intel_bb_pools);
+	}
+
+	pthread_mutex_unlock(&intel_bb_pool_lock);
+}
+
+/**
+ * intel_bb_pool_disable:
+ * @fd: i915 drm fd
+ *
+ * Closes all batches kept in the @fd pool and disables pooling. Batches
+ * still owned by intel_bbs are closed when those release them.
+ */
+void intel_bb_pool_disable(int fd)
+{
+	struct intel_bb_pool *pool;
+
+	pthread_mutex_lock(&intel_bb_pool_lock);
+
+	pool = __intel_bb_pool_find(fd);
+	if (pool)
+		__intel_bb_pool_free(pool, true);
+
+	pthread_mutex_unlock(&intel_bb_pool_lock);
+}
+
+/**
+ * intel_bb_pool_reinit:
+ *
+ * Forgets all batch buffer pools without touching their handles, the fds
+ * they belong to may already be closed. Batches still owned by intel_bbs
+ * are not returned to any pool afterwards.
+ */
+void intel_bb_pool_reinit(void)
+{
+	struct intel_bb_pool *pool, *tmp;
+
+	pthread_mutex_lock(&intel_bb_pool_lock);
+
+	igt_list_for_each_entry_safe(pool, tmp, &intel_bb_pools, link)
+		__intel_bb_pool_free(pool, false);
+	intel_bb_pool_generation++;
+
+	pthread_mutex_unlock(&intel_bb_pool_lock);
+}
+
+/*
+ * Returns an idle batch from the pool or creates a new one. Only intel_bbs
+ * created while pooling was enabled use the pool, their @size is rounded up
+ * to its size class, which ibb->batch was allocated with.
+ */
+static uint32_t __intel_bb_create_bo(struct intel_bb *ibb, uint32_t *size)
+{
+	struct intel_bb_pool_entry *entry = NULL;
+	struct intel_bb_pool *pool;
+	struct igt_list_head *list;
+	int class;
+
+	igt_assert(!ibb->pool_entry);
+
+	class = __intel_bb_pool_class(*size);
+	if (ibb->driver != INTEL_DRIVER_I915 || !ibb->pooled || class < 0)
+		return gem_create(ibb->fd, *size);
+
+	pthread_mutex_lock(&intel_bb_pool_lock);
+
+	pool = __intel_bb_pool_find(ibb->fd);
+	if (pool) {
+		list = &pool->classes[class];
+		if (!igt_list_empty(list)) {
+			entry = igt_list_first_entry(list, entry, link);
+			if (__intel_bb_pool_entry_busy(entry))
+				entry = NULL;
+			else
+				igt_list_del(&entry->link);
+		}
+	}
+
+	pthread_mutex_unlock(&intel_bb_pool_lock);
+
+	if (!pool)
+		return gem_create(ibb->fd, *size);
+
+	*size = 1u << (class + INTEL_BB_POOL_MIN_SHIFT);
+	if (!entry) {
+		entry = calloc(1, sizeof(*entry));
+		igt_assert(entry);
+
+		entry->handle = gem_create(ibb->fd, *size);
+		entry->fence = -1;
+	}
+	entry->generation = intel_bb_pool_generation;
+	ibb->pool_entry = entry;
+
+	return entry->handle;
+}
+
+/* Returns the batch to its pool, or closes it if it doesn't come from one */
+static void __intel_bb_release_bo(struct intel_bb *ibb)
+{
+	struct intel_bb_pool_entry *entry = ibb->pool_entry;
+	struct intel_bb_pool *pool;
+	int class;
+
+	if (!entry) {
+		gem_close(ibb->fd, ibb->handle);
+		return;
+	}
+
+	ibb->pool_entry = NULL;
+	class = __intel_bb_pool_class(ibb->size);
+
+	pthread_mutex_lock(&intel_bb_pool_lock);
+
+	pool = __intel_bb_pool_find(ibb->fd);
+	if (pool && entry->generation == intel_bb_pool_generation) {
+		/* ibb->fence covers the last execbuf of this batch, if any */
+		entry->fence = ibb->fence >= 0 ? dup(ibb->fence) : -1;
+		igt_list_add_tail(&entry->link, &pool->classes[class]);
+		entry = NULL;
+	}
+
+	pthread_mutex_unlock(&intel_bb_pool_lock);
+
+	if (entry) {
+		gem_close(ibb->fd, entry->handle);
+		free(entry);
+	}
+}
+
 /**
  * __intel_bb_create:
  * @fd: drm fd - i915 or xe
@@ -922,13 +1252,15 @@ __intel_bb_create(int fd, uint32_t ctx, uint32_t vm, const intel_ctx_cfg_t *cfg,
 	 */
 	if (ibb->driver == INTEL_DRIVER_I915) {
 		ibb->uses_full_ppgtt = gem_uses_full_ppgtt(fd);
+		ibb->safe_alignment = gem_detect_safe_alignment(fd);
 
 		if (!alignment)
-			alignment = gem_detect_safe_alignment(fd);
+			alignment = ibb->safe_alignment;
 
 		ibb->alignment = alignment;
 		ibb->gtt_size = gem_aperture_size(fd);
-		ibb->handle = gem_create(fd, size);
+		ibb->pooled = __intel_bb_pool_enabled(fd);
+		ibb->handle = __intel_bb_create_bo(ibb, &size);
 
 		if (!ibb->uses_full_ppgtt)
 			do_relocs = true;
@@ -1219,9 +1551,9 @@ static void __intel_bb_destroy_relocations(struct intel_bb *ibb)
 
 	/* Free relocations */
 	for (i = 0; i < ibb->num_objects; i++) {
-		free(from_user_pointer(ibb->objects[i]->relocs_ptr));
-		ibb->objects[i]->relocs_ptr = to_user_pointer(NULL);
-		ibb->objects[i]->relocation_count = 0;
+		free(from_user_pointer(ibb->objects[i].relocs_ptr));
+		ibb->objects[i].relocs_ptr = to_user_pointer(NULL);
+		ibb->objects[i].relocation_count = 0;
 	}
 
 	ibb->relocs = NULL;
@@ -1230,23 +1562,25 @@ static void __intel_bb_destroy_relocations(struct intel_bb *ibb)
 }
 
 static void __intel_bb_destroy_objects(struct intel_bb *ibb)
+{
+	/* Objects stay in the cache, just drop them from the next execbuf */
+	ibb->num_objects = 0;
+}
+
+static void __intel_bb_destroy_cache(struct intel_bb *ibb)
 {
 	free(ibb->objects);
 	ibb->objects = NULL;
 
-	tdestroy(ibb->current, free);
-	ibb->current = NULL;
+	free(ibb->object_index);
+	ibb->object_index = NULL;
+	ibb->object_index_mask = 0;
 
 	ibb->num_objects = 0;
+	ibb->num_cached = 0;
 	ibb->allocated_objects = 0;
 }
 
-static void __intel_bb_destroy_cache(struct intel_bb *ibb)
-{
-	tdestroy(ibb->root, free);
-	ibb->root = NULL;
-}
-
 static void __intel_bb_remove_intel_bufs(struct intel_bb *ibb)
 {
 	struct intel_buf *entry, *tmp;
@@ -1283,7 +1617,7 @@ void intel_bb_destroy(struct intel_bb *ibb)
 		intel_allocator_free(ibb->allocator_handle, ibb->handle);
 		intel_allocator_close(ibb->allocator_handle);
 	}
-	gem_close(ibb->fd, ibb->handle);
+	__intel_bb_release_bo(ibb);
 
 	if (ibb->fence >= 0)
 		close(ibb->fence);
@@ -1292,6 +1626,7 @@ void intel_bb_destroy(struct intel_bb *ibb)
 	if (ibb->vm_id && !ibb->ctx)
 		xe_vm_destroy(ibb->fd, ibb->vm_id);
 
+	intel_bb_recording_destroy(ibb->recording);
 	free(ibb->batch);
 	free(ibb->cfg);
 	free(ibb);
@@ -1304,7 +1639,7 @@ static struct drm_xe_vm_bind_op *xe_alloc_bind_ops(struct intel_bb *ibb,
 						   uint32_t op, uint32_t flags,
 						   uint32_t prefetch_region)
 {
-	struct drm_i915_gem_exec_object2 **objects = ibb->objects;
+	struct drm_i915_gem_exec_object2 *objects = ibb->objects;
 	struct drm_xe_vm_bind_op *bind_ops, *ops;
 	bool set_obj = (op & 0xffff) == DRM_XE_VM_BIND_OP_MAP;
 
@@ -1316,16 +1651,16 @@ static struct drm_xe_vm_bind_op *xe_alloc_bind_ops(struct intel_bb *ibb,
 		ops = &bind_ops[i];
 
 		if (set_obj)
-			ops->obj = objects[i]->handle;
+			ops->obj = objects[i].handle;
 
 		ops->op = op;
 		ops->flags = flags;
 		ops->obj_offset = 0;
-		ops->addr = objects[i]->offset;
-		ops->range = XE_OBJ_SIZE(objects[i]->rsvd1);
+		ops->addr = objects[i].offset;
+		ops->range = XE_OBJ_SIZE(objects[i].rsvd1);
 		ops->prefetch_mem_region_instance = prefetch_region;
 		if (set_obj)
-			ops->pat_index = XE_OBJ_PAT_IDX(objects[i]->rsvd1);
+			ops->pat_index = XE_OBJ_PAT_IDX(objects[i].rsvd1);
 
 		igt_debug("  [%d]: handle: %u, offset: %llx, size: %llx pat_index: %u\n",
 			  i, ops->obj, (long long)ops->addr, (long long)ops->range,
@@ -1391,20 +1726,21 @@ void intel_bb_reset(struct intel_bb *ibb, bool purge_objects_cache)
 	if (ibb->refcount > 1)
 		return;
 
+	igt_assert_f(!ibb->recording, "Cannot reset bb while recording!\n");
+
 	/*
 	 * To avoid relocation objects previously pinned to high virtual
 	 * addresses should keep 48bit flag. Ensure we won't clear it
 	 * in the reset path.
 	 */
 	for (i = 0; i < ibb->num_objects; i++)
-		ibb->objects[i]->flags &= EXEC_OBJECT_SUPPORTS_48B_ADDRESS;
+		ibb->objects[i].flags &= EXEC_OBJECT_SUPPORTS_48B_ADDRESS;
 
 	if (ibb->driver == INTEL_DRIVER_XE && ibb->xe_bound)
 		__unbind_xe_objects(ibb);
 
 	__intel_bb_destroy_relocations(ibb);
 	__intel_bb_destroy_objects(ibb);
-	__reallocate_objects(ibb);
 
 	if (purge_objects_cache) {
 		__intel_bb_remove_intel_bufs(ibb);
@@ -1415,15 +1751,15 @@ void intel_bb_reset(struct intel_bb *ibb, bool purge_objects_cache)
 	 * When we use allocators we're in no-reloc mode so we have to free
 	 * and reacquire offset (ibb->handle can change in multiprocess
 	 * environment). We also have to remove and add it again to
-	 * objects and cache tree.
+	 * the object cache.
 	 */
 	if (ibb->allocator_type != INTEL_ALLOCATOR_NONE && !purge_objects_cache)
 		intel_bb_remove_object(ibb, ibb->handle, ibb->batch_offset,
 				       ibb->size);
 
-	gem_close(ibb->fd, ibb->handle);
+	__intel_bb_release_bo(ibb);
 	if (ibb->driver == INTEL_DRIVER_I915)
-		ibb->handle = gem_create(ibb->fd, ibb->size);
+		ibb->handle = __intel_bb_create_bo(ibb, &ibb->size);
 	else
 		ibb->handle = xe_bo_create(ibb->fd, 0, ibb->size,
 					   vram_if_possible(ibb->fd, 0),
@@ -1488,9 +1824,9 @@ void intel_bb_print(struct intel_bb *ibb)
 	igt_info("gtt_size: %" PRIu64 ", supports 48bit: %d\n",
 		 ibb->gtt_size, ibb->supports_48b_address);
 	igt_info("ctx: %u\n", ibb->ctx);
-	igt_info("root: %p\n", ibb->root);
-	igt_info("objects: %p, num_objects: %u, allocated obj: %u\n",
-		 ibb->objects, ibb->num_objects, ibb->allocated_objects);
+	igt_info("objects: %p, num_objects: %u, cached obj: %u, allocated obj: %u\n",
+		 ibb->objects, ibb->num_objects, ibb->num_cached,
+		 ibb->allocated_objects);
 	igt_info("relocs: %p, num_relocs: %u, allocated_relocs: %u\n----\n",
 		 ibb->relocs, ibb->num_relocs, ibb->allocated_relocs);
 }
@@ -1560,120 +1896,194 @@ void intel_bb_set_dump_base64(struct intel_bb *ibb, bool dump)
 	ibb->dump_base64 = dump;
 }
 
-static int __compare_objects(const void *p1, const void *p2)
-{
-	const struct drm_i915_gem_exec_object2 *o1 = p1, *o2 = p2;
-
-	return (int) ((int64_t) o1->handle - (int64_t) o2->handle);
-}
-
 static struct drm_i915_gem_exec_object2 *
 __add_to_cache(struct intel_bb *ibb, uint32_t handle)
 {
-	struct drm_i915_gem_exec_object2 **found, *object;
+	struct drm_i915_gem_exec_object2 *object;
+	uint32_t *slot;
 
-	object = malloc(sizeof(*object));
-	igt_assert(object);
+	if (ibb->object_index) {
+		slot = __object_index_slot(ibb, handle);
+		if (*slot)
+			return &ibb->objects[*slot - 1];
+	}
 
-	object->handle = handle;
-	object->alignment = 0;
-	found = tsearch((void *) object, &ibb->root, __compare_objects);
+	/* Growing may rebuild the index, so look the slot up afterwards */
+	__reallocate_objects(ibb);
+	slot = __object_index_slot(ibb, handle);
 
-	if (*found == object) {
-		memset(object, 0, sizeof(*object));
-		object->handle = handle;
-		object->offset = INTEL_BUF_INVALID_ADDRESS;
-	} else {
-		free(object);
-		object = *found;
-	}
+	object = &ibb->objects[ibb->num_cached];
+	memset(object, 0, sizeof(*object));
+	object->handle = handle;
+	object->offset = INTEL_BUF_INVALID_ADDRESS;
+	*slot = ++ibb->num_cached;
 
 	return object;
 }
 
 static bool __remove_from_cache(struct intel_bb *ibb, uint32_t handle)
 {
-	struct drm_i915_gem_exec_object2 **found, *object;
+	uint32_t *slot, i, last;
 
-	object = intel_bb_find_object(ibb, handle);
-	if (!object) {
+	slot = ibb->object_index ? __object_index_slot(ibb, handle) : NULL;
+	if (!slot || !*slot) {
 		igt_warn("Object: handle: %u not found\n", handle);
 		return false;
 	}
 
-	found = tdelete((void *) object, &ibb->root, __compare_objects);
-	if (!found)
-		return false;
+	i = *slot - 1;
+	igt_assert(i >= ibb->num_objects);
+	__object_index_remove(ibb, slot);
 
-	free(object);
+	/* Fill the hole with the last cached object */
+	last = --ibb->num_cached;
+	if (i != last) {
+		ibb->objects[i] = ibb->objects[last];
+		*__object_index_slot(ibb, ibb->objects[i].handle) = i + 1;
+	}
 
 	return true;
 }
 
-static int __compare_handles(const void *p1, const void *p2)
-{
-	return (int) (*(int32_t *) p1 - *(int32_t *) p2);
-}
-
-static void __add_to_objects(struct intel_bb *ibb,
-			     struct drm_i915_gem_exec_object2 *object)
+/*
+ * __add_to_objects:
+ * @ibb: pointer to intel_bb
+ * @object: cached object
+ *
+ * Adds @object to the current execbuf by moving it to the end of the
+ * execbuf prefix of the cache. Returns the new location of @object.
+ */
+static struct drm_i915_gem_exec_object2 *
+__add_to_objects(struct intel_bb *ibb,
+		 struct drm_i915_gem_exec_object2 *object)
 {
-	uint32_t **found, *handle;
+	uint32_t i = object - ibb->objects;
 
-	handle = malloc(sizeof(*handle));
-	igt_assert(handle);
+	if (i < ibb->num_objects)
+		return object;
 
-	*handle = object->handle;
-	found = tsearch((void *) handle, &ibb->current, __compare_handles);
+	__swap_objects(ibb, i, ibb->num_objects);
 
-	if (*found == handle) {
-		__reallocate_objects(ibb);
-		igt_assert(ibb->num_objects < ibb->allocated_objects);
-		ibb->objects[ibb->num_objects++] = object;
-	} else {
-		free(handle);
-	}
+	return &ibb->objects[ibb->num_objects++];
 }
 
 static void __remove_from_objects(struct intel_bb *ibb,
 				  struct drm_i915_gem_exec_object2 *object)
 {
-	uint32_t i, **handle, *to_free;
-	bool found = false;
-
-	for (i = 0; i < ibb->num_objects; i++) {
-		if (ibb->objects[i] == object) {
-			found = true;
-			break;
-		}
-	}
+	uint32_t i = object - ibb->objects;
 
 	/*
 	 * When we reset bb (without purging) we have:
 	 * 1. cache which contains all cached objects
-	 * 2. objects array which contains only bb object (cleared in reset
+	 * 2. objects prefix which contains only bb object (cleared in reset
 	 *    path with bb object added at the end)
-	 * So !found is normal situation and no warning is added here.
+	 * So object outside the prefix is normal situation and no warning
+	 * is added here.
 	 */
-	if (!found)
+	if (i >= ibb->num_objects)
 		return;
 
-	ibb->num_objects--;
-	if (i < ibb->num_objects)
-		memmove(&ibb->objects[i], &ibb->objects[i + 1],
-			sizeof(object) * (ibb->num_objects - i));
-
-	handle = tfind((void *) &object->handle,
-		       &ibb->current, __compare_handles);
-	if (!handle) {
-		igt_warn("Object %u doesn't exist in the tree, can't remove",
-			 object->handle);
-		return;
+	__swap_objects(ibb, i, --ibb->num_objects);
+}
+
+/*
+ * Batch recording
+ *
+ * While recording, objects added to the intel_bb and relocations emitted
+ * into the batch are logged. intel_bb_record_end() then captures the batch
+ * contents, so intel_bb_replay() only has to copy them back and patch the
+ * addresses, which may differ in the replaying intel_bb.
+ */
+#define RECORD_BATCH (~0u)
+#define RECORD_OBJECT_FLAGS (EXEC_OBJECT_WRITE | EXEC_OBJECT_NEEDS_FENCE | \
+			     EXEC_OBJECT_CAPTURE | EXEC_OBJECT_ASYNC)
+
+struct intel_bb_record_object {
+	uint32_t handle;
+	uint8_t pat_index;
+	uint64_t size;
+	uint64_t alignment;
+	uint64_t flags;
+
+	/* Set when added as an intel_buf, to keep it tracked on replay */
+	struct intel_buf *buf;
+};
+
+struct intel_bb_record_reloc {
+	/* Handle while recording, then index into objects or RECORD_BATCH */
+	uint32_t object;
+	uint32_t offset;
+	uint32_t read_domains;
+	uint32_t write_domain;
+	uint64_t delta;
+};
+
+struct intel_bb_recording {
+	uint32_t *batch;
+	uint32_t batch_len;	/* the rest of the batch is zero */
+	uint32_t end_offset;
+
+	struct intel_bb_record_object *objects;
+	uint32_t num_objects;
+	uint32_t allocated_objects;
+
+	struct intel_bb_record_reloc *relocs;
+	uint32_t num_relocs;
+	uint32_t allocated_relocs;
+};
+
+static struct intel_bb_record_object *
+__record_object(struct intel_bb_recording *rec, uint32_t handle,
+		uint64_t size, uint64_t alignment, uint8_t pat_index,
+		bool write)
+{
+	struct intel_bb_record_object *object;
+
+	if (rec->num_objects == rec->allocated_objects) {
+		rec->allocated_objects = max_t(uint32_t, 16,
+					       2 * rec->allocated_objects);
+		rec->objects = realloc(rec->objects, rec->allocated_objects *
+				       sizeof(*rec->objects));
+		igt_assert(rec->objects);
 	}
 
-	to_free = *handle;
-	tdelete((void *) &object->handle, &ibb->current, __compare_handles);
-	free(to_free);
+	object = &rec->objects[rec->num_objects++];
+	memset(object, 0, sizeof(*object));
+	object->handle = handle;
+	object->size = size;
+	object->alignment = alignment;
+	object->pat_index = pat_index;
+	object->flags = write ? EXEC_OBJECT_WRITE : 0;
+
+	return object;
+}
+
+static void __record_reloc(struct intel_bb *ibb, uint32_t to_handle,
+			   uint32_t handle, uint32_t read_domains,
+			   uint32_t write_domain, uint64_t delta,
+			   uint64_t offset)
+{
+	struct intel_bb_recording *rec = ibb->recording;
+	struct intel_bb_record_reloc *reloc;
+
+	igt_assert_f(to_handle == ibb->handle,
+		     "Only relocations in the batch can be recorded\n");
+	igt_assert(ALIGN(offset, 4) == offset);
+
+	if (rec->num_relocs == rec->allocated_relocs) {
+		rec->allocated_relocs = max_t(uint32_t, 16,
+					      2 * rec->allocated_relocs);
+		rec->relocs = realloc(rec->relocs, rec->allocated_relocs *
+				      sizeof(*rec->relocs));
+		igt_assert(rec->relocs);
+	}
+
+	reloc = &rec->relocs[rec->num_relocs++];
+	reloc->object = handle;
+	reloc->offset = offset;
+	reloc->read_domains = read_domains;
+	reloc->write_domain = write_domain;
+	reloc->delta = delta;
 }
 
 /**
@@ -1700,13 +2110,17 @@ __intel_bb_add_object(struct intel_bb *ibb, uint32_t handle, uint64_t size,
 		   || ALIGN(offset, alignment) == offset);
 	igt_assert(is_power_of_two(alignment));
 
+	if (ibb->recording)
+		__record_object(ibb->recording, handle, size, alignment,
+				pat_index, write);
+
 	if (ibb->driver == INTEL_DRIVER_I915)
-		alignment = max_t(uint64_t, alignment, gem_detect_safe_alignment(ibb->fd));
+		alignment = max_t(uint64_t, alignment, ibb->safe_alignment);
 	else
 		alignment = max_t(uint64_t, ibb->alignment, alignment);
 
 	object = __add_to_cache(ibb, handle);
-	__add_to_objects(ibb, object);
+	object = __add_to_objects(ibb, object);
 
 	/*
 	 * If object->offset == INVALID_ADDRESS we added freshly object to the
@@ -1860,6 +2274,9 @@ __intel_bb_add_intel_buf(struct intel_bb *ibb, struct intel_buf *buf,
 	igt_assert(obj);
 	buf->addr.offset = obj->offset;
 
+	if (ibb->recording)
+		ibb->recording->objects[ibb->recording->num_objects - 1].buf = buf;
+
 	if (igt_list_empty(&buf->link)) {
 		igt_list_add_tail(&buf->link, &ibb->intel_bufs);
 		buf->ibb = ibb;
@@ -1920,32 +2337,33 @@ void intel_bb_print_intel_bufs(struct intel_bb *ibb)
 struct drm_i915_gem_exec_object2 *
 intel_bb_find_object(struct intel_bb *ibb, uint32_t handle)
 {
-	struct drm_i915_gem_exec_object2 object = { .handle = handle };
-	struct drm_i915_gem_exec_object2 **found;
+	uint32_t *slot;
+
+	if (!ibb->object_index)
+		return NULL;
 
-	found = tfind((void *) &object, &ibb->root, __compare_objects);
-	if (!found)
+	slot = __object_index_slot(ibb, handle);
+	if (!*slot)
 		return NULL;
 
-	return *found;
+	return &ibb->objects[*slot - 1];
 }
 
 bool
 intel_bb_object_set_flag(struct intel_bb *ibb, uint32_t handle, uint64_t flag)
 {
-	struct drm_i915_gem_exec_object2 object = { .handle = handle };
-	struct drm_i915_gem_exec_object2 **found;
+	struct drm_i915_gem_exec_object2 *object;
 
-	igt_assert_f(ibb->root, "Trying to search in null tree\n");
+	igt_assert_f(ibb->num_cached, "Trying to search in empty cache\n");
 
-	found = tfind((void *) &object, &ibb->root, __compare_objects);
-	if (!found) {
+	object = intel_bb_find_object(ibb, handle);
+	if (!object) {
 		igt_warn("Trying to set fence on not found handle: %u\n",
 			 handle);
 		return false;
 	}
 
-	(*found)->flags |= flag;
+	object->flags |= flag;
 
 	return true;
 }
@@ -1953,17 +2371,16 @@ intel_bb_object_set_flag(struct intel_bb *ibb, uint32_t handle, uint64_t flag)
 bool
 intel_bb_object_clear_flag(struct intel_bb *ibb, uint32_t handle, uint64_t flag)
 {
-	struct drm_i915_gem_exec_object2 object = { .handle = handle };
-	struct drm_i915_gem_exec_object2 **found;
+	struct drm_i915_gem_exec_object2 *object;
 
-	found = tfind((void *) &object, &ibb->root, __compare_objects);
-	if (!found) {
+	object = intel_bb_find_object(ibb, handle);
+	if (!object) {
 		igt_warn("Trying to set fence on not found handle: %u\n",
 			 handle);
 		return false;
 	}
 
-	(*found)->flags &= ~flag;
+	object->flags &= ~flag;
 
 	return true;
 }
@@ -1998,6 +2415,10 @@ static uint64_t intel_bb_add_reloc(struct intel_bb *ibb,
 	object = intel_bb_find_object(ibb, handle);
 	igt_assert(object);
 
+	if (ibb->recording)
+		__record_reloc(ibb, to_handle, handle, read_domains,
+			       write_domain, delta, offset);
+
 	/* In no-reloc mode we just return the previously assigned address */
 	if (!ibb->enforce_relocs)
 		goto out;
@@ -2187,6 +2608,200 @@ uint64_t intel_bb_offset_reloc_to_object(struct intel_bb *ibb,
 				  delta, offset, presumed_offset);
 }
 
+/**
+ * intel_bb_record_begin:
+ * @ibb: pointer to intel_bb
+ *
+ * Starts recording the commands emitted into @ibb together with the objects
+ * and relocations they use, to be replayed later with intel_bb_replay().
+ * Recording has to start on an empty batch, i.e. a freshly created or reset
+ * one, and only relocations in the batch itself can be recorded.
+ */
+void intel_bb_record_begin(struct intel_bb *ibb)
+{
+	igt_assert(ibb);
+	igt_assert_f(!ibb->recording, "bb is already recording!\n");
+	igt_assert_f(intel_bb_offset(ibb) == 0 && ibb->num_objects == 1,
+		     "Recording has to start on an empty bb!\n");
+
+	ibb->recording = calloc(1, sizeof(*ibb->recording));
+	igt_assert(ibb->recording);
+}
+
+static int __record_object_cmp(const void *a, const void *b)
+{
+	const struct intel_bb_record_object *oa = a, *ob = b;
+
+	return oa->handle < ob->handle ? -1 : oa->handle > ob->handle;
+}
+
+/**
+ * intel_bb_record_end:
+ * @ibb: pointer to intel_bb
+ *
+ * Stops recording and captures the batch contents. @ibb itself is left
+ * untouched, so it can be executed as usual.
+ *
+ * The recording references objects by handle and intel_bufs by pointer,
+ * they have to outlive it.
+ *
+ * Returns: the recording, to be freed with intel_bb_recording_destroy().
+ */
+struct intel_bb_recording *intel_bb_record_end(struct intel_bb *ibb)
+{
+	struct intel_bb_recording *rec;
+	struct intel_bb_record_object *object, key = {};
+	struct drm_i915_gem_exec_object2 *exec_object;
+	uint32_t i, n, len;
+
+	igt_assert(ibb);
+	igt_assert_f(ibb->recording, "bb is not recording!\n");
+	rec = ibb->recording;
+	ibb->recording = NULL;
+
+	/* Merge repeated adds, the batch itself is replaced on replay */
+	qsort(rec->objects, rec->num_objects, sizeof(*rec->objects),
+	      __record_object_cmp);
+	for (i = n = 0; i < rec->num_objects; i++) {
+		object = &rec->objects[i];
+		if (object->handle == ibb->handle)
+			continue;
+
+		if (n && rec->objects[n - 1].handle == object->handle) {
+			rec->objects[n - 1].alignment =
+				max_t(uint64_t, rec->objects[n - 1].alignment,
+				      object->alignment);
+			rec->objects[n - 1].flags |= object->flags;
+			if (object->buf)
+				rec->objects[n - 1].buf = object->buf;
+			continue;
+		}
+
+		rec->objects[n++] = *object;
+	}
+	rec->num_objects = n;
+
+	/* Pick up flags set directly, e.g. by intel_bb_emit_reloc_fenced() */
+	for (i = 0; i < rec->num_objects; i++) {
+		exec_object = intel_bb_find_object(ibb, rec->objects[i].handle);
+		if (exec_object)
+			rec->objects[i].flags |= exec_object->flags &
+						 RECORD_OBJECT_FLAGS;
+	}
+
+	for (i = 0; i < rec->num_relocs; i++) {
+		if (rec->relocs[i].object == ibb->handle) {
+			rec->relocs[i].object = RECORD_BATCH;
+			continue;
+		}
+
+		key.handle = rec->relocs[i].object;
+		object = bsearch(&key, rec->objects, rec->num_objects,
+				 sizeof(*rec->objects), __record_object_cmp);
+		igt_assert(object);
+		rec->relocs[i].object = object - rec->objects;
+	}
+
+	/* State may be placed past the end offset, keep up to the last dword */
+	for (len = ibb->size; len && !ibb->batch[len / 4 - 1]; len -= 4)
+		;
+
+	rec->batch = malloc(len);
+	igt_assert(!len || rec->batch);
+	memcpy(rec->batch, ibb->batch, len);
+	rec->batch_len = len;
+	rec->end_offset = intel_bb_offset(ibb);
+
+	return rec;
+}
+
+/**
+ * intel_bb_replay:
+ * @ibb: pointer to intel_bb
+ * @rec: recording from intel_bb_record_end()
+ *
+ * Replays @rec into the empty (freshly created or reset) @ibb: adds the
+ * recorded objects, copies the recorded commands and patches the addresses
+ * of the objects in @ibb, emitting relocations if @ibb uses them. The
+ * batch pointer is left where the recording ended, so more commands can be
+ * emitted before executing @ibb.
+ *
+ * @ibb can be any intel_bb on the same fd and gen as the recorded one.
+ */
+void intel_bb_replay(struct intel_bb *ibb,
+		     const struct intel_bb_recording *rec)
+{
+	const struct intel_bb_record_object *object;
+	const struct intel_bb_record_reloc *reloc;
+	struct drm_i915_gem_exec_object2 *exec_object;
+	uint64_t address, offset;
+	uint32_t handle, i;
+	bool write;
+
+	igt_assert(ibb && rec);
+	igt_assert_f(intel_bb_offset(ibb) == 0,
+		     "Replay has to start on an empty bb!\n");
+	igt_assert(rec->batch_len <= ibb->size && rec->end_offset <= ibb->size);
+
+	for (i = 0; i < rec->num_objects; i++) {
+		object = &rec->objects[i];
+		write = object->flags & EXEC_OBJECT_WRITE;
+
+		/* intel_bufs can only be tracked by a single bb */
+		if (object->buf && (!object->buf->ibb || object->buf->ibb == ibb)) {
+			exec_object = __intel_bb_add_intel_buf(ibb, object->buf,
+							       object->alignment,
+							       write);
+		} else {
+			offset = intel_bb_get_object_offset(ibb, object->handle);
+			exec_object = __intel_bb_add_object(ibb, object->handle,
+							    object->size, offset,
+							    object->alignment,
+							    object->pat_index,
+							    write);
+		}
+		exec_object->flags |= object->flags;
+	}
+
+	memcpy(ibb->batch, rec->batch, rec->batch_len);
+
+	for (i = 0; i < rec->num_relocs; i++) {
+		reloc = &rec->relocs[i];
+		handle = reloc->object == RECORD_BATCH ?
+			 ibb->handle : rec->objects[reloc->object].handle;
+
+		address = intel_bb_add_reloc(ibb, ibb->handle, handle,
+					     reloc->read_domains,
+					     reloc->write_domain,
+					     reloc->delta, reloc->offset, -1);
+		address += reloc->delta;
+
+		/* Same as the kernel, relocations are qwords from gen8 */
+		ibb->batch[reloc->offset / 4] = address;
+		if (ibb->gen >= 8)
+			ibb->batch[reloc->offset / 4 + 1] = address >> 32;
+	}
+
+	intel_bb_ptr_set(ibb, rec->end_offset);
+}
+
+/**
+ * intel_bb_recording_destroy:
+ * @rec: recording from intel_bb_record_end()
+ *
+ * Frees @rec.
+ */
+void intel_bb_recording_destroy(struct intel_bb_recording *rec)
+{
+	if (!rec)
+		return;
+
+	free(rec->batch);
+	free(rec->objects);
+	free(rec->relocs);
+	free(rec);
+}
+
 /*
  * @intel_bb_set_pxp:
  * @ibb: pointer to intel_bb
@@ -2280,64 +2895,50 @@ static void intel_bb_dump_base64(struct intel_bb *ibb, int linelen)
 	free(str);
 }
 
-static void print_node(const void *node, VISIT which, int depth)
+static void print_objects(struct intel_bb *ibb)
 {
-	const struct drm_i915_gem_exec_object2 *object =
-		*(const struct drm_i915_gem_exec_object2 **) node;
-	(void) depth;
-
-	switch (which) {
-	case preorder:
-	case endorder:
-		break;
+	uint32_t i;
 
-	case postorder:
-	case leaf:
-		igt_info("\t handle: %u, offset: 0x%" PRIx64 "\n",
-			 object->handle, (uint64_t) object->offset);
-		break;
-	}
+	for (i = 0; i < ibb->num_cached; i++)
+		igt_info("\t handle: %u, offset: 0x%" PRIx64 "%s\n",
+			 ibb->objects[i].handle,
+			 (uint64_t) ibb->objects[i].offset,
+			 i < ibb->num_objects ? "" : " (cached)");
 }
 
 void intel_bb_dump_cache(struct intel_bb *ibb)
 {
 	igt_info("[pid: %ld] dump cache\n", (long) getpid());
-	twalk(ibb->root, print_node);
+	print_objects(ibb);
 }
 
-static struct drm_i915_gem_exec_object2 *
-create_objects_array(struct intel_bb *ibb)
+/*
+ * The object cache is passed to the kernel as is, so offsets of objects in
+ * the execbuf are converted to canonical form around the ioctl.
+ */
+static void canonicalize_offsets(struct intel_bb *ibb)
 {
-	struct drm_i915_gem_exec_object2 *objects;
 	uint32_t i;
 
-	objects = malloc(sizeof(*objects) * ibb->num_objects);
-	igt_assert(objects);
+	for (i = 0; i < ibb->num_objects; i++)
+		ibb->objects[i].offset = CANONICAL(ibb->objects[i].offset);
+}
 
-	for (i = 0; i < ibb->num_objects; i++) {
-		objects[i] = *(ibb->objects[i]);
-		objects[i].offset = CANONICAL(objects[i].offset);
-	}
+static void decanonicalize_offsets(struct intel_bb *ibb)
+{
+	uint32_t i;
 
-	return objects;
+	for (i = 0; i < ibb->num_objects; i++)
+		ibb->objects[i].offset = DECANONICAL(ibb->objects[i].offset);
 }
 
-static void update_offsets(struct intel_bb *ibb,
-			   struct drm_i915_gem_exec_object2 *objects)
+static void update_offsets(struct intel_bb *ibb)
 {
 	struct drm_i915_gem_exec_object2 *object;
 	struct intel_buf *entry;
-	uint32_t i;
-
-	for (i = 0; i < ibb->num_objects; i++) {
-		object = intel_bb_find_object(ibb, objects[i].handle);
-		igt_assert(object);
-
-		object->offset = DECANONICAL(objects[i].offset);
 
-		if (i == 0)
-			ibb->batch_offset = object->offset;
-	}
+	decanonicalize_offsets(ibb);
+	ibb->batch_offset = ibb->objects[0].offset;
 
 	igt_list_for_each_entry(entry, &ibb->intel_bufs, link) {
 		object = intel_bb_find_object(ibb, entry->handle);
@@ -2451,26 +3052,25 @@ __xe_bb_exec(struct intel_bb *ibb, uint64_t flags, bool sync)
  *
  * Returns: 0 on success, otherwise errno.
  *
- * Note: In this step execobj for bb is allocated and inserted to the objects
- * array.
+ * Note: The object cache is used as the execbuf object array, with the bb
+ * object first.
 */
 int __intel_bb_exec(struct intel_bb *ibb, uint32_t end_offset,
 			   uint64_t flags, bool sync)
 {
 	struct drm_i915_gem_execbuffer2 execbuf;
-	struct drm_i915_gem_exec_object2 *objects;
 	int ret, fence, new_fence;
 
-	ibb->objects[0]->relocs_ptr = to_user_pointer(ibb->relocs);
-	ibb->objects[0]->relocation_count = ibb->num_relocs;
-	ibb->objects[0]->handle = ibb->handle;
-	ibb->objects[0]->offset = ibb->batch_offset;
+	igt_assert(ibb->num_objects && ibb->objects[0].handle == ibb->handle);
+	ibb->objects[0].relocs_ptr = to_user_pointer(ibb->relocs);
+	ibb->objects[0].relocation_count = ibb->num_relocs;
+	ibb->objects[0].offset = ibb->batch_offset;
 
 	gem_write(ibb->fd, ibb->handle, 0, ibb->batch, ibb->size);
 
 	memset(&execbuf, 0, sizeof(execbuf));
-	objects = create_objects_array(ibb);
-	execbuf.buffers_ptr = to_user_pointer(objects);
+	canonicalize_offsets(ibb);
+	execbuf.buffers_ptr = to_user_pointer(ibb->objects);
 	execbuf.buffer_count = ibb->num_objects;
 	execbuf.batch_len = end_offset;
 	execbuf.rsvd1 = ibb->ctx;
@@ -2488,12 +3088,12 @@ int __intel_bb_exec(struct intel_bb *ibb, uint32_t end_offset,
 	ret = __gem_execbuf_wr(ibb->fd, &execbuf);
 	if (ret) {
 		intel_bb_dump_execbuf(ibb, &execbuf);
-		free(objects);
+		decanonicalize_offsets(ibb);
 		return ret;
 	}
 
 	/* Update addresses in the cache */
-	update_offsets(ibb, objects);
+	update_offsets(ibb);
 
 	/* Save/merge fences */
 	fence = execbuf.rsvd2 >> 32;
@@ -2512,14 +3112,12 @@ int __intel_bb_exec(struct intel_bb *ibb, uint32_t end_offset,
 
 	if (ibb->debug) {
 		intel_bb_dump_execbuf(ibb, &execbuf);
-		if (intel_bb_debug_tree) {
-			igt_info("\nTree:\n");
-			twalk(ibb->root, print_node);
+		if (intel_bb_debug_cache) {
+			igt_info("\nCache:\n");
+			print_objects(ibb);
 		}
 	}
 
-	free(objects);
-
 	return 0;
 }
 
@@ -2556,16 +3154,15 @@ void intel_bb_exec(struct intel_bb *ibb, uint32_t end_offset,
  */
 uint64_t intel_bb_get_object_offset(struct intel_bb *ibb, uint32_t handle)
 {
-	struct drm_i915_gem_exec_object2 object = { .handle = handle };
-	struct drm_i915_gem_exec_object2 **found;
+	struct drm_i915_gem_exec_object2 *object;
 
 	igt_assert(ibb);
 
-	found = tfind((void *)&object, &ibb->root, __compare_objects);
-	if (!found)
+	object = intel_bb_find_object(ibb, handle);
+	if (!object)
 		return INTEL_BUF_INVALID_ADDRESS;
 
-	return (*found)->offset;
+	return object->offset;
 }
 
 /*
@@ -259,6 +259,7 @@ struct intel_bb {
 	uint32_t *batch;
 	uint32_t *ptr;
 	uint64_t alignment;
+	uint64_t safe_alignment; /* i915 only, queried once */
 	int fence;
 
 	uint64_t gtt_size;
@@ -278,16 +279,20 @@ struct intel_bb {
 	/* Context configuration */
 	intel_ctx_cfg_t *cfg;
 
-	/* Cache */
-	void *root;
-
-	/* Current objects for execbuf */
-	void *current;
-
-	/* Objects for current execbuf */
-	struct drm_i915_gem_exec_object2 **objects;
+	/*
+	 * Object cache, passed directly as the execbuf object array. The
+	 * first num_objects entries are the objects for the current execbuf,
+	 * the remaining ones up to num_cached are only cached. Pointers into
+	 * the array are invalidated by adding or removing objects.
+	 */
+	struct drm_i915_gem_exec_object2 *objects;
 	uint32_t num_objects;
+	uint32_t num_cached;
 	uint32_t allocated_objects;
+
+	/* Open addressing handle -> (objects index + 1) lookup table */
+	uint32_t *object_index;
+	uint32_t object_index_mask;
 	uint64_t batch_offset;
 
 	struct drm_i915_gem_relocation_entry *relocs;
@@ -297,6 +302,15 @@ struct intel_bb {
 	/* Tracked intel_bufs */
 	struct igt_list_head intel_bufs;
 
+	/* Whether pooling was enabled for the fd when the bb was created */
+	bool pooled;
+
+	/* Pool entry of the batch, NULL if it is not pooled */
+	struct intel_bb_pool_entry *pool_entry;
+
+	/* Recording in progress, see intel_bb_record_begin() */
+	struct intel_bb_recording *recording;
+
 	/*
 	 * BO recreate in reset path only when refcount == 0
 	 * Currently we don't need to use atomics because intel_bb
@@ -329,6 +343,10 @@ void intel_bb_destroy(struct intel_bb *ibb);
 void intel_bb_reinit_allocator(void);
 void intel_bb_track(bool do_tracking);
 
+void intel_bb_pool_enable(int fd);
+void intel_bb_pool_disable(int fd);
+void intel_bb_pool_reinit(void);
+
 static inline void intel_bb_ref(struct intel_bb *ibb)
 {
 	ibb->refcount++;
@@ -474,6 +492,14 @@ uint64_t intel_bb_offset_reloc_to_object(struct intel_bb *ibb,
 					 uint32_t offset,
 					 uint64_t presumed_offset);
 
+struct intel_bb_recording;
+
+void intel_bb_record_begin(struct intel_bb *ibb);
+struct intel_bb_recording *intel_bb_record_end(struct intel_bb *ibb);
+void intel_bb_replay(struct intel_bb *ibb,
+		     const struct intel_bb_recording *rec);
+void intel_bb_recording_destroy(struct intel_bb_recording *rec);
+
 int __intel_bb_exec(struct intel_bb *ibb, uint32_t end_offset,
 			uint64_t flags, bool sync);
 
@@ -0,0 +1,185 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <i915_drm.h>
+
+#include "igt_core.h"
+#include "i915/perf.h"
+
+#define N_RECORDS 64
+#define REPORT_SIZE 256
+
+struct record {
+	struct drm_i915_perf_record_header header;
+	uint8_t report[REPORT_SIZE];
+};
+
+static struct record records[N_RECORDS];
+
+static void fill_records(unsigned int seed)
+{
+	srand(seed);
+
+	for (int r = 0; r < N_RECORDS; r++) {
+		records[r].header.type = DRM_I915_PERF_RECORD_SAMPLE;
+		records[r].header.size = sizeof(records[r]);
+
+		/* Keep some records equal to their predecessor so that zero
+		 * deltas as well as wrapped counters are covered.
+		 */
+		if (r && rand() % 8 == 0) {
+			memcpy(records[r].report, records[r - 1].report,
+			       REPORT_SIZE);
+			continue;
+		}
+
+		for (int i = 0; i < REPORT_SIZE; i++)
+			records[r].report[i] = rand();
+	}
+}
+
+static void check_format(int format, int shift)
+{
+	const struct drm_i915_perf_record_header *ptrs[N_RECORDS];
+	struct intel_perf_accumulator batch[N_RECORDS - 1];
+	struct intel_perf_metric_set metric_set = {
+		.perf_oa_format = format,
+	};
+	struct intel_perf perf = {
+		.devinfo.oa_timestamp_shift = shift,
+	};
+
+	for (int seed = 0; seed < 16; seed++) {
+		fill_records(seed);
+
+		for (int r = 0; r < N_RECORDS; r++)
+			ptrs[r] = &records[r].header;
+
+		memset(batch, 0xff, sizeof(batch));
+		intel_perf_accumulate_report_batch(batch, &perf, &metric_set,
+						   ptrs, N_RECORDS);
+
+		for (int r = 0; r < N_RECORDS - 1; r++) {
+			struct intel_perf_accumulator acc;
+
+			intel_perf_accumulate_reports(&acc, &perf, &metric_set,
+						      ptrs[r], ptrs[r + 1]);
+
+			for (int i = 0; i < INTEL_PERF_MAX_RAW_OA_COUNTERS; i++)
+				igt_assert_eq_u64(batch[r].deltas[i],
+						  acc.deltas[i]);
+		}
+	}
+}
+
+static void check_read_batch(uint32_t devid)
+{
+	/* One slice, 8 subslices of 8 EUs each. */
+	struct {
+		struct drm_i915_query_topology_info info;
+		uint8_t data[1 + 8 + 8];
+	} topology = {
+		.info = {
+			.max_slices = 1,
+			.max_subslices = 8,
+			.max_eus_per_subslice = 8,
+			.subslice_offset = 1,
+			.subslice_stride = 1,
+			.eu_offset = 2,
+			.eu_stride = 1,
+		},
+	};
+	const struct drm_i915_perf_record_header *ptrs[N_RECORDS];
+	struct intel_perf_accumulator batch[N_RECORDS - 1];
+	struct intel_perf_metric_set *metric_set;
+	struct intel_perf *perf;
+
+	memset(topology.data, 0xff, sizeof(topology.data));
+	topology.data[0] = 1;
+
+	perf = intel_perf_for_devinfo(devid, 0, 12000000, 300, 1200,
+				      &topology.info);
+	igt_assert(perf);
+
+	fill_records(devid);
+	for (int r = 0; r < N_RECORDS; r++)
+		ptrs[r] = &records[r].header;
+
+	igt_list_for_each_entry(metric_set, &perf->metric_sets, link) {
+		intel_perf_accumulate_report_batch(batch, perf, metric_set,
+						   ptrs, N_RECORDS);
+
+		for (int c = 0; c < metric_set->n_counters; c++) {
+			struct intel_perf_logical_counter *counter =
+				&metric_set->counters[c];
+			uint64_t values_uint64[N_RECORDS - 1];
+			double values_float[N_RECORDS - 1];
+
+			switch (counter->storage) {
+			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_UINT64:
+			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_UINT32:
+			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_BOOL32:
+				intel_perf_read_counter_batch_uint64(perf, counter,
+								     batch, N_RECORDS - 1,
+								     values_uint64);
+				for (int r = 0; r < N_RECORDS - 1; r++)
+					igt_assert_eq_u64(values_uint64[r],
+							  counter->read_uint64(perf, metric_set,
+									       batch[r].deltas));
+				break;
+			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_DOUBLE:
+			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_FLOAT:
+				intel_perf_read_counter_batch_float(perf, counter,
+								    batch, N_RECORDS - 1,
+								    values_float);
+				for (int r = 0; r < N_RECORDS - 1; r++) {
+					double value = counter->read_float(perf, metric_set,
+									   batch[r].deltas);
+
+					igt_assert(!memcmp(&values_float[r], &value,
+							   sizeof(value)));
+				}
+				break;
+			}
+		}
+	}
+
+	intel_perf_free(perf);
+}
+
+igt_main
+{
+	static const struct {
+		const char *name;
+		int format;
+	} formats[] = {
+		{ "a24u40-a14u32-b8-c8", I915_OA_FORMAT_A24u40_A14u32_B8_C8 },
+		{ "a32u40-a4u32-b8-c8", I915_OA_FORMAT_A32u40_A4u32_B8_C8 },
+		{ "oar-a32u40-a4u32-b8-c8", I915_OAR_FORMAT_A32u40_A4u32_B8_C8 },
+		{ "a45-b8-c8", I915_OA_FORMAT_A45_B8_C8 },
+		{ "oam-mpec8u32-b8-c8", I915_OAM_FORMAT_MPEC8u32_B8_C8 },
+	};
+
+	for (int f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+		igt_describe("Check batched accumulation matches pairwise accumulation.");
+		igt_subtest_f("%s", formats[f].name) {
+			check_format(formats[f].format, 0);
+			check_format(formats[f].format, 2);
+			check_format(formats[f].format, -1);
+		}
+	}
+
+	igt_describe("Check batched counter reads match per-report reads.");
+	igt_subtest("read-batch") {
+		/* HSW, SKL GT2, TGL GT2, ADL-S */
+		static const uint32_t devids[] = { 0x0416, 0x1916, 0x9a49, 0x4680 };
+
+		for (int d = 0; d < sizeof(devids) / sizeof(devids[0]); d++)
+			check_read_batch(devids[d]);
+	}
+}
@@ -0,0 +1,177 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <i915_drm.h>
+
+#include "igt_core.h"
+#include "i915/perf.h"
+#include "i915/perf_data.h"
+#include "i915/perf_data_reader.h"
+
+#define N_RECORDS 100
+#define REPORT_SIZE 256
+
+static void write_record(int fd, uint32_t type, const void *data, uint16_t size)
+{
+	struct drm_i915_perf_record_header header = {
+		.type = type,
+		.size = sizeof(header) + size,
+	};
+
+	igt_assert_eq(write(fd, &header, sizeof(header)), sizeof(header));
+	igt_assert_eq(write(fd, data, size), size);
+}
+
+/* A HSW RenderBasic recording of N_RECORDS samples. */
+static int create_recording(void)
+{
+	struct intel_perf_record_version version = {
+		.version = INTEL_PERF_RECORD_VERSION,
+	};
+	struct intel_perf_record_device_info info = {
+		.timestamp_frequency = 12500000,
+		.device_id = 0x0416,
+		.gt_min_frequency = 300,
+		.gt_max_frequency = 1200,
+		.oa_format = I915_OA_FORMAT_A45_B8_C8,
+		.metric_set_name = "RenderBasic",
+	};
+	/* One slice, 8 subslices of 8 EUs each, padded to keep the
+	 * following records 8 bytes aligned like the recorder does.
+	 */
+	struct {
+		struct drm_i915_query_topology_info info;
+		uint8_t data[24];
+	} topology = {
+		.info = {
+			.max_slices = 1,
+			.max_subslices = 8,
+			.max_eus_per_subslice = 8,
+			.subslice_offset = 1,
+			.subslice_stride = 1,
+			.eu_offset = 2,
+			.eu_stride = 1,
+		},
+	};
+	struct intel_perf_record_timestamp_correlation corr;
+	uint32_t report[REPORT_SIZE / 4] = {};
+	FILE *file = tmpfile();
+	int fd;
+
+	igt_assert(file);
+	fd = dup(fileno(file));
+	fclose(file);
+
+	memset(topology.data, 0xff, 1 + 8 + 8);
+	topology.data[0] = 1;
+
+	write_record(fd, INTEL_PERF_RECORD_TYPE_VERSION, &version, sizeof(version));
+	write_record(fd, INTEL_PERF_RECORD_TYPE_DEVICE_INFO, &info, sizeof(info));
+	write_record(fd, INTEL_PERF_RECORD_TYPE_DEVICE_TOPOLOGY,
+		     &topology, sizeof(topology));
+
+	corr.cpu_timestamp = 1000000;
+	corr.gpu_timestamp = 0;
+	write_record(fd, INTEL_PERF_RECORD_TYPE_TIMESTAMP_CORRELATION,
+		     &corr, sizeof(corr));
+
+	for (int r = 0; r < N_RECORDS; r++) {
+		report[1] = r * 1000; /* timestamp */
+		report[2] = r / 10; /* context id */
+		write_record(fd, DRM_I915_PERF_RECORD_SAMPLE, report, sizeof(report));
+	}
+
+	corr.cpu_timestamp += N_RECORDS * 80000;
+	corr.gpu_timestamp = N_RECORDS * 1000;
+	write_record(fd, INTEL_PERF_RECORD_TYPE_TIMESTAMP_CORRELATION,
+		     &corr, sizeof(corr));
+
+	return fd;
+}
+
+/* Cut the recording in the middle of its last sample. */
+static void truncate_recording(int fd)
+{
+	off_t size = lseek(fd, 0, SEEK_END);
+
+	size -= sizeof(struct drm_i915_perf_record_header) +
+		sizeof(struct intel_perf_record_timestamp_correlation);
+	igt_assert_eq(ftruncate(fd, size - REPORT_SIZE / 2), 0);
+}
+
+static void check_records(int fd, uint64_t n_records, int end)
+{
+	struct intel_perf_data_stream stream;
+	const struct drm_i915_perf_record_header *header;
+	uint64_t n = 0;
+	int ret;
+
+	igt_assert_f(intel_perf_data_stream_init(&stream, fd),
+		     "%s\n", stream.error_msg);
+	igt_assert_eq_u64(stream.n_records, n_records);
+
+	while ((ret = intel_perf_data_stream_next_record(&stream, &header)) > 0)
+		n++;
+
+	igt_assert_eq(ret, end);
+	igt_assert_eq_u64(n, n_records);
+	igt_assert_eq(!!stream.error_msg[0], end != 0);
+
+	intel_perf_data_stream_fini(&stream);
+}
+
+static void check_timeline(int fd, uint64_t n_records, int end)
+{
+	struct intel_perf_data_stream stream;
+	struct intel_perf_timeline_item item;
+	uint64_t record_end = 0;
+	int ret;
+
+	igt_assert_f(intel_perf_data_stream_init(&stream, fd),
+		     "%s\n", stream.error_msg);
+
+	while ((ret = intel_perf_data_stream_next_timeline_item(&stream, &item)) > 0)
+		record_end = item.record_end;
+
+	igt_assert_eq(ret, end);
+	if (!end)
+		igt_assert_eq_u64(record_end, n_records - 1);
+
+	/* Iteration stays over until the stream is positioned again. */
+	igt_assert_eq(intel_perf_data_stream_next_timeline_item(&stream, &item), 0);
+	igt_assert_eq(intel_perf_data_stream_seek_record(&stream, 0), 0);
+
+	intel_perf_data_stream_fini(&stream);
+}
+
+igt_main
+{
+	int fd = -1;
+
+	igt_fixture
+		fd = create_recording();
+
+	igt_describe("Check a complete recording reads to its end.");
+	igt_subtest("clean") {
+		check_records(fd, N_RECORDS, 0);
+		check_timeline(fd, N_RECORDS, 0);
+	}
+
+	igt_describe("Check a recording cut short reports the truncated record.");
+	igt_subtest("truncated") {
+		truncate_recording(fd);
+		check_records(fd, N_RECORDS - 1, -EINVAL);
+		check_timeline(fd, N_RECORDS - 1, -EINVAL);
+	}
+
+	igt_fixture
+		close(fd);
+}
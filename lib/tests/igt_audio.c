@@ -26,6 +26,7 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "igt_core.h"
 #include "igt_audio.h"
@@ -35,6 +36,8 @@
 #define BUFFER_LEN 2048
 /** PHASESHIFT_LEN: how many samples will be truncated from the signal */
 #define PHASESHIFT_LEN 8
+/** PAGE_LEN: how many samples are fed at once to the streaming detector */
+#define PAGE_LEN 128
 
 static const int test_freqs[] = { 300, 700, 5000 };
 
@@ -42,13 +45,33 @@ static const size_t test_freqs_len = sizeof(test_freqs) / sizeof(test_freqs[0]);
 
 #define TEST_EXTRA_FREQ 500
 
+static bool streaming;
+
+static bool detect(struct audio_signal *signal, const double *buf, size_t len)
+{
+	struct audio_detector *detector;
+	unsigned int streak = 0;
+	size_t i;
+
+	if (!streaming)
+		return audio_signal_detect(signal, SAMPLING_RATE, 0, buf, len);
+
+	detector = audio_detector_init(signal, SAMPLING_RATE, 0, len);
+	for (i = 0; i < len; i += PAGE_LEN)
+		streak = audio_detector_feed(detector, &buf[i],
+					     len - i < PAGE_LEN ? len - i : PAGE_LEN);
+	audio_detector_fini(detector);
+
+	return streak == 1;
+}
+
 static void test_signal_detect_untampered(struct audio_signal *signal)
 {
 	double buf[BUFFER_LEN];
 	bool ok;
 
 	audio_signal_fill(signal, buf, BUFFER_LEN / CHANNELS);
-	ok = audio_signal_detect(signal, SAMPLING_RATE, 0, buf, BUFFER_LEN);
+	ok = detect(signal, buf, BUFFER_LEN);
 	igt_assert(ok);
 }
 
@@ -57,7 +80,7 @@ static void test_signal_detect_silence(struct audio_signal *signal)
 	double buf[BUFFER_LEN] = {0};
 	bool ok;
 
-	ok = audio_signal_detect(signal, SAMPLING_RATE, 0, buf, BUFFER_LEN);
+	ok = detect(signal, buf, BUFFER_LEN);
 
 	igt_assert(!ok);
 }
@@ -76,7 +99,7 @@ static void test_signal_detect_noise(struct audio_signal *signal)
 		buf[i] = (double) r / RAND_MAX * 2 - 1;
 	}
 
-	ok = audio_signal_detect(signal, SAMPLING_RATE, 0, buf, BUFFER_LEN);
+	ok = detect(signal, buf, BUFFER_LEN);
 
 	igt_assert(!ok);
 }
@@ -97,7 +120,7 @@ static void test_signal_detect_with_missing_freq(struct audio_signal *signal)
 	audio_signal_synthesize(missing);
 
 	audio_signal_fill(missing, buf, BUFFER_LEN / CHANNELS);
-	ok = audio_signal_detect(signal, SAMPLING_RATE, 0, buf, BUFFER_LEN);
+	ok = detect(signal, buf, BUFFER_LEN);
 	igt_assert(!ok);
 }
 
@@ -117,7 +140,7 @@ static void test_signal_detect_with_unexpected_freq(struct audio_signal *signal)
 	audio_signal_synthesize(extra);
 
 	audio_signal_fill(extra, buf, BUFFER_LEN / CHANNELS);
-	ok = audio_signal_detect(signal, SAMPLING_RATE, 0, buf, BUFFER_LEN);
+	ok = detect(signal, buf, BUFFER_LEN);
 	igt_assert(!ok);
 }
 
@@ -136,7 +159,7 @@ static void test_signal_detect_held_sample(struct audio_signal *signal)
 	for (i = 0; i < 5; i++)
 		buf[BUFFER_LEN / 3 + i] = value;
 
-	ok = audio_signal_detect(signal, SAMPLING_RATE, 0, buf, BUFFER_LEN);
+	ok = detect(signal, buf, BUFFER_LEN);
 
 	free(buf);
 
@@ -167,13 +190,165 @@ static void test_signal_detect_phaseshift(struct audio_signal *signal)
 	memmove(&buf[BUFFER_LEN / 3], &buf[BUFFER_LEN / 3 + PHASESHIFT_LEN],
 		(2 * BUFFER_LEN / 3) * sizeof(double));
 
-	ok = audio_signal_detect(signal, SAMPLING_RATE, 0, buf, BUFFER_LEN);
+	ok = detect(signal, buf, BUFFER_LEN);
 
 	free(buf);
 
 	igt_assert(!ok);
 }
 
+static void test_signal_detect_stream(struct audio_signal *signal)
+{
+	struct audio_detector *detector;
+	double *buf;
+	size_t len, i, page;
+	unsigned int streak = 0;
+
+	/* A few windows, not aligned with the pages */
+	len = 4 * BUFFER_LEN + PAGE_LEN / 2;
+	buf = malloc(len * sizeof(double));
+	audio_signal_fill(signal, buf, len);
+
+	detector = audio_detector_init(signal, SAMPLING_RATE, 0, BUFFER_LEN);
+	for (i = 0; i < len; i += page) {
+		page = len - i < PAGE_LEN - 1 ? len - i : PAGE_LEN - 1;
+		streak = audio_detector_feed(detector, &buf[i], page);
+	}
+	igt_assert_eq(streak, 4);
+
+	/* Silence in the next window breaks the streak */
+	memset(buf, 0, BUFFER_LEN * sizeof(double));
+	igt_assert_eq(audio_detector_feed(detector, buf, BUFFER_LEN), 0);
+
+	audio_detector_reset(detector);
+	audio_signal_fill(signal, buf, BUFFER_LEN);
+	igt_assert_eq(audio_detector_feed(detector, buf, BUFFER_LEN), 1);
+
+	audio_detector_fini(detector);
+	free(buf);
+}
+
+static struct audio_signal *fill_to_signal(void)
+{
+	struct audio_signal *signal;
+	size_t i;
+
+	signal = audio_signal_init(2, SAMPLING_RATE);
+	for (i = 0; i < test_freqs_len; i++) {
+		igt_assert_eq(audio_signal_add_frequency(signal, test_freqs[i],
+							 -1), 0);
+		igt_assert_eq(audio_signal_add_frequency(signal,
+							 test_freqs[i] + 100,
+							 1), 0);
+	}
+	audio_signal_synthesize(signal);
+
+	return signal;
+}
+
+static void test_signal_fill_to(snd_pcm_format_t format)
+{
+	struct audio_signal *a, *b;
+	/* Not a multiple of the internal block size */
+	size_t len = BUFFER_LEN + 13;
+	int32_t *expected, *buf;
+	double *tmp;
+	int i;
+
+	a = fill_to_signal();
+	b = fill_to_signal();
+	tmp = malloc(2 * len * sizeof(double));
+	expected = calloc(2 * len, sizeof(int32_t));
+	buf = calloc(2 * len, sizeof(int32_t));
+
+	/* Several fills, to check the signals stay in phase */
+	for (i = 0; i < 3; i++) {
+		audio_signal_fill(a, tmp, len);
+		audio_convert_to(expected, tmp, 2 * len, format);
+		audio_signal_fill_to(b, buf, len, format);
+		igt_assert(memcmp(expected, buf, 2 * len * sizeof(int32_t)) == 0);
+	}
+
+	free(buf);
+	free(expected);
+	free(tmp);
+	audio_signal_fini(b);
+	audio_signal_fini(a);
+}
+
+/* The scalar conversion, which the SIMD paths of audio_convert_to() match */
+static int32_t convert_sample(double sample, snd_pcm_format_t format)
+{
+	switch (format) {
+	case SND_PCM_FORMAT_S16_LE:
+		return (int16_t)(INT16_MAX * sample);
+	case SND_PCM_FORMAT_S24_LE:
+		return (int32_t)(0x7FFFFF * sample);
+	case SND_PCM_FORMAT_S32_LE:
+		return (int32_t)(INT32_MAX * sample);
+	default:
+		igt_assert(false);
+	}
+}
+
+/** CONVERT_LEN: longest conversion checked, an odd number of samples */
+#define CONVERT_LEN 67
+
+static void test_convert_to(snd_pcm_format_t format)
+{
+	size_t size = format == SND_PCM_FORMAT_S16_LE ?
+		sizeof(int16_t) : sizeof(int32_t);
+	double src[CONVERT_LEN + 1];
+	uint8_t dst[(CONVERT_LEN + 2) * sizeof(int32_t)];
+	size_t len, offset, i;
+	int32_t value;
+
+	/* Full scale, zeroes and values truncating towards zero */
+	for (i = 0; i <= CONVERT_LEN; i++) {
+		switch (i % 6) {
+		case 0:
+			src[i] = (i / 6) & 1 ? 1.0 : -1.0;
+			break;
+		case 1:
+			src[i] = 0.0;
+			break;
+		default:
+			src[i] = ((double)i / CONVERT_LEN - 0.5) * 1.999;
+			break;
+		}
+	}
+
+	/*
+	 * Every length covers the vector loops and a different tail. The
+	 * buffers are also misaligned and the samples past len must be left
+	 * alone.
+	 */
+	for (offset = 0; offset < 2; offset++) {
+		for (len = 0; len <= CONVERT_LEN; len++) {
+			memset(dst, 0x5a, sizeof(dst));
+			audio_convert_to(dst + offset * size, src + offset,
+					 len, format);
+
+			for (i = 0; i < len + 1; i++) {
+				uint8_t *d = dst + (offset + i) * size;
+
+				if (size == sizeof(int16_t))
+					value = *(int16_t *)d;
+				else
+					value = *(int32_t *)d;
+
+				if (i == len)
+					igt_assert_eq(value, size == sizeof(int16_t) ?
+						      0x5a5a : 0x5a5a5a5a);
+				else
+					igt_assert_eq(value,
+						      convert_sample(src[offset + i],
+								     format));
+			}
+		}
+	}
+}
+
 igt_main
 {
 	struct audio_signal *signal = NULL;
@@ -215,8 +390,58 @@ igt_main
 		igt_subtest("signal-detect-phaseshift")
 			test_signal_detect_phaseshift(signal);
 
+		igt_subtest_group {
+			igt_fixture
+				streaming = true;
+
+			igt_subtest("streaming-signal-detect-untampered")
+				test_signal_detect_untampered(signal);
+
+			igt_subtest("streaming-signal-detect-silence")
+				test_signal_detect_silence(signal);
+
+			igt_subtest("streaming-signal-detect-noise")
+				test_signal_detect_noise(signal);
+
+			igt_subtest("streaming-signal-detect-with-missing-freq")
+				test_signal_detect_with_missing_freq(signal);
+
+			igt_subtest("streaming-signal-detect-with-unexpected-freq")
+				test_signal_detect_with_unexpected_freq(signal);
+
+			igt_subtest("streaming-signal-detect-held-sample")
+				test_signal_detect_held_sample(signal);
+
+			igt_subtest("streaming-signal-detect-phaseshift")
+				test_signal_detect_phaseshift(signal);
+
+			igt_subtest("streaming-signal-detect-stream")
+				test_signal_detect_stream(signal);
+
+			igt_fixture
+				streaming = false;
+		}
+
 		igt_fixture {
 			audio_signal_fini(signal);
 		}
 	}
+
+	igt_subtest("signal-fill-to-s16")
+		test_signal_fill_to(SND_PCM_FORMAT_S16_LE);
+
+	igt_subtest("signal-fill-to-s24")
+		test_signal_fill_to(SND_PCM_FORMAT_S24_LE);
+
+	igt_subtest("signal-fill-to-s32")
+		test_signal_fill_to(SND_PCM_FORMAT_S32_LE);
+
+	igt_subtest("convert-to-s16")
+		test_convert_to(SND_PCM_FORMAT_S16_LE);
+
+	igt_subtest("convert-to-s24")
+		test_convert_to(SND_PCM_FORMAT_S24_LE);
+
+	igt_subtest("convert-to-s32")
+		test_convert_to(SND_PCM_FORMAT_S32_LE);
 }
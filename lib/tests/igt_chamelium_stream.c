@@ -0,0 +1,361 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "igt_aux.h"
+#include "igt_chamelium_stream.h"
+#include "igt_core.h"
+
+/* A stand-in for the Chamelium stream server, speaking just enough of the
+ * protocol for real-time audio dumps. */
+
+#define PAGE_SAMPLES 64
+
+#define KIND_RESPONSE 1
+#define KIND_DATA 2
+
+#define TYPE_GET_VERSION 1
+#define TYPE_DUMP_REALTIME_AUDIO 7
+#define TYPE_STOP_DUMP_AUDIO 8
+
+#define ERROR_AUDIO_MEM_OVERFLOW_DROP 7
+
+struct stream_server {
+	int listen_fd;
+	unsigned int port;
+	pthread_t thread;
+	/* Posted by the test once it consumed a burst */
+	sem_t next_burst;
+
+	int bursts;
+	/* Messages per burst: the page numbered drop_page is dropped */
+	int burst_len;
+	int drop_page;
+	/* Pages still in flight when the stop request is received */
+	int extra_pages;
+
+	bool ok;
+};
+
+static int32_t sample(int page, int i)
+{
+	return page * 1000 + i;
+}
+
+static bool read_all(int fd, void *buf, size_t len)
+{
+	ssize_t ret;
+
+	while (len > 0) {
+		ret = read(fd, buf, len);
+		if (ret <= 0)
+			return false;
+		buf = (char *)buf + ret;
+		len -= ret;
+	}
+
+	return true;
+}
+
+static bool write_all(int fd, const void *buf, size_t len)
+{
+	ssize_t ret;
+
+	while (len > 0) {
+		ret = write(fd, buf, len);
+		if (ret <= 0)
+			return false;
+		buf = (const char *)buf + ret;
+		len -= ret;
+	}
+
+	return true;
+}
+
+static bool write_message(int fd, int kind, int type, int err,
+			  const void *body, size_t len)
+{
+	uint16_t header[4];
+	uint32_t length = htonl(len);
+
+	header[0] = htons(type | kind << 8);
+	header[1] = htons(err);
+	memcpy(&header[2], &length, sizeof(length));
+
+	return write_all(fd, header, sizeof(header)) &&
+	       write_all(fd, body, len);
+}
+
+static bool expect_request(int fd, int type, size_t len)
+{
+	uint16_t header[4];
+	uint32_t length;
+	char body[16];
+
+	if (!read_all(fd, header, sizeof(header)))
+		return false;
+
+	memcpy(&length, &header[2], sizeof(length));
+	if (ntohs(header[0]) != type || ntohl(length) != len)
+		return false;
+
+	return read_all(fd, body, len);
+}
+
+static bool write_page(int fd, int page)
+{
+	uint32_t buf[1 + PAGE_SAMPLES];
+
+	buf[0] = htonl(page);
+	for (int i = 0; i < PAGE_SAMPLES; i++)
+		buf[1 + i] = sample(page, i);
+
+	return write_message(fd, KIND_DATA, TYPE_DUMP_REALTIME_AUDIO, 0,
+			     buf, sizeof(buf));
+}
+
+static bool serve(struct stream_server *server, int fd)
+{
+	static const char version[] = { 1, 0 };
+	int page = 0;
+
+	if (!expect_request(fd, TYPE_GET_VERSION, 0) ||
+	    !write_message(fd, KIND_RESPONSE, TYPE_GET_VERSION, 0,
+			   version, sizeof(version)))
+		return false;
+
+	if (!expect_request(fd, TYPE_DUMP_REALTIME_AUDIO, 1) ||
+	    !write_message(fd, KIND_RESPONSE, TYPE_DUMP_REALTIME_AUDIO, 0,
+			   NULL, 0))
+		return false;
+
+	for (int b = 0; b < server->bursts; b++) {
+		if (b)
+			sem_wait(&server->next_burst);
+
+		for (int i = 0; i < server->burst_len; i++, page++) {
+			bool ok;
+
+			if (page == server->drop_page)
+				ok = write_message(fd, KIND_DATA,
+						   TYPE_DUMP_REALTIME_AUDIO,
+						   ERROR_AUDIO_MEM_OVERFLOW_DROP,
+						   NULL, 0);
+			else
+				ok = write_page(fd, page);
+			if (!ok)
+				return false;
+		}
+	}
+
+	if (!expect_request(fd, TYPE_STOP_DUMP_AUDIO, 0))
+		return false;
+
+	for (int i = 0; i < server->extra_pages; i++, page++)
+		if (!write_page(fd, page))
+			return false;
+
+	return write_message(fd, KIND_RESPONSE, TYPE_STOP_DUMP_AUDIO, 0,
+			     NULL, 0);
+}
+
+static void *server_thread(void *data)
+{
+	struct stream_server *server = data;
+	int fd;
+
+	fd = accept(server->listen_fd, NULL, NULL);
+	if (fd >= 0) {
+		server->ok = serve(server, fd);
+		close(fd);
+	}
+
+	return NULL;
+}
+
+static void server_start(struct stream_server *server, int bursts,
+			 int burst_len, int drop_page, int extra_pages)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t addr_len = sizeof(addr);
+
+	memset(server, 0, sizeof(*server));
+	server->bursts = bursts;
+	server->burst_len = burst_len;
+	server->drop_page = drop_page;
+	server->extra_pages = extra_pages;
+	sem_init(&server->next_burst, 0, 0);
+
+	server->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	igt_assert(server->listen_fd >= 0);
+	igt_assert_eq(bind(server->listen_fd, (struct sockaddr *)&addr,
+			   sizeof(addr)), 0);
+	igt_assert_eq(listen(server->listen_fd, 1), 0);
+	igt_assert_eq(getsockname(server->listen_fd, (struct sockaddr *)&addr,
+				  &addr_len), 0);
+	server->port = ntohs(addr.sin_port);
+
+	igt_assert_eq(pthread_create(&server->thread, NULL, server_thread,
+				     server), 0);
+}
+
+static void server_finish(struct stream_server *server)
+{
+	pthread_join(server->thread, NULL);
+	close(server->listen_fd);
+	sem_destroy(&server->next_burst);
+	igt_assert(server->ok);
+}
+
+static void check_page(const struct chamelium_stream_audio_page *page,
+		       int expected)
+{
+	igt_assert_eq(page->page_count, expected);
+	igt_assert_eq(page->buf_len, PAGE_SAMPLES);
+	for (int i = 0; i < PAGE_SAMPLES; i++)
+		igt_assert_eq(page->buf[i], sample(expected, i));
+}
+
+static void test_receive(void)
+{
+	struct stream_server server;
+	struct chamelium_stream_audio_page page = {};
+	struct chamelium_stream *client;
+	int expected;
+
+	server_start(&server, 1, 8, 3, 2);
+	client = chamelium_stream_init_with_host("127.0.0.1", server.port);
+	igt_assert(client);
+
+	igt_assert(chamelium_stream_dump_realtime_audio(client,
+							CHAMELIUM_STREAM_REALTIME_BEST_EFFORT));
+	for (expected = 0; expected < 8; expected++) {
+		if (expected == 3)
+			continue;
+
+		igt_assert(chamelium_stream_receive_realtime_audio(client,
+								   &page.page_count,
+								   &page.buf,
+								   &page.buf_len));
+		check_page(&page, expected);
+	}
+	igt_assert(chamelium_stream_stop_realtime_audio(client));
+
+	free(page.buf);
+	chamelium_stream_deinit(client);
+	server_finish(&server);
+}
+
+static void test_pipeline(void)
+{
+	struct chamelium_stream_audio_stats stats;
+	struct chamelium_stream_audio_page *page;
+	struct stream_server server;
+	struct chamelium_stream *client;
+	int expected = 0;
+
+	/* Bursts as large as the ring, so that it wraps without overruns */
+	server_start(&server, 4, 4, 6, 3);
+	client = chamelium_stream_init_with_host("127.0.0.1", server.port);
+	igt_assert(client);
+
+	igt_assert(chamelium_stream_start_realtime_audio(client,
+							 CHAMELIUM_STREAM_REALTIME_BEST_EFFORT,
+							 4));
+	for (int b = 0; b < 4; b++) {
+		for (int i = 0; i < 4; i++, expected++) {
+			if (expected == 6)
+				continue;
+
+			page = chamelium_stream_next_audio_page(client);
+			igt_assert(page);
+			check_page(page, expected);
+			chamelium_stream_release_audio_page(client, page);
+		}
+		sem_post(&server.next_burst);
+	}
+	igt_assert(chamelium_stream_stop_realtime_audio(client));
+
+	chamelium_stream_get_audio_stats(client, &stats);
+	igt_assert_eq(stats.received, 15);
+	igt_assert_eq(stats.dropped, 1);
+	igt_assert_eq(stats.overruns, 0);
+
+	/* The pages sent after the stop request are not handed out */
+	igt_assert(!chamelium_stream_next_audio_page(client));
+
+	chamelium_stream_deinit(client);
+	server_finish(&server);
+}
+
+static bool all_pages_received(struct chamelium_stream *client, int count)
+{
+	struct chamelium_stream_audio_stats stats;
+
+	chamelium_stream_get_audio_stats(client, &stats);
+	return stats.received + stats.dropped + stats.overruns == count;
+}
+
+static void test_overrun(void)
+{
+	struct chamelium_stream_audio_page *first, *second;
+	struct chamelium_stream_audio_stats stats;
+	struct stream_server server;
+	struct chamelium_stream *client;
+
+	server_start(&server, 1, 6, -1, 0);
+	client = chamelium_stream_init_with_host("127.0.0.1", server.port);
+	igt_assert(client);
+
+	igt_assert(chamelium_stream_start_realtime_audio(client,
+							 CHAMELIUM_STREAM_REALTIME_BEST_EFFORT,
+							 2));
+	igt_assert(igt_wait(all_pages_received(client, 6), 5000, 10));
+
+	/* The pages held in the ring are not overwritten by newer ones */
+	first = chamelium_stream_next_audio_page(client);
+	second = chamelium_stream_next_audio_page(client);
+	igt_assert(first && second);
+	check_page(first, 0);
+	check_page(second, 1);
+
+	chamelium_stream_get_audio_stats(client, &stats);
+	igt_assert_eq(stats.received, 2);
+	igt_assert_eq(stats.dropped, 0);
+	igt_assert_eq(stats.overruns, 4);
+
+	chamelium_stream_release_audio_page(client, first);
+	chamelium_stream_release_audio_page(client, second);
+	igt_assert(chamelium_stream_stop_realtime_audio(client));
+
+	chamelium_stream_deinit(client);
+	server_finish(&server);
+}
+
+igt_main
+{
+	igt_describe("Check pages are received one by one, skipping dropped ones.");
+	igt_subtest("audio-receive")
+		test_receive();
+
+	igt_describe("Check the pipelined receiver hands pages in order through its ring.");
+	igt_subtest("audio-pipeline")
+		test_pipeline();
+
+	igt_describe("Check the pipelined receiver discards pages when its ring is full.");
+	igt_subtest("audio-overrun")
+		test_overrun();
+}
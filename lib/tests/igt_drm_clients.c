@@ -0,0 +1,328 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_drm_clients.h"
+
+#define ARRAY_SIZE(arr) (sizeof(arr)/sizeof(arr[0]))
+
+static char root[64];
+static char proc[64];
+static char dev[64];
+
+__attribute__((format(printf, 2, 3)))
+static void write_file(const char *path, const char *fmt, ...)
+{
+	va_list ap;
+	FILE *f;
+
+	f = fopen(path, "w");
+	igt_assert(f);
+
+	va_start(ap, fmt);
+	vfprintf(f, fmt, ap);
+	va_end(ap);
+
+	fclose(f);
+}
+
+static void add_pid(unsigned int pid, const char *name)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/%u", proc, pid);
+	igt_assert_eq(mkdir(path, 0755), 0);
+	snprintf(path, sizeof(path), "%s/%u/fd", proc, pid);
+	igt_assert_eq(mkdir(path, 0755), 0);
+	snprintf(path, sizeof(path), "%s/%u/fdinfo", proc, pid);
+	igt_assert_eq(mkdir(path, 0755), 0);
+
+	snprintf(path, sizeof(path), "%s/%u/stat", proc, pid);
+	write_file(path, "%u (%s) S 1 %u %u 0 -1\n", pid, name, pid, pid);
+}
+
+static void del_pid(unsigned int pid)
+{
+	char cmd[PATH_MAX + 16];
+
+	snprintf(cmd, sizeof(cmd), "rm -rf %s/%u", proc, pid);
+	igt_assert_eq(system(cmd), 0);
+}
+
+static void add_fd(unsigned int pid, unsigned int fd, const char *target)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/%u/fd/%u", proc, pid, fd);
+	igt_assert_eq(symlink(target, path), 0);
+
+	snprintf(path, sizeof(path), "%s/%u/fdinfo/%u", proc, pid, fd);
+	write_file(path, "pos:\t0\nflags:\t02100002\nmnt_id:\t26\n");
+}
+
+static void add_drm_fd(unsigned int pid, unsigned int fd, unsigned long id,
+		       unsigned long render)
+{
+	char path[PATH_MAX];
+
+	add_fd(pid, fd, dev);
+
+	snprintf(path, sizeof(path), "%s/%u/fdinfo/%u", proc, pid, fd);
+	write_file(path,
+		   "pos:\t0\n"
+		   "flags:\t02100002\n"
+		   "mnt_id:\t26\n"
+		   "drm-driver:\ti915\n"
+		   "drm-pdev:\t0000:00:02.0\n"
+		   "drm-client-id:\t%lu\n"
+		   "drm-engine-render:\t%lu ns\n"
+		   "drm-engine-copy:\t0 ns\n"
+		   "drm-engine-capacity-copy:\t2\n"
+		   "drm-total-system0:\t4 KiB\n"
+		   "drm-resident-system0:\t0\n",
+		   id, render);
+}
+
+static void del_fd(unsigned int pid, unsigned int fd)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/%u/fd/%u", proc, pid, fd);
+	igt_assert_eq(unlink(path), 0);
+	snprintf(path, sizeof(path), "%s/%u/fdinfo/%u", proc, pid, fd);
+	igt_assert_eq(unlink(path), 0);
+}
+
+static const char *engine_map[] = { "render", "copy" };
+
+static int client_id_cmp(const void *_a, const void *_b, void *unused)
+{
+	const struct igt_drm_client *a = _a;
+	const struct igt_drm_client *b = _b;
+
+	return (a->id > b->id) - (a->id < b->id);
+}
+
+static int client_id_reverse_cmp(const void *a, const void *b, void *unused)
+{
+	return client_id_cmp(b, a, unused);
+}
+
+/* Like the tools, sort after scanning to move the freed clients last. */
+static struct igt_drm_clients *scan(struct igt_drm_clients *clients)
+{
+	igt_drm_clients_scan(clients, NULL,
+			     engine_map, ARRAY_SIZE(engine_map),
+			     NULL, 0);
+
+	return igt_drm_clients_sort(clients, client_id_cmp);
+}
+
+static struct igt_drm_client *
+find_client(struct igt_drm_clients *clients, unsigned long id)
+{
+	struct igt_drm_client *c;
+	int tmp;
+
+	igt_for_each_drm_client(clients, c, tmp) {
+		if (c->status == IGT_DRM_CLIENT_ALIVE && c->id == id)
+			return c;
+	}
+
+	return NULL;
+}
+
+static unsigned int count_clients(struct igt_drm_clients *clients)
+{
+	struct igt_drm_client *c;
+	unsigned int count = 0;
+	int tmp;
+
+	igt_for_each_drm_client(clients, c, tmp)
+		count += c->status == IGT_DRM_CLIENT_ALIVE;
+
+	return count;
+}
+
+static struct igt_drm_clients *clients;
+
+static void remove_root(void)
+{
+	char cmd[PATH_MAX + 16];
+
+	if (!root[0])
+		return;
+
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+	igt_ignore_warn(system(cmd));
+	root[0] = '\0';
+}
+
+static void remove_root_handler(int sig)
+{
+	remove_root();
+}
+
+static void teardown(void)
+{
+	if (clients)
+		igt_drm_clients_free(clients);
+	clients = NULL;
+
+	remove_root();
+}
+
+/*
+ * Every subtest starts from a fresh proc root, with a DRM client (id 7) in
+ * process 100 and process 200 without DRM fds, scanned once.
+ */
+static void setup(void)
+{
+	teardown();
+
+	strcpy(root, "/tmp/igt_drm_clients.XXXXXX");
+	igt_assert(mkdtemp(root));
+
+	snprintf(proc, sizeof(proc), "%s/proc", root);
+	igt_assert_eq(mkdir(proc, 0755), 0);
+
+	snprintf(dev, sizeof(dev), "%s/renderD128", root);
+	igt_require_f(mknod(dev, S_IFCHR | 0600, makedev(226, 128)) == 0,
+		      "Unable to create a fake DRM device node, needs CAP_MKNOD\n");
+
+	clients = igt_drm_clients_init(NULL);
+	igt_assert(clients);
+	igt_assert_eq(igt_drm_clients_set_proc_root(clients, proc), 0);
+
+	add_pid(100, "glxgears");
+	add_fd(100, 0, "/dev/null");
+	add_drm_fd(100, 3, 7, 1000);
+
+	add_pid(200, "bash");
+	add_fd(200, 0, "/dev/null");
+	add_fd(200, 1, "/dev/null");
+
+	scan(clients);
+}
+
+igt_main
+{
+	igt_fixture
+		igt_install_exit_handler(remove_root_handler);
+
+	igt_describe("Check clients are found under a synthetic proc root.");
+	igt_subtest("scan") {
+		struct igt_drm_client *c;
+
+		setup();
+		igt_assert_eq(count_clients(clients), 1);
+
+		c = find_client(clients, 7);
+		igt_assert(c);
+		igt_assert_eq(c->pid, 100);
+		igt_assert_eq(c->drm_minor, 128);
+		igt_assert(!strcmp(c->name, "glxgears"));
+		igt_assert_eq(c->engines->num_engines, 2);
+		igt_assert_eq(c->engines->capacity[1], 2);
+		igt_assert_eq_u64(c->utilization[0].last_engine_time, 1000);
+		igt_assert_eq_u64(c->memory[0].total, 4096);
+	}
+
+	igt_describe("Check fdinfo is re-parsed for unchanged fd tables.");
+	igt_subtest("update") {
+		struct igt_drm_client *c;
+
+		setup();
+		del_fd(100, 3);
+		add_drm_fd(100, 3, 7, 5000);
+
+		scan(clients);
+		igt_assert_eq(count_clients(clients), 1);
+
+		c = find_client(clients, 7);
+		igt_assert(c);
+		igt_assert_eq(c->samples, 2);
+		igt_assert_eq(c->utilization[0].delta_engine_time, 4000);
+		igt_assert_eq(c->agg_delta_engine_time, 4000);
+	}
+
+	igt_describe("Check DRM fds opened by a process are picked up.");
+	igt_subtest("new-fd") {
+		setup();
+		add_drm_fd(200, 5, 8, 0);
+		add_drm_fd(100, 4, 9, 0);
+
+		scan(clients);
+		igt_assert_eq(count_clients(clients), 3);
+		igt_assert_eq(find_client(clients, 8)->pid, 200);
+		igt_assert(!strcmp(find_client(clients, 8)->name, "bash"));
+		igt_assert_eq(find_client(clients, 9)->pid, 100);
+
+		/* Re-ordering the array must not confuse the lookups. */
+		igt_drm_clients_sort(clients, client_id_reverse_cmp);
+		scan(clients);
+		igt_assert_eq(count_clients(clients), 3);
+		igt_assert_eq(find_client(clients, 7)->samples, 3);
+	}
+
+	igt_describe("Check an fd number re-used for a DRM device is picked up.");
+	igt_subtest("reuse-fd") {
+		setup();
+		del_fd(200, 1);
+		add_drm_fd(200, 1, 8, 0);
+
+		scan(clients);
+		igt_assert_eq(count_clients(clients), 2);
+		igt_assert_eq(find_client(clients, 8)->pid, 200);
+	}
+
+	igt_describe("Check a client shared by two fds is reported once.");
+	igt_subtest("duplicate") {
+		setup();
+		add_drm_fd(200, 5, 8, 0);
+		scan(clients);
+		igt_assert_eq(count_clients(clients), 2);
+
+		add_drm_fd(200, 6, 8, 0);
+		scan(clients);
+		igt_assert_eq(count_clients(clients), 2);
+		igt_assert_eq(find_client(clients, 8)->pid, 200);
+	}
+
+	igt_describe("Check clients of closed fds and exited processes go away.");
+	igt_subtest("exit") {
+		setup();
+		add_drm_fd(200, 5, 8, 0);
+		add_drm_fd(100, 4, 9, 0);
+		scan(clients);
+		igt_assert_eq(count_clients(clients), 3);
+
+		del_fd(100, 4);
+
+		scan(clients);
+		igt_assert_eq(count_clients(clients), 2);
+		igt_assert(!find_client(clients, 9));
+
+		del_pid(200);
+
+		scan(clients);
+		igt_assert_eq(count_clients(clients), 1);
+		igt_assert(!find_client(clients, 8));
+		igt_assert(find_client(clients, 7));
+	}
+
+	igt_fixture
+		teardown();
+}
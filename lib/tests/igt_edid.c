@@ -26,10 +26,13 @@
 #include "config.h"
 
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "igt_core.h"
 #include "igt_kms.h"
 #include "igt_edid.h"
+#include "igt_rand.h"
 
 static const unsigned char edid_header[] = {
 	0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00
@@ -64,9 +67,24 @@ static bool edid_block_checksum(const unsigned char *raw_edid)
 	return csum == 0;
 }
 
+static bool edid_is_valid(const struct edid *edid)
+{
+	const uint8_t *raw_edid = (const uint8_t *) edid;
+	size_t i;
+
+	if (!edid_header_is_valid(raw_edid))
+		return false;
+
+	for (i = 0; i <= edid->extensions_len; i++)
+		if (!edid_block_checksum(raw_edid + i * EDID_BLOCK_SIZE))
+			return false;
+
+	return true;
+}
+
 typedef const struct edid *(*get_edid_func)(void);
 
-igt_simple_main
+static void test_getters(void)
 {
 	const struct {
 		const char *desc;
@@ -74,10 +92,14 @@ igt_simple_main
 		size_t exts;
 	} funcs[] = {
 		{ "base", igt_kms_get_base_edid, 0 },
+		{ "full", igt_kms_get_full_edid, 0 },
+		{ "base_tile", igt_kms_get_base_tile_edid, 0 },
 		{ "alt", igt_kms_get_alt_edid, 0 },
 		{ "hdmi_audio", igt_kms_get_hdmi_audio_edid, 1 },
+		{ "dp_audio", igt_kms_get_dp_audio_edid, 1 },
 		{ "4k", igt_kms_get_4k_edid, 1 },
 		{ "3d", igt_kms_get_3d_edid, 1 },
+		{ "aspect_ratio", igt_kms_get_aspect_ratio_edid, 1 },
 		{0},
 	}, *f;
 	const struct edid *edid;
@@ -103,5 +125,197 @@ igt_simple_main
 				     "CEA block checksum failed on %s EDID",
 				     f->desc);
 		}
+
+		/* built once, then shared */
+		igt_assert_f(f->f() == edid,
+			     "%s EDID was built twice", f->desc);
 	}
 }
+
+static void test_tiled(void)
+{
+	const struct edid **edid;
+	const struct edid_ext *ext;
+
+	edid = igt_kms_get_tiled_edid(1, 0);
+	igt_assert(igt_kms_get_tiled_edid(1, 0) == edid);
+
+	for (int i = 0; i < 2; i++) {
+		igt_assert_f(edid_is_valid(edid[i]),
+			     "invalid tile %d EDID", i);
+		igt_assert_eq(edid[i]->extensions_len, 1);
+
+		ext = &edid[i]->extensions[0];
+		igt_assert_eq(ext->tag, EDID_EXT_DISPLAYID);
+		igt_assert_eq(ext->data.tile.topo[0], 0x10);
+		igt_assert_eq(ext->data.tile.topo[1], i ? 0x00 : 0x10);
+	}
+}
+
+static void test_template(void)
+{
+	struct edid_template *tmpl;
+	const struct edid *edid, *base = igt_kms_get_base_edid();
+
+	tmpl = edid_template_create(base);
+	edid = edid_template_edid(tmpl);
+	igt_assert(edid != base);
+	igt_assert(memcmp(edid, base, edid_get_size(base)) == 0);
+
+	igt_assert(edid_template_ref(tmpl) == tmpl);
+	edid_template_unref(tmpl);
+	igt_assert(memcmp(edid, base, edid_get_size(base)) == 0);
+	edid_template_unref(tmpl);
+}
+
+#define FUZZ_LOOPS 10000
+
+/* Composes an EDID with random CEA data blocks, and returns its expected
+ * deep color flags. */
+static uint8_t random_composition(struct edid_builder *builder,
+				  uint32_t *seed)
+{
+	struct cea_sad sads[4];
+	uint8_t svds[16];
+	char raw_hdmi[HDMI_VSDB_MAX_SIZE] = {0};
+	struct hdmi_vsdb *hdmi = (struct hdmi_vsdb *) raw_hdmi;
+	struct cea_speaker_alloc speakers = {0};
+	size_t avail = sizeof(builder->cea->data.cea.data);
+	uint8_t deep_color = 0;
+	size_t i, n;
+
+	edid_builder_init(builder, igt_kms_get_base_edid());
+
+	for (;;) {
+		switch (hars_petruska_f54_1_random(seed) % 5) {
+		case 0:
+			n = 1 + hars_petruska_f54_1_random(seed) % 4;
+			if (1 + n * sizeof(*sads) > avail)
+				goto done;
+			for (i = 0; i < n; i++)
+				cea_sad_init_pcm(&sads[i], 1 + i, 0x7f, 0x7);
+			edid_builder_add_sad(builder, sads, n);
+			avail -= 1 + n * sizeof(*sads);
+			break;
+		case 1:
+			n = 1 + hars_petruska_f54_1_random(seed) % 16;
+			if (1 + n > avail)
+				goto done;
+			for (i = 0; i < n; i++)
+				svds[i] = 1 + hars_petruska_f54_1_random(seed) % 64;
+			edid_builder_add_svd(builder, svds, n);
+			avail -= 1 + n;
+			break;
+		case 2:
+			n = HDMI_VSDB_MIN_SIZE +
+			    hars_petruska_f54_1_random(seed) %
+			    (HDMI_VSDB_MAX_SIZE - HDMI_VSDB_MIN_SIZE + 1);
+			if (1 + CEA_VSDB_HEADER_SIZE + n > avail)
+				goto done;
+			hdmi->src_phy_addr[0] = 0x10;
+			hdmi->flags1 = hars_petruska_f54_1_random(seed);
+			/* Only the first HDMI VSDB with deep color counts */
+			if (n > HDMI_VSDB_MIN_SIZE && !deep_color &&
+			    hdmi->flags1 & (7 << 4))
+				deep_color = hdmi->flags1;
+			edid_builder_add_hdmi_vsdb(builder, hdmi, n);
+			avail -= 1 + CEA_VSDB_HEADER_SIZE + n;
+			break;
+		case 3:
+			if (1 + sizeof(speakers) > avail)
+				goto done;
+			speakers.speakers = hars_petruska_f54_1_random(seed) & 0x7f;
+			edid_builder_add_speaker_alloc(builder, &speakers);
+			avail -= 1 + sizeof(speakers);
+			break;
+		default:
+			goto done;
+		}
+	}
+
+done:
+	edid_builder_set_cea_flags(builder, EDID_CEA_BASIC_AUDIO);
+
+	return deep_color;
+}
+
+static void test_builder_fuzz(void)
+{
+	struct edid_builder builder;
+	struct edid_template *tmpl;
+	const struct edid *edid;
+	uint32_t seed = 0x1D;
+	uint8_t deep_color;
+
+	for (int loop = 0; loop < FUZZ_LOOPS; loop++) {
+		deep_color = random_composition(&builder, &seed);
+		tmpl = edid_builder_finish(&builder);
+		edid = edid_template_edid(tmpl);
+
+		igt_assert_f(edid_is_valid(edid), "invalid EDID, loop %d", loop);
+		igt_assert(memcmp(edid, edid_builder_edid(&builder),
+				  edid_get_size(edid)) == 0);
+		igt_assert_eq(edid->extensions_len, builder.cea ? 1 : 0);
+		igt_assert_eq(edid_get_size(edid),
+			      (1 + edid->extensions_len) * EDID_BLOCK_SIZE);
+		if (builder.cea)
+			igt_assert_eq(builder.cea->data.cea.dtd_start,
+				      4 + builder.cea_size);
+		igt_assert_eq(edid_get_deep_color_from_vsdb(edid), deep_color);
+
+		edid_template_unref(tmpl);
+	}
+}
+
+static void test_parser_fuzz(void)
+{
+	struct edid_builder builder;
+	struct edid *edid;
+	uint32_t seed = 0x2E;
+	size_t size, offset;
+	char mfg[3];
+
+	for (int loop = 0; loop < FUZZ_LOOPS; loop++) {
+		random_composition(&builder, &seed);
+		edid_template_unref(edid_builder_finish(&builder));
+
+		/* Exactly sized, for the sanitizers to catch overreads */
+		size = edid_get_size(edid_builder_edid(&builder));
+		edid = malloc(size);
+		memcpy(edid, builder.raw, size);
+
+		/* Flip random bytes, except the extension count which sizes
+		 * the buffer. The parsers must stay within the EDID. */
+		for (int i = 0; i < 8; i++) {
+			offset = hars_petruska_f54_1_random(&seed) % size;
+			if (offset != offsetof(struct edid, extensions_len))
+				((uint8_t *) edid)[offset] ^=
+					1 + hars_petruska_f54_1_random(&seed) % 255;
+		}
+
+		edid_get_mfg(edid, mfg);
+		edid_get_deep_color_from_vsdb(edid);
+		edid_get_bit_depth_from_vid(edid);
+		igt_assert_eq(edid_get_size(edid), size);
+
+		free(edid);
+	}
+}
+
+igt_main
+{
+	igt_subtest("getters")
+		test_getters();
+
+	igt_subtest("tiled")
+		test_tiled();
+
+	igt_subtest("template")
+		test_template();
+
+	igt_subtest("builder-fuzz")
+		test_builder_fuzz();
+
+	igt_subtest("parser-fuzz")
+		test_parser_fuzz();
+}
@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "igt_core.h"
+
+#define THREADS 4
+#define LOOPS 1000
+
+struct lines {
+	int count;
+	char *first, *last;
+};
+
+static bool collect(const char *line, void *data)
+{
+	struct lines *lines = data;
+
+	if (!lines->count++)
+		lines->first = strdup(line);
+	free(lines->last);
+	lines->last = strdup(line);
+
+	return false;
+}
+
+static struct lines inspect(void)
+{
+	struct lines lines = {};
+
+	igt_log_buffer_inspect(collect, &lines);
+	return lines;
+}
+
+static void free_lines(struct lines *lines)
+{
+	free(lines->first);
+	free(lines->last);
+}
+
+static void *log_thread(void *data)
+{
+	for (int n = 0; n < LOOPS; n++)
+		igt_debug("thread message %d\n", n);
+
+	return NULL;
+}
+
+igt_main
+{
+	igt_describe("Check the messages are kept in order, with their prefix.");
+	igt_subtest("order") {
+		struct lines lines;
+
+		igt_debug("first %d\n", 1);
+		igt_log("domain", IGT_LOG_DEBUG, "second\n");
+		igt_debug("third ");
+		igt_debug("continued\n");
+
+		lines = inspect();
+		igt_assert_eq(lines.count, 4);
+		igt_assert(strstr(lines.first, ") DEBUG: first 1\n"));
+		igt_assert_eq(strcmp(lines.last, "continued\n"), 0);
+		free_lines(&lines);
+	}
+
+	igt_describe("Check only the most recent messages are kept.");
+	igt_subtest("wrap") {
+		struct lines lines;
+
+		for (int n = 0; n < 1000; n++)
+			igt_debug("message %d\n", n);
+
+		lines = inspect();
+		igt_assert_eq(lines.count, 256);
+		igt_assert(strstr(lines.first, "DEBUG: message 744\n"));
+		igt_assert(strstr(lines.last, "DEBUG: message 999\n"));
+		free_lines(&lines);
+	}
+
+	igt_describe("Check messages longer than a ring entry are kept whole.");
+	igt_subtest("long") {
+		struct lines lines;
+		char buf[4096];
+
+		memset(buf, 'x', sizeof(buf) - 1);
+		buf[sizeof(buf) - 1] = '\0';
+		igt_debug("%s\n", buf);
+
+		lines = inspect();
+		igt_assert_eq(lines.count, 1);
+		igt_assert(strstr(lines.first, buf));
+		free_lines(&lines);
+	}
+
+	igt_describe("Check messages from concurrent threads are all recorded.");
+	igt_subtest("threads") {
+		pthread_t threads[THREADS];
+		struct lines lines;
+
+		for (int n = 0; n < THREADS; n++)
+			pthread_create(&threads[n], NULL, log_thread, NULL);
+		for (int n = 0; n < THREADS; n++)
+			pthread_join(threads[n], NULL);
+
+		lines = inspect();
+		igt_assert_eq(lines.count, 256);
+		igt_assert(strstr(lines.last, "[thread:"));
+		free_lines(&lines);
+	}
+}
@@ -228,6 +228,129 @@ static void test_reallocation(void)
 	igt_stats_fini(&stats);
 }
 
+static void test_quantile(void)
+{
+	igt_stats_t stats;
+
+	igt_stats_init(&stats);
+	push_fixture_1(&stats);
+
+	igt_assert_eq_double(igt_stats_get_quantile(&stats, 0.), 2);
+	igt_assert_eq_double(igt_stats_get_quantile(&stats, .5), 6);
+	igt_assert_eq_double(igt_stats_get_quantile(&stats, .9), 9.2);
+	igt_assert_eq_double(igt_stats_get_quantile(&stats, 1.), 10);
+
+	igt_stats_fini(&stats);
+}
+
+/* Deterministic log-normal latencies of a few microseconds, in ns. */
+static uint64_t next_latency(uint32_t *seed)
+{
+	double u1, u2;
+
+	*seed = *seed * 1103515245 + 12345;
+	u1 = (*seed >> 8) / (double)(1 << 24) + 1e-9;
+	*seed = *seed * 1103515245 + 12345;
+	u2 = (*seed >> 8) / (double)(1 << 24);
+
+	return exp(8. + sqrt(-2. * log(u1)) * cos(2. * M_PI * u2));
+}
+
+static void assert_close(double value, double expected, double tolerance)
+{
+	igt_assert_f(fabs(value - expected) <= tolerance * fabs(expected),
+		     "%f is not within %.2f%% of %f\n",
+		     value, 100 * tolerance, expected);
+}
+
+static void assert_histogram(igt_stats_t *histogram, igt_stats_t *exact)
+{
+	static const double quantiles[] = { .01, .25, .5, .75, .99, .999 };
+	double q1, q2, q3, e1, e2, e3;
+
+	igt_assert_eq(histogram->n_values, exact->n_values);
+	igt_assert_eq(igt_stats_get_min(histogram), igt_stats_get_min(exact));
+	igt_assert_eq(igt_stats_get_max(histogram), igt_stats_get_max(exact));
+	igt_assert_eq_double(igt_stats_get_quantile(histogram, 1.),
+			     igt_stats_get_max(exact));
+
+	for (int i = 0; i < ARRAY_SIZE(quantiles); i++)
+		assert_close(igt_stats_get_quantile(histogram, quantiles[i]),
+			     igt_stats_get_quantile(exact, quantiles[i]), .01);
+
+	igt_stats_get_quartiles(histogram, &q1, &q2, &q3);
+	igt_stats_get_quartiles(exact, &e1, &e2, &e3);
+	assert_close(q1, e1, .01);
+	assert_close(q2, e2, .01);
+	assert_close(q3, e3, .01);
+	assert_close(igt_stats_get_median(histogram),
+		     igt_stats_get_median(exact), .01);
+	assert_close(igt_stats_get_iqm(histogram),
+		     igt_stats_get_iqm(exact), .01);
+
+	assert_close(igt_stats_get_mean(histogram),
+		     igt_stats_get_mean(exact), 1e-9);
+	assert_close(igt_stats_get_variance(histogram),
+		     igt_stats_get_variance(exact), 1e-6);
+}
+
+static void test_histogram(void)
+{
+	igt_stats_t histogram, exact;
+	uint32_t seed = 0;
+
+	igt_stats_init_with_mode(&histogram, IGT_STATS_HISTOGRAM);
+	igt_stats_init_with_mode(&exact, IGT_STATS_EXACT);
+	igt_assert(!histogram.values_u64);
+
+	for (int i = 0; i < 100000; i++) {
+		uint64_t value = next_latency(&seed);
+
+		igt_stats_push(&histogram, value);
+		igt_stats_push(&exact, value);
+	}
+
+	assert_histogram(&histogram, &exact);
+
+	igt_stats_fini(&histogram);
+	igt_stats_fini(&exact);
+}
+
+static void test_histogram_merge(void)
+{
+	igt_stats_t histogram, threads[4], exact;
+	uint32_t seed = 1;
+
+	igt_stats_init_with_mode(&histogram, IGT_STATS_HISTOGRAM);
+	igt_stats_init(&exact);
+
+	for (int t = 0; t < ARRAY_SIZE(threads); t++) {
+		igt_stats_init_with_mode(&threads[t], IGT_STATS_HISTOGRAM);
+
+		/* Give each thread its own distribution */
+		for (int i = 0; i < 10000 * (t + 1); i++) {
+			uint64_t value = next_latency(&seed) << t;
+
+			igt_stats_push(&threads[t], value);
+			igt_stats_push(&exact, value);
+		}
+
+		igt_stats_merge(&histogram, &threads[t]);
+		igt_stats_fini(&threads[t]);
+	}
+
+	assert_histogram(&histogram, &exact);
+
+	/* Exact values can be merged into a histogram as well */
+	igt_stats_merge(&histogram, &exact);
+	igt_assert_eq(histogram.n_values, 2 * exact.n_values);
+	assert_close(igt_stats_get_quantile(&histogram, .99),
+		     igt_stats_get_quantile(&exact, .99), .01);
+
+	igt_stats_fini(&histogram);
+	igt_stats_fini(&exact);
+}
+
 igt_simple_main
 {
 	test_init_zero();
@@ -240,4 +363,7 @@ igt_simple_main
 	test_invalidate_mean();
 	test_std_deviation();
 	test_reallocation();
+	test_quantile();
+	test_histogram();
+	test_histogram_merge();
 }
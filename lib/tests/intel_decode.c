@@ -0,0 +1,130 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "igt_core.h"
+#include "i915/intel_decode.h"
+
+#define ARRAY_SIZE(arr) (sizeof(arr)/sizeof(arr[0]))
+
+#define MI_NOOP			0x00000000
+#define MI_LOAD_REGISTER_IMM	0x11000001
+#define MI_BATCH_BUFFER_END	0x05000000
+#define PIPE_CONTROL		0x7a000004
+#define XY_SRC_COPY_BLT		0x54c00006
+#define VERTEX_BUFFERS		0x78080003
+#define UNKNOWN_3D		0x7fff0000
+
+#define GTT_OFFSET 0x10000
+
+static const uint32_t batch[] = {
+	MI_NOOP,
+	PIPE_CONTROL, 0, 0, 0, 0, 0,
+	MI_LOAD_REGISTER_IMM, 0x2000, PIPE_CONTROL,
+	PIPE_CONTROL, 0, 0, 0, 0, 0,
+	MI_BATCH_BUFFER_END,
+	PIPE_CONTROL, 0, 0, 0, 0, 0,
+};
+
+/* One packet of each kind sized by the opcode tables, or not */
+static const uint32_t packets[] = {
+	XY_SRC_COPY_BLT, 0, 0, 0, 0, 0, 0, 0,
+	VERTEX_BUFFERS, 0, 0, 0, 0,
+	UNKNOWN_3D,
+	MI_NOOP,
+	MI_BATCH_BUFFER_END,
+};
+
+static struct intel_decode *ctx;
+
+static void check_find(uint32_t mask, uint32_t value,
+		       const uint32_t *expected, int count)
+{
+	uint32_t offsets[ARRAY_SIZE(batch)];
+
+	memset(offsets, 0, sizeof(offsets));
+	igt_assert_eq(intel_decode_find(ctx, mask, value, offsets, 1),
+		      count);
+	igt_assert(!count || offsets[0] == GTT_OFFSET + 4 * expected[0]);
+	igt_assert_eq(offsets[1], 0);
+
+	igt_assert_eq(intel_decode_find(ctx, mask, value, offsets,
+					ARRAY_SIZE(offsets)), count);
+	for (int i = 0; i < count; i++)
+		igt_assert_eq(offsets[i], GTT_OFFSET + 4 * expected[i]);
+}
+
+igt_main
+{
+	igt_fixture {
+		/* Skylake GT2 */
+		ctx = intel_decode_context_alloc(0x1912);
+		igt_assert(ctx);
+		intel_decode_set_batch_pointer(ctx, (void *)batch, GTT_OFFSET,
+					       ARRAY_SIZE(batch));
+	}
+
+	igt_describe("Check packets are found by header, skipping their payload.");
+	igt_subtest("find") {
+		static const uint32_t pipe_control[] = { 1, 10 };
+		static const uint32_t lri[] = { 7 };
+
+		check_find(0xffff0000, PIPE_CONTROL & 0xffff0000,
+			   pipe_control, ARRAY_SIZE(pipe_control));
+		check_find(0xff800000, MI_LOAD_REGISTER_IMM & 0xff800000,
+			   lri, ARRAY_SIZE(lri));
+		check_find(~0u, 0x12345678, NULL, 0);
+	}
+
+	igt_describe("Check the packets past MI_BATCH_BUFFER_END are only walked when dumped.");
+	igt_subtest("find-past-end") {
+		static const uint32_t pipe_control[] = { 1, 10, 17 };
+
+		intel_decode_set_dump_past_end(ctx, 1);
+		check_find(0xffff0000, PIPE_CONTROL & 0xffff0000,
+			   pipe_control, ARRAY_SIZE(pipe_control));
+		intel_decode_set_dump_past_end(ctx, 0);
+	}
+
+	igt_describe("Check the packet lengths are taken from the opcode tables.");
+	igt_subtest("find-lengths") {
+		static const uint32_t all[] = { 0, 8, 13, 14, 15 };
+
+		intel_decode_set_batch_pointer(ctx, (void *)packets, GTT_OFFSET,
+					       ARRAY_SIZE(packets));
+		check_find(0, 0, all, ARRAY_SIZE(all));
+		intel_decode_set_batch_pointer(ctx, (void *)batch, GTT_OFFSET,
+					       ARRAY_SIZE(batch));
+	}
+
+	igt_describe("Check finding packets does not produce any output.");
+	igt_subtest("find-quiet") {
+		char *buf = NULL;
+		size_t size = 0;
+		FILE *file;
+
+		file = open_memstream(&buf, &size);
+		igt_assert(file);
+		intel_decode_set_output_file(ctx, file);
+
+		intel_decode_find(ctx, 0, 0, NULL, 0);
+		fflush(file);
+		igt_assert_eq(size, 0);
+
+		intel_decode(ctx);
+		fflush(file);
+		igt_assert(size && strstr(buf, "PIPE_CONTROL"));
+
+		intel_decode_set_output_file(ctx, stdout);
+		fclose(file);
+		free(buf);
+	}
+
+	igt_fixture
+		intel_decode_context_free(ctx);
+}
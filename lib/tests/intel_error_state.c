@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2024 Intel Corporation
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "igt_core.h"
+#include "i915/intel_error_state.h"
+
+#define ARRAY_SIZE(arr) (sizeof(arr)/sizeof(arr[0]))
+
+static uint32_t batch[1024], ring[37];
+static const uint32_t hex[] = { 0x12345678, 0x9abcdef0, 0, 0xffffffff };
+
+/* Same encoding as the kernel, with 'z' for zero words. */
+static void fprint_ascii85(FILE *file, const uint32_t *data, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		uint32_t v = data[i];
+		char out[5];
+
+		if (!v) {
+			fputc('z', file);
+			continue;
+		}
+
+		for (int c = 4; c >= 0; c--) {
+			out[c] = '!' + v % 85;
+			v /= 85;
+		}
+		fwrite(out, 1, 5, file);
+	}
+	fputc('\n', file);
+}
+
+static void fprint_zlib(FILE *file, const uint32_t *data, size_t count)
+{
+	uLongf len = compressBound(count * 4);
+	uint32_t *out = calloc(len / 4 + 1, 4);
+
+	igt_assert(out);
+	igt_assert_eq(compress((Bytef *)out, &len, (const Bytef *)data, count * 4),
+		      Z_OK);
+
+	fputc(':', file);
+	fprint_ascii85(file, out, (len + 3) / 4);
+	free(out);
+}
+
+static char *write_error_state(void)
+{
+	char *path = strdup("/tmp/igt_error_state.XXXXXX");
+	FILE *file;
+	int fd;
+
+	igt_assert(path);
+	fd = mkstemp(path);
+	igt_assert(fd >= 0);
+	file = fdopen(fd, "w");
+	igt_assert(file);
+
+	fprintf(file,
+		"Kernel: 6.8.0\n"
+		"Time: 1 s 0 us\n"
+		"PCI ID: 0x9a49\n"
+		"EIR: 0x00000000\n"
+		"IER: 0x00001234\n"
+		"rcs0 command stream:\n"
+		"  IDLE?: no\n"
+		"  START: 0x00001000\n"
+		"  HEAD:  0x00000040 [0x00000040]\n"
+		"  ACTHD: 0x00000001_00002010\n"
+		"bcs0 command stream:\n"
+		"  START: 0x00003000\n"
+		"  ACTHD: 0x00000000_00003000\n"
+		"rcs0 --- batch = 0x00000001 00002000\n");
+	fprint_zlib(file, batch, ARRAY_SIZE(batch));
+	fprintf(file, "rcs0 --- ring = 0x00000000 00001000\n~");
+	fprint_ascii85(file, ring, ARRAY_SIZE(ring));
+	fprintf(file, "bcs0 --- 2 requests\n"
+		"bcs0 --- HW Context = 0x00000000 fffe0000\n");
+	for (int i = 0; i < ARRAY_SIZE(hex); i++)
+		fprintf(file, "%08x : %08x\n", i * 4, hex[i]);
+	fprintf(file, "bcs0 --- ring = 0x00000000 00004000\n"
+		"Display state:\n");
+
+	fclose(file);
+	return path;
+}
+
+static void check_bo(struct intel_error_state *es, const char *engine,
+		     const char *name, uint64_t gtt_offset,
+		     const uint32_t *expected, int count)
+{
+	const struct intel_error_state_bo *bo;
+	uint32_t *data;
+
+	bo = intel_error_state_find_bo(es, engine, name);
+	igt_assert(bo);
+	igt_assert_eq_u64(bo->gtt_offset, gtt_offset);
+
+	igt_assert_eq(intel_error_state_decode_bo(es, bo, &data), count);
+	igt_assert(!count || !memcmp(data, expected, count * sizeof(*data)));
+	free(data);
+}
+
+igt_main
+{
+	struct intel_error_state *es = NULL;
+	char *path = NULL;
+
+	igt_fixture {
+		for (int i = 0; i < ARRAY_SIZE(batch); i++)
+			batch[i] = i % 3 ? 0x7a000000 | i : 0;
+		for (int i = 0; i < ARRAY_SIZE(ring); i++)
+			ring[i] = i % 5 ? ~i : 0;
+
+		path = write_error_state();
+		es = intel_error_state_open(path);
+		igt_assert(es);
+	}
+
+	igt_describe("Check the engines and registers are indexed.");
+	igt_subtest("registers") {
+		const struct intel_error_state_engine *engine;
+		uint64_t value;
+
+		igt_assert_eq(es->devid, 0x9a49);
+		igt_assert_eq(es->num_engines, 2);
+
+		igt_assert(intel_error_state_read_register(es, NULL, "IER", &value));
+		igt_assert_eq_u64(value, 0x1234);
+		igt_assert(!intel_error_state_read_register(es, NULL, "ACTHD", &value));
+
+		engine = intel_error_state_find_engine(es, "rcs0");
+		igt_assert(engine);
+		igt_assert_eq(engine->num_registers, 3);
+		igt_assert(intel_error_state_read_register(es, engine, "ACTHD", &value));
+		igt_assert_eq_u64(value, 0x100002010ull);
+		igt_assert(intel_error_state_read_register(es, engine, "HEAD", &value));
+		igt_assert_eq_u64(value, 0x40);
+		igt_assert(!intel_error_state_read_register(es, engine, "IDLE?", &value));
+
+		engine = intel_error_state_find_engine(es, "bcs0");
+		igt_assert(engine);
+		igt_assert(intel_error_state_read_register(es, engine, "START", &value));
+		igt_assert_eq_u64(value, 0x3000);
+
+		igt_assert(!intel_error_state_find_engine(es, "vcs0"));
+	}
+
+	igt_describe("Check buffers are decoded from each encoding.");
+	igt_subtest("buffers") {
+		igt_assert_eq(es->num_bos, 4);
+
+		check_bo(es, "rcs0", "batch", 0x100002000ull, batch, ARRAY_SIZE(batch));
+		check_bo(es, "rcs0", "ring", 0x1000, ring, ARRAY_SIZE(ring));
+		check_bo(es, "bcs0", "HW context", 0xfffe0000, hex, ARRAY_SIZE(hex));
+		check_bo(es, "bcs0", "ring", 0x4000, NULL, 0);
+
+		igt_assert_eq(intel_error_state_find_bo(es, NULL, "ring")->gtt_offset,
+			      0x1000);
+		igt_assert(!intel_error_state_find_bo(es, "vcs0", "batch"));
+	}
+
+	igt_fixture {
+		intel_error_state_close(es);
+		unlink(path);
+		free(path);
+	}
+}
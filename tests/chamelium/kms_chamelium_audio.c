@@ -65,6 +65,8 @@
 
 /* Capture paremeters control the audio signal we receive */
 #define CAPTURE_SAMPLES 2048
+/* Pages buffered by the stream receiver while the previous ones are analyzed */
+#define CAPTURE_RING_PAGES 16
 
 #define AUDIO_TIMEOUT 2000 /* ms */
 /* A streak of 3 gives confidence that the signal is good. */
@@ -79,6 +81,7 @@ struct audio_state {
 	struct chamelium *chamelium;
 	struct chamelium_port *port;
 	struct chamelium_stream *stream;
+	struct chamelium_stream_audio_page *page; /* last received page */
 
 	/* The capture format is only available after capture has started. */
 	struct {
@@ -194,7 +197,8 @@ static void audio_state_start(struct audio_state *state, const char *name)
 	chamelium_start_capturing_audio(state->chamelium, state->port, false);
 
 	stream_mode = CHAMELIUM_STREAM_REALTIME_STOP_WHEN_OVERFLOW;
-	ok = chamelium_stream_dump_realtime_audio(state->stream, stream_mode);
+	ok = chamelium_stream_start_realtime_audio(state->stream, stream_mode,
+						   CAPTURE_RING_PAGES);
 	igt_assert_f(ok, "Failed to start streaming audio capture\n");
 
 	/* Start playing audio */
@@ -246,16 +250,20 @@ static void audio_state_start(struct audio_state *state, const char *name)
 	}
 }
 
+/* The received page is valid until the next call or audio_state_stop(). */
 static void audio_state_receive(struct audio_state *state, int32_t **recv,
 				size_t *recv_len)
 {
-	bool ok;
-	size_t page_count;
 	size_t recv_size;
 
-	ok = chamelium_stream_receive_realtime_audio(state->stream, &page_count,
-						     recv, recv_len);
-	igt_assert_f(ok, "Failed to receive audio from stream server\n");
+	if (state->page)
+		chamelium_stream_release_audio_page(state->stream, state->page);
+
+	state->page = chamelium_stream_next_audio_page(state->stream);
+	igt_assert_f(state->page,
+		     "Failed to receive audio from stream server\n");
+	*recv = state->page->buf;
+	*recv_len = state->page->buf_len;
 
 	state->msec = state->recv_pages * *recv_len /
 		      (double)state->capture.channels /
@@ -275,6 +283,7 @@ static void audio_state_stop(struct audio_state *state, bool success)
 	bool ok;
 	int ret;
 	struct chamelium_audio_file *audio_file;
+	struct chamelium_stream_audio_stats stats;
 	enum igt_log_level log_level;
 
 	igt_debug("Stopping audio playback\n");
@@ -282,9 +291,21 @@ static void audio_state_stop(struct audio_state *state, bool success)
 	ret = pthread_join(state->thread, NULL);
 	igt_assert_f(ret == 0, "Failed to join audio playback thread\n");
 
+	if (state->page) {
+		chamelium_stream_release_audio_page(state->stream, state->page);
+		state->page = NULL;
+	}
+
 	ok = chamelium_stream_stop_realtime_audio(state->stream);
 	igt_assert_f(ok, "Failed to stop streaming audio capture\n");
 
+	chamelium_stream_get_audio_stats(state->stream, &stats);
+	igt_debug("Received %lu audio pages, %lu dropped, %lu overruns\n",
+		  stats.received, stats.dropped, stats.overruns);
+	if (stats.overruns)
+		igt_warn("%lu audio pages were lost, the capture isn't "
+			 "processed fast enough\n", stats.overruns);
+
 	audio_file =
 		chamelium_stop_capturing_audio(state->chamelium, state->port);
 	if (audio_file) {
@@ -379,14 +400,9 @@ static int audio_output_frequencies_callback(void *data, void *buffer,
 					     int samples)
 {
 	struct audio_state *state = data;
-	double *tmp;
-	size_t len;
 
-	len = samples * state->playback.channels;
-	tmp = malloc(len * sizeof(double));
-	audio_signal_fill(state->signal, tmp, samples);
-	audio_convert_to(buffer, tmp, len, state->playback.format);
-	free(tmp);
+	audio_signal_fill_to(state->signal, buffer, samples,
+			     state->playback.format);
 
 	return state->run ? 0 : -1;
 }
@@ -394,10 +410,11 @@ static int audio_output_frequencies_callback(void *data, void *buffer,
 static bool test_audio_frequencies(struct audio_state *state)
 {
 	int freq, step;
-	int32_t *recv, *buf;
-	double *channel;
-	size_t i, j, streak;
-	size_t recv_len, buf_len, buf_cap, channel_len;
+	int32_t *recv;
+	struct audio_detector **detectors;
+	size_t i, j;
+	size_t recv_len;
+	unsigned int streak;
 	bool success;
 	int capture_chan;
 
@@ -435,70 +452,49 @@ static bool test_audio_frequencies(struct audio_state *state)
 		     "Capture rate (%dHz) doesn't match playback rate (%dHz)\n",
 		     state->capture.rate, state->playback.rate);
 
-	/* Needs to be a multiple of 128, because that's the number of samples
-	 * we get per channel each time we receive an audio page from the
-	 * Chamelium device.
-	 *
-	 * Additionally, this value needs to be high enough to guarantee we
-	 * capture a full period of each sine we generate. If we capture 2048
-	 * samples at a 192KHz sampling rate, we get a full period for a >94Hz
-	 * sines. For lower sampling rates, the capture duration will be
-	 * longer.
+	/* The detectors analyze CAPTURE_SAMPLES samples per channel at once.
+	 * This value needs to be high enough to guarantee we capture a full
+	 * period of each sine we generate. If we capture 2048 samples at a
+	 * 192KHz sampling rate, we get a full period for a >94Hz sines. For
+	 * lower sampling rates, the capture duration will be longer.
+	 */
+	detectors = calloc(state->playback.channels, sizeof(*detectors));
+	igt_assert(detectors);
+	for (j = 0; j < state->playback.channels; j++)
+		detectors[j] = audio_detector_init(state->signal,
+						   state->capture.rate, j,
+						   CAPTURE_SAMPLES);
+
+	/* Each audio page is analyzed as soon as it's received, the signal
+	 * is detected once the last MIN_STREAK windows of every channel
+	 * contained it.
 	 */
-	channel_len = CAPTURE_SAMPLES;
-	channel = malloc(sizeof(double) * channel_len);
-
-	buf_cap = state->capture.channels * channel_len;
-	buf = malloc(sizeof(int32_t) * buf_cap);
-	buf_len = 0;
-
-	recv = NULL;
-	recv_len = 0;
-
 	success = false;
-	streak = 0;
 	while (!success && state->msec < AUDIO_TIMEOUT) {
 		audio_state_receive(state, &recv, &recv_len);
 
-		memcpy(&buf[buf_len], recv, recv_len * sizeof(int32_t));
-		buf_len += recv_len;
-
-		if (buf_len < buf_cap)
-			continue;
-		igt_assert(buf_len == buf_cap);
-
-		igt_debug("Detecting audio signal, t=%d msec\n", state->msec);
-
+		success = true;
 		for (j = 0; j < state->playback.channels; j++) {
 			capture_chan = state->channel_mapping[j];
 			igt_assert(capture_chan >= 0);
-			igt_debug("Processing channel %zu (captured as "
-				  "channel %d)\n",
-				  j, capture_chan);
-
-			audio_extract_channel_s32_le(channel, channel_len, buf,
-						     buf_len,
-						     state->capture.channels,
-						     capture_chan);
 
-			if (audio_signal_detect(state->signal,
-						state->capture.rate, j, channel,
-						channel_len))
-				streak++;
-			else
-				streak = 0;
+			streak = audio_detector_feed_s32_le(detectors[j], recv,
+							    recv_len,
+							    state->capture.channels,
+							    capture_chan);
+			if (streak < MIN_STREAK)
+				success = false;
 		}
-
-		buf_len = 0;
-
-		success = streak == MIN_STREAK * state->playback.channels;
 	}
 
+	igt_debug("Audio signal %sdetected, t=%d msec\n",
+		  success ? "" : "not ", state->msec);
+
 	audio_state_stop(state, success);
 
-	free(recv);
-	free(buf);
-	free(channel);
+	for (j = 0; j < state->playback.channels; j++)
+		audio_detector_fini(detectors[j]);
+	free(detectors);
 	audio_signal_fini(state->signal);
 
 	check_audio_infoframe(state);
@@ -589,8 +585,6 @@ static bool test_audio_flatline(struct audio_state *state)
 	for (i = 0; i < state->playback.channels; i++)
 		falling_edges[i] = -1;
 
-	recv = NULL;
-	recv_len = 0;
 	amp_success = false;
 	streak = 0;
 	while (!amp_success && state->msec < AUDIO_TIMEOUT) {
@@ -669,8 +663,6 @@ static bool test_audio_flatline(struct audio_state *state)
 	success = amp_success && align_success;
 	audio_state_stop(state, success);
 
-	free(recv);
-
 	return success;
 }
 
@@ -63,6 +63,12 @@
  *
  * SUBTEST: blit-reloc-purge-cache
  *
+ * SUBTEST: blit-replay-noreloc
+ * Description: Replay a recorded blit in reset and other batches
+ *
+ * SUBTEST: blit-replay-reloc
+ * Description: Replay a recorded blit in reset and other batches
+ *
  * SUBTEST: crc32
  * Description: Compare cpu and gpu crc32 sums on input object
  *
@@ -94,6 +100,12 @@
  *
  * SUBTEST: offset-control
  *
+ * SUBTEST: pool-enable-after-create
+ * Description: Check bbs created before the batch pool keep their size
+ *
+ * SUBTEST: pooled-bb
+ * Description: Check batches are reused from the batch pool
+ *
  * SUBTEST: purge-bb
  *
  * SUBTEST: render
@@ -843,6 +855,139 @@ static void blit(struct buf_ops *bops,
 	intel_bb_destroy(ibb);
 }
 
+static void blit_replay(struct buf_ops *bops, enum reloc_objects reloc_obj)
+{
+	int i915 = buf_ops_get_fd(bops);
+	struct intel_bb_recording *rec;
+	struct intel_bb *ibb, *ibb2;
+	struct intel_buf *src, *dst;
+	uint64_t flags = I915_EXEC_BLT;
+	uint8_t color;
+	int i;
+
+	if (reloc_obj == RELOC) {
+		ibb = intel_bb_create_with_relocs(i915, PAGE_SIZE);
+		ibb2 = intel_bb_create_with_relocs(i915, PAGE_SIZE);
+	} else {
+		igt_require(gem_uses_full_ppgtt(i915));
+		ibb = intel_bb_create_no_relocs(i915, PAGE_SIZE);
+		ibb2 = intel_bb_create_no_relocs(i915, PAGE_SIZE);
+		flags |= I915_EXEC_NO_RELOC;
+	}
+
+	if (debug_bb) {
+		intel_bb_set_debug(ibb, true);
+		intel_bb_set_debug(ibb2, true);
+	}
+
+	src = create_buf(bops, WIDTH, HEIGHT, COLOR_CC);
+	dst = create_buf(bops, WIDTH, HEIGHT, COLOR_00);
+
+	intel_bb_record_begin(ibb);
+	__emit_blit(ibb, src, dst);
+	intel_bb_emit_bbe(ibb);
+	rec = intel_bb_record_end(ibb);
+
+	intel_bb_exec(ibb, intel_bb_offset(ibb), flags, true);
+	check_buf(dst, COLOR_CC);
+
+	/* The batch is recreated on reset, the copy has to be patched */
+	for (i = 0; i < 8; i++) {
+		color = i * 0x11;
+		fill_buf(src, color);
+		fill_buf(dst, ~color);
+
+		intel_bb_reset(ibb, i & 1);
+		intel_bb_replay(ibb, rec);
+		intel_bb_exec(ibb, intel_bb_offset(ibb), flags, true);
+		check_buf(dst, color);
+	}
+
+	/* Replaying into another bb takes its own addresses */
+	fill_buf(src, COLOR_77);
+	fill_buf(dst, COLOR_00);
+	intel_bb_replay(ibb2, rec);
+	intel_bb_exec(ibb2, intel_bb_offset(ibb2), flags, true);
+	check_buf(dst, COLOR_77);
+
+	intel_bb_recording_destroy(rec);
+	intel_buf_destroy(src);
+	intel_buf_destroy(dst);
+	intel_bb_destroy(ibb2);
+	intel_bb_destroy(ibb);
+}
+
+static void pooled_bb(struct buf_ops *bops)
+{
+	int i915 = buf_ops_get_fd(bops);
+	struct intel_buf *src, *dst;
+	struct intel_bb *ibb;
+	uint32_t handle;
+	uint8_t color;
+	int i;
+
+	intel_bb_pool_enable(i915);
+
+	/* Pooled batches are rounded up to their size class */
+	ibb = intel_bb_create(i915, PAGE_SIZE + 1);
+	igt_assert_eq(ibb->size, 2 * PAGE_SIZE);
+
+	/* An idle batch is reused on reset */
+	handle = ibb->handle;
+	intel_bb_emit_bbe(ibb);
+	intel_bb_exec(ibb, intel_bb_offset(ibb), I915_EXEC_DEFAULT, true);
+	intel_bb_reset(ibb, false);
+	igt_assert_eq(ibb->handle, handle);
+	intel_bb_destroy(ibb);
+
+	/* Busy or not, blits from pooled batches have to land */
+	ibb = intel_bb_create(i915, PAGE_SIZE);
+	src = create_buf(bops, WIDTH, HEIGHT, COLOR_CC);
+	dst = create_buf(bops, WIDTH, HEIGHT, COLOR_00);
+	for (i = 0; i < 16; i++) {
+		color = i * 0x11;
+		fill_buf(src, color);
+
+		__emit_blit(ibb, src, dst);
+		intel_bb_flush_blit(ibb);
+		intel_bb_sync(ibb);
+		check_buf(dst, color);
+	}
+
+	intel_buf_destroy(src);
+	intel_buf_destroy(dst);
+	intel_bb_destroy(ibb);
+
+	intel_bb_pool_disable(i915);
+}
+
+static void pool_enable_after_create(struct buf_ops *bops)
+{
+	int i915 = buf_ops_get_fd(bops);
+	struct intel_bb *ibb;
+	uint32_t size = PAGE_SIZE + 24;
+
+	ibb = intel_bb_create(i915, size);
+
+	/* The batch isn't pooled, so reset must not round its size up */
+	intel_bb_pool_enable(i915);
+	intel_bb_reset(ibb, false);
+	igt_assert_eq(ibb->size, size);
+
+	/* Use the whole batch, the end is padded to a qword */
+	while (intel_bb_offset(ibb) < size - 2 * sizeof(uint32_t))
+		intel_bb_out(ibb, MI_NOOP);
+	intel_bb_emit_bbe(ibb);
+	igt_assert_eq(intel_bb_offset(ibb), size);
+	intel_bb_exec(ibb, intel_bb_offset(ibb), I915_EXEC_DEFAULT, true);
+
+	intel_bb_reset(ibb, true);
+	igt_assert_eq(ibb->size, size);
+	intel_bb_destroy(ibb);
+
+	intel_bb_pool_disable(i915);
+}
+
 static void scratch_buf_init(struct buf_ops *bops,
 			     struct intel_buf *buf,
 			     int width, int height,
@@ -1647,6 +1792,14 @@ igt_main_args("dpibc:", NULL, help_str, opt_handler, NULL)
 	igt_subtest("blit-noreloc-purge-cache")
 		blit(bops, NORELOC, PURGE_CACHE, INTEL_ALLOCATOR_SIMPLE);
 
+	igt_describe("Replay a recorded blit in reset and other batches");
+	igt_subtest("blit-replay-reloc")
+		blit_replay(bops, RELOC);
+
+	igt_describe("Replay a recorded blit in reset and other batches");
+	igt_subtest("blit-replay-noreloc")
+		blit_replay(bops, NORELOC);
+
 	igt_subtest("intel-bb-blit-none")
 		do_intel_bb_blit(bops, 10, I915_TILING_NONE);
 
@@ -1661,6 +1814,14 @@ igt_main_args("dpibc:", NULL, help_str, opt_handler, NULL)
 	igt_subtest("offset-control")
 		offset_control(bops);
 
+	igt_describe("Check batches are reused from the batch pool");
+	igt_subtest("pooled-bb")
+		pooled_bb(bops);
+
+	igt_describe("Check bbs created before the batch pool keep their size");
+	igt_subtest("pool-enable-after-create")
+		pool_enable_after_create(bops);
+
 	igt_subtest("delta-check")
 		delta_check(bops);
 
@@ -48,6 +48,9 @@
  *
  * SUBTEST: prune-stale-modes
  * Description: Tests pruning of stale modes
+ *
+ * SUBTEST: probe-snapshot
+ * Description: Test connector probe results are reused until the outputs are reset
  */
 
 IGT_TEST_DESCRIPTION("Check the debugfs force connector/edid features work"
@@ -298,6 +301,41 @@ static void prune_stale_modes(int drm_fd, drmModeConnectorPtr connector)
 				FORCE_CONNECTOR_UNSPECIFIED);
 }
 
+static int output_connection(igt_display_t *display,
+			     drmModeConnectorPtr connector)
+{
+	igt_output_t *output = igt_output_from_connector(display, connector);
+
+	igt_assert(output && output->config.connector);
+
+	return output->config.connector->connection;
+}
+
+static void probe_snapshot(int drm_fd, drmModeConnectorPtr connector)
+{
+	igt_display_t display;
+
+	igt_display_probe_snapshot(true);
+
+	kmstest_force_connector(drm_fd, connector, FORCE_CONNECTOR_ON);
+	igt_display_require(&display, drm_fd);
+	igt_assert_eq(output_connection(&display, connector),
+		      DRM_MODE_CONNECTED);
+	igt_display_fini(&display);
+
+	/* The next display reuses the probe results of the previous one... */
+	kmstest_force_connector(drm_fd, connector, FORCE_CONNECTOR_OFF);
+	igt_display_require(&display, drm_fd);
+	igt_assert_eq(output_connection(&display, connector),
+		      DRM_MODE_CONNECTED);
+
+	/* ...until the outputs are reset. */
+	igt_display_reset_outputs(&display);
+	igt_assert_eq(output_connection(&display, connector),
+		      DRM_MODE_DISCONNECTED);
+	igt_display_fini(&display);
+}
+
 static int opt_handler(int opt, int opt_index, void *data)
 {
 	switch (opt) {
@@ -410,6 +448,17 @@ end:
 			tests[i].func(drm_fd, connector);
 	}
 
+	igt_describe("Test connector probe results are reused until the outputs are reset.");
+	igt_subtest("probe-snapshot")
+		probe_snapshot(drm_fd, connector);
+
+	igt_fixture {
+		/* Also when probe-snapshot failed halfway through */
+		igt_display_probe_snapshot(false);
+		kmstest_force_connector(drm_fd, connector,
+					FORCE_CONNECTOR_UNSPECIFIED);
+	}
+
 	igt_fixture {
 		drmModeFreeConnector(connector);
 		drm_close_driver(drm_fd);
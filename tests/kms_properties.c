@@ -67,6 +67,11 @@
  * @non-atomic:      legacy
  */
 
+/**
+ * SUBTEST: property-cache
+ * Description: Test cached property values are reused until the next commit
+ */
+
 struct additional_test {
 	const char *name;
 	uint32_t obj_type;
@@ -757,6 +762,50 @@ static void invalid_properties(igt_display_t *display, bool atomic)
 		test_object_invalid_properties(display, output->id, DRM_MODE_OBJECT_CONNECTOR, atomic);
 }
 
+static void property_cache(igt_display_t *display)
+{
+	igt_prop_cache_stats_t stats;
+	igt_output_t *output;
+	igt_plane_t *primary;
+	bool found = false;
+	struct igt_fb fb;
+	uint64_t value;
+	enum pipe pipe;
+
+	igt_display_reset(display);
+	for_each_pipe_with_valid_output(display, pipe, output) {
+		found = true;
+		break;
+	}
+	igt_require(found);
+
+	igt_display_cache_prop_values(display, true);
+	prepare_pipe(display, pipe, output, &fb);
+	primary = igt_pipe_get_plane_type(&display->pipes[pipe],
+					  DRM_PLANE_TYPE_PRIMARY);
+
+	value = igt_plane_get_prop(primary, IGT_PLANE_FB_ID);
+	igt_assert_eq_u64(value, fb.fb_id);
+
+	stats = display->prop_stats;
+	igt_assert_eq_u64(igt_plane_get_prop(primary, IGT_PLANE_CRTC_ID),
+			  display->pipes[pipe].crtc_id);
+	igt_assert_eq_u64(igt_plane_get_prop(primary, IGT_PLANE_FB_ID), value);
+	igt_assert_eq(display->prop_stats.ioctls, stats.ioctls);
+	igt_assert_lt(stats.hits, display->prop_stats.hits);
+
+	/* Commits must drop the cached values. */
+	igt_plane_set_fb(primary, NULL);
+	igt_display_commit2(display, display->is_atomic ? COMMIT_ATOMIC : COMMIT_LEGACY);
+
+	stats = display->prop_stats;
+	igt_assert_eq_u64(igt_plane_get_prop(primary, IGT_PLANE_FB_ID), 0);
+	igt_assert_lt(stats.ioctls, display->prop_stats.ioctls);
+
+	cleanup_pipe(display, pipe, output, &fb);
+	igt_display_cache_prop_values(display, false);
+}
+
 igt_main
 {
 	igt_display_t display;
@@ -833,6 +882,10 @@ igt_main
 			get_prop_sanity(&display, true);
 	}
 
+	igt_describe("Test cached property values are reused until the next commit");
+	igt_subtest("property-cache")
+		property_cache(&display);
+
 	igt_fixture {
 		igt_display_fini(&display);
 		drm_close_driver(display.drm_fd);
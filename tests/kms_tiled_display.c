@@ -399,7 +399,7 @@ static void test_with_chamelium(data_t *data)
 {
 	int i, count = 0;
 	uint8_t htile = 2, vtile = 1;
-	struct edid **edid;
+	const struct edid **edid;
 
 	data->chamelium = chamelium_init(data->drm_fd, &data->display);
 	igt_require(data->chamelium);
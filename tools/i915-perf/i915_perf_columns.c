@@ -0,0 +1,330 @@
+/*
+ * Copyright © 2024 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <i915_drm.h>
+
+#include "i915/perf.h"
+#include "i915/perf_data_reader.h"
+#include "i915_perf_columns.h"
+
+#define MIN(a,b) ((a) > (b) ? (b) : (a))
+
+/* Rows converted and written at once by a thread. */
+#define CHUNK_ROWS 16384
+
+/* Report pairs accumulated at once within a chunk. */
+#define ACCUMULATE_BATCH 256
+
+struct export {
+	const struct intel_perf_data_reader *reader;
+	struct intel_perf_logical_counter **counters;
+	uint32_t n_columns;
+
+	const struct i915_perf_columns_chunk *chunks;
+	uint32_t n_chunks;
+	union i915_perf_columns_value *stats;
+
+	int fd;
+	uint32_t next_chunk;
+	int error;
+};
+
+static bool
+counter_is_float(const struct intel_perf_logical_counter *counter)
+{
+	return counter->storage == INTEL_PERF_LOGICAL_COUNTER_STORAGE_DOUBLE ||
+	       counter->storage == INTEL_PERF_LOGICAL_COUNTER_STORAGE_FLOAT;
+}
+
+static int
+pwrite_all(int fd, const void *data, size_t size, off_t offset)
+{
+	while (size) {
+		ssize_t ret = pwrite(fd, data, size, offset);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		data = (const char *)data + ret;
+		size -= ret;
+		offset += ret;
+	}
+
+	return 0;
+}
+
+static void
+column_stats(const union i915_perf_columns_value *values, uint64_t n,
+	     bool is_float, union i915_perf_columns_value *stats)
+{
+	stats[0] = stats[1] = values[0];
+
+	for (uint64_t i = 1; i < n; i++) {
+		if (is_float) {
+			if (values[i].f < stats[0].f)
+				stats[0].f = values[i].f;
+			if (values[i].f > stats[1].f)
+				stats[1].f = values[i].f;
+		} else {
+			if (values[i].u64 < stats[0].u64)
+				stats[0].u64 = values[i].u64;
+			if (values[i].u64 > stats[1].u64)
+				stats[1].u64 = values[i].u64;
+		}
+	}
+}
+
+static void
+convert_chunk(struct export *export, uint32_t chunk,
+	      struct intel_perf_accumulator *accs,
+	      union i915_perf_columns_value *values)
+{
+	const struct intel_perf_data_reader *reader = export->reader;
+	const struct drm_i915_perf_record_header **records =
+		reader->records + (uint64_t)chunk * CHUNK_ROWS;
+	uint64_t n_rows = export->chunks[chunk].n_rows;
+	union i915_perf_columns_value *stats =
+		export->stats + (uint64_t)chunk * export->n_columns * 2;
+
+	for (uint64_t row = 0; row < n_rows; row += ACCUMULATE_BATCH) {
+		uint32_t n = MIN(n_rows - row, ACCUMULATE_BATCH);
+
+		intel_perf_accumulate_report_batch(accs,
+						   reader->perf, reader->metric_set,
+						   records + row, n + 1);
+
+		for (uint32_t i = 0; i < n; i++)
+			values[row + i].u64 =
+				intel_perf_read_record_timestamp(reader->perf,
+								 reader->metric_set,
+								 records[row + i]);
+
+		for (uint32_t c = 1; c < export->n_columns; c++) {
+			const struct intel_perf_logical_counter *counter =
+				export->counters[c - 1];
+			union i915_perf_columns_value *column =
+				values + c * n_rows + row;
+
+			if (counter_is_float(counter))
+				intel_perf_read_counter_batch_float(reader->perf, counter,
+								    accs, n, &column->f);
+			else
+				intel_perf_read_counter_batch_uint64(reader->perf, counter,
+								     accs, n, &column->u64);
+		}
+	}
+
+	column_stats(values, n_rows, false, stats);
+	for (uint32_t c = 1; c < export->n_columns; c++)
+		column_stats(values + c * n_rows, n_rows,
+			     counter_is_float(export->counters[c - 1]),
+			     stats + c * 2);
+}
+
+static void *
+export_thread(void *data)
+{
+	struct export *export = data;
+	struct intel_perf_accumulator *accs;
+	union i915_perf_columns_value *values;
+
+	accs = calloc(ACCUMULATE_BATCH, sizeof(*accs));
+	values = calloc((size_t)CHUNK_ROWS * export->n_columns, sizeof(*values));
+	if (!accs || !values) {
+		__atomic_store_n(&export->error, -ENOMEM, __ATOMIC_RELAXED);
+		goto out;
+	}
+
+	for (;;) {
+		uint32_t chunk = __atomic_fetch_add(&export->next_chunk, 1,
+						    __ATOMIC_RELAXED);
+		int ret;
+
+		if (chunk >= export->n_chunks ||
+		    __atomic_load_n(&export->error, __ATOMIC_RELAXED))
+			break;
+
+		convert_chunk(export, chunk, accs, values);
+
+		ret = pwrite_all(export->fd, values,
+				 export->chunks[chunk].n_rows *
+				 export->n_columns * sizeof(*values),
+				 export->chunks[chunk].offset);
+		if (ret) {
+			__atomic_store_n(&export->error, ret, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+
+out:
+	free(values);
+	free(accs);
+
+	return NULL;
+}
+
+/**
+ * i915_perf_export_columns:
+ * @reader: a loaded recording
+ * @counters: the logical counters to export
+ * @n_counters: number of counters
+ * @path: output file
+ *
+ * Evaluates @counters for every pair of consecutive reports of @reader and
+ * writes them in the columnar format described in i915_perf_columns.h. The
+ * capture is split into chunks of CHUNK_ROWS rows which are converted in
+ * parallel, one thread per CPU. The location of each chunk in the file only
+ * depends on its size, so threads write their chunks as soon as they are
+ * done and the headers are written last.
+ *
+ * Returns: 0 on success, a negative errno otherwise.
+ */
+int
+i915_perf_export_columns(const struct intel_perf_data_reader *reader,
+			 struct intel_perf_logical_counter **counters,
+			 uint32_t n_counters,
+			 const char *path)
+{
+	struct i915_perf_columns_header header = {
+		.version = I915_PERF_COLUMNS_VERSION,
+		.n_columns = n_counters + 1,
+		.chunk_rows = CHUNK_ROWS,
+	};
+	struct i915_perf_columns_column *columns;
+	struct i915_perf_columns_chunk *chunks;
+	struct export export = {
+		.reader = reader,
+		.counters = counters,
+		.n_columns = n_counters + 1,
+	};
+	size_t columns_size, chunks_size, stats_size;
+	pthread_t *threads;
+	long n_threads;
+	uint64_t offset;
+	int ret;
+
+	memcpy(header.magic, I915_PERF_COLUMNS_MAGIC, sizeof(header.magic));
+	header.n_rows = reader->n_records > 1 ? reader->n_records - 1 : 0;
+	header.n_chunks = (header.n_rows + CHUNK_ROWS - 1) / CHUNK_ROWS;
+	snprintf(header.metric_set, sizeof(header.metric_set), "%s",
+		 reader->metric_set->symbol_name);
+
+	columns_size = header.n_columns * sizeof(*columns);
+	chunks_size = header.n_chunks * sizeof(*chunks);
+	stats_size = (size_t)header.n_chunks * header.n_columns * 2 *
+		     sizeof(*export.stats);
+
+	columns = calloc(header.n_columns, sizeof(*columns));
+	chunks = calloc(header.n_chunks ?: 1, sizeof(*chunks));
+	export.stats = calloc(stats_size ?: 1, 1);
+	assert(columns && chunks && export.stats);
+
+	snprintf(columns[0].name, sizeof(columns[0].name), "timestamp");
+	columns[0].type = I915_PERF_COLUMNS_UINT64;
+	for (uint32_t c = 0; c < n_counters; c++) {
+		snprintf(columns[c + 1].name, sizeof(columns[c + 1].name), "%s",
+			 counters[c]->symbol_name);
+		columns[c + 1].type = counter_is_float(counters[c]) ?
+			I915_PERF_COLUMNS_DOUBLE : I915_PERF_COLUMNS_UINT64;
+	}
+
+	offset = sizeof(header) + columns_size + chunks_size + stats_size;
+	header.data_offset = (offset + 4095) & ~4095ull;
+
+	offset = header.data_offset;
+	for (uint32_t i = 0; i < header.n_chunks; i++) {
+		chunks[i].offset = offset;
+		chunks[i].n_rows = MIN(header.n_rows - (uint64_t)i * CHUNK_ROWS,
+				       CHUNK_ROWS);
+		offset += chunks[i].n_rows * header.n_columns *
+			  sizeof(union i915_perf_columns_value);
+	}
+
+	export.chunks = chunks;
+	export.n_chunks = header.n_chunks;
+
+	export.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (export.fd < 0) {
+		ret = -errno;
+		goto out;
+	}
+
+	n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n_threads > header.n_chunks)
+		n_threads = header.n_chunks;
+	if (n_threads < 1)
+		n_threads = 1;
+
+	threads = calloc(n_threads, sizeof(*threads));
+	assert(threads);
+
+	for (long i = 0; i < n_threads; i++) {
+		ret = pthread_create(&threads[i], NULL, export_thread, &export);
+		if (ret) {
+			__atomic_store_n(&export.error, -ret, __ATOMIC_RELAXED);
+			n_threads = i;
+			break;
+		}
+	}
+
+	for (long i = 0; i < n_threads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	ret = export.error;
+	if (!ret)
+		ret = pwrite_all(export.fd, columns, columns_size, sizeof(header));
+	if (!ret)
+		ret = pwrite_all(export.fd, chunks, chunks_size,
+				 sizeof(header) + columns_size);
+	if (!ret)
+		ret = pwrite_all(export.fd, export.stats, stats_size,
+				 sizeof(header) + columns_size + chunks_size);
+	/* The header goes last so that a partial file is never valid. */
+	if (!ret)
+		ret = pwrite_all(export.fd, &header, sizeof(header), 0);
+	if (!ret && ftruncate(export.fd, offset))
+		ret = -errno;
+
+	close(export.fd);
+out:
+	free(export.stats);
+	free(chunks);
+	free(columns);
+
+	return ret;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright © 2024 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef I915_PERF_COLUMNS_H
+#define I915_PERF_COLUMNS_H
+
+#include <stdint.h>
+
+struct intel_perf_data_reader;
+struct intel_perf_logical_counter;
+
+/*
+ * Layout of the columnar export of i915-perf-reader (--export). One row is
+ * written per pair of consecutive reports, all values are 8 bytes wide and
+ * in host byte order:
+ *
+ *   struct i915_perf_columns_header
+ *   struct i915_perf_columns_column columns[n_columns]
+ *   struct i915_perf_columns_chunk chunks[n_chunks]
+ *   union i915_perf_columns_value stats[n_chunks][n_columns][2] (min, max)
+ *   (padding up to data_offset)
+ *   chunk data, for each chunk:
+ *     union i915_perf_columns_value values[n_columns][chunk.n_rows]
+ *
+ * Column 0 is the GPU timestamp of the first report of each pair, the other
+ * columns are the exported logical counters.
+ */
+
+#define I915_PERF_COLUMNS_MAGIC "I915PCOL"
+#define I915_PERF_COLUMNS_VERSION 1
+
+enum i915_perf_columns_type {
+	I915_PERF_COLUMNS_UINT64,
+	I915_PERF_COLUMNS_DOUBLE,
+};
+
+struct i915_perf_columns_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t n_columns;
+	uint64_t n_rows;
+	uint32_t n_chunks;
+	uint32_t chunk_rows; /* Rows per chunk, except for the last one. */
+	uint64_t data_offset; /* Offset of the first chunk. */
+	char metric_set[64];
+};
+
+struct i915_perf_columns_column {
+	char name[64];
+	uint32_t type; /* enum i915_perf_columns_type */
+	uint32_t pad;
+};
+
+struct i915_perf_columns_chunk {
+	uint64_t offset;
+	uint64_t n_rows;
+};
+
+union i915_perf_columns_value {
+	uint64_t u64;
+	double f;
+};
+
+int i915_perf_export_columns(const struct intel_perf_data_reader *reader,
+			     struct intel_perf_logical_counter **counters,
+			     uint32_t n_counters,
+			     const char *path);
+
+#endif /* I915_PERF_COLUMNS_H */
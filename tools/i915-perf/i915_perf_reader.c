@@ -40,6 +40,7 @@
 #include "intel_chipset.h"
 #include "i915/perf.h"
 #include "i915/perf_data_reader.h"
+#include "i915_perf_columns.h"
 
 #define MAX(a,b) ((a) > (b) ? (a) : (b))
 #define MIN(a,b) ((a) > (b) ? (b) : (a))
@@ -54,7 +55,13 @@ usage(void)
 	       "     --counters, -c c1,c2,...  List of counters to display values for.\n"
 	       "                               Use 'all' to display all counters.\n"
 	       "                               Use 'list' to list available counters.\n"
-	       "     --reports, -r             Print out data per report.\n");
+	       "     --reports, -r             Print out data per report.\n"
+	       "     --window, -w start,end    Only print the timeline between two CPU\n"
+	       "                               timestamps (ns), streaming the recording\n"
+	       "                               instead of loading all of it.\n"
+	       "     --export, -e file         Write the counters of every report pair\n"
+	       "                               to a columnar file (all counters unless\n"
+	       "                               --counters is given).\n");
 }
 
 static struct intel_perf_logical_counter *
@@ -166,8 +173,28 @@ get_logical_counters(struct intel_perf_metric_set *metric_set,
 	return counters;
 }
 
+static bool
+counter_is_float(const struct intel_perf_logical_counter *counter)
+{
+	return counter->storage == INTEL_PERF_LOGICAL_COUNTER_STORAGE_DOUBLE ||
+	       counter->storage == INTEL_PERF_LOGICAL_COUNTER_STORAGE_FLOAT;
+}
+
 static void
-print_report_deltas(const struct intel_perf_data_reader *reader,
+print_counter_value(const struct intel_perf_logical_counter *counter,
+		    bool is_float, uint64_t value_uint64, double value_float)
+{
+	if (is_float)
+		fprintf(stdout, "   %s: %f\n",
+			counter->symbol_name, value_float);
+	else
+		fprintf(stdout, "   %s: %" PRIu64 "\n",
+			counter->symbol_name, value_uint64);
+}
+
+static void
+print_report_deltas(const struct intel_perf *perf,
+		    const struct intel_perf_metric_set *metric_set,
 		    const struct drm_i915_perf_record_header *i915_report0,
 		    const struct drm_i915_perf_record_header *i915_report1,
 		    struct intel_perf_logical_counter **counters,
@@ -175,31 +202,170 @@ print_report_deltas(const struct intel_perf_data_reader *reader,
 {
 	struct intel_perf_accumulator accu;
 
-	intel_perf_accumulate_reports(&accu,
-				      reader->perf, reader->metric_set,
+	intel_perf_accumulate_reports(&accu, perf, metric_set,
 				      i915_report0, i915_report1);
 
 	for (uint32_t c = 0; c < n_counters; c++) {
 		struct intel_perf_logical_counter *counter = counters[c];
 
-		switch (counter->storage) {
-		case INTEL_PERF_LOGICAL_COUNTER_STORAGE_UINT64:
-		case INTEL_PERF_LOGICAL_COUNTER_STORAGE_UINT32:
-		case INTEL_PERF_LOGICAL_COUNTER_STORAGE_BOOL32:
-			fprintf(stdout, "   %s: %" PRIu64 "\n",
-				counter->symbol_name, counter->read_uint64(reader->perf,
-									   reader->metric_set,
-									   accu.deltas));
-			break;
-		case INTEL_PERF_LOGICAL_COUNTER_STORAGE_DOUBLE:
-		case INTEL_PERF_LOGICAL_COUNTER_STORAGE_FLOAT:
-			fprintf(stdout, "   %s: %f\n",
-				counter->symbol_name, counter->read_float(reader->perf,
-									  reader->metric_set,
-									  accu.deltas));
-			break;
+		if (counter_is_float(counter))
+			print_counter_value(counter, true, 0,
+					    counter->read_float(perf, metric_set,
+								accu.deltas));
+		else
+			print_counter_value(counter, false,
+					    counter->read_uint64(perf, metric_set,
+								 accu.deltas), 0);
+	}
+}
+
+/* Number of report pairs decoded and evaluated at once by print_timeline_reports(). */
+#define REPORT_BATCH 256
+
+static void
+print_timeline_reports(const struct intel_perf_data_reader *reader,
+		       uint32_t record_start, uint32_t record_end,
+		       struct intel_perf_logical_counter **counters,
+		       uint32_t n_counters)
+{
+	struct intel_perf_accumulator *accs;
+	uint64_t *values_uint64;
+	double *values_float;
+	bool *is_float;
+
+	accs = calloc(REPORT_BATCH, sizeof(*accs));
+	values_uint64 = calloc((size_t)n_counters * REPORT_BATCH, sizeof(*values_uint64));
+	values_float = calloc((size_t)n_counters * REPORT_BATCH, sizeof(*values_float));
+	is_float = calloc(n_counters, sizeof(*is_float));
+	assert(accs && values_uint64 && values_float && is_float);
+
+	/* Look at the storage once, not for every report. */
+	for (uint32_t c = 0; c < n_counters; c++)
+		is_float[c] = counter_is_float(counters[c]);
+
+	for (uint32_t start = record_start; start < record_end; start += REPORT_BATCH) {
+		uint32_t n = MIN(record_end - start, REPORT_BATCH);
+
+		intel_perf_accumulate_report_batch(accs,
+						   reader->perf, reader->metric_set,
+						   &reader->records[start], n + 1);
+
+		/* Evaluate one counter at a time over the whole batch. */
+		for (uint32_t c = 0; c < n_counters; c++) {
+			if (is_float[c])
+				intel_perf_read_counter_batch_float(reader->perf, counters[c],
+								    accs, n,
+								    values_float + c * REPORT_BATCH);
+			else
+				intel_perf_read_counter_batch_uint64(reader->perf, counters[c],
+								     accs, n,
+								     values_uint64 + c * REPORT_BATCH);
+		}
+
+		for (uint32_t i = 0; i < n; i++) {
+			uint32_t r = start + i;
+
+			fprintf(stdout, " report%i = %s\n",
+				r - record_start,
+				intel_perf_read_report_reason(reader->perf, reader->records[r]));
+			for (uint32_t c = 0; c < n_counters; c++)
+				print_counter_value(counters[c], is_float[c],
+						    values_uint64[c * REPORT_BATCH + i],
+						    values_float[c * REPORT_BATCH + i]);
 		}
 	}
+
+	free(is_float);
+	free(values_float);
+	free(values_uint64);
+	free(accs);
+}
+
+static int
+print_window(int fd, const char *path, const char *counter_names,
+	     uint64_t window_start, uint64_t window_end)
+{
+	struct intel_perf_data_stream stream;
+	struct intel_perf_logical_counter **counters;
+	struct intel_perf_timeline_item item;
+	const struct intel_device_info *devinfo;
+	int32_t n_counters;
+	int ret = EXIT_FAILURE;
+	int err;
+
+	if (!intel_perf_data_stream_init(&stream, fd)) {
+		fprintf(stderr, "Unable to parse '%s': %s.\n",
+			path, stream.error_msg);
+		goto exit;
+	}
+
+	counters = get_logical_counters(stream.metric_set, counter_names, &n_counters);
+	if (n_counters < 0) {
+		ret = EXIT_SUCCESS;
+		goto exit;
+	}
+
+	devinfo = intel_get_device_info(stream.devinfo.devid);
+
+	fprintf(stdout, "Recorded on device=0x%x(%s) graphics_ver=%i\n",
+		stream.devinfo.devid, devinfo->codename,
+		stream.devinfo.graphics_ver);
+	fprintf(stdout, "Metric used : %s (%s) uuid=%s\n",
+		stream.metric_set->symbol_name, stream.metric_set->name,
+		stream.metric_set->hw_config_guid);
+	fprintf(stdout, "Reports: %"PRIu64"\n", stream.n_records);
+	fprintf(stdout, "Timestamp correlation points: %u\n", stream.n_correlations);
+
+	if (stream.n_correlations < 2) {
+		fprintf(stderr, "Less than 2 CPU/GPU timestamp correlation points.\n");
+		goto free_counters;
+	}
+
+	if (strcmp(stream.metric_set_uuid, stream.metric_set->hw_config_guid)) {
+		fprintf(stdout,
+			"WARNING: Recording used a different HW configuration.\n"
+			"WARNING: This could lead to inconsistent counter values.\n");
+	}
+
+	err = intel_perf_data_stream_seek_cpu_timestamp(&stream, window_start);
+	if (err == -ERANGE) {
+		ret = EXIT_SUCCESS;
+		goto free_counters;
+	}
+	if (err)
+		goto read_error;
+
+	while ((err = intel_perf_data_stream_next_timeline_item(&stream, &item)) > 0) {
+		if (item.cpu_ts_start > window_end)
+			break;
+
+		fprintf(stdout, "Time: CPU=0x%016" PRIx64 "-0x%016" PRIx64
+			" GPU=0x%016" PRIx64 "-0x%016" PRIx64"\n",
+			item.cpu_ts_start, item.cpu_ts_end,
+			item.ts_start, item.ts_end);
+		fprintf(stdout, "hw_id=0x%x %s\n",
+			item.hw_id, item.hw_id == 0xffffffff ? "(idle)" : "");
+
+		print_report_deltas(stream.perf, stream.metric_set,
+				    stream.timeline_record_start,
+				    stream.timeline_record_end,
+				    counters, n_counters);
+	}
+
+	if (err >= 0) {
+		ret = EXIT_SUCCESS;
+		goto free_counters;
+	}
+
+ read_error:
+	fprintf(stderr, "Unable to read '%s': %s.\n", path, stream.error_msg);
+ free_counters:
+	free(counters);
+ exit:
+	intel_perf_data_stream_fini(&stream);
+	close(fd);
+
+	return ret;
 }
 
 int
@@ -209,6 +375,8 @@ main(int argc, char *argv[])
 		{"help",             no_argument, 0, 'h'},
 		{"counters",   required_argument, 0, 'c'},
 		{"reports",          no_argument, 0, 'r'},
+		{"window",     required_argument, 0, 'w'},
+		{"export",     required_argument, 0, 'e'},
 		{0, 0, 0, 0}
 	};
 	struct intel_perf_data_reader reader;
@@ -218,8 +386,11 @@ main(int argc, char *argv[])
 	int32_t n_counters;
 	int fd, opt;
 	bool print_reports = false;
+	uint64_t window_start = 0, window_end = 0;
+	bool window = false;
+	const char *export_path = NULL;
 
-	while ((opt = getopt_long(argc, argv, "hc:r", long_options, NULL)) != -1) {
+	while ((opt = getopt_long(argc, argv, "hc:rw:e:", long_options, NULL)) != -1) {
 		switch (opt) {
 		case 'h':
 			usage();
@@ -230,6 +401,19 @@ main(int argc, char *argv[])
 		case 'r':
 			print_reports = true;
 			break;
+		case 'w':
+			if (sscanf(optarg, "%"SCNu64",%"SCNu64,
+				   &window_start, &window_end) != 2 ||
+			    window_start > window_end) {
+				fprintf(stderr, "Invalid window '%s'.\n", optarg);
+				usage();
+				return EXIT_FAILURE;
+			}
+			window = true;
+			break;
+		case 'e':
+			export_path = optarg;
+			break;
 		default:
 			fprintf(stderr, "Internal error: "
 				"unexpected getopt value: %d\n", opt);
@@ -250,6 +434,16 @@ main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
+	if (window) {
+		if (print_reports) {
+			fprintf(stderr, "--reports is not supported with --window.\n");
+			return EXIT_FAILURE;
+		}
+
+		return print_window(fd, argv[optind], counter_names,
+				    window_start, window_end);
+	}
+
 	if (!intel_perf_data_reader_init(&reader, fd)) {
 		fprintf(stderr, "Unable to parse '%s': %s.\n",
 			argv[optind], reader.error_msg);
@@ -260,6 +454,27 @@ main(int argc, char *argv[])
 	if (n_counters < 0)
 		goto exit;
 
+	if (export_path) {
+		int ret;
+
+		if (!counter_names)
+			counters = get_logical_counters(reader.metric_set, "all",
+							&n_counters);
+
+		ret = i915_perf_export_columns(&reader, counters, n_counters,
+					       export_path);
+		if (ret) {
+			fprintf(stderr, "Unable to export to '%s': %s.\n",
+				export_path, strerror(-ret));
+			intel_perf_data_reader_fini(&reader);
+			return EXIT_FAILURE;
+		}
+
+		fprintf(stdout, "Exported %u counters of %u reports to '%s'\n",
+			n_counters, reader.n_records, export_path);
+		goto exit;
+	}
+
 	devinfo = intel_get_device_info(reader.devinfo.devid);
 
 	fprintf(stdout, "Recorded on device=0x%x(%s) graphics_ver=%i\n",
@@ -318,22 +533,15 @@ main(int argc, char *argv[])
 		fprintf(stdout, "hw_id=0x%x %s\n",
 			item->hw_id, item->hw_id == 0xffffffff ? "(idle)" : "");
 
-		print_report_deltas(&reader,
+		print_report_deltas(reader.perf, reader.metric_set,
 				    reader.records[item->record_start],
 				    reader.records[item->record_end],
 				    counters, n_counters);
 
-		if (print_reports) {
-			for (uint32_t r = item->record_start; r < item->record_end; r++) {
-				fprintf(stdout, " report%i = %s\n",
-					r - item->record_start,
-					intel_perf_read_report_reason(reader.perf, reader.records[r]));
-				print_report_deltas(&reader,
-						    reader.records[r],
-						    reader.records[r + 1],
-						    counters, n_counters);
-			}
-		}
+		if (print_reports)
+			print_timeline_reports(&reader,
+					       item->record_start, item->record_end,
+					       counters, n_counters);
 	}
 
  exit:
@@ -33,11 +33,97 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <time.h>
 
 #include "i915/intel_decode.h"
 
 struct intel_decode *ctx;
 
+static enum {
+	DECODE,
+	FIND,
+	BENCHMARK,
+} mode = DECODE;
+static uint32_t find_value, find_mask = 0xffff0000;
+static FILE *null_file;
+
+static double
+elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) +
+		1e-9 * (now.tv_nsec - start->tv_nsec);
+}
+
+static void
+find_batch(int count)
+{
+	uint32_t *offsets;
+	int found, i;
+
+	offsets = calloc(count, sizeof(*offsets));
+	if (offsets == NULL) {
+		fprintf(stderr, "Out of memory.\n");
+		exit(1);
+	}
+
+	found = intel_decode_find(ctx, find_mask, find_value, offsets, count);
+	for (i = 0; i < found; i++)
+		printf("0x%08x\n", offsets[i]);
+
+	free(offsets);
+}
+
+static void
+benchmark_batch(int count)
+{
+	struct timespec start;
+	double decode, find;
+	int loops;
+
+	intel_decode_set_output_file(ctx, null_file);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	loops = 0;
+	do {
+		intel_decode(ctx);
+		loops++;
+	} while (elapsed(&start) < 1);
+	decode = elapsed(&start) / loops;
+	intel_decode_set_output_file(ctx, stdout);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	loops = 0;
+	do {
+		intel_decode_find(ctx, find_mask, find_value, NULL, 0);
+		loops++;
+	} while (elapsed(&start) < 1);
+	find = elapsed(&start) / loops;
+
+	printf("%d dwords: decode %.1f MiB/s, find %.1f MiB/s\n", count,
+	       4.0 * count / decode / (1 << 20),
+	       4.0 * count / find / (1 << 20));
+}
+
+static void
+process_batch(void *data, uint32_t offset, int count)
+{
+	intel_decode_set_batch_pointer(ctx, data, offset, count);
+
+	switch (mode) {
+	case DECODE:
+		intel_decode(ctx);
+		break;
+	case FIND:
+		find_batch(count);
+		break;
+	case BENCHMARK:
+		benchmark_batch(count);
+		break;
+	}
+}
+
 static void
 read_bin_file(const char * filename)
 {
@@ -58,8 +144,7 @@ read_bin_file(const char * filename)
 
 	offset = 0;
 	while ((ret = read (fd, buf, sizeof(buf))) > 0) {
-		intel_decode_set_batch_pointer(ctx, buf, offset, ret/4);
-		intel_decode(ctx);
+		process_batch(buf, offset, ret/4);
 		offset += ret;
 	}
 	close (fd);
@@ -112,8 +197,7 @@ read_data_file(const char * filename)
     }
 
     if (count) {
-	intel_decode_set_batch_pointer(ctx, data, gtt_offset, count);
-	intel_decode(ctx);
+	process_batch(data, gtt_offset, count);
     }
 
     free (data);
@@ -166,12 +250,14 @@ main (int argc, char *argv[])
 		{"devid", 1, 0, 'd'},
 		{"ascii", 0, 0, 'a'},
 		{"binary", 0, 0, 'b'},
+		{"find", 1, 0, 'f'},
+		{"benchmark", 0, 0, 'B'},
 		{ 0 }
 	};
 
 	devid_str = getenv("INTEL_DEVID_OVERRIDE");
 
-	while((c = getopt_long(argc, argv, "ad:b",
+	while((c = getopt_long(argc, argv, "ad:bf:B",
 			       long_options, &option_index)) != -1) {
 		switch(c) {
 		case 'd':
@@ -183,6 +269,17 @@ main (int argc, char *argv[])
 		case 'a':
 			binary = 0;
 			break;
+		case 'f':
+			/* <header>[:<mask>], e.g. 0x7a000000 for PIPE_CONTROL */
+			find_value = strtoul(optarg, &optarg, 0);
+			if (*optarg == ':')
+				find_mask = strtoul(optarg + 1, NULL, 0);
+			find_value &= find_mask;
+			mode = FIND;
+			break;
+		case 'B':
+			mode = BENCHMARK;
+			break;
 		default:
 			printf("unkown command options\n");
 			break;
@@ -194,6 +291,15 @@ main (int argc, char *argv[])
 
 	ctx = intel_decode_context_alloc(devid);
 
+	if (mode == BENCHMARK) {
+		null_file = fopen("/dev/null", "w");
+		if (null_file == NULL) {
+			fprintf(stderr, "Failed to open /dev/null: %s\n",
+				strerror(errno));
+			exit(1);
+		}
+	}
+
 	if (optind == argc) {
 		fprintf(stderr, "no input file given\n");
 		exit(-1);
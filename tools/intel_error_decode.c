@@ -49,8 +49,11 @@
 #include <sys/stat.h>
 #include <err.h>
 #include <assert.h>
-#include <zlib.h>
 #include <ctype.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <time.h>
 
 #include "intel_chipset.h"
 #include "intel_io.h"
@@ -58,6 +61,7 @@
 #include "intel_reg.h"
 #include "drmtest.h"
 #include "i915/intel_decode.h"
+#include "i915/intel_error_state.h"
 
 static uint32_t
 print_head(unsigned int reg)
@@ -479,92 +483,264 @@ static void decode(struct intel_decode *ctx,
 	*count = 0;
 }
 
-static int zlib_inflate(uint32_t **ptr, int len)
-{
-	struct z_stream_s zstream;
-	void *out;
+/*
+ * With an mmap()ed input, the ascii85 blobs are decoded ahead of the printing
+ * by a pool of threads. Workers claim the blob lines in file order, so blob N
+ * as seen by read_data() ends up in slots[N % BLOB_SLOTS], and do not run more
+ * than BLOB_SLOTS blobs ahead of the consumer to bound the memory usage.
+ */
+#define BLOB_SLOTS 64
 
-	memset(&zstream, 0, sizeof(zstream));
+struct blob_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
 
-	zstream.next_in = (unsigned char *)*ptr;
-	zstream.avail_in = 4*len;
+	const char *pos, *end; /* Scanning position of the workers. */
+	uint64_t next; /* Next blob to be claimed by a worker. */
+	uint64_t consumed; /* Next blob to be handed to read_data(). */
+	bool stop;
 
-	if (inflateInit(&zstream) != Z_OK)
-		return 0;
+	struct {
+		uint32_t *data;
+		int count;
+		bool done;
+	} slots[BLOB_SLOTS];
 
-	out = malloc(128*4096); /* approximate obj size */
-	zstream.next_out = out;
-	zstream.avail_out = 128*4096;
+	pthread_t *threads;
+	int num_threads;
+};
 
-	do {
-		switch (inflate(&zstream, Z_SYNC_FLUSH)) {
-		case Z_STREAM_END:
-			goto end;
-		case Z_OK:
-			break;
-		default:
-			inflateEnd(&zstream);
-			return 0;
+static const char *
+next_blob_line(const char **pos, const char *end, size_t *len, bool *inflate)
+{
+	while (*pos < end) {
+		const char *line = *pos;
+		const char *eol = memchr(line, '\n', end - line) ?: end;
+
+		*pos = eol < end ? eol + 1 : end;
+		if (line[0] == ':' || line[0] == '~') {
+			*len = eol - line - 1;
+			*inflate = line[0] == ':';
+			return line + 1;
 		}
+	}
+
+	return NULL;
+}
+
+static void *blob_worker(void *arg)
+{
+	struct blob_pool *pool = arg;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		const char *text;
+		uint32_t *data;
+		uint64_t blob;
+		bool inflate;
+		size_t len;
+		int count;
+
+		while (!pool->stop && pool->next >= pool->consumed + BLOB_SLOTS)
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		if (pool->stop)
+			break;
 
-		if (zstream.avail_out)
+		text = next_blob_line(&pool->pos, pool->end, &len, &inflate);
+		if (!text)
 			break;
 
-		out = realloc(out, 2*zstream.total_out);
-		if (out == NULL) {
-			inflateEnd(&zstream);
-			return 0;
-		}
+		blob = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+
+		count = intel_error_state_decode_ascii85(text, len, inflate, &data);
 
-		zstream.next_out = (unsigned char *)out + zstream.total_out;
-		zstream.avail_out = zstream.total_out;
-	} while (1);
-end:
-	inflateEnd(&zstream);
-	free(*ptr);
-	*ptr = out;
-	return zstream.total_out / 4;
+		pthread_mutex_lock(&pool->lock);
+		pool->slots[blob % BLOB_SLOTS].data = data;
+		pool->slots[blob % BLOB_SLOTS].count = count;
+		pool->slots[blob % BLOB_SLOTS].done = true;
+		pthread_cond_broadcast(&pool->cond);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
 }
 
-static int ascii85_decode(const char *in, uint32_t **out, bool inflate)
+static struct blob_pool *
+blob_pool_create(const char *data, size_t size, int num_threads)
 {
-	int len = 0, size = 1024;
+	struct blob_pool *pool;
 
-	*out = realloc(*out, sizeof(uint32_t)*size);
-	if (*out == NULL)
-		return 0;
+	pool = calloc(1, sizeof(*pool));
+	assert(pool);
 
-	while (*in >= '!' && *in <= 'z') {
-		uint32_t v = 0;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+	pool->pos = data;
+	pool->end = data + size;
 
-		if (len == size) {
-			size *= 2;
-			*out = realloc(*out, sizeof(uint32_t)*size);
-			if (*out == NULL)
-				return 0;
-		}
+	pool->threads = calloc(num_threads, sizeof(*pool->threads));
+	assert(pool->threads);
+	for (int i = 0; i < num_threads; i++) {
+		if (pthread_create(&pool->threads[i], NULL, blob_worker, pool))
+			break;
+		pool->num_threads++;
+	}
 
-		if (*in == 'z') {
-			in++;
-		} else {
-			v += in[0] - 33; v *= 85;
-			v += in[1] - 33; v *= 85;
-			v += in[2] - 33; v *= 85;
-			v += in[3] - 33; v *= 85;
-			v += in[4] - 33;
-			in += 5;
+	if (!pool->num_threads) {
+		free(pool->threads);
+		free(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+/* Returns the next blob in file order, the caller owns *data. */
+static int blob_pool_get(struct blob_pool *pool, uint32_t **data)
+{
+	uint64_t blob;
+	int count;
+
+	pthread_mutex_lock(&pool->lock);
+	blob = pool->consumed;
+	while (!pool->slots[blob % BLOB_SLOTS].done)
+		pthread_cond_wait(&pool->cond, &pool->lock);
+
+	*data = pool->slots[blob % BLOB_SLOTS].data;
+	count = pool->slots[blob % BLOB_SLOTS].count;
+	pool->slots[blob % BLOB_SLOTS].done = false;
+	pool->consumed++;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	return count;
+}
+
+static void blob_pool_destroy(struct blob_pool *pool)
+{
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (int i = 0; i < pool->num_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	/* Blobs decoded ahead but never consumed. */
+	for (int i = 0; i < BLOB_SLOTS; i++) {
+		if (pool->slots[i].done)
+			free(pool->slots[i].data);
+	}
+
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->threads);
+	free(pool);
+}
+
+struct input {
+	FILE *file; /* getline() mode */
+
+	const char *map, *pos, *end; /* mmap() mode */
+	size_t map_size;
+	struct blob_pool *pool;
+
+	char *line;
+	size_t line_size;
+
+	/* The ascii85 data of the current line if it is a blob. */
+	const char *blob;
+	size_t blob_len;
+};
+
+static ssize_t input_getline(struct input *in)
+{
+	const char *line, *eol;
+	size_t len;
+
+	if (in->file) {
+		ssize_t ret = getline(&in->line, &in->line_size, in->file);
+
+		if (ret > 0) {
+			in->blob = in->line + 1;
+			in->blob_len = ret - 1;
 		}
-		(*out)[len++] = v;
+		return ret;
 	}
 
-	if (!inflate)
-		return len;
+	if (in->pos >= in->end)
+		return -1;
+
+	line = in->pos;
+	eol = memchr(line, '\n', in->end - line);
+	len = eol ? eol - line + 1 : in->end - line;
+	in->pos = line + len;
 
-	return zlib_inflate(out, len);
+	/* Blob lines can be huge and are not copied, see input_blob(). */
+	if (line[0] == ':' || line[0] == '~') {
+		in->blob = line + 1;
+		in->blob_len = len - 1;
+		len = 1;
+	}
+
+	if (len + 1 > in->line_size) {
+		in->line_size = len + 1;
+		in->line = realloc(in->line, in->line_size);
+		assert(in->line);
+	}
+	memcpy(in->line, line, len);
+	in->line[len] = '\0';
+
+	return len;
+}
+
+static int input_blob(struct input *in, uint32_t **data)
+{
+	if (in->pool)
+		return blob_pool_get(in->pool, data);
+
+	return intel_error_state_decode_ascii85(in->blob, in->blob_len,
+						in->line[0] == ':', data);
+}
+
+static bool input_mmap(struct input *in, FILE *file, int num_threads)
+{
+	struct stat st;
+	void *map;
+
+	if (fstat(fileno(file), &st) || !S_ISREG(st.st_mode) || !st.st_size)
+		return false;
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+	if (map == MAP_FAILED)
+		return false;
+
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	in->file = NULL;
+	in->map = in->pos = map;
+	in->map_size = st.st_size;
+	in->end = in->map + in->map_size;
+	if (num_threads)
+		in->pool = blob_pool_create(in->map, in->map_size, num_threads);
+
+	return true;
+}
+
+static void input_fini(struct input *in)
+{
+	blob_pool_destroy(in->pool);
+	if (in->map)
+		munmap((void *)in->map, in->map_size);
+	free(in->line);
 }
 
 static void
-read_data_file(FILE *file)
+read_data(struct input *in)
 {
 	struct intel_decode *decode_ctx = NULL;
 	uint32_t devid = PCI_CHIP_I855_GM;
@@ -574,8 +750,6 @@ read_data_file(FILE *file)
 	int num_rings = 0;
 	long long unsigned fence;
 	int data_size = 0, count = 0, matched;
-	char *line = NULL;
-	size_t line_size;
 	uint32_t offset, value, ring_length = 0;
 	uint64_t gtt_offset = 0;
 	uint32_t head_offset = -1;
@@ -583,11 +757,14 @@ read_data_file(FILE *file)
 	char *ring_name = NULL;
 	int do_decode = 1;
 
-	while (getline(&line, &line_size, file) > 0) {
+	while (input_getline(in) > 0) {
+		char *line = in->line;
 		char *dashes;
 
 		if (line[0] == ':' || line[0] == '~') {
-			count = ascii85_decode(line+1, &data, line[0] == ':');
+			free(data);
+			count = input_blob(in, &data);
+			data_size = count;
 			if (count == 0)
 				fprintf(stderr, "ASCII85 decode failed (%s - %s).\n",
 					ring_name, buffer_name);
@@ -765,10 +942,115 @@ read_data_file(FILE *file)
 	       data, &count, do_decode);
 
 	free(data);
-	free(line);
 	free(ring_name);
 }
 
+static void benchmark(struct input *in)
+{
+	uint64_t blobs = 0, in_bytes = 0, out_bytes = 0;
+	struct timespec start, end;
+	double elapsed;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (input_getline(in) > 0) {
+		uint32_t *data;
+		int count;
+
+		if (in->line[0] != ':' && in->line[0] != '~')
+			continue;
+
+		in_bytes += in->blob_len;
+		count = input_blob(in, &data);
+		out_bytes += 4ull * count;
+		blobs++;
+		free(data);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed = (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+
+	printf("%"PRIu64" blobs, %.1f MiB encoded, %.1f MiB decoded in %.3fs: %.1f MiB/s\n",
+	       blobs, in_bytes / 1048576.0, out_bytes / 1048576.0, elapsed,
+	       elapsed > 0 ? in_bytes / 1048576.0 / elapsed : 0);
+}
+
+static void process_file(FILE *file, int num_threads, bool bench)
+{
+	struct input in = { .file = file };
+
+	/* Regular files are mmapped and have their blobs decoded in parallel. */
+	input_mmap(&in, file, num_threads);
+
+	if (bench)
+		benchmark(&in);
+	else
+		read_data(&in);
+
+	input_fini(&in);
+}
+
+/* Only decodes the buffer selected as "[<engine>:]<name>", e.g. "rcs0:batch". */
+static int print_buffer(const char *path, const char *select)
+{
+	const struct intel_error_state_engine *engine;
+	const struct intel_error_state_bo *bo;
+	struct intel_decode *decode_ctx = NULL;
+	struct intel_error_state *es;
+	char *ring_name = NULL;
+	const char *name;
+	uint32_t *data;
+	uint64_t acthd;
+	int count, ret = 1;
+
+	es = intel_error_state_open(path);
+	if (!es) {
+		fprintf(stderr, "Failed to index %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+
+	name = strchr(select, ':');
+	if (name) {
+		ring_name = strndup(select, name - select);
+		name++;
+	} else {
+		name = select;
+	}
+
+	bo = intel_error_state_find_bo(es, ring_name, name);
+	if (!bo) {
+		fprintf(stderr, "No %s buffer in %s\n", select, path);
+		goto out;
+	}
+
+	if (es->devid) {
+		printf("Detected GEN%i chipset\n", intel_gen(es->devid));
+		decode_ctx = intel_decode_context_alloc(es->devid);
+	}
+
+	engine = intel_error_state_find_engine(es, bo->engine);
+	if (decode_ctx && engine &&
+	    intel_error_state_read_register(es, engine, "ACTHD", &acthd))
+		intel_decode_set_head_tail(decode_ctx, acthd, 0xffffffff);
+
+	count = intel_error_state_decode_bo(es, bo, &data);
+	if (count) {
+		decode(decode_ctx, bo->name, bo->engine,
+		       bo->gtt_offset, -1, data, &count, 1);
+		ret = 0;
+	} else {
+		fprintf(stderr, "Failed to decode %s\n", select);
+	}
+
+	free(data);
+	if (decode_ctx)
+		intel_decode_context_free(decode_ctx);
+out:
+	free(ring_name);
+	intel_error_state_close(es);
+	return ret;
+}
+
 static void setup_pager(void)
 {
 	int fds[2];
@@ -793,6 +1075,27 @@ static void setup_pager(void)
 	}
 }
 
+static void usage(const char *name)
+{
+	fprintf(stderr,
+			"intel_gpu_decode: Parse an Intel GPU i915_error_state\n"
+			"Usage:\n"
+			"\t%s [-j <threads>] [-b] [<file>]\n"
+			"\t%s -s [<engine>:]<buffer> <file>\n"
+			"\n"
+			"With no arguments, debugfs-dri-directory is probed for in "
+			"/debug and \n"
+			"/sys/kernel/debug.  Otherwise, it may be "
+			"specified.  If a file is given,\n"
+			"it is parsed as an GPU dump in the format of "
+			"/debug/dri/0/i915_error_state.\n"
+			"\n"
+			"\t-j <threads>\tNumber of threads decoding buffers (default: CPUs)\n"
+			"\t-b\t\tOnly decode the buffers and report the throughput\n"
+			"\t-s <buffer>\tOnly decode the given buffer, e.g. rcs0:batch\n",
+			name, name);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -800,28 +1103,50 @@ main(int argc, char *argv[])
 	const char *path;
 	char *filename = NULL;
 	struct stat st;
-	int error;
-
-	if (argc > 2) {
-		fprintf(stderr,
-				"intel_gpu_decode: Parse an Intel GPU i915_error_state\n"
-				"Usage:\n"
-				"\t%s [<file>]\n"
-				"\n"
-				"With no arguments, debugfs-dri-directory is probed for in "
-				"/debug and \n"
-				"/sys/kernel/debug.  Otherwise, it may be "
-				"specified.  If a file is given,\n"
-				"it is parsed as an GPU dump in the format of "
-				"/debug/dri/0/i915_error_state.\n",
-				argv[0]);
+	int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	const char *select = NULL;
+	bool bench = false;
+	int error, opt;
+
+	while ((opt = getopt(argc, argv, "j:bs:h")) != -1) {
+		switch (opt) {
+		case 'j':
+			num_threads = atoi(optarg);
+			break;
+		case 'b':
+			bench = true;
+			break;
+		case 's':
+			select = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (argc - optind > 1 || num_threads < 0) {
+		usage(argv[0]);
 		return 1;
 	}
 
-	if (isatty(1))
+	if (select) {
+		/* The index needs the whole file mapped. */
+		if (optind == argc) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		if (isatty(1))
+			setup_pager();
+
+		return print_buffer(argv[optind], select);
+	}
+
+	if (isatty(1) && !bench)
 		setup_pager();
 
-	if (argc == 1) {
+	if (optind == argc) {
 		if (isatty(0)) {
 			path = "/sys/class/drm/card0/error";
 			error = stat(path, &st);
@@ -840,11 +1165,11 @@ main(int argc, char *argv[])
 				     "\tsudo mount -t debugfs debugfs /sys/kernel/debug\n");
 			}
 		} else {
-			read_data_file(stdin);
+			process_file(stdin, num_threads, bench);
 			exit(0);
 		}
 	} else {
-		path = argv[1];
+		path = argv[optind];
 		error = stat(path, &st);
 		if (error != 0) {
 			fprintf(stderr, "Error opening %s: %s\n",
@@ -885,7 +1210,7 @@ main(int argc, char *argv[])
 		}
 	}
 
-	read_data_file(file);
+	process_file(file, num_threads, bench);
 	fclose(file);
 
 	if (filename != path)
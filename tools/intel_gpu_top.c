@@ -39,6 +39,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -49,6 +50,7 @@
 #include "igt_perf.h"
 #include "igt_drm_clients.h"
 #include "igt_drm_fdinfo.h"
+#include "intel_gpu_top_record.h"
 
 #define ARRAY_SIZE(arr) (sizeof(arr)/sizeof(arr[0]))
 
@@ -1032,6 +1034,7 @@ print_percentage_bar(double percent, double max, int max_len, bool numeric)
 }
 
 #define DEFAULT_PERIOD_MS (1000)
+#define DEFAULT_RECORD_SAMPLES (8192)
 
 static void
 usage(const char *appname)
@@ -1051,8 +1054,10 @@ usage(const char *appname)
 		"\t[-d <device>]   Device filter, please check manual page for more details.\n"
 		"\t[-p]            Default to showing physical engines instead of classes.\n"
 		"\t[-m]            Default to showing all memory regions.\n"
+		"\t[-r <file>]     Record binary samples into a ring file.\n"
+		"\t[-n <samples>]  Number of samples kept in the ring (default %u).\n"
 		"\n",
-		appname, DEFAULT_PERIOD_MS);
+		appname, DEFAULT_PERIOD_MS, DEFAULT_RECORD_SAMPLES);
 	igt_device_print_filter_types();
 }
 
@@ -2603,14 +2608,338 @@ static void intel_scan_clients(struct intel_clients *iclients)
 	}
 }
 
+/*
+ * Recording mode writes the raw counter values into a memory mapped ring of
+ * fixed layout samples (see intel_gpu_top_record.h) and leaves all formatting
+ * to intel_gpu_top_export, which keeps the per sample cost low enough to run
+ * at millisecond periods.
+ */
+
+/* Scanning /proc is much more expensive than reading the PMU. */
+#define RECORD_CLIENTS_PERIOD_US (100000)
+
+struct recorder {
+	struct gpu_top_rec_header *hdr;
+	size_t size;
+
+	unsigned int num_counters;
+	struct pmu_counter **pmu;
+	struct gpu_top_rec_counter *counters;
+};
+
+static void
+record_counter(struct recorder *rec, struct pmu_counter *pmu,
+	       const char *group, const char *item, const char *unit,
+	       double d, double s, bool engine)
+{
+	struct gpu_top_rec_counter *cnt;
+
+	if (!pmu->present)
+		return;
+
+	rec->pmu = realloc(rec->pmu, (rec->num_counters + 1) * sizeof(*rec->pmu));
+	assert(rec->pmu);
+	rec->counters = realloc(rec->counters,
+				(rec->num_counters + 1) * sizeof(*rec->counters));
+	assert(rec->counters);
+
+	rec->pmu[rec->num_counters] = pmu;
+
+	cnt = &rec->counters[rec->num_counters++];
+	memset(cnt, 0, sizeof(*cnt));
+	strncpy(cnt->group, group, sizeof(cnt->group) - 1);
+	strncpy(cnt->item, item, sizeof(cnt->item) - 1);
+	strncpy(cnt->unit, unit, sizeof(cnt->unit) - 1);
+	cnt->engine = engine;
+	cnt->d = d;
+	cnt->s = s;
+}
+
+static void record_counters(struct recorder *rec, struct engines *engines)
+{
+	char group[32], unit[16];
+	unsigned int i;
+
+	record_counter(rec, &engines->freq_req, "frequency", "requested", "MHz",
+		       1, 1, false);
+	record_counter(rec, &engines->freq_act, "frequency", "actual", "MHz",
+		       1, 1, false);
+
+	if (engines->num_gts > 1) {
+		for (i = 0; i < engines->num_gts; i++) {
+			snprintf(group, sizeof(group), "frequency-gt%u", i);
+			record_counter(rec, &engines->freq_req_gt[i], group,
+				       "requested", "MHz", 1, 1, false);
+			record_counter(rec, &engines->freq_act_gt[i], group,
+				       "actual", "MHz", 1, 1, false);
+		}
+	}
+
+	record_counter(rec, &engines->irq, "interrupts", "count", "irq/s",
+		       1, 1, false);
+	record_counter(rec, &engines->rc6, "rc6", "value", "%", 1e9, 100, false);
+
+	if (engines->num_gts > 1) {
+		for (i = 0; i < engines->num_gts; i++) {
+			snprintf(group, sizeof(group), "rc6-gt%u", i);
+			record_counter(rec, &engines->rc6_gt[i], group,
+				       "value", "%", 1e9, 100, false);
+		}
+	}
+
+	record_counter(rec, &engines->r_gpu, "power", "GPU", "W",
+		       1, engines->r_gpu.scale, false);
+	record_counter(rec, &engines->r_pkg, "power", "Package", "W",
+		       1, engines->r_pkg.scale, false);
+
+	if (engines->num_imc) {
+		snprintf(unit, sizeof(unit), "%s/s", engines->imc_reads.units);
+		record_counter(rec, &engines->imc_reads, "imc-bandwidth",
+			       "reads", unit, 1, engines->imc_reads.scale, false);
+		record_counter(rec, &engines->imc_writes, "imc-bandwidth",
+			       "writes", unit, 1, engines->imc_writes.scale,
+			       false);
+	}
+
+	for (i = 0; i < engines->num_engines; i++) {
+		struct engine *engine = engine_ptr(engines, i);
+
+		record_counter(rec, &engine->busy, engine->display_name,
+			       "busy", "%", 1e9, 100, true);
+		record_counter(rec, &engine->sema, engine->display_name,
+			       "sema", "%", 1e9, 100, true);
+		record_counter(rec, &engine->wait, engine->display_name,
+			       "wait", "%", 1e9, 100, true);
+	}
+}
+
+static int
+recorder_open(struct recorder *rec, const char *path, unsigned int num_slots,
+	      unsigned int period_us, const char *device,
+	      struct engines *engines, struct intel_clients *iclients)
+{
+	struct gpu_top_rec_header *hdr;
+	unsigned int header_size, sample_size, i;
+	struct timespec ts;
+	uint64_t seq, magic;
+	int fd, ret;
+
+	memset(rec, 0, sizeof(*rec));
+	record_counters(rec, engines);
+
+	header_size = sizeof(*hdr) + rec->num_counters * sizeof(*rec->counters);
+	header_size = (header_size + 4095) & ~4095;
+	sample_size = gpu_top_rec_sample_size(rec->num_counters,
+					      GPU_TOP_REC_MAX_CLIENTS);
+	rec->size = header_size + (size_t)num_slots * sample_size;
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		ret = -errno;
+		goto err;
+	}
+
+	if (ftruncate(fd, rec->size)) {
+		ret = -errno;
+		close(fd);
+		goto err;
+	}
+
+	hdr = mmap(NULL, rec->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	ret = -errno;
+	close(fd);
+	if (hdr == MAP_FAILED)
+		goto err;
+
+	rec->hdr = hdr;
+
+	hdr->version = GPU_TOP_REC_VERSION;
+	hdr->header_size = header_size;
+	hdr->sample_size = sample_size;
+	hdr->num_slots = num_slots;
+	hdr->num_counters = rec->num_counters;
+	hdr->max_clients = GPU_TOP_REC_MAX_CLIENTS;
+	hdr->period_us = period_us;
+	strncpy(hdr->device, device, sizeof(hdr->device) - 1);
+
+	pmu_sample(engines);
+	clock_gettime(CLOCK_REALTIME, &ts);
+	hdr->start_ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	hdr->start_ts = engines->ts.cur;
+
+	if (iclients->clients) {
+		const struct igt_drm_client_engines *classes = &iclients->classes;
+
+		hdr->num_classes = classes->max_engine_id + 1;
+		if (hdr->num_classes > GPU_TOP_REC_MAX_CLASSES)
+			hdr->num_classes = GPU_TOP_REC_MAX_CLASSES;
+		for (i = 0; i < hdr->num_classes; i++) {
+			if (!classes->names[i])
+				continue;
+
+			strncpy(hdr->class_names[i], classes->names[i],
+				sizeof(hdr->class_names[i]) - 1);
+			hdr->class_capacity[i] = classes->capacity[i];
+		}
+	}
+
+	memcpy(hdr + 1, rec->counters, rec->num_counters * sizeof(*rec->counters));
+
+	for (seq = 0; seq < num_slots; seq++)
+		gpu_top_rec_slot(hdr, seq)->seq = GPU_TOP_REC_SEQ_INVALID;
+
+	/*
+	 * Publish the magic last, with a release store, so readers which see
+	 * it with an acquire load also see the complete header.
+	 */
+	memcpy(&magic, GPU_TOP_REC_MAGIC, sizeof(magic));
+	__atomic_store_n((uint64_t *)hdr->magic, magic, __ATOMIC_RELEASE);
+
+	return 0;
+
+err:
+	free(rec->pmu);
+	free(rec->counters);
+	return ret;
+}
+
+static void
+record_clients(struct gpu_top_rec_header *hdr, struct gpu_top_rec_sample *s,
+	       struct igt_drm_clients *clients)
+{
+	struct gpu_top_rec_client *rc = gpu_top_rec_clients(hdr, s);
+	struct igt_drm_client *c;
+	int tmp;
+
+	s->flags |= GPU_TOP_REC_SAMPLE_CLIENTS;
+
+	igt_for_each_drm_client(clients, c, tmp) {
+		unsigned int i, num;
+
+		if (c->status != IGT_DRM_CLIENT_ALIVE)
+			continue;
+
+		if (s->num_clients == hdr->max_clients) {
+			s->flags |= GPU_TOP_REC_SAMPLE_TRUNCATED;
+			break;
+		}
+
+		rc->pid = c->pid;
+		rc->id = c->id;
+		memcpy(rc->name, c->print_name, sizeof(rc->name));
+
+		num = c->engines->max_engine_id + 1;
+		if (num > hdr->num_classes)
+			num = hdr->num_classes;
+		for (i = 0; i < num; i++)
+			rc->engine_time[i] = c->utilization[i].last_engine_time;
+		for (; i < GPU_TOP_REC_MAX_CLASSES; i++)
+			rc->engine_time[i] = 0;
+
+		s->num_clients++;
+		rc++;
+	}
+}
+
+static void
+record_sample(struct recorder *rec, struct engines *engines,
+	      struct igt_drm_clients *clients)
+{
+	struct gpu_top_rec_header *hdr = rec->hdr;
+	uint64_t seq = hdr->write_seq;
+	struct gpu_top_rec_sample *s = gpu_top_rec_slot(hdr, seq);
+	uint64_t *values = gpu_top_rec_values(s);
+	unsigned int i;
+
+	/* Invalidate the slot while it is being overwritten. */
+	__atomic_store_n(&s->seq, GPU_TOP_REC_SEQ_INVALID, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	s->ts = engines->ts.cur;
+	s->num_clients = 0;
+	s->flags = 0;
+
+	for (i = 0; i < rec->num_counters; i++)
+		values[i] = rec->pmu[i]->val.cur;
+
+	if (clients)
+		record_clients(hdr, s, clients);
+
+	__atomic_store_n(&s->seq, seq, __ATOMIC_RELEASE);
+	__atomic_store_n(&hdr->write_seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+static void recorder_close(struct recorder *rec)
+{
+	munmap(rec->hdr, rec->size);
+	free(rec->pmu);
+	free(rec->counters);
+}
+
+static void timespec_add_us(struct timespec *ts, unsigned int us)
+{
+	ts->tv_nsec += (long)(us % USEC_PER_SEC) * 1000;
+	ts->tv_sec += us / USEC_PER_SEC + ts->tv_nsec / 1000000000;
+	ts->tv_nsec %= 1000000000;
+}
+
+static int
+record(const char *path, unsigned int num_slots, unsigned int period_us,
+       const char *device, struct engines *engines,
+       struct intel_clients *iclients)
+{
+	unsigned int clients_us = RECORD_CLIENTS_PERIOD_US;
+	struct timespec next;
+	struct recorder rec;
+	int ret;
+
+	ret = recorder_open(&rec, path, num_slots, period_us, device, engines,
+			    iclients);
+	if (ret) {
+		fprintf(stderr, "Failed to create recording '%s'! (%s)\n",
+			path, strerror(-ret));
+		return ret;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	while (!stop_top) {
+		bool scan = clients_us >= RECORD_CLIENTS_PERIOD_US;
+
+		pmu_sample(engines);
+
+		if (scan && iclients->clients) {
+			intel_scan_clients(iclients);
+			clients_us = 0;
+		}
+
+		record_sample(&rec, engines,
+			      scan ? iclients->clients : NULL);
+
+		clients_us += period_us;
+
+		/* Absolute deadlines so the sampling period does not drift. */
+		timespec_add_us(&next, period_us);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				       &next, NULL) == EINTR && !stop_top)
+			;
+	}
+
+	recorder_close(&rec);
+
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
 	unsigned int period_us = DEFAULT_PERIOD_MS * 1000;
+	unsigned int record_samples = DEFAULT_RECORD_SAMPLES;
 	bool physical_engines = false;
 	bool separate_regions = false;
-	struct intel_clients iclients;
+	struct intel_clients iclients = { };
 	int con_w = -1, con_h = -1;
 	char *output_path = NULL;
+	char *record_path = NULL;
 	struct engines *engines;
 	int ret = 0, ch;
 	bool list_device = false;
@@ -2620,14 +2949,34 @@ int main(int argc, char **argv)
 	struct timespec ts;
 
 	/* Parse options */
-	while ((ch = getopt(argc, argv, "o:s:d:mpcJLlh")) != -1) {
+	while ((ch = getopt(argc, argv, "o:s:d:r:n:mpcJLlh")) != -1) {
 		switch (ch) {
 		case 'o':
 			output_path = optarg;
 			break;
 		case 's':
-			period_us = atoi(optarg) * 1000;
+			period_us = atof(optarg) * 1000;
+			break;
+		case 'r':
+			record_path = optarg;
+			break;
+		case 'n': {
+			unsigned long n;
+			char *end;
+
+			/* strtoul() would silently wrap negative numbers. */
+			errno = 0;
+			n = strtoul(optarg, &end, 10);
+			if (errno || end == optarg || *end || !n ||
+			    n > UINT_MAX || strchr(optarg, '-')) {
+				fprintf(stderr,
+					"Invalid number of recording samples '%s'!\n",
+					optarg);
+				exit(1);
+			}
+			record_samples = n;
 			break;
+		}
 		case 'd':
 			opt_device = strdup(optarg);
 			break;
@@ -2659,7 +3008,8 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if (output_mode == INTERACTIVE && (output_path || isatty(1) != 1))
+	if (output_mode == INTERACTIVE &&
+	    (output_path || record_path || isatty(1) != 1))
 		output_mode = TEXT;
 
 	if (output_path && strcmp(output_path, "-")) {
@@ -2771,6 +3121,13 @@ int main(int argc, char **argv)
 	if (has_drm_fdinfo(&card))
 		intel_init_clients(&iclients, &card, engines);
 
+	if (record_path) {
+		if (record(record_path, record_samples, period_us, pmu_device,
+			   engines, &iclients))
+			ret = EXIT_FAILURE;
+		goto err_record;
+	}
+
 	pmu_sample(engines);
 	intel_scan_clients(&iclients);
 	gettime(&ts);
@@ -2870,6 +3227,7 @@ int main(int argc, char **argv)
 	if (output_mode == JSON)
 		printf("]\n");
 
+err_record:
 	intel_free_clients(&iclients);
 
 	free(codename);
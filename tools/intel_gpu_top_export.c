@@ -0,0 +1,425 @@
+/*
+ * Copyright © 2024 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Converts recordings made with "intel_gpu_top -r" into the same JSON or CSV
+ * output intel_gpu_top produces when running live.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "intel_gpu_top_record.h"
+
+enum {
+	JSON,
+	CSV
+} output_mode;
+
+static FILE *out;
+
+static void usage(const char *appname)
+{
+	printf("intel_gpu_top_export - Convert intel_gpu_top recordings\n"
+	       "\n"
+	       "Usage: %s [parameters] <recording>\n"
+	       "\n"
+	       "\tThe following parameters are optional:\n\n"
+	       "\t[-h]            Show this help text.\n"
+	       "\t[-c]            Output CSV formatted data.\n"
+	       "\t[-J]            Output JSON formatted data (default).\n"
+	       "\t[-o <file|->]   Output to specified file or '-' for standard out.\n"
+	       "\n",
+	       appname);
+}
+
+static const struct gpu_top_rec_counter *
+counters(const struct gpu_top_rec_header *hdr)
+{
+	return (const struct gpu_top_rec_counter *)(hdr + 1);
+}
+
+static double
+counter_value(const struct gpu_top_rec_counter *cnt, uint64_t cur,
+	      uint64_t prev, double t)
+{
+	double v;
+
+	/* Same as pmu_calc() in intel_gpu_top. */
+	v = cur - prev;
+	v /= cnt->d;
+	v /= t;
+	v *= cnt->s;
+
+	if (cnt->s == 100.0 && v > 100.0)
+		v = 100.0;
+
+	return v;
+}
+
+static void csv_header(const struct gpu_top_rec_header *hdr)
+{
+	const struct gpu_top_rec_counter *cnt = counters(hdr);
+	unsigned int i;
+
+	fprintf(out, "timestamp ns,period ms");
+	for (i = 0; i < hdr->num_counters; i++)
+		fprintf(out, ",%s %s %s", cnt[i].group, cnt[i].item,
+			cnt[i].unit);
+	fprintf(out, "\n");
+}
+
+static void
+csv_sample(const struct gpu_top_rec_header *hdr, uint64_t timestamp, double t,
+	   const uint64_t *cur, const uint64_t *prev)
+{
+	const struct gpu_top_rec_counter *cnt = counters(hdr);
+	unsigned int i;
+
+	fprintf(out, "%" PRIu64 ",%f", timestamp, t * 1e3);
+	for (i = 0; i < hdr->num_counters; i++)
+		fprintf(out, ",%f", counter_value(&cnt[i], cur[i], prev[i], t));
+	fprintf(out, "\n");
+}
+
+static const struct gpu_top_rec_client *
+find_client(const struct gpu_top_rec_client *clients, unsigned int num,
+	    const struct gpu_top_rec_client *c)
+{
+	unsigned int i;
+
+	for (i = 0; i < num; i++) {
+		if (clients[i].id == c->id && clients[i].pid == c->pid)
+			return &clients[i];
+	}
+
+	return NULL;
+}
+
+static void
+json_clients(const struct gpu_top_rec_header *hdr,
+	     const struct gpu_top_rec_client *cur, unsigned int num_cur,
+	     const struct gpu_top_rec_client *prev, unsigned int num_prev,
+	     double t)
+{
+	unsigned int i, j;
+
+	fprintf(out, ",\n\t\"clients\": {");
+
+	for (i = 0; i < num_cur; i++) {
+		const struct gpu_top_rec_client *c = &cur[i];
+		const struct gpu_top_rec_client *p;
+		bool first = true;
+
+		fprintf(out, "%s\n\t\t\"%" PRIu64 "\": {\n", i ? "," : "", c->id);
+		fprintf(out, "\t\t\t\"name\": \"%.*s\",\n",
+			(int)sizeof(c->name), c->name);
+		fprintf(out, "\t\t\t\"pid\": \"%u\"", c->pid);
+
+		p = find_client(prev, num_prev, c);
+		if (p) {
+			fprintf(out, ",\n\t\t\t\"engine-classes\": {");
+
+			for (j = 0; j < hdr->num_classes; j++) {
+				double pct;
+
+				if (!hdr->class_capacity[j])
+					continue;
+
+				pct = c->engine_time[j] - p->engine_time[j];
+				pct = pct / t / 1e9 * 100;
+				if (pct > 100.0 * hdr->class_capacity[j])
+					pct = 100.0 * hdr->class_capacity[j];
+
+				fprintf(out, "%s\n\t\t\t\t\"%.*s\": {\n"
+					"\t\t\t\t\t\"busy\": \"%f\",\n"
+					"\t\t\t\t\t\"unit\": \"%%\"\n"
+					"\t\t\t\t}",
+					first ? "" : ",",
+					(int)sizeof(hdr->class_names[j]),
+					hdr->class_names[j], pct);
+				first = false;
+			}
+
+			fprintf(out, "\n\t\t\t}");
+		}
+
+		fprintf(out, "\n\t\t}");
+	}
+
+	fprintf(out, "\n\t}");
+}
+
+static void
+json_sample(const struct gpu_top_rec_header *hdr, unsigned int idx,
+	    uint64_t timestamp, double t,
+	    const uint64_t *cur, const uint64_t *prev)
+{
+	const struct gpu_top_rec_counter *cnt = counters(hdr);
+	bool engines = false;
+	unsigned int i;
+
+	fprintf(out, "%s{\n", idx ? ",\n" : "");
+	fprintf(out, "\t\"period\": {\n"
+		"\t\t\"duration\": %f,\n"
+		"\t\t\"unit\": \"ms\",\n"
+		"\t\t\"timestamp\": %" PRIu64 "\n"
+		"\t}", t * 1e3, timestamp);
+
+	for (i = 0; i < hdr->num_counters; i++) {
+		const char *indent = cnt[i].engine ? "\t\t" : "\t";
+		bool new_group = !i || strcmp(cnt[i].group, cnt[i - 1].group);
+
+		if (new_group) {
+			if (i) /* Close the previous group with its unit. */
+				fprintf(out, ",\n%s\t\"unit\": \"%s\"\n%s}",
+					cnt[i - 1].engine ? "\t\t" : "\t",
+					cnt[i - 1].unit,
+					cnt[i - 1].engine ? "\t\t" : "\t");
+
+			if (cnt[i].engine && !engines) {
+				fprintf(out, ",\n\t\"engines\": {\n");
+				engines = true;
+			} else {
+				fprintf(out, ",\n");
+			}
+
+			fprintf(out, "%s\"%s\": {\n", indent, cnt[i].group);
+		} else {
+			fprintf(out, ",\n");
+		}
+
+		fprintf(out, "%s\t\"%s\": %f", indent, cnt[i].item,
+			counter_value(&cnt[i], cur[i], prev[i], t));
+	}
+
+	if (i)
+		fprintf(out, ",\n%s\t\"unit\": \"%s\"\n%s}",
+			cnt[i - 1].engine ? "\t\t" : "\t", cnt[i - 1].unit,
+			cnt[i - 1].engine ? "\t\t" : "\t");
+	if (engines)
+		fprintf(out, "\n\t}");
+}
+
+static bool
+copy_sample(struct gpu_top_rec_header *hdr, uint64_t seq,
+	    struct gpu_top_rec_sample *dst)
+{
+	struct gpu_top_rec_sample *src = gpu_top_rec_slot(hdr, seq);
+
+	if (__atomic_load_n(&src->seq, __ATOMIC_ACQUIRE) != seq)
+		return false;
+
+	memcpy(dst, src, hdr->sample_size);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	/* Overwritten by a live recorder while copying? */
+	return __atomic_load_n(&src->seq, __ATOMIC_RELAXED) == seq;
+}
+
+static int export(struct gpu_top_rec_header *hdr)
+{
+	struct gpu_top_rec_sample *cur, *prev, *clients, *tmp;
+	bool have_prev = false, have_clients = false;
+	uint64_t seq, end, first;
+	unsigned int idx = 0;
+
+	end = __atomic_load_n(&hdr->write_seq, __ATOMIC_ACQUIRE);
+	first = end > hdr->num_slots ? end - hdr->num_slots : 0;
+
+	cur = malloc(hdr->sample_size);
+	prev = malloc(hdr->sample_size);
+	clients = malloc(hdr->sample_size);
+	if (!cur || !prev || !clients) {
+		free(cur);
+		free(prev);
+		free(clients);
+		return -ENOMEM;
+	}
+
+	if (output_mode == JSON)
+		fprintf(out, "[\n");
+	else
+		csv_header(hdr);
+
+	for (seq = first; seq < end; seq++) {
+		uint64_t timestamp;
+		double t;
+
+		if (!copy_sample(hdr, seq, cur)) {
+			/* Lost to ring wraparound, restart the delta chain. */
+			have_prev = have_clients = false;
+			continue;
+		}
+
+		if (!have_prev || cur->ts <= prev->ts)
+			goto next;
+
+		t = (double)(cur->ts - prev->ts) / 1e9;
+		timestamp = hdr->start_ns + (cur->ts - hdr->start_ts);
+
+		if (output_mode == JSON) {
+			json_sample(hdr, idx, timestamp, t,
+				    gpu_top_rec_values(cur),
+				    gpu_top_rec_values(prev));
+
+			if (cur->flags & GPU_TOP_REC_SAMPLE_CLIENTS &&
+			    have_clients)
+				json_clients(hdr,
+					     gpu_top_rec_clients(hdr, cur),
+					     cur->num_clients,
+					     gpu_top_rec_clients(hdr, clients),
+					     clients->num_clients,
+					     (double)(cur->ts - clients->ts) / 1e9);
+
+			fprintf(out, "\n}");
+		} else {
+			csv_sample(hdr, timestamp, t,
+				   gpu_top_rec_values(cur),
+				   gpu_top_rec_values(prev));
+		}
+
+		idx++;
+
+next:
+		if (cur->flags & GPU_TOP_REC_SAMPLE_CLIENTS) {
+			/* Keep the last client sample around for deltas. */
+			memcpy(clients, cur, hdr->sample_size);
+			have_clients = true;
+		}
+
+		have_prev = true;
+		tmp = prev;
+		prev = cur;
+		cur = tmp;
+	}
+
+	if (output_mode == JSON)
+		fprintf(out, "\n]\n");
+
+	free(clients);
+	free(cur);
+	free(prev);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct gpu_top_rec_header *hdr;
+	char *output_path = NULL;
+	struct stat st;
+	uint64_t magic;
+	int fd, ch, ret;
+
+	while ((ch = getopt(argc, argv, "o:cJh")) != -1) {
+		switch (ch) {
+		case 'o':
+			output_path = optarg;
+			break;
+		case 'c':
+			output_mode = CSV;
+			break;
+		case 'J':
+			output_mode = JSON;
+			break;
+		case 'h':
+			usage(argv[0]);
+			exit(0);
+		default:
+			fprintf(stderr, "Invalid option %c!\n", (char)optopt);
+			usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	if (optind >= argc) {
+		usage(argv[0]);
+		exit(1);
+	}
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		fprintf(stderr, "Failed to open recording '%s'! (%s)\n",
+			argv[optind], strerror(errno));
+		exit(1);
+	}
+
+	if (st.st_size < sizeof(*hdr)) {
+		fprintf(stderr, "Recording '%s' is too small!\n", argv[optind]);
+		exit(1);
+	}
+
+	hdr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (hdr == MAP_FAILED) {
+		fprintf(stderr, "Failed to map recording! (%s)\n",
+			strerror(errno));
+		exit(1);
+	}
+
+	/* Pairs with the release store of the magic by the recorder. */
+	magic = __atomic_load_n((const uint64_t *)hdr->magic, __ATOMIC_ACQUIRE);
+	if (memcmp(&magic, GPU_TOP_REC_MAGIC, sizeof(magic)) ||
+	    hdr->version != GPU_TOP_REC_VERSION ||
+	    !hdr->num_slots ||
+	    hdr->num_classes > GPU_TOP_REC_MAX_CLASSES ||
+	    hdr->sample_size != gpu_top_rec_sample_size(hdr->num_counters,
+							hdr->max_clients) ||
+	    hdr->header_size < sizeof(*hdr) +
+			       hdr->num_counters * sizeof(struct gpu_top_rec_counter) ||
+	    hdr->header_size + (uint64_t)hdr->num_slots * hdr->sample_size >
+	    st.st_size) {
+		fprintf(stderr, "'%s' is not a valid intel_gpu_top recording!\n",
+			argv[optind]);
+		exit(1);
+	}
+
+	if (output_path && strcmp(output_path, "-")) {
+		out = fopen(output_path, "w");
+		if (!out) {
+			fprintf(stderr, "Failed to open output file - '%s'!\n",
+				strerror(errno));
+			exit(1);
+		}
+	} else {
+		out = stdout;
+	}
+
+	ret = export(hdr);
+	if (ret)
+		fprintf(stderr, "Export failed! (%s)\n", strerror(-ret));
+
+	fclose(out);
+	munmap(hdr, st.st_size);
+
+	return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
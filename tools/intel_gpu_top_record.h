@@ -0,0 +1,132 @@
+/*
+ * Copyright © 2024 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef INTEL_GPU_TOP_RECORD_H
+#define INTEL_GPU_TOP_RECORD_H
+
+#include <stdint.h>
+
+/*
+ * Layout of the intel_gpu_top recording file (-r). The file is a header page
+ * followed by a ring of fixed size sample slots, all in host byte order:
+ *
+ *   struct gpu_top_rec_header
+ *   struct gpu_top_rec_counter counters[num_counters]
+ *   (padding up to header_size)
+ *   slot[num_slots], each of sample_size bytes:
+ *     struct gpu_top_rec_sample
+ *     uint64_t values[num_counters]
+ *     struct gpu_top_rec_client clients[max_clients]
+ *
+ * Counter and client values are the raw cumulative values as read from the
+ * PMU and fdinfo, conversion into rates is left to the exporter
+ * (intel_gpu_top_export). Sample number N lives in slot N % num_slots and is
+ * valid only while its seq field equals N, which allows reading a ring that
+ * is still being written to.
+ */
+
+#define GPU_TOP_REC_MAGIC "IGTGPUTR"
+#define GPU_TOP_REC_VERSION 1
+
+#define GPU_TOP_REC_MAX_CLIENTS 16
+#define GPU_TOP_REC_MAX_CLASSES 8
+
+#define GPU_TOP_REC_SEQ_INVALID (~0ULL)
+
+struct gpu_top_rec_counter {
+	char group[48]; /* JSON group name, e.g. "frequency" or "Render/3D/0" */
+	char item[16]; /* Member name within the group, e.g. "actual" */
+	char unit[16];
+	uint32_t engine; /* Non-zero for per engine counters. */
+	uint32_t pad;
+	double d; /* Divisor applied to the delta before the period. */
+	double s; /* Scale applied after dividing by the period. */
+};
+
+struct gpu_top_rec_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size; /* Offset of the first slot. */
+	uint32_t sample_size; /* Size of a slot in bytes. */
+	uint32_t num_slots;
+	uint32_t num_counters;
+	uint32_t max_clients;
+	uint32_t num_classes;
+	uint32_t period_us;
+	uint64_t start_ns; /* CLOCK_REALTIME when the recording started. */
+	uint64_t start_ts; /* PMU timestamp corresponding to start_ns. */
+	uint64_t write_seq; /* Number of samples written so far. */
+	char device[64];
+	char class_names[GPU_TOP_REC_MAX_CLASSES][16];
+	uint32_t class_capacity[GPU_TOP_REC_MAX_CLASSES]; /* Engines per class. */
+};
+
+struct gpu_top_rec_client {
+	uint32_t pid;
+	uint32_t pad;
+	uint64_t id;
+	char name[24];
+	uint64_t engine_time[GPU_TOP_REC_MAX_CLASSES]; /* Cumulative, ns. */
+};
+
+struct gpu_top_rec_sample {
+	uint64_t seq;
+	uint64_t ts; /* PMU timestamp, ns. */
+	uint32_t num_clients; /* Zero if clients were not scanned. */
+	uint32_t flags;
+};
+
+#define GPU_TOP_REC_SAMPLE_CLIENTS (1 << 0) /* Client data was scanned. */
+#define GPU_TOP_REC_SAMPLE_TRUNCATED (1 << 1) /* More than max_clients. */
+
+static inline uint64_t *
+gpu_top_rec_values(struct gpu_top_rec_sample *s)
+{
+	return (uint64_t *)(s + 1);
+}
+
+static inline struct gpu_top_rec_client *
+gpu_top_rec_clients(const struct gpu_top_rec_header *h,
+		    struct gpu_top_rec_sample *s)
+{
+	return (struct gpu_top_rec_client *)(gpu_top_rec_values(s) +
+					     h->num_counters);
+}
+
+static inline unsigned int
+gpu_top_rec_sample_size(unsigned int num_counters, unsigned int max_clients)
+{
+	return sizeof(struct gpu_top_rec_sample) +
+	       num_counters * sizeof(uint64_t) +
+	       max_clients * sizeof(struct gpu_top_rec_client);
+}
+
+static inline struct gpu_top_rec_sample *
+gpu_top_rec_slot(struct gpu_top_rec_header *h, uint64_t seq)
+{
+	return (struct gpu_top_rec_sample *)((char *)h + h->header_size +
+					     (seq % h->num_slots) *
+					     h->sample_size);
+}
+
+#endif /* INTEL_GPU_TOP_RECORD_H */